@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @file Bitops.hpp
+ * @brief Bit-level kernels over string values, as used by the bitmap commands.
+ * @details Bits are numbered from the most significant bit of the first
+ * byte: bit 0 is `0x80` of byte 0, bit 9 is `0x40` of byte 1. The kernels
+ * work on whole 64-bit words wherever the range allows, and only fall back
+ * to single bytes or bits at its edges.
+ */
+
+namespace bitops {
+    enum class Op {
+        AND,
+        OR,
+        XOR,
+        NOT,
+    };
+
+    /**
+     * @brief Counts the set bits of `data`.
+     */
+    uint64_t popcount(std::string_view data);
+
+    /**
+     * @brief Counts the set bits with positions in `[first, last]`, which must lie within `data`.
+     */
+    uint64_t popcount(std::string_view data, uint64_t first, uint64_t last);
+
+    /**
+     * @brief Finds the first bit equal to `bit` with a position in `[first, last]`, which must lie within `data`.
+     * @return The bit's position, or -1 if there is none.
+     */
+    int64_t findBit(std::string_view data, uint64_t first, uint64_t last, bool bit);
+
+    /**
+     * @brief Combines `sources` bitwise into a string as long as the longest of them.
+     * @details Shorter sources count as padded with zero bytes. `NOT` takes a single source.
+     */
+    std::string apply(Op op, const std::vector<std::string_view>& sources);
+}
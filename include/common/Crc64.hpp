@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file Crc64.hpp
+ * @brief CRC-64 (Jones polynomial, reflected), as used to checksum snapshots.
+ * @details The checksum can be computed incrementally: feed each chunk with
+ * the value returned for the previous one, starting from 0. It is computed
+ * eight bytes at a time (slicing-by-8), so checksumming a snapshot costs a
+ * small fraction of writing it.
+ */
+
+/**
+ * @brief Extends `crc` with `len` bytes of `data`.
+ */
+uint64_t crc64(uint64_t crc, const void* data, size_t len);
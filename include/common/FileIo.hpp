@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file FileIo.hpp
+ * @brief Blocking file descriptor helpers shared by the snapshot, append-only
+ * file and replication code.
+ */
+
+/**
+ * @brief Writes all `len` bytes of `data` to `fd`, retrying short writes and EINTR.
+ * @return false (with `errno` set) if a write fails.
+ */
+bool writeAll(int fd, const uint8_t* data, size_t len);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @file Glob.hpp
+ * @brief Glob-style pattern matching, as used by KEYS and the SCAN family's MATCH option.
+ * @details Supported syntax:
+ * - `*` matches any sequence of characters, including an empty one;
+ * - `?` matches exactly one character;
+ * - `[abc]`, `[a-z]` and `[^abc]` match one character from (or not from) a set;
+ * - `\` makes the following character literal, also inside brackets.
+ * An unterminated `[` is matched literally.
+ */
+
+namespace glob {
+    /**
+     * @brief Tells whether the whole of `str` matches `pattern`.
+     */
+    bool match(std::string_view pattern, std::string_view str);
+
+    /**
+     * @class Pattern
+     * @brief A pattern compiled once for matching against many strings.
+     * @details Compilation extracts what every match must contain: a literal
+     * prefix and suffix, the longest literal run of each `*`-separated
+     * segment (in order) and a minimum length. Candidates are rejected with
+     * `memcmp`/`memmem` on these before the general matcher runs, and
+     * patterns made only of literals and stars (`user:*`, `*:session:*`,
+     * `a*b`) are decided by the prefilter alone.
+     */
+    class Pattern {
+    public:
+        explicit Pattern(std::string_view pattern);
+
+        bool matches(std::string_view str) const;
+
+    private:
+        std::string pattern;
+        std::string prefix;
+        std::string suffix;
+        /// @brief Literal runs that must appear, in order, between the prefix and the suffix.
+        std::vector<std::string> fragments;
+        /// @brief The number of characters any match has (at least, if `has_star`).
+        size_t min_length = 0;
+        bool has_star = false;
+        /// @brief Only literals and stars: the prefilter is exact.
+        bool literal_only = true;
+    };
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @file HashSlot.hpp
+ * @brief Maps keys to one of 16384 hash slots, the unit in which the keyspace is partitioned.
+ * @details A key's slot is the CRC-16 (XMODEM) of the key modulo 16384.
+ * When the key contains a non-empty `{...}` section, only the part between
+ * the first `{` and the next `}` is hashed, so that related keys such as
+ * `{user:1}:name` and `{user:1}:cart` always land in the same slot.
+ */
+
+/// @brief The number of hash slots.
+const size_t HASH_SLOTS = 16384;
+
+/**
+ * @brief CRC-16/XMODEM (polynomial 0x1021) of `len` bytes of `data`.
+ */
+uint16_t crc16(const void* data, size_t len);
+
+/**
+ * @brief Returns the hash slot of `key`, honouring its hash tag.
+ */
+size_t keyHashSlot(std::string_view key);
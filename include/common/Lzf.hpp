@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * @file Lzf.hpp
+ * @brief A fast LZ77 compressor in the LZF format, as used for snapshot segments and large strings.
+ * @details The output is a sequence of literal runs and back references:
+ * - `000LLLLL` followed by `L + 1` literal bytes (1 to 32);
+ * - `LLLooooo oooooooo` copies `L + 2` bytes (3 to 8) from `o + 1` bytes back,
+ *   up to 8 KiB, with `L == 7` meaning an extra length byte follows the
+ *   first one (up to 264 bytes).
+ *
+ * Matches are found through a single-entry hash table of 3-byte prefixes, so
+ * compression runs at hundreds of MB/s and decompression at memory speed,
+ * trading some ratio for it: text like JSON typically shrinks 3-5x.
+ *
+ * Every call is counted in process-wide statistics, which `INFO` reports.
+ */
+
+namespace lzf {
+    /**
+     * @brief Compresses `len` bytes of `in` into `out`, which has room for `out_len` bytes.
+     * @return The compressed size, or 0 if it would not fit in `out_len`:
+     * pass less than `len` to only get output that is actually smaller.
+     */
+    size_t compress(const uint8_t* in, size_t len, uint8_t* out, size_t out_len);
+
+    /**
+     * @brief Decompresses `len` bytes of `in` into exactly `out_len` bytes of `out`.
+     * @return false if the input is corrupt or does not decompress to `out_len` bytes.
+     */
+    bool decompress(const uint8_t* in, size_t len, uint8_t* out, size_t out_len);
+
+    /**
+     * @brief Compresses a string into a self-describing blob (its length as a varint, then the compressed bytes).
+     * @param max_size Only succeed if the blob takes at most this many bytes.
+     * @return false if the string doesn't compress to `max_size` bytes.
+     */
+    bool compressString(std::string_view in, size_t max_size, std::string& blob);
+
+    /**
+     * @brief Restores a string from a blob made by `compressString`.
+     * @return false if the blob is corrupt.
+     */
+    bool decompressString(std::string_view blob, std::string& out);
+
+    /**
+     * @brief Returns the length of the string a blob decompresses to, or 0 if the blob is corrupt.
+     */
+    size_t decompressedSize(std::string_view blob);
+
+    /**
+     * @brief Counters of the work done by this process since it started.
+     */
+    struct Stats {
+        uint64_t compressCalls;
+        uint64_t compressedIn;     ///< Bytes fed to `compress`.
+        uint64_t compressedOut;    ///< Bytes it produced, counting the input of calls whose output did not fit.
+        uint64_t incompressible;   ///< Calls whose output did not fit.
+        uint64_t compressNs;
+        uint64_t decompressCalls;
+        uint64_t decompressedOut;  ///< Bytes produced by `decompress`.
+        uint64_t decompressNs;
+    };
+
+    Stats stats();
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @file Memory.hpp
+ * @brief Process-wide heap accounting.
+ * @details The server replaces the global `operator new`/`operator delete`
+ * so that every C++ allocation adds its usable size to a counter, which gives
+ * the memory limit an exact, O(1) view of the memory held by the keyspace and
+ * its indexes. Only the server links `Memory.cpp`; the other tools use the
+ * default allocator.
+ */
+
+namespace memory {
+    /**
+     * @brief Returns the number of heap bytes currently allocated through `operator new`.
+     */
+    size_t usedMemory();
+}
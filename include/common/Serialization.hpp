@@ -18,6 +18,7 @@ enum ErrorType {
     ERR_UNKNOWN_COMMAND = 0,
     ERR_WRONG_ARGS = 1,
     ERR_PROTOCOL = 2,
+    ERR_REDIRECT = 3, ///< Cluster mode: MOVED or ASK, naming the node to ask instead.
 };
 
 struct ResponseBuilder {
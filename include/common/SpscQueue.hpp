@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * @file SpscQueue.hpp
+ * @brief A bounded lock-free queue between exactly one producer thread and one consumer thread.
+ * @details The slots form a ring indexed by two ever-increasing counters:
+ * the producer owns `tail`, the consumer owns `head`, and each publishes its
+ * counter with a release store that the other side reads with an acquire
+ * load, so a slot is handed over without any lock or read-modify-write.
+ * Each side also caches the last value it saw of the other's counter and only
+ * reloads it when the ring looks full (or empty), which keeps the shared
+ * cache lines from bouncing between cores on every operation.
+ */
+template <typename T>
+class SpscQueue {
+public:
+    /**
+     * @brief Creates an empty queue holding up to `capacity` items, rounded up to a power of two.
+     */
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    /**
+     * @brief Appends an item (producer only).
+     * @return false, leaving `item` untouched, if the queue is full.
+     */
+    bool push(T&& item) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cachedHead == slots.size()) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t - cachedHead == slots.size()) return false;
+        }
+        slots[t & mask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest item into `item` (consumer only).
+     * @return false if the queue is empty.
+     */
+    bool pop(T& item) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h == cachedTail) return false;
+        }
+        item = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return slots.size(); }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+
+    // Each side's counter and cache on its own cache line.
+    alignas(64) std::atomic<size_t> head{0};
+    size_t cachedTail = 0;
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t cachedHead = 0;
+};
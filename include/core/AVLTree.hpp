@@ -4,6 +4,7 @@
 #include <memory>
 #include <cassert>
 #include <functional>
+#include <vector>
 
 class AVLTree {
 public:
@@ -18,26 +19,69 @@ public:
         virtual ~Node() = default;
     };
 
+    AVLTree() = default;
     ~AVLTree();
 
+    AVLTree(AVLTree&& other) noexcept;
+    AVLTree& operator=(AVLTree&& other) noexcept;
+
+    AVLTree(const AVLTree&) = delete;
+    AVLTree& operator=(const AVLTree&) = delete;
+
     std::unique_ptr<Node> detach(Node* node);
 
     void clear();
 
     void insert(std::unique_ptr<Node> newNode, const std::function<int(Node*, Node*)>& compare);
 
+    /**
+     * @brief Builds a perfectly balanced tree from nodes that are already in order.
+     * @details Runs in O(n) with no rotations; heights and subtree sizes are
+     * computed bottom-up as each subtree is completed. The tree must be empty.
+     */
+    void buildFromSorted(std::vector<std::unique_ptr<Node>> nodes);
+
+    /**
+     * @brief Unlinks every node and returns them in order, leaving the tree empty.
+     */
+    std::vector<std::unique_ptr<Node>> releaseInOrder();
+
     Node* findByRank(int32_t rank);
 
     Node* find(Node* key, const std::function<int(Node*, Node*)> &compare);
 
+    /**
+     * @brief Searches with a comparator bound to the key, so no probe node is needed.
+     * @param compareWithKey Returns the ordering of the key relative to the given node.
+     */
+    Node* find(const std::function<int(Node*)>& compareWithKey);
+
     Node* getRoot() const { return root; }
 
+    /**
+     * @brief Returns the smallest node in O(1), or `nullptr` if the tree is empty.
+     */
+    Node* first() const { return leftmost; }
+
+    /**
+     * @brief Returns the largest node in O(1), or `nullptr` if the tree is empty.
+     */
+    Node* last() const { return rightmost; }
+
+    static Node* successor(Node* node);
+    static Node* predecessor(Node* node);
+
     size_t size() const { return node_count; }
 
 private:
     Node* root = nullptr;
     size_t node_count = 0;
 
+    // Cached extremes, kept up to date by insert/detach. Rotations preserve
+    // the in-order sequence, so they never invalidate them.
+    Node* leftmost = nullptr;
+    Node* rightmost = nullptr;
+
     static uint32_t getHight(const Node* node);
     static uint32_t getSubtreeSize(const Node* node);
 
@@ -49,6 +93,13 @@ private:
     static Node* fixRightImbalance(Node* node);
     static Node* balance(Node* node);
 
-    static Node* removeNodeWithOneChild(Node* node);
+    /**
+     * @brief Recomputes heights and sizes from `node` up to the root, rotating where needed.
+     */
+    void rebalanceUpwards(Node* node);
+
+    void removeNodeWithOneChild(Node* node);
+
+    static Node* buildRange(std::vector<std::unique_ptr<Node>>& nodes, size_t begin, size_t end, Node* parent);
     void deleteTree(Node* root);
 };
\ No newline at end of file
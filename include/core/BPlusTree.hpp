@@ -0,0 +1,146 @@
+#pragma once
+
+#include "ZSetIndex.hpp"
+#include <cstdint>
+
+/**
+ * @file BPlusTree.hpp
+ * @brief Defines the BPlusTree class, a cache-friendly `ZSetIndex` engine.
+ */
+
+/**
+ * @class BPlusTree
+ * @brief A counted B+tree of (score, member) pairs.
+ * @details All pairs live in leaves holding up to `LEAF_CAPACITY` entries,
+ * with scores and members kept in separate arrays so that a search scans a
+ * contiguous run of doubles and only touches member strings on score ties.
+ * Leaves are chained in both directions, so range scans walk whole arrays
+ * instead of chasing one pointer per element.
+ *
+ * Inner nodes hold up to `INNER_CAPACITY` children. Next to every child
+ * pointer they store the number of pairs in that subtree, which makes rank
+ * lookups O(log n) without per-element bookkeeping. Separator keys are lower
+ * bounds of the subtree to their right; they are not updated on removal since
+ * a stale lower bound still routes searches correctly.
+ *
+ * Nodes never borrow from their siblings: once a removal leaves a node less
+ * than a quarter full, it is merged into an adjacent sibling if both fit in
+ * one node.
+ */
+class BPlusTree : public ZSetIndex {
+public:
+    static constexpr uint32_t LEAF_CAPACITY = 64;
+    static constexpr uint32_t INNER_CAPACITY = 64;
+
+    BPlusTree();
+    ~BPlusTree() override;
+
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+    const char* name() const override { return "btree"; }
+
+    void insert(const std::string& member, double score) override;
+    bool remove(const std::string& member, double score) override;
+    void updateScore(const std::string& member, double old_score, double new_score) override;
+    void insertSorted(std::vector<ZSetEntry> entries) override;
+    size_t size() const override { return element_count; }
+    void range(size_t start, size_t count, bool reverse, const Visitor& visitor) override;
+    void pop(size_t count, bool reverse, const Visitor& visitor) override;
+    void clear() override;
+
+private:
+    struct Node {
+        bool leaf;
+        uint32_t count = 0;
+
+        explicit Node(bool is_leaf): leaf(is_leaf) {}
+    };
+
+    // Node arrays have one spare slot so that an insertion can overflow a
+    // full node before it is split in two.
+
+    struct Leaf: public Node {
+        Leaf* prev = nullptr;
+        Leaf* next = nullptr;
+        double scores[LEAF_CAPACITY + 1];
+        std::string members[LEAF_CAPACITY + 1];
+
+        Leaf(): Node(true) {}
+    };
+
+    struct Inner: public Node {
+        /// @brief `children[i]` holds `sizes[i]` pairs in total.
+        Node* children[INNER_CAPACITY + 1];
+        uint32_t sizes[INNER_CAPACITY + 1];
+        /// @brief `keyScores[i]`/`keyMembers[i]` is a lower bound of `children[i + 1]`.
+        double keyScores[INNER_CAPACITY];
+        std::string keyMembers[INNER_CAPACITY];
+
+        Inner(): Node(false) {}
+    };
+
+    /**
+     * @struct Split
+     * @brief Describes the new right sibling produced when a node overflows.
+     */
+    struct Split {
+        Node* right = nullptr;
+        double score = 0;
+        std::string member;
+    };
+
+    Node* root;
+    size_t element_count = 0;
+
+    static int compare(double score_a, const std::string& member_a, double score_b, const std::string& member_b);
+
+    /**
+     * @brief Returns the index of the child of `inner` whose range contains the key.
+     */
+    static uint32_t childIndex(const Inner* inner, double score, const std::string& member);
+
+    /**
+     * @brief Returns the position of the first pair in `leaf` not less than the key.
+     */
+    static uint32_t lowerBound(const Leaf* leaf, double score, const std::string& member);
+
+    static uint32_t subtreeSize(const Node* node);
+
+    Split insertInto(Node* node, const std::string& member, double score);
+    Split insertIntoLeaf(Leaf* leaf, const std::string& member, double score);
+    static Split splitLeaf(Leaf* leaf);
+    static Split splitInner(Inner* inner);
+
+    bool removeFrom(Node* node, const std::string& member, double score);
+
+    /**
+     * @brief Merges `inner->children[i + 1]` into `inner->children[i]` if they fit in one node.
+     */
+    static bool tryMerge(Inner* inner, uint32_t i);
+
+    /**
+     * @brief Finds the leaf whose key range contains (score, member).
+     */
+    Leaf* findLeaf(double score, const std::string& member) const;
+
+    /**
+     * @brief Finds the leaf holding the pair of the given rank.
+     * @param rank On return, the position of the pair within the leaf.
+     */
+    Leaf* findLeafByRank(size_t& rank) const;
+
+    /**
+     * @brief Moves every pair out of the tree in order, leaving it empty.
+     */
+    std::vector<ZSetEntry> drain();
+
+    /**
+     * @brief Replaces the (empty) tree by one built bottom-up from sorted pairs.
+     * @details Leaves are filled level by level with evenly distributed
+     * entries, then each inner level is built over the one below it.
+     */
+    void build(std::vector<ZSetEntry> entries);
+
+    static void destroy(Node* node);
+};
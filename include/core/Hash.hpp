@@ -0,0 +1,109 @@
+#pragma once
+
+#include "HashTable.hpp"
+#include "ListPack.hpp"
+#include <string>
+#include <string_view>
+#include <functional>
+#include <memory>
+
+/**
+ * @file Hash.hpp
+ * @brief Defines the Hash data type, a map of fields to string values.
+ */
+
+struct HashFieldNode : public HashTable::Node {
+    std::string field;
+    std::string value;
+};
+
+/**
+ * @class Hash
+ * @brief A map from fields to values, stored under a single key.
+ * @details A hash starts out in the compact `LISTPACK` encoding: a single
+ * contiguous buffer of alternating field/value entries, in insertion order,
+ * searched linearly. Once it holds more than `maxListpackEntries` fields or a
+ * field or value longer than `maxListpackValue` bytes, it is converted (once,
+ * and never back) to the `HASHTABLE` encoding, with one node per field.
+ */
+class Hash {
+public:
+    enum class Encoding {
+        LISTPACK,
+        HASHTABLE,
+    };
+
+    /// @brief The maximum number of fields a listpack-encoded hash may hold.
+    static size_t maxListpackEntries;
+    /// @brief The maximum field or value length (in bytes) a listpack-encoded hash may hold.
+    static size_t maxListpackValue;
+
+    using FieldCallback = std::function<void(std::string_view field, std::string_view value)>;
+
+    Hash();
+    ~Hash();
+
+    Hash(Hash&&) noexcept;
+    Hash& operator=(Hash&&) noexcept;
+
+    Hash(const Hash&) = delete;
+    Hash& operator=(const Hash&) = delete;
+
+    Encoding getEncoding() const { return encoding; }
+
+    /**
+     * @brief Returns the name of the encoding, as reported by OBJECT ENCODING.
+     */
+    const char* encodingName() const;
+
+    /**
+     * @brief Returns the number of fields in the hash.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Sets the value of a field, adding the field if needed.
+     * @return true if the field is new.
+     */
+    bool set(std::string_view field, std::string_view value);
+
+    /**
+     * @brief Looks up the value of a field.
+     * @param value Receives the value if the field exists.
+     * @return true if the field exists.
+     */
+    bool get(std::string_view field, std::string& value);
+
+    /**
+     * @brief Removes a field.
+     * @return true if the field was present.
+     */
+    bool remove(std::string_view field);
+
+    /**
+     * @brief Visits every field with its value, in no particular order.
+     * @details The hash must not be modified meanwhile.
+     */
+    void forEach(const FieldCallback& callback);
+
+private:
+    Encoding encoding = Encoding::LISTPACK;
+    ListPack listpack;
+    std::unique_ptr<HashTable> table;
+
+    /**
+     * @brief Migrates every field from the listpack into a freshly allocated hash table.
+     */
+    void convertToTable();
+
+    /**
+     * @brief Finds the listpack offset of the field entry equal to `field`.
+     * @return The offset of the field entry, or `listpack.end()` if not found.
+     */
+    size_t listpackFind(std::string_view field) const;
+
+    HashFieldNode* tableLookup(std::string_view field);
+    void tableInsert(std::string_view field, std::string_view value);
+
+    static bool fieldEquals(HashTable::Node* node, HashTable::Node* key);
+};
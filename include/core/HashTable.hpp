@@ -4,6 +4,8 @@
 #include <memory>
 #include <functional>
 #include <cassert>
+#include <cstdint>
+#include <string_view>
 
 /**
  * @file HashTable.hpp
@@ -19,7 +21,9 @@
  * exceeds a threshold, a new, larger table is created. Elements are then
  * gradually migrated from the `olderTable` to the `newerTable` with each
  * subsequent operation (insert, lookup, remove), ensuring that resizing
- * overhead is amortized over time.
+ * overhead is amortized over time. After deletions leave the table sparse,
+ * it shrinks the same way. Owners can also migrate in time-bounded steps
+ * with `rehashStep` while they are idle.
  */
 class HashTable {
 public:
@@ -83,6 +87,28 @@ public:
      */
     std::unique_ptr<Node> remove(Node* key, const std::function<bool(Node*, Node*)>& equals);
 
+    /**
+     * @brief Sizes an empty table for `count` elements.
+     * @details The table gets the number of slots it would have grown to
+     * while `count` elements were inserted, without the rehashes in between.
+     * A table that already holds elements is left alone.
+     */
+    void reserve(size_t count);
+
+    /**
+     * @brief Migrates nodes to the newer table for about `budget_us` microseconds.
+     * @details Meant to be called while the owner is idle, so that a rehash
+     * completes (and the older table is released) without waiting for
+     * further operations.
+     * @return true if rehashing is still in progress.
+     */
+    bool rehashStep(int64_t budget_us);
+
+    /**
+     * @brief Tells whether elements are being migrated between the two tables.
+     */
+    bool isRehashing() const { return !olderTable.slots.empty(); }
+
     /**
      * @brief Returns the total number of elements in the hash table.
      * @return The combined element count from both the newer and older tables.
@@ -98,10 +124,52 @@ public:
     /**
      * @brief Applies a function to every node in the hash table.
      * @details This is used to implement commands like KEYS that need to iterate over all data.
+     * Rehashing is paused until it returns, so the callback may look nodes up
+     * (in this table too) and every node is still visited exactly once. It
+     * must not insert or remove nodes.
      * @param callback The function to execute for each node.
      */
     void forEach(const std::function<void(Node*)>& callback);
 
+    /**
+     * @brief Visits the nodes of one slot (or group of slots) and returns the cursor to resume from.
+     * @details Start with cursor 0 and call again with the returned cursor
+     * until it is 0. The cursor's bits are incremented in reverse order (high
+     * bit first), so slot indices stay valid prefixes across resizes: every
+     * node present for the whole iteration is visited at least once, even if
+     * the table grows or rehashes in between calls. While rehashing, a call
+     * visits a slot of the smaller table along with all the slots of the
+     * larger table it expands to. Nodes may be visited more than once.
+     * Rehashing is paused during the call, as in `forEach`.
+     * @param cursor 0 to start, otherwise a value returned by a previous call.
+     * @param callback Called for every visited node; it may look nodes up but must not modify the table.
+     * @return The next cursor, or 0 once the iteration is complete.
+     */
+    size_t scan(size_t cursor, const std::function<void(Node*)>& callback);
+
+    /**
+     * @brief Picks up to `count` nodes from a random position of the table.
+     * @details Starts at a random slot (of either table, weighted by their
+     * element counts) and collects nodes from consecutive slots. The result
+     * is not uniformly distributed, but it is cheap and random enough for
+     * sampling-based policies such as eviction.
+     * @param count The maximum number of nodes to return.
+     * @return The sampled nodes; fewer than `count` only if the table is that small.
+     */
+    std::vector<Node*> sample(size_t count);
+
+    /**
+     * @brief Computes the FNV-1a hash of a string.
+     * @details Shared by every user of the table so that keys and members are
+     * hashed consistently.
+     */
+    static uint64_t hashString(std::string_view str);
+
+    /// @brief The average number of elements per slot at which a table grows (shared by all tables).
+    static size_t maxLoadFactor;
+    /// @brief The fill (elements per 100 slots) under which a table shrinks after a removal.
+    static size_t minFillPercent;
+
     HashTable(const HashTable&) = delete;
     HashTable& operator=(const HashTable&) = delete;
 
@@ -131,6 +199,9 @@ private:
     /// @brief Tracks the current slot index being migrated from `olderTable` during rehashing.
     size_t migrateIndex = 0;
 
+    /// @brief The number of `forEach` and `scan` calls in progress. While it is non-zero, no rehash starts or makes progress.
+    size_t rehashPauses = 0;
+
     /**
      * @brief Initializes a Table with a specified size.
      * @param table The `Table` struct to initialize.
@@ -171,18 +242,31 @@ private:
     /**
      * @brief Begins the incremental rehashing process.
      * @details The current `newerTable` becomes the `olderTable`, and a new `newerTable`
-     * is created with double the capacity. The migration index is reset.
+     * is created with `size` slots: double the capacity to grow, or less to
+     * shrink. The migration index is reset.
      */
-    void startRehashing();
+    void startRehashing(size_t size);
+
+    /**
+     * @brief Starts shrinking the table if its fill dropped under `minFillPercent`.
+     */
+    void shrinkIfSparse();
 
     /**
      * @brief Performs a small, fixed amount of rehashing work.
-     * @details Moves a limited number of nodes from one slot in the `olderTable` to the
-     * `newerTable`. This method is called by public-facing operations to
+     * @details Moves a limited number of nodes from the `olderTable` to the
+     * `newerTable`, skipping a limited number of empty slots. This method is called by public-facing operations to
      * distribute the cost of rehashing over time. Once all elements are
      * migrated, the `olderTable` is cleared.
      */
     void helpRehashing();
 
     void forEachInTable(Table& table, const std::function<void(Node*)>& callback);
+
+    static void visitSlot(Table& table, size_t pos, const std::function<void(Node*)>& callback);
+
+    /**
+     * @brief Advances a cursor to the next slot index in reverse-binary order, under `mask`.
+     */
+    static size_t nextCursor(size_t cursor, size_t mask);
 };
\ No newline at end of file
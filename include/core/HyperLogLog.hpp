@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @file HyperLogLog.hpp
+ * @brief HyperLogLog cardinality sketches, stored as plain string values.
+ * @details A sketch estimates the number of distinct elements added to it
+ * with a standard error of 0.81%, in at most 12 KB, however many elements
+ * it has seen. Elements are hashed to 64 bits: the low 14 bits select one
+ * of 16384 registers, which keeps the longest run of trailing zeros (plus
+ * one) seen in the remaining bits.
+ *
+ * A sketch is a string starting with a 16-byte header: the magic `HYLL`,
+ * the encoding, three unused bytes and the cached cardinality (64-bit
+ * little endian, its top bit set when the cache is stale). It is followed by
+ * the registers in one of two encodings:
+ * - `DENSE`: 16384 6-bit registers packed LSB-first, 12288 bytes;
+ * - `SPARSE`: run-length opcodes, compact while most registers are zero.
+ *   `00xxxxxx` is a run of 1-64 zero registers, `01xxxxxx yyyyyyyy` a run
+ *   of 1-16384 zero registers and `1vvvvvxx` a run of 1-4 registers set to
+ *   the value 1-32.
+ *
+ * Sketches start sparse and are converted to dense once the sparse form
+ * outgrows `sparseMaxBytes` or a register needs a value above 32.
+ */
+
+namespace hll {
+    /// @brief The number of index bits, and the number of registers.
+    constexpr int P = 14;
+    constexpr size_t REGISTERS = size_t(1) << P;
+    /// @brief The number of hash bits left to count zeros in; registers hold at most Q + 1.
+    constexpr int Q = 64 - P;
+    constexpr size_t HEADER_SIZE = 16;
+    constexpr size_t DENSE_SIZE = HEADER_SIZE + REGISTERS * 6 / 8;
+
+    /// @brief The size (in bytes) a sparse sketch may grow to before it is made dense.
+    extern size_t sparseMaxBytes;
+
+    /**
+     * @brief The registers of a sketch, one per byte, as used to merge sketches.
+     */
+    using Registers = std::array<uint8_t, REGISTERS>;
+
+    /**
+     * @brief Returns an empty (sparse) sketch.
+     */
+    std::string create();
+
+    /**
+     * @brief Tells whether a string value holds a sketch with a well-formed header.
+     * @details The sparse opcodes are only checked as they are decoded.
+     */
+    bool isValid(std::string_view sketch);
+
+    bool isSparse(std::string_view sketch);
+
+    /**
+     * @brief Adds an element to a sketch.
+     * @return 1 if a register changed (the estimate may have changed), 0 if
+     * not, or -1 if the sparse encoding is corrupt.
+     */
+    int add(std::string& sketch, std::string_view element);
+
+    /**
+     * @brief Returns the estimated cardinality, from the cache when it is fresh.
+     * @details A stale cache is refreshed in place.
+     * @return false if the sparse encoding is corrupt.
+     */
+    bool count(std::string& sketch, uint64_t& cardinality);
+
+    /**
+     * @brief Raises `registers` to the maximum of themselves and those of `sketch`.
+     * @return false if the sparse encoding is corrupt.
+     */
+    bool merge(Registers& registers, std::string_view sketch);
+
+    /**
+     * @brief Estimates the cardinality of a set of registers.
+     */
+    uint64_t estimate(const Registers& registers);
+
+    /**
+     * @brief Encodes registers as a sketch, sparse if that fits in `sparseMaxBytes`.
+     */
+    std::string fromRegisters(const Registers& registers);
+}
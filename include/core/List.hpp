@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ListPack.hpp"
+#include <list>
+#include <string>
+#include <string_view>
+#include <functional>
+
+/**
+ * @file List.hpp
+ * @brief Defines the List data type, a sequence of strings stored as a quicklist.
+ */
+
+/**
+ * @class List
+ * @brief A sequence of strings with O(1) pushes and pops at both ends.
+ * @details Elements are stored in a doubly linked list of `ListPack` nodes
+ * (a "quicklist"), each holding up to `maxListpackBytes` of consecutive
+ * elements. Pushes and pops only touch the first or last node, and scans
+ * read contiguous buffers instead of chasing one heap node per element. An
+ * element larger than the limit gets a node of its own.
+ */
+class List {
+public:
+    /// @brief The size (in bytes) a node may grow to before a new node is started.
+    static size_t maxListpackBytes;
+
+    using ElementCallback = std::function<void(std::string_view element)>;
+
+    const char* encodingName() const { return "quicklist"; }
+
+    /**
+     * @brief Returns the number of elements in the list.
+     */
+    size_t size() const { return count; }
+
+    /**
+     * @brief Returns the number of listpack nodes.
+     */
+    size_t nodeCount() const { return nodes.size(); }
+
+    void pushFront(std::string_view element);
+    void pushBack(std::string_view element);
+
+    /**
+     * @brief Removes the first element.
+     * @param element Receives the removed element.
+     * @return false if the list is empty.
+     */
+    bool popFront(std::string& element);
+
+    /**
+     * @brief Removes the last element.
+     * @param element Receives the removed element.
+     * @return false if the list is empty.
+     */
+    bool popBack(std::string& element);
+
+    /**
+     * @brief Reads the element at `index` (0 is the first element).
+     * @return false if `index` is out of range.
+     */
+    bool index(size_t index, std::string& element) const;
+
+    /**
+     * @brief Visits the elements with indices in `[start, stop]`, in order.
+     * @details Both bounds must already be normalised, with `stop < size()`.
+     */
+    void range(size_t start, size_t stop, const ElementCallback& callback) const;
+
+    /**
+     * @brief Keeps only the elements with indices in `[start, stop]`.
+     * @details An empty range (`start > stop` or `start >= size()`) clears the list.
+     */
+    void trim(size_t start, size_t stop);
+
+private:
+    using Node = std::list<ListPack>::const_iterator;
+
+    std::list<ListPack> nodes;
+    size_t count = 0;
+
+    /**
+     * @brief Tells whether `element` can be appended to `node` without exceeding the size limit.
+     */
+    static bool fits(const ListPack& node, std::string_view element);
+
+    /**
+     * @brief Finds the node holding the element at `index`, walking from the nearest end.
+     * @param offset Receives the element's position inside that node.
+     */
+    Node locate(size_t index, size_t& offset) const;
+
+    /**
+     * @brief Returns the byte offset of the `n`-th entry of a node.
+     */
+    static size_t entryOffset(const ListPack& node, size_t n);
+
+    void removeFront(size_t n);
+    void removeBack(size_t n);
+};
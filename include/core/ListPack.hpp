@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+/**
+ * @file ListPack.hpp
+ * @brief Defines the ListPack class, a compact sequence of byte strings stored
+ * in a single contiguous buffer.
+ */
+
+/**
+ * @class ListPack
+ * @brief A contiguous, variable-length encoded list of byte strings.
+ * @details Each entry is laid out as `<len><bytes><backlen>`, where `len` is a
+ * varint holding the payload length and `backlen` is the size of
+ * `<len><bytes>` encoded so that it can be decoded from right to left. This
+ * makes the list traversable in both directions without any per-entry heap
+ * allocation or pointers, which is what makes it suitable as the storage of
+ * small collections (it trades O(n) inserts for cache-friendly linear scans).
+ *
+ * Entries are addressed by their byte offset in the buffer. Offsets are only
+ * valid until the next modification of the list.
+ */
+class ListPack {
+public:
+    /**
+     * @brief Returns the offset of the first entry (equal to `end()` if empty).
+     */
+    size_t begin() const { return 0; }
+
+    /**
+     * @brief Returns the past-the-end offset.
+     */
+    size_t end() const { return buffer.size(); }
+
+    /**
+     * @brief Returns the offset of the entry following the one at `pos`.
+     */
+    size_t next(size_t pos) const;
+
+    /**
+     * @brief Returns the offset of the entry preceding the one at `pos`.
+     * @details `pos` may be `end()` to obtain the last entry. Must not be
+     * called with the offset of the first entry.
+     */
+    size_t prev(size_t pos) const;
+
+    /**
+     * @brief Returns a view on the payload of the entry at `pos`.
+     * @note The view is invalidated by any modification of the list.
+     */
+    std::string_view get(size_t pos) const;
+
+    /**
+     * @brief Inserts a new entry before the one at `pos`.
+     * @return The offset of the inserted entry.
+     */
+    size_t insert(size_t pos, std::string_view value);
+
+    /**
+     * @brief Removes the entry at `pos`.
+     * @return The offset of the entry that followed the removed one.
+     */
+    size_t erase(size_t pos);
+
+    /**
+     * @brief Removes `n` consecutive entries, starting with the one at `pos`, in a single move.
+     * @return The offset of the entry that followed the last removed one.
+     */
+    size_t erase(size_t pos, size_t n);
+
+    /**
+     * @brief Replaces the payload of the entry at `pos`.
+     */
+    void replace(size_t pos, std::string_view value);
+
+    void pushBack(std::string_view value) { insert(end(), value); }
+    void pushFront(std::string_view value) { insert(begin(), value); }
+
+    /**
+     * @brief Returns the number of entries.
+     */
+    size_t size() const { return count; }
+
+    bool empty() const { return count == 0; }
+
+    /**
+     * @brief Returns the number of bytes allocated for the encoded entries.
+     */
+    size_t bytes() const { return buffer.capacity(); }
+
+    /**
+     * @brief Releases unused capacity of the underlying buffer.
+     */
+    void shrinkToFit() { buffer.shrink_to_fit(); }
+
+    void clear();
+
+private:
+    std::vector<uint8_t> buffer;
+    uint32_t count = 0;
+
+    static size_t varintSize(uint64_t value);
+    static size_t encodeVarint(uint8_t* out, uint64_t value);
+    static size_t encodeBacklen(uint8_t* out, uint64_t value);
+    uint64_t decodeVarint(size_t pos, size_t& len) const;
+    uint64_t decodeBacklen(size_t last, size_t& len) const;
+
+    /**
+     * @brief Returns the number of bytes `value` occupies once encoded as an entry.
+     */
+    static size_t encodedSize(std::string_view value);
+
+    /**
+     * @brief Encodes `value` as a complete entry into `out`, which must hold `encodedSize(value)` bytes.
+     */
+    static void encodeEntry(uint8_t* out, std::string_view value);
+
+    /**
+     * @brief Returns the total encoded size of the entry starting at `pos`.
+     */
+    size_t entrySize(size_t pos) const;
+};
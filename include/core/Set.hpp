@@ -0,0 +1,117 @@
+#pragma once
+
+#include "HashTable.hpp"
+#include <string>
+#include <string_view>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * @file Set.hpp
+ * @brief Defines the Set data type, an unordered collection of unique strings.
+ */
+
+struct SetMemberNode : public HashTable::Node {
+    std::string member;
+};
+
+/**
+ * @class Set
+ * @brief A collection of unique members with O(1) or O(log n) membership tests.
+ * @details A set whose members are all integers (in canonical decimal form)
+ * starts out in the `INTSET` encoding: a sorted array of `int64_t`, searched
+ * by binary search, at 8 bytes per member. Once it holds a non-integer member
+ * or more than `maxIntsetEntries` members, it is converted (once, and never
+ * back) to the `HASHTABLE` encoding, with one node per member.
+ */
+class Set {
+public:
+    enum class Encoding {
+        INTSET,
+        HASHTABLE,
+    };
+
+    /// @brief The maximum number of members an intset-encoded set may hold.
+    static size_t maxIntsetEntries;
+
+    using MemberCallback = std::function<void(std::string_view member)>;
+
+    Set();
+    ~Set();
+
+    Set(Set&&) noexcept;
+    Set& operator=(Set&&) noexcept;
+
+    Set(const Set&) = delete;
+    Set& operator=(const Set&) = delete;
+
+    Encoding getEncoding() const { return encoding; }
+
+    /**
+     * @brief Returns the name of the encoding, as reported by OBJECT ENCODING.
+     */
+    const char* encodingName() const;
+
+    /**
+     * @brief Returns the number of members in the set.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Adds a member.
+     * @return true if the member is new.
+     */
+    bool add(std::string_view member);
+
+    /**
+     * @brief Removes a member.
+     * @return true if the member was present.
+     */
+    bool remove(std::string_view member);
+
+    bool contains(std::string_view member);
+
+    /**
+     * @brief Visits every member, in ascending order for an intset and in no
+     * particular order otherwise. The set must not be modified meanwhile.
+     */
+    void forEach(const MemberCallback& callback);
+
+    /**
+     * @brief Visits the members present in every one of `sets`.
+     * @details When all the sets are intsets, the sorted arrays are
+     * intersected directly, smallest first: with a branch-free merge for
+     * arrays of similar sizes, or with a galloping binary search through the
+     * larger one when their sizes are far apart. Otherwise the members of the
+     * smallest set are probed against the others.
+     */
+    static void intersect(std::vector<Set*> sets, const MemberCallback& callback);
+
+    /**
+     * @brief Parses a member as an intset integer.
+     * @details Only the canonical decimal form is accepted (no sign on zero,
+     * no leading zeros or spaces), so that a member converts back to the
+     * exact same string.
+     */
+    static bool parseInteger(std::string_view member, int64_t& value);
+
+private:
+    Encoding encoding = Encoding::INTSET;
+    std::vector<int64_t> intset;
+    std::unique_ptr<HashTable> table;
+
+    /**
+     * @brief Migrates every member from the intset into a freshly allocated hash table.
+     */
+    void convertToTable();
+
+    void tableInsert(std::string_view member);
+
+    /**
+     * @brief Intersects two sorted arrays into `out` (which may alias `a`).
+     */
+    static void intersectSorted(const std::vector<int64_t>& a, const std::vector<int64_t>& b, std::vector<int64_t>& out);
+
+    static bool memberEquals(HashTable::Node* node, HashTable::Node* key);
+};
@@ -1,20 +1,192 @@
 #pragma once
 
-#include "AVLTree.hpp"
 #include "HashTable.hpp"
+#include "ListPack.hpp"
+#include "ZSetIndex.hpp"
 #include <string>
+#include <string_view>
+#include <functional>
+#include <memory>
 
-struct ZSetNode: public AVLTree::Node {
-    double score;
-    std::string member;
-};
+/**
+ * @file ZSet.hpp
+ * @brief Defines the SortedSet data type and the nodes used by its tree encoding.
+ */
 
 struct ZSetMemberNode : public HashTable::Node {
     std::string member;
     double score;
 };
 
-struct SortedSet {
-    HashTable member_to_score_map;
-    AVLTree score_sorted_tree;
-};
\ No newline at end of file
+/**
+ * @class SortedSet
+ * @brief A collection of unique members ordered by (score, member).
+ * @details A sorted set starts out in the compact `LISTPACK` encoding: a single
+ * contiguous buffer of alternating member/score entries kept in sorted order
+ * and searched linearly. Once it holds more than `maxListpackEntries` members
+ * or a member longer than `maxListpackValue` bytes, it is converted (once, and
+ * never back) to the `TREE` encoding, where a `HashTable` maps members to
+ * scores and a `ZSetIndex` keeps the members ordered for rank queries. The
+ * index engine is chosen from `indexEngine` at conversion time.
+ */
+class SortedSet {
+public:
+    enum class Encoding {
+        LISTPACK,
+        TREE,
+    };
+
+    /// @brief The maximum number of members a listpack-encoded set may hold.
+    static size_t maxListpackEntries;
+    /// @brief The maximum member length (in bytes) a listpack-encoded set may hold.
+    static size_t maxListpackValue;
+    /// @brief The batch size from which `addMany` takes the bulk-load path.
+    static constexpr size_t BULK_LOAD_MIN_BATCH = 64;
+    /// @brief The ordered index engine used by sets converted to the tree encoding.
+    static ZSetIndex::Engine indexEngine;
+
+    using RangeCallback = std::function<void(const std::string&, double)>;
+
+    SortedSet();
+    ~SortedSet();
+
+    SortedSet(SortedSet&&) noexcept;
+    SortedSet& operator=(SortedSet&&) noexcept;
+
+    SortedSet(const SortedSet&) = delete;
+    SortedSet& operator=(const SortedSet&) = delete;
+
+    Encoding getEncoding() const { return encoding; }
+
+    /**
+     * @brief Returns the name of the encoding, as reported by OBJECT ENCODING.
+     */
+    const char* encodingName() const;
+
+    /**
+     * @brief Returns the number of members in the set.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Options of `add`, mirroring the ZADD flags.
+     */
+    enum AddFlags {
+        ADD_NONE = 0,
+        ADD_NX   = 1 << 0,  ///< Only add new members, never update existing ones.
+        ADD_XX   = 1 << 1,  ///< Only update existing members, never add new ones.
+        ADD_GT   = 1 << 2,  ///< Only update when the new score is greater than the current one.
+        ADD_LT   = 1 << 3,  ///< Only update when the new score is less than the current one.
+        ADD_INCR = 1 << 4,  ///< Increment the current score (0 for new members) instead of replacing it.
+    };
+
+    /**
+     * @brief The outcome of `add`.
+     */
+    enum class AddResult {
+        ADDED,         ///< The member was new and has been added.
+        UPDATED,       ///< The score of an existing member changed.
+        UNCHANGED,     ///< The member already had the requested score.
+        SKIPPED,       ///< The NX/XX/GT/LT conditions prevented the operation.
+        NOT_A_NUMBER,  ///< The increment produced NaN; the set is untouched.
+    };
+
+    /**
+     * @brief Adds a member or updates the score of an existing one.
+     * @details Score updates reuse the member's existing storage and only
+     * reorder the index if the new score moves the member past a neighbour.
+     * @param flags A combination of `AddFlags`.
+     * @param new_score If not null, receives the member's resulting score
+     * unless the result is SKIPPED or NOT_A_NUMBER.
+     */
+    AddResult add(const std::string& member, double score, int flags = ADD_NONE, double* new_score = nullptr);
+
+    /**
+     * @brief Adds or updates a batch of members, as if `add` were called for each in order.
+     * @details Large batches bypass per-member index insertion: the batch is
+     * deduplicated (the last score given for a member wins), sorted, and
+     * handed to the index's bulk path, which builds or rebuilds the index in
+     * linear time.
+     * @return The number of members that were newly added.
+     */
+    size_t addMany(std::vector<ZSetEntry> entries);
+
+    /**
+     * @brief Removes a member from the set.
+     * @return true if the member was present.
+     */
+    bool remove(const std::string& member);
+
+    /**
+     * @brief Looks up the score of a member.
+     * @param score Receives the score if the member exists.
+     * @return true if the member exists.
+     */
+    bool getScore(const std::string& member, double& score);
+
+    /**
+     * @brief Visits the members with ranks in `[start, stop]`, in order.
+     * @details Both bounds must already be normalised to valid ranks. When
+     * `reverse` is set, ranks are counted from the highest score downwards.
+     */
+    void range(size_t start, size_t stop, bool reverse, const RangeCallback& callback);
+
+    /**
+     * @brief Removes up to `count` members with the lowest scores (the
+     * highest when `reverse` is set), visiting each one in pop order.
+     */
+    void pop(size_t count, bool reverse, const RangeCallback& callback);
+
+    /**
+     * @brief Visits every member with its score, in no particular order.
+     * @details Walks the listpack or the member hash table directly, without
+     * touching the ordered index. The set must not be modified meanwhile.
+     */
+    void forEach(const RangeCallback& callback);
+
+    /**
+     * @brief Visits a batch of members for an incremental scan (see `HashTable::scan`).
+     * @details A listpack is small enough to be visited whole in the first call.
+     * @return The cursor to resume from, or 0 once every member was visited.
+     */
+    size_t scan(size_t cursor, const RangeCallback& callback);
+
+private:
+    /**
+     * @struct Tree
+     * @brief The storage of the `TREE` encoding, allocated only once the set outgrows the listpack.
+     */
+    struct Tree {
+        HashTable member_to_score_map;
+        std::unique_ptr<ZSetIndex> score_index;
+    };
+
+    Encoding encoding = Encoding::LISTPACK;
+    ListPack listpack;
+    std::unique_ptr<Tree> tree;
+
+    /**
+     * @brief Migrates every member from the listpack into a freshly allocated tree.
+     */
+    void convertToTree();
+
+    /**
+     * @brief Finds the listpack offset of the member entry equal to `member`.
+     * @return The offset of the member entry, or `listpack.end()` if not found.
+     */
+    size_t listpackFind(std::string_view member) const;
+
+    void listpackInsert(const std::string& member, double score);
+
+    /**
+     * @brief Changes the score of the member entry at `pos`, moving the pair only if needed.
+     */
+    void listpackUpdate(size_t pos, const std::string& member, double score);
+
+    static double listpackScore(std::string_view encoded);
+
+    void treeInsert(const std::string& member, double score, uint64_t hashCode);
+    ZSetMemberNode* treeLookup(const std::string& member, uint64_t hashCode);
+
+    static bool memberEquals(HashTable::Node* node, HashTable::Node* key);
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "AVLTree.hpp"
+#include <string>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * @file ZSetIndex.hpp
+ * @brief Defines the ZSetIndex interface, the ordered index behind the tree
+ * encoding of a sorted set, and its AVL tree implementation.
+ */
+
+struct ZSetNode: public AVLTree::Node {
+    double score;
+    std::string member;
+};
+
+/**
+ * @struct ZSetEntry
+ * @brief A (score, member) pair, ordered by score and then by member.
+ */
+struct ZSetEntry {
+    std::string member;
+    double score;
+
+    bool operator<(const ZSetEntry& other) const {
+        if (score != other.score) return score < other.score;
+        return member < other.member;
+    }
+};
+
+/**
+ * @class ZSetIndex
+ * @brief An ordered, rank-aware collection of (score, member) pairs.
+ * @details Pairs are ordered by score, then by member. The index does not
+ * enforce member uniqueness; the owning `SortedSet` guarantees it through its
+ * member-to-score hash table.
+ */
+class ZSetIndex {
+public:
+    /**
+     * @brief The available index implementations.
+     */
+    enum class Engine {
+        AVL,    ///< One heap node per member (`AVLTree`).
+        BTREE,  ///< Wide, rank-augmented nodes (`BPlusTree`).
+    };
+
+    using Visitor = std::function<void(const std::string&, double)>;
+
+    virtual ~ZSetIndex() = default;
+
+    /**
+     * @brief Creates an empty index using the given engine.
+     */
+    static std::unique_ptr<ZSetIndex> create(Engine engine);
+
+    /**
+     * @brief Returns the name reported by OBJECT ENCODING for this index.
+     */
+    virtual const char* name() const = 0;
+
+    virtual void insert(const std::string& member, double score) = 0;
+
+    /**
+     * @brief Removes the pair (score, member).
+     * @return true if the pair was present.
+     */
+    virtual bool remove(const std::string& member, double score) = 0;
+
+    /**
+     * @brief Changes the score of an existing member.
+     * @details If the new score keeps the pair between its current neighbours,
+     * the score is rewritten in place without restructuring the index.
+     */
+    virtual void updateScore(const std::string& member, double old_score, double new_score) = 0;
+
+    /**
+     * @brief Inserts a batch of pairs sorted in ascending order.
+     * @details An empty index is built directly from the batch in O(n). A
+     * non-empty index merges the batch with its existing pairs and is rebuilt
+     * when the batch is large relative to the index (see `shouldRebuild`),
+     * and otherwise inserts the pairs one by one.
+     */
+    virtual void insertSorted(std::vector<ZSetEntry> entries) = 0;
+
+    virtual size_t size() const = 0;
+
+    /**
+     * @brief Visits `count` pairs starting at rank `start`, in order.
+     * @details When `reverse` is set, ranks are counted from the highest
+     * score and pairs are visited in descending order.
+     */
+    virtual void range(size_t start, size_t count, bool reverse, const Visitor& visitor) = 0;
+
+    /**
+     * @brief Removes up to `count` pairs with the lowest scores (the highest
+     * when `reverse` is set), visiting each one in order as it is removed.
+     */
+    virtual void pop(size_t count, bool reverse, const Visitor& visitor) = 0;
+
+    virtual void clear() = 0;
+
+protected:
+    /**
+     * @brief Decides whether merging `batch` pairs into `existing` ones is
+     * cheaper as an O(n + m) rebuild than as `batch` O(log n) insertions.
+     */
+    static bool shouldRebuild(size_t existing, size_t batch) {
+        return existing == 0 || batch * 8 >= existing;
+    }
+};
+
+/**
+ * @class AVLZSetIndex
+ * @brief A `ZSetIndex` backed by an `AVLTree` of `ZSetNode`s.
+ */
+class AVLZSetIndex : public ZSetIndex {
+public:
+    const char* name() const override { return "avltree"; }
+
+    void insert(const std::string& member, double score) override;
+    bool remove(const std::string& member, double score) override;
+    void updateScore(const std::string& member, double old_score, double new_score) override;
+    void insertSorted(std::vector<ZSetEntry> entries) override;
+    size_t size() const override { return tree.size(); }
+    void range(size_t start, size_t count, bool reverse, const Visitor& visitor) override;
+    void pop(size_t count, bool reverse, const Visitor& visitor) override;
+    void clear() override { tree.clear(); }
+
+private:
+    AVLTree tree;
+
+    static int compareNodes(AVLTree::Node* a, AVLTree::Node* b);
+
+    /**
+     * @brief Finds the node holding (score, member) without building a probe node.
+     */
+    AVLTree::Node* findNode(const std::string& member, double score);
+};
@@ -10,6 +10,8 @@
 #include <cstring>
 #include <stdexcept>
 #include <vector>
+#include <deque>
+#include <memory>
 
 namespace net {
     
@@ -31,6 +33,12 @@ namespace net {
      */
     void set_nonblocking(int fd);
 
+    /**
+     * @brief An immutable chunk of output, reference-counted so that it can be
+     * queued on many connections without being copied (e.g. a published message).
+     */
+    using SharedBuffer = std::shared_ptr<const std::vector<uint8_t>>;
+
     class Connection {
     private:
         // client address
@@ -43,10 +51,23 @@ namespace net {
         bool want_write = false;
         bool want_close = false;
 
+        // Set while the application holds a request of this connection (e.g.
+        // a blocking pop); no further requests are processed until it resumes.
+        bool blocked = false;
+
+        // Set while the application withholds this connection's output (e.g.
+        // replies to writes that are not durable yet); nothing is sent until it is cleared.
+        bool hold_output = false;
+
         // Buffers for incoming and outgoing data
         std::vector<uint8_t> incoming;
         std::vector<uint8_t> outgoing;
 
+        // Output queued by reference. It always precedes `outgoing`, and the
+        // first `shared_sent` bytes of its front buffer were already sent.
+        std::deque<SharedBuffer> shared_outgoing;
+        size_t shared_sent = 0;
+
         /**
          * @brief Constructor for the Connection class
          * @param client_fd File descriptor for the client
@@ -55,6 +76,14 @@ namespace net {
          */
         Connection(const int& client_fd, const struct sockaddr_in& client_addr);
 
+        /**
+         * @brief Constructor for a connection without a socket
+         * @details Stands in for a client served elsewhere, e.g. by another
+         * shard of the server; its output is collected, never sent
+         * @returns void
+         */
+        Connection(): addr{} {}
+
         /**
          * @brief Appends data to the outgoing buffer to be sent
          * @param data Data to append
@@ -70,6 +99,19 @@ namespace net {
          */
         void appendOutgoing(const std::string& str);
 
+        /**
+         * @brief Queues a shared buffer to be sent after everything appended so far
+         * @param buffer The buffer to queue, which is not copied
+         * @returns void
+         */
+        void appendShared(SharedBuffer buffer);
+
+        /**
+         * @brief Tells whether any output is waiting to be sent
+         * @returns bool
+         */
+        bool hasOutgoing() const { return !outgoing.empty() || !shared_outgoing.empty(); }
+
         /**
          * @brief Appends data to the incoming buffer to be processed
          * @param data Data to append
@@ -86,7 +128,7 @@ namespace net {
         void consumeIncoming(size_t len);
 
         /**
-         * @brief Consumes data from the outgoing buffer
+         * @brief Consumes sent data from the shared buffers, then from the outgoing buffer
          * @param len Length of the data to consume
          * @returns void
          */
@@ -5,6 +5,7 @@
 #include <memory>
 #include <cassert>
 #include <iostream>
+#include <functional>
 
 using net::Connection;
 
@@ -14,6 +15,9 @@ private:
     uint16_t PORT;
     // Using a map for efficient fd-based lookups and unique_ptr for memory management
     std::unordered_map<int, std::unique_ptr<Connection>> clients;
+    // Other descriptors polled alongside the connections, such as an eventfd
+    // signalled by a worker thread: the events to wait for and the callback
+    std::unordered_map<int, std::pair<short, std::function<void()>>> watchers;
 
     /**
      * @brief Accepts incoming client connections and adds them to the clients map.
@@ -42,6 +46,13 @@ private:
      */
     void recv(Connection& client);
 
+    /**
+     * @brief Processes every complete request buffered by a client and starts sending the replies.
+     * @param client The client connection whose incoming buffer should be handled.
+     * @return void
+     */
+    void handleIncoming(Connection& client);
+
 protected:
     /**
      * @brief Handles an incoming request from a client.
@@ -51,12 +62,64 @@ protected:
      */
     virtual void onRequest(Connection& client, const std::string& request);
 
+    /**
+     * @brief Returns how long the event loop may wait for I/O, in milliseconds.
+     * @details Derived classes with pending timers override this so that `onTick`
+     * runs in time. The default of -1 waits indefinitely.
+     */
+    virtual int pollTimeout();
+
+    /**
+     * @brief Called once per event loop iteration, after I/O events have been handled.
+     */
+    virtual void onTick();
+
+    /**
+     * @brief Called when `poll()` timed out without any I/O event, before `onTick`.
+     * @details A good time for background work that would otherwise add latency
+     * to requests. Derived classes with such work pending return a zero
+     * `pollTimeout` to get called again right away.
+     */
+    virtual void onIdle();
+
+    /**
+     * @brief Called just before a client connection is closed and destroyed.
+     * @param client The client connection being closed.
+     */
+    virtual void onDisconnect(Connection& client);
+
+    /**
+     * @brief Resumes a blocked client: clears `blocked`, sends whatever the application
+     * queued on its outgoing buffer and processes its pipelined requests.
+     * @param client The client connection to resume.
+     * @return void
+     */
+    void resume(Connection& client);
+
+    /**
+     * @brief Polls another file descriptor alongside the connections.
+     * @param fd The descriptor to watch, which the caller keeps owning.
+     * @param on_ready Called from the event loop whenever `fd` is ready (or has an error).
+     * @param events The `poll()` events to wait for; watching `fd` again replaces them.
+     * @return void
+     */
+    void watch(int fd, std::function<void()> on_ready, short events = POLLIN);
+
+    /**
+     * @brief Stops watching a file descriptor registered with `watch`.
+     * @param fd The descriptor to forget.
+     * @return void
+     */
+    void unwatch(int fd);
+
 public:
     /**
      * @brief Constructor for the Server class.
      * @param port The port number to listen on.
+     * @param reuse_port Set SO_REUSEPORT, so that several servers (e.g. one per
+     * thread) listen on the same port and the kernel spreads connections among them.
      */
-    Server(uint16_t port);
+    Server(uint16_t port, bool reuse_port = false);
 
     /**
      * @brief Runs the server and handles client connections.
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @file AppendOnlyFile.hpp
+ * @brief The append-only file and the background thread that fsyncs it.
+ * @details The event loop appends with `write()`, which only copies into the
+ * page cache. The `fsync` that makes the data durable can take milliseconds,
+ * so it runs on a background thread according to the policy:
+ * - `ALWAYS`: the event loop requests a sync after each iteration's writes
+ *   and holds their replies until `syncedOffset()` covers them. Writes that
+ *   arrive while a sync is in flight are all covered by the next one, so one
+ *   fsync commits a whole group of them.
+ * - `EVERYSEC`: the thread syncs once a second, so at most about a second of
+ *   writes can be lost.
+ * - `NO`: the kernel flushes on its own schedule.
+ *
+ * Each completed sync is signalled on `notifyFd()`, an eventfd that the event
+ * loop polls.
+ */
+class AppendOnlyFile {
+public:
+    enum class FsyncPolicy {
+        ALWAYS,
+        EVERYSEC,
+        NO,
+    };
+
+    AppendOnlyFile();
+
+    /**
+     * @brief Stops the thread and closes the file.
+     */
+    ~AppendOnlyFile();
+
+    /**
+     * @brief Opens `path` for appending, creating it if needed.
+     * @return false (with `errno` set) if it can't be opened.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Switches to another open descriptor (a rewritten log) holding
+     * `size` bytes, which must already be durable, and closes the current one.
+     */
+    void replace(int new_fd, uint64_t size);
+
+    void close();
+
+    bool isOpen() const { return fd != -1; }
+
+    /**
+     * @brief Appends `len` bytes with `write()`.
+     * @return The number of bytes written, which is less than `len` (with
+     * `errno` set) if a write failed.
+     */
+    size_t append(const uint8_t* data, size_t len);
+
+    /**
+     * @brief Asks the thread to sync everything appended so far.
+     */
+    void requestSync();
+
+    /**
+     * @brief Reads (and so clears) the notification of completed syncs.
+     */
+    void clearNotification();
+
+    void setPolicy(FsyncPolicy policy);
+    FsyncPolicy getPolicy() const { return policy; }
+
+    /// @brief The size of the file, counting every byte appended so far.
+    uint64_t size() const { return written; }
+    /// @brief The size of the file's prefix known to be on disk.
+    uint64_t syncedOffset() const { return synced; }
+    /// @brief The number of fsyncs that failed so far.
+    size_t syncErrors() const { return failedSyncs; }
+
+    int notifyFd() const { return eventFd; }
+
+    AppendOnlyFile(const AppendOnlyFile&) = delete;
+    AppendOnlyFile& operator=(const AppendOnlyFile&) = delete;
+
+private:
+    std::mutex mutex;
+    std::condition_variable wakeup;
+
+    int fd = -1;
+    /// @brief Bumped whenever `fd` changes, so a sync of the previous file doesn't count.
+    uint64_t generation = 0;
+    std::atomic<FsyncPolicy> policy{FsyncPolicy::EVERYSEC};
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> synced{0};
+    uint64_t syncRequested = 0;
+    std::atomic<size_t> failedSyncs{0};
+    bool stopping = false;
+
+    int eventFd = -1;
+    std::thread worker;
+
+    void run();
+};
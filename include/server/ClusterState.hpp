@@ -0,0 +1,128 @@
+#pragma once
+
+#include "../common/HashSlot.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @file ClusterState.hpp
+ * @brief What a cluster node knows of the cluster: its nodes, the node serving each hash slot, and the slots being migrated.
+ * @details Every node serves the keys of the hash slots assigned to it and
+ * redirects clients to the owners of the others. A node claims its slots
+ * with a configuration epoch: when two nodes claim a slot, the higher epoch
+ * wins. A node that takes over a migrated slot moves to a new epoch, above
+ * every epoch seen in the cluster (`currentEpoch`), so its claim prevails
+ * everywhere as it spreads.
+ *
+ * The state is saved to the cluster config file, one line per node in the
+ * format of CLUSTER NODES, followed by `vars currentEpoch <epoch>`:
+ *
+ *     <id> <host>:<port> <flags> - 0 <last seen> <config epoch> <link> <slot>|<first>-<last> ... [<slot>->-<id>] [<slot>-<-<id>]
+ *
+ * where `[slot->-id]` marks a slot migrating to node `id`, and
+ * `[slot-<-id]` one imported from it.
+ */
+
+/**
+ * @struct ClusterNode
+ * @brief A node of the cluster, and this node's link to it.
+ */
+struct ClusterNode {
+    /// @brief 40 hex digits. A node met by its address has a made-up id until it introduces itself.
+    std::string id;
+    std::string host;
+    uint16_t port = 0;
+    /// @brief The epoch of its claim on its slots.
+    uint64_t configEpoch = 0;
+    /// @brief Met with CLUSTER MEET and not heard from yet.
+    bool handshake = false;
+    /// @brief When it was added, and when it was last heard from (Unix time, ms; 0 for never).
+    int64_t createdMs = 0;
+    int64_t lastSeenMs = 0;
+
+    // The outgoing link carrying this node's heartbeats to it (none to itself).
+    int linkFd = -1;
+    bool linkConnected = false;
+    /// @brief When the link was last opened, or attempted.
+    int64_t linkCreatedMs = 0;
+    int64_t heartbeatSentMs = 0;
+
+    std::string address() const { return host + ":" + std::to_string(port); }
+};
+
+class ClusterState {
+public:
+    /**
+     * @brief Starts a cluster of one: `myself`, with id `my_id` and no slots.
+     */
+    ClusterState(const std::string& my_id, const std::string& host, uint16_t port);
+
+    ClusterNode* myself;
+    /// @brief The highest epoch seen in the cluster.
+    uint64_t currentEpoch = 0;
+    std::vector<std::unique_ptr<ClusterNode>> nodes;
+
+    /// @brief The node serving each slot, or nullptr.
+    std::array<ClusterNode*, HASH_SLOTS> slots{};
+    /// @brief For each slot this node serves, the node its keys are moving to, if any.
+    std::array<ClusterNode*, HASH_SLOTS> migratingTo{};
+    /// @brief For each slot this node is taking over, the node it comes from, if any.
+    std::array<ClusterNode*, HASH_SLOTS> importingFrom{};
+
+    ClusterNode* findNode(const std::string& id) const;
+    ClusterNode* findNodeByAddress(const std::string& host, uint16_t port) const;
+
+    ClusterNode* addNode(const std::string& id, const std::string& host, uint16_t port);
+
+    /**
+     * @brief Forgets a node: its slots become unassigned. Its link must be closed.
+     */
+    void removeNode(ClusterNode* node);
+
+    /**
+     * @brief Counts the slots assigned to `node`, or to any node.
+     */
+    size_t countSlots(const ClusterNode* node = nullptr) const;
+
+    /**
+     * @brief Returns the ranges of slots served by `node`, as (first, last) pairs.
+     */
+    std::vector<std::pair<size_t, size_t>> slotRanges(const ClusterNode* node) const;
+
+    /**
+     * @brief Formats `slotRanges`, e.g. "0-5460,7000", or "-" without slots.
+     */
+    std::string formatSlotRanges(const ClusterNode* node) const;
+
+    /**
+     * @brief Parses `formatSlotRanges` output, marking the slots in `claimed`.
+     * @return false if it is malformed.
+     */
+    static bool parseSlotRanges(const std::string& ranges, std::vector<bool>& claimed);
+
+    /**
+     * @brief Describes the nodes as CLUSTER NODES does (and the config file holds).
+     * @param node_timeout_ms How long a node may stay silent before it is flagged `fail?`.
+     */
+    std::string describeNodes(int64_t now_ms, int64_t node_timeout_ms) const;
+
+    /**
+     * @brief Writes the state to `path`, replacing it atomically.
+     * @return false (with `errno` set) if it could not be written.
+     */
+    bool save(const std::string& path) const;
+
+    /**
+     * @brief Loads the state saved at `path`.
+     * @return nullptr if there is no file at `path`.
+     * @throws std::runtime_error if the file is unreadable or corrupt.
+     */
+    static std::unique_ptr<ClusterState> load(const std::string& path);
+
+    ClusterState(const ClusterState&) = delete;
+    ClusterState& operator=(const ClusterState&) = delete;
+};
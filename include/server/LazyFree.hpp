@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * @file LazyFree.hpp
+ * @brief A background thread that destroys objects handed over by the event loop.
+ * @details Tearing down a large value (a sorted set with millions of members
+ * is as many heap nodes) takes long enough to stall every client. Such values
+ * are moved into a `LazyFree` queue instead and destroyed by its thread. An
+ * object must not be shared with the event loop once it is handed over.
+ */
+class LazyFree {
+public:
+    LazyFree();
+
+    /**
+     * @brief Destroys every queued object, then stops the thread.
+     */
+    ~LazyFree();
+
+    /**
+     * @brief Takes ownership of `object` and destroys it on the background thread.
+     */
+    template <typename T>
+    void free(T&& object) {
+        enqueue(std::make_unique<Holder<std::decay_t<T>>>(std::forward<T>(object)));
+    }
+
+    /// @brief The number of objects handed over but not destroyed yet.
+    size_t pending() const { return pendingObjects; }
+    /// @brief The number of objects destroyed by the background thread so far.
+    size_t freed() const { return freedObjects; }
+
+    LazyFree(const LazyFree&) = delete;
+    LazyFree& operator=(const LazyFree&) = delete;
+
+private:
+    struct Garbage {
+        virtual ~Garbage() = default;
+    };
+
+    template <typename T>
+    struct Holder : Garbage {
+        explicit Holder(T&& object): object(std::move(object)) {}
+        T object;
+    };
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<std::unique_ptr<Garbage>> queue;
+    bool stopping = false;
+
+    std::atomic<size_t> pendingObjects{0};
+    std::atomic<size_t> freedObjects{0};
+
+    std::thread worker;
+
+    void enqueue(std::unique_ptr<Garbage> garbage);
+    void run();
+};
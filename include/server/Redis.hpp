@@ -3,9 +3,27 @@
 #include "../net/Server.hpp"
 #include "../core/HashTable.hpp"
 #include "../core/ZSet.hpp"
+#include "../core/Hash.hpp"
+#include "../core/Set.hpp"
+#include "../core/List.hpp"
+#include "../core/HyperLogLog.hpp"
 #include "../common/Serialization.hpp"
+#include "../common/Glob.hpp"
+#include "LazyFree.hpp"
+#include "AppendOnlyFile.hpp"
+#include "ReplicationBacklog.hpp"
+#include "ShardSet.hpp"
+#include "ClusterState.hpp"
 #include <variant>
 #include <algorithm>
+#include <deque>
+#include <memory>
+#include <set>
+#include <unordered_set>
+#include <optional>
+#include <type_traits>
+#include <ctime>
+#include <sys/types.h>
 
 // Structure to hold a parsed request command
 struct Request {
@@ -35,32 +53,1185 @@ struct Request {
     }
 };
 
+/**
+ * @brief Appends a command to `out` in the wire format: a u32 message length,
+ * a u32 argument count and each argument as a u32 length and its bytes.
+ * @details This is how the append-only file and the replication stream log writes.
+ */
+template <typename Args>
+inline void appendCommand(Buffer& out, const Args& args) {
+    auto putU32 = [&out](size_t value) {
+        uint32_t word = static_cast<uint32_t>(value);
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&word);
+        out.insert(out.end(), bytes, bytes + 4);
+    };
+
+    size_t body = 4;
+    for (const auto& arg: args) {
+        body += 4 + arg.size();
+    }
+    putU32(body);
+    putU32(args.size());
+    for (const auto& arg: args) {
+        putU32(arg.size());
+        out.insert(out.end(), arg.begin(), arg.end());
+    }
+}
+
+/**
+ * @brief Parses a signed 64-bit integer, rejecting trailing garbage.
+ */
+bool parseInt64(const std::string& str, int64_t& value);
+
 struct DataEntry: public HashTable::Node {
+    using Value = std::variant<std::string, SortedSet, Hash, Set, List>;
+
     std::string key;
-    std::variant<std::string, SortedSet> value;
+    Value value;
+    /// @brief Unix time (in milliseconds) at which the key expires, or 0 if it never does.
+    int64_t expire_at_ms = 0;
+    /**
+     * @brief The access clock used by eviction, refreshed on every lookup.
+     * @details Holds the LRU clock (seconds) of the last access, or under the
+     * LFU policy the minutes clock of the last decay (upper 24 bits) and a
+     * logarithmic access counter (lower 8 bits).
+     */
+    uint32_t access_clock = 0;
+    /**
+     * @brief Whether the string value holds an LZF blob (see `lzf::compressString`)
+     * rather than the string itself, as SET stores large strings when
+     * `string-compression-threshold` is set.
+     */
+    bool compressed = false;
+};
+
+/**
+ * @brief Properties of a command that the dispatcher acts on.
+ */
+enum CommandFlags {
+    CMD_READONLY  = 0,
+    CMD_WRITE     = 1 << 0,  ///< May modify the keyspace.
+    CMD_DENYOOM   = 1 << 1,  ///< May grow memory usage: refused when over `maxmemory`.
+    CMD_PUBSUB    = 1 << 2,  ///< Allowed on a connection in subscribed mode.
+    CMD_BLOCKING  = 1 << 3,  ///< May park the connection until one of its keys is written.
+    CMD_NUMKEYS   = 1 << 4,  ///< Keys are a destination, then a count of source keys and the sources.
+    CMD_ALLSHARDS = 1 << 5,  ///< Sharded mode: reads or changes every shard, so runs on the first with the others paused.
+    CMD_BROADCAST = 1 << 6,  ///< Sharded mode: also executed on every other shard, replying with the local result.
+    CMD_ASKING    = 1 << 7,  ///< Cluster mode: may use a slot being imported, as if preceded by ASKING.
+};
+
+/**
+ * @brief How keys are chosen for eviction once `maxmemory` is reached.
+ */
+enum class EvictionPolicy {
+    NOEVICTION,   ///< Refuse commands that may grow memory usage.
+    ALLKEYS_LRU,  ///< Evict the least recently used keys.
+    ALLKEYS_LFU,  ///< Evict the least frequently used keys.
+    VOLATILE_TTL, ///< Evict the keys with a TTL that expire soonest.
+};
+
+/**
+ * @brief Whether write commands are logged to the append-only file.
+ */
+enum class AofState {
+    OFF,
+    WAIT_REWRITE, ///< Enabled: the first rewrite creates the file, meanwhile writes are only buffered.
+    ON,
+};
+
+/**
+ * @struct ConfigParam
+ * @brief A runtime-tunable setting exposed through CONFIG GET/SET.
+ * @details `set` returns false when the value cannot be parsed or is out of range.
+ */
+struct ConfigParam {
+    std::function<std::string()> get;
+    std::function<bool(const std::string&)> set;
+};
+
+/**
+ * @brief What a blocked client pops once one of its keys can serve it.
+ */
+enum class BlockedPop {
+    ZSET_MIN,   ///< BZPOPMIN
+    ZSET_MAX,   ///< BZPOPMAX
+    LIST_HEAD,  ///< BLPOP
+    LIST_TAIL,  ///< BRPOP
+};
+
+/**
+ * @struct BlockedClient
+ * @brief A connection parked by a blocking pop until one of its keys can be popped.
+ */
+struct BlockedClient {
+    std::vector<std::string> keys;
+    BlockedPop pop = BlockedPop::ZSET_MIN;
+    int64_t deadline_ms = 0; ///< Expiry on the steady clock, or 0 to wait forever.
+};
+
+/**
+ * @struct PubSubClient
+ * @brief The channels and patterns a connection in subscribed mode listens to.
+ */
+struct PubSubClient {
+    std::set<std::string> channels;
+    std::set<std::string> patterns;
+
+    size_t count() const { return channels.size() + patterns.size(); }
+};
+
+/**
+ * @struct PatternSubscribers
+ * @brief The connections subscribed to a pattern, with the pattern compiled once.
+ */
+struct PatternSubscribers {
+    glob::Pattern pattern;
+    std::vector<Connection*> subscribers;
+};
+
+/**
+ * @brief How far a replica connected to this server is in its synchronisation.
+ */
+enum class ReplicaState {
+    WAIT_BGSAVE_START, ///< Needs a full resync: waits for a snapshot to be forked for it.
+    WAIT_BGSAVE_END,   ///< Its snapshot is being written; the stream is buffered meanwhile.
+    ONLINE,            ///< Receives the stream as it is produced.
+};
+
+/**
+ * @struct ReplicaClient
+ * @brief A connection that issued PSYNC, and what it was sent so far.
+ */
+struct ReplicaClient {
+    ReplicaState state = ReplicaState::WAIT_BGSAVE_START;
+    /// @brief The stream produced since its snapshot forked, sent right after the snapshot.
+    Buffer pending;
+    /// @brief The offset the replica last reported having processed.
+    uint64_t ackOffset = 0;
+    /// @brief When it last reported it, on the steady clock.
+    int64_t lastAckMs = 0;
+};
+
+/**
+ * @brief Where a replica is in following its primary.
+ */
+enum class MasterLinkState {
+    NONE,       ///< Not a replica.
+    CONNECT,    ///< Must connect, which the replication cron retries every second.
+    CONNECTING, ///< Waiting for the connection to complete.
+    HANDSHAKE,  ///< Sent PSYNC, waiting for the reply.
+    TRANSFER,   ///< Receiving the snapshot of a full resync.
+    CONNECTED,  ///< Applying the stream.
 };
 
 class RedisServer : public Server {
 public:
-    RedisServer(uint16_t port);
+    /**
+     * @param shard_set The shards this server is one of, in sharded mode: it
+     * then serves the keys of the hash slots congruent to `shard_index` modulo
+     * their number, and shares the port with the others.
+     */
+    RedisServer(uint16_t port, ShardSet* shard_set = nullptr, size_t shard_index = 0);
+
+    /**
+     * @brief Changes a setting, as CONFIG SET does.
+     * @return false if the parameter is unknown or the value invalid.
+     */
+    bool setConfig(const std::string& name, const std::string& value);
+
+    /**
+     * @brief Loads the keyspace from the append-only file (when enabled) or
+     * the snapshot, then starts logging writes if enabled.
+     * @throws std::runtime_error if the file to load is unreadable or corrupt.
+     */
+    void loadDataFromDisk();
 
 private:
     HashTable dataStore;
 
+    // Blocking pops: a FIFO of waiting connections per key, the keys that
+    // received new members since the last tick, and the pending timeouts.
+    std::unordered_map<Connection*, BlockedClient> blockedClients;
+    std::unordered_map<std::string, std::deque<Connection*>> blockingKeys;
+    std::vector<std::string> readyKeys;
+    std::set<std::pair<int64_t, Connection*>> blockingDeadlines;
+
+    // Pub/Sub: the subscribers of each channel and pattern, and what each
+    // subscribed connection listens to.
+    std::unordered_map<std::string, std::vector<Connection*>> pubsubChannels;
+    std::unordered_map<std::string, PatternSubscribers> pubsubPatterns;
+    std::unordered_map<Connection*, PubSubClient> pubsubClients;
+
+    /// @brief The connection whose request is being executed, if any.
+    Connection* currentClient = nullptr;
+
+    // Keys with a TTL, ordered by expiry time so the active expiry cycle only
+    // ever touches keys that are actually due.
+    std::set<std::pair<int64_t, DataEntry*>> expiryIndex;
+    /// @brief Unix time (ms) before which the next active expiry cycle must not start.
+    int64_t nextExpireCycleMs = 0;
+    /// @brief Active expiry cycles per second (at most).
+    size_t hz = 10;
+    /// @brief The time an active expiry cycle may run for, in microseconds.
+    size_t activeExpireBudgetUs = 1000;
+    size_t expiredKeys = 0;
+
+    /// @brief Finish rehashing the keyspace table while idle, for at most `activeExpireBudgetUs` per step.
+    bool activeRehashing = true;
+
+    // Memory limit and eviction (see Eviction.cpp).
+
+    /**
+     * @struct EvictionCandidate
+     * @brief A sampled key, ranked by how good a victim it is (higher is better).
+     */
+    struct EvictionCandidate {
+        uint64_t score;
+        std::string key;
+    };
+
+    /// @brief The memory limit in bytes, or 0 for no limit.
+    size_t maxMemory = 0;
+    EvictionPolicy evictionPolicy = EvictionPolicy::NOEVICTION;
+    size_t maxMemorySamples = 5;
+    size_t lfuLogFactor = 10;
+    size_t lfuDecayTime = 1;
+    size_t evictedKeys = 0;
+    /// @brief The best candidates seen by recent samplings, in ascending score order.
+    std::vector<EvictionCandidate> evictionPool;
+    /// @brief Set when eviction ran out of time and must continue from `onTick`.
+    bool evictionPending = false;
+
+    // Lazy freeing: large values are destroyed on a background thread.
+
+    LazyFree lazyFree;
+    /// @brief DEL frees large values in the background, like UNLINK.
+    bool lazyfreeLazyUserDel = false;
+    /// @brief Values overwritten by SET are freed in the background when large.
+    bool lazyfreeLazyServerDel = false;
+
+    // String compression: SET stores strings of at least this many bytes
+    // LZF-compressed (0 disables it), and GET decompresses them.
+
+    size_t stringCompressionThreshold = 0;
+
+    // Snapshots (see Snapshot.cpp).
+
+    std::string snapshotFilename = "dump.rdb";
+    /// @brief Compress snapshot segments with LZF.
+    bool snapshotCompression = true;
+    /// @brief The pid of the BGSAVE child, or -1 when no snapshot is being written.
+    pid_t snapshotChild = -1;
+    /// @brief The number of write commands executed since the last successful save.
+    size_t dirty = 0;
+    /// @brief The value of `dirty` when the running BGSAVE forked.
+    size_t dirtyAtSnapshot = 0;
+    time_t lastSaveTime = 0;
+    bool lastBgsaveOk = true;
+
+    // Append-only file (see AppendOnly.cpp).
+
+    /// @brief The `appendonly` setting, which `aofState` follows once the data is loaded.
+    bool appendOnly = false;
+    AofState aofState = AofState::OFF;
+    std::string aofFilename = "appendonly.aof";
+    AppendOnlyFile aof;
+    /// @brief Write commands executed since the last flush to the file, in wire format.
+    Buffer aofBuffer;
+    /// @brief Write commands executed since the rewrite child forked, appended to its output.
+    Buffer aofRewriteBuffer;
+    /// @brief The pid of the rewrite child, or -1 when the log is not being rewritten.
+    pid_t aofRewriteChild = -1;
+    /// @brief Start a rewrite as soon as no other child is running.
+    bool aofRewriteScheduled = false;
+    bool aofLastWriteOk = true;
+    bool lastAofRewriteOk = true;
+    /// @brief The size of the file after the last rewrite, which automatic rewrites compare against.
+    uint64_t aofBaseSize = 0;
+    /// @brief Rewrite automatically once the file has grown by this percentage (0 disables it).
+    size_t aofRewritePercentage = 100;
+    /// @brief ...but only once it is at least this large.
+    size_t aofRewriteMinSize = 64 << 20;
+    /// @brief Connections whose replies wait for this iteration's writes to be synced (`appendfsync always`).
+    std::vector<Connection*> aofPendingClients;
+    /// @brief Held connections, with the file offset that must be synced before their replies are sent.
+    std::unordered_map<Connection*, uint64_t> aofSyncWaiters;
+    /// @brief Set while replaying a file, so that the replayed commands are not logged again.
+    bool loading = false;
+    /// @brief Set once `loadDataFromDisk` ran, after which enabling `appendonly` starts logging right away.
+    bool diskDataLoaded = false;
+    /// @brief The form in which the executing command is logged, when it differs from how it was sent (empty to log nothing).
+    std::optional<std::vector<std::string>> rewrittenCommand;
+
+    // Replication (see Replication.cpp). The dataset's history is identified
+    // by `replicationId`, and `replOffset` counts the bytes of its stream.
+
+    std::string replicationId = newReplicationId();
+    uint64_t replOffset = 0;
+    /// @brief The history a promoted replica followed before, which it can still serve up to `previousReplicationIdEnd`.
+    std::string previousReplicationId;
+    uint64_t previousReplicationIdEnd = 0;
+    /// @brief The latest bytes of the stream, kept from the time the first replica connects.
+    std::unique_ptr<ReplicationBacklog> replBacklog;
+    size_t replBacklogSize = 1 << 20;
+    /// @brief Seconds without traffic after which a replication link is considered broken.
+    size_t replTimeout = 60;
+    std::unordered_map<Connection*, ReplicaClient> replicas;
+    size_t syncFull = 0;
+    size_t syncPartialOk = 0;
+    size_t syncPartialErr = 0;
+    /// @brief Steady clock time (ms) before which the next once-a-second replication round must not start.
+    int64_t nextReplicationCronMs = 0;
+    int64_t lastReplicaPingMs = 0;
+
+    // The primary this server replicates, and the link to it.
+
+    std::string masterHost;
+    uint16_t masterPort = 0;
+    MasterLinkState masterLinkState = MasterLinkState::NONE;
+    int masterFd = -1;
+    /// @brief Received from the primary and not processed yet.
+    Buffer masterInput;
+    int64_t masterLastIoMs = 0;
+    /// @brief The history announced by FULLRESYNC, adopted once its snapshot is loaded.
+    std::string transferReplicationId;
+    uint64_t transferOffset = 0;
+    /// @brief The snapshot bytes still to receive, once their count was read.
+    std::optional<uint64_t> transferRemaining;
+    int transferFd = -1;
+
+    // Sharded mode (see Sharding.cpp): the other shards, and the requests
+    // in flight to and from them.
+
+    ShardSet* shards = nullptr;
+    size_t shardIndex = 0;
+    /// @brief Set while executing a command whose keys span shards, with the
+    /// other shards paused: keys are then looked up in their owner's table.
+    bool crossShard = false;
+    uint64_t nextForwardToken = 0;
+    /// @brief The clients waiting for the reply to a forwarded request, by token.
+    std::unordered_map<uint64_t, Connection*> forwardedRequests;
+
+    /**
+     * @struct PendingReply
+     * @brief A client's reply, in request order, while some of its requests are in flight to other shards.
+     */
+    struct PendingReply {
+        size_t shard;
+        /// @brief The forwarded request's token, 0 for a request executed here.
+        uint64_t token;
+        bool done;
+        Buffer response;
+    };
+
+    /// @brief The replies of each client with forwarded requests in flight,
+    /// held back until those of its earlier requests are sent.
+    std::unordered_map<Connection*, std::deque<PendingReply>> pendingReplies;
+    /// @brief A request that waits for its client's forwarded requests to complete (see `ShardRoute`).
+    std::unordered_map<Connection*, Request> deferredRequests;
+
+    /**
+     * @struct RemoteClient
+     * @brief A blocking request forwarded by another shard, parked here on a stand-in connection.
+     */
+    struct RemoteClient {
+        size_t shard;
+        uint64_t token;
+        std::unique_ptr<Connection> conn;
+    };
+
+    std::unordered_map<Connection*, RemoteClient> remoteClients;
+    /// @brief Messages for each shard that did not fit in its queue yet.
+    std::vector<std::deque<ShardMessage>> shardOutbox;
+    size_t forwardedCount = 0;
+    size_t crossShardCount = 0;
+
+    // Cluster mode (see Cluster.cpp): the cluster as this node sees it, and
+    // the keys of each hash slot, which migrations move a slot at a time.
+
+    /// @brief The `cluster-enabled` setting, which creates `cluster` when the data is loaded.
+    bool clusterEnabled = false;
+    std::string clusterConfigFile = "nodes.conf";
+    /// @brief The address other nodes and redirected clients reach this node at.
+    std::string clusterAnnounceIp = "127.0.0.1";
+    /// @brief Milliseconds without a heartbeat after which a node is flagged `fail?`, and a handshake given up.
+    size_t clusterNodeTimeout = 15000;
+    uint16_t listenPort = 0;
+    std::unique_ptr<ClusterState> cluster;
+    /// @brief The keys stored in each hash slot, indexed in cluster mode only.
+    std::vector<std::unordered_set<DataEntry*>> slotKeys;
+    /// @brief Connections that sent ASKING: their next command may use a slot being imported.
+    std::unordered_set<Connection*> askingClients;
+    /// @brief Save the cluster config at the next cron.
+    bool clusterConfigDirty = false;
+    /// @brief Send every node a heartbeat at the next cron, rather than once a second.
+    bool clusterBroadcast = false;
+    /// @brief Unix time (ms) before which the next cluster cron must not start.
+    int64_t nextClusterCronMs = 0;
+
+    /**
+     * @struct MigrateSocket
+     * @brief A connection to a MIGRATE target, kept for the next batch of keys.
+     */
+    struct MigrateSocket {
+        int fd;
+        int64_t lastUseMs;
+    };
+
+    /// @brief The open MIGRATE connections, by "host:port".
+    std::unordered_map<std::string, MigrateSocket> migrateSockets;
+
     using CommandHandler = std::function<void(const Request&, Buffer&)>;
-    std::unordered_map<std::string, CommandHandler> commandTable;
+
+    struct Command {
+        CommandHandler handler;
+        int flags; ///< A combination of `CommandFlags`.
+        // Where the keys are: from `firstKey` to `lastKey` (negative counts
+        // from the end) every `keyStep` arguments. `firstKey` is 0 without keys.
+        int firstKey = 0;
+        int lastKey = 0;
+        int keyStep = 1;
+    };
+
+    std::unordered_map<std::string, Command> commandTable;
+    std::unordered_map<std::string, ConfigParam> configTable;
 
     void handleGet(const Request& request, Buffer& response);
     void handleSet(const Request& request, Buffer& response);
     void handleDel(const Request& request, Buffer& response);
+    void handleUnlink(const Request& request, Buffer& response);
+    void handleFlushAll(const Request& request, Buffer& response);
     void handleZAdd(const Request& request, Buffer& response);
+    void handleZIncrBy(const Request& request, Buffer& response);
     void handleZRem(const Request& request, Buffer& response);
     void handleKeys(const Request& request, Buffer& response);
+    void handleScan(const Request& request, Buffer& response);
     void handlePing(const Request& request, Buffer& response);
     void handleZRange(const Request& request, Buffer& response);
     void handleZScore(const Request& request, Buffer& response);
     void handleUnknown(const Request& request, Buffer& response);
     void handleZRevRange(const Request& request, Buffer& response);
+    void handleZScan(const Request& request, Buffer& response);
+    void handleZUnionStore(const Request& request, Buffer& response);
+    void handleZInterStore(const Request& request, Buffer& response);
+    void handleZDiffStore(const Request& request, Buffer& response);
+    void handleZPopMin(const Request& request, Buffer& response);
+    void handleZPopMax(const Request& request, Buffer& response);
+    void handleBZPopMin(const Request& request, Buffer& response);
+    void handleBZPopMax(const Request& request, Buffer& response);
+    void handleExpire(const Request& request, Buffer& response);
+    void handlePExpire(const Request& request, Buffer& response);
+    void handleTTL(const Request& request, Buffer& response);
+    void handlePTTL(const Request& request, Buffer& response);
+    void handlePersist(const Request& request, Buffer& response);
+    void handleInfo(const Request& request, Buffer& response);
+    void handleConfig(const Request& request, Buffer& response);
+    void handleObject(const Request& request, Buffer& response);
+    void handleHSet(const Request& request, Buffer& response);
+    void handleHGet(const Request& request, Buffer& response);
+    void handleHMGet(const Request& request, Buffer& response);
+    void handleHDel(const Request& request, Buffer& response);
+    void handleHGetAll(const Request& request, Buffer& response);
+    void handleHIncrBy(const Request& request, Buffer& response);
+    void handleHLen(const Request& request, Buffer& response);
+    void handleSAdd(const Request& request, Buffer& response);
+    void handleSRem(const Request& request, Buffer& response);
+    void handleSIsMember(const Request& request, Buffer& response);
+    void handleSCard(const Request& request, Buffer& response);
+    void handleSMembers(const Request& request, Buffer& response);
+    void handleSInter(const Request& request, Buffer& response);
+    void handleSUnion(const Request& request, Buffer& response);
+    void handleSDiff(const Request& request, Buffer& response);
+    void handleLPush(const Request& request, Buffer& response);
+    void handleRPush(const Request& request, Buffer& response);
+    void handleLPop(const Request& request, Buffer& response);
+    void handleRPop(const Request& request, Buffer& response);
+    void handleLRange(const Request& request, Buffer& response);
+    void handleLLen(const Request& request, Buffer& response);
+    void handleLIndex(const Request& request, Buffer& response);
+    void handleLTrim(const Request& request, Buffer& response);
+    void handleBLPop(const Request& request, Buffer& response);
+    void handleBRPop(const Request& request, Buffer& response);
+    void handlePFAdd(const Request& request, Buffer& response);
+    void handlePFCount(const Request& request, Buffer& response);
+    void handlePFMerge(const Request& request, Buffer& response);
+    void handleSetBit(const Request& request, Buffer& response);
+    void handleGetBit(const Request& request, Buffer& response);
+    void handleBitCount(const Request& request, Buffer& response);
+    void handleBitPos(const Request& request, Buffer& response);
+    void handleBitOp(const Request& request, Buffer& response);
+    void handleSubscribe(const Request& request, Buffer& response);
+    void handleUnsubscribe(const Request& request, Buffer& response);
+    void handlePSubscribe(const Request& request, Buffer& response);
+    void handlePUnsubscribe(const Request& request, Buffer& response);
+    void handlePublish(const Request& request, Buffer& response);
+    void handleSave(const Request& request, Buffer& response);
+    void handleBgSave(const Request& request, Buffer& response);
+    void handleLastSave(const Request& request, Buffer& response);
+    void handleBgRewriteAof(const Request& request, Buffer& response);
+    void handlePExpireAt(const Request& request, Buffer& response);
+    void handleReplicaOf(const Request& request, Buffer& response);
+    void handlePSync(const Request& request, Buffer& response);
+    void handleReplConf(const Request& request, Buffer& response);
+    void handleCluster(const Request& request, Buffer& response);
+    void handleAsking(const Request& request, Buffer& response);
+    void handleDump(const Request& request, Buffer& response);
+    void handleRestore(const Request& request, Buffer& response);
+    void handleMigrate(const Request& request, Buffer& response);
+
+    /**
+     * @struct ScanOptions
+     * @brief The cursor and options of a SCAN-family command.
+     */
+    struct ScanOptions {
+        size_t cursor = 0;
+        std::optional<glob::Pattern> pattern;
+        /// @brief Roughly how many elements to visit per call (not how many to return).
+        size_t count = 10;
+    };
+
+    /**
+     * @brief Parses `<cursor> [MATCH pattern] [COUNT count]`, starting at `cursor_index`.
+     * @return false (with an error written to `response`) on invalid arguments.
+     */
+    static bool parseScanOptions(const Request& request, size_t cursor_index, ScanOptions& options, Buffer& response);
+
+    /**
+     * @brief Looks up the value of type `T` (`Hash`, `Set`, `List`, ...) stored at `key`.
+     * @details A string is decompressed in place first (see `rawString`).
+     * @param value Receives the value, or `nullptr` if the key is missing.
+     * @return false (with an error written to `response`) if the key holds another type.
+     */
+    template <class T>
+    bool lookupTyped(const std::string& key, T*& value, Buffer& response) {
+        value = nullptr;
+        DataEntry* entry = lookupEntry(key);
+        if (!entry) {
+            return true;
+        }
+        if (!std::holds_alternative<T>(entry->value)) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
+            return false;
+        }
+        if constexpr (std::is_same_v<T, std::string>) {
+            value = &rawString(entry);
+        } else {
+            value = &std::get<T>(entry->value);
+        }
+        return true;
+    }
+
+    enum class SetOp { INTER, UNION, DIFF };
+
+    /**
+     * @brief Shared implementation of SINTER, SUNION and SDIFF.
+     */
+    void setOpGeneric(const Request& request, Buffer& response, SetOp op);
+
+    /**
+     * @brief Compresses the string just stored in `entry` if it is at least
+     * `stringCompressionThreshold` bytes long and compresses well, and
+     * updates `entry->compressed` either way.
+     */
+    void compressString(DataEntry* entry);
+
+    /**
+     * @brief Returns the string value of `entry`, decompressing it in place
+     * first if needed, for commands that read or modify its bytes.
+     */
+    std::string& rawString(DataEntry* entry);
+
+    /**
+     * @brief Replies with the string value of `entry`, leaving it compressed.
+     */
+    void replyString(DataEntry* entry, Buffer& response);
+
+    /**
+     * @brief Looks up the HyperLogLog sketch stored as a string at `key`.
+     * @param sketch Receives the sketch, or `nullptr` if the key is missing.
+     * @return false (with an error written to `response`) if the key holds
+     * another type or a string that is not a sketch.
+     */
+    bool lookupHyperLogLog(const std::string& key, std::string*& sketch, Buffer& response);
+
+    /**
+     * @brief Shared implementation of LPUSH and RPUSH.
+     */
+    void pushGeneric(const Request& request, Buffer& response, bool to_tail);
+
+    /**
+     * @brief Shared implementation of LPOP and RPOP.
+     */
+    void popGeneric(const Request& request, Buffer& response, bool from_tail);
+
+    /**
+     * @brief Shared implementation of BLPOP and BRPOP.
+     */
+    void blockingPopGeneric(const Request& request, Buffer& response, bool from_tail);
+
+    /**
+     * @brief Pops one element of the list at `key` as a [key, element] reply.
+     * @return false (writing nothing) if the key holds no list elements.
+     */
+    bool listPopWithKey(const std::string& key, bool from_tail, Buffer& response);
+
+    /**
+     * @brief Shared implementation of DEL and UNLINK.
+     * @param lazy Free large values on the lazy-free thread.
+     */
+    void delGeneric(const Request& request, Buffer& response, bool lazy);
+
+    /**
+     * @brief Tells whether destroying `value` is costly enough to be worth
+     * handing it to the lazy-free thread: more than `LAZYFREE_THRESHOLD` allocations.
+     */
+    static bool isCostlyToFree(const DataEntry::Value& value);
+
+    /**
+     * @brief Shared implementation of ZADD and ZINCRBY.
+     * @param flags A combination of `SortedSet::AddFlags`.
+     * @param report_changed Reply with the number of added and updated members (ZADD CH).
+     */
+    void zaddGeneric(const std::string& key, std::vector<ZSetEntry> entries, int flags, bool report_changed, Buffer& response);
+
+    /**
+     * @brief Shared implementation of ZRANGE and ZREVRANGE.
+     */
+    void zrangeGeneric(const Request& request, Buffer& response, bool reverse);
+
+    enum class ZSetOp { UNION, INTER, DIFF };
+
+    /**
+     * @brief Shared implementation of ZUNIONSTORE, ZINTERSTORE and ZDIFFSTORE.
+     * @details The result is computed into a batch first (so the destination
+     * may also be one of the inputs) and then bulk-loaded into a new set.
+     */
+    void zsetStoreGeneric(const Request& request, Buffer& response, ZSetOp op);
+
+    /**
+     * @brief Shared implementation of ZPOPMIN and ZPOPMAX.
+     */
+    void zpopGeneric(const Request& request, Buffer& response, bool pop_max);
+
+    /**
+     * @brief Shared implementation of BZPOPMIN and BZPOPMAX.
+     * @details Pops from the first non-empty key right away; otherwise the
+     * current connection is parked until a write makes one of its keys
+     * non-empty or the timeout expires.
+     */
+    void bzpopGeneric(const Request& request, Buffer& response, bool pop_max);
+
+    /**
+     * @brief Pops one member of the sorted set at `key` as a [key, member, score] reply.
+     * @return false (writing nothing) if the key holds no sorted set members.
+     */
+    bool popWithKey(const std::string& key, bool pop_max, Buffer& response);
+
+    /* Blocking operations (see Blocking.cpp) */
+
+    /**
+     * @brief Queues a Pub/Sub confirmation (`[kind, name, count]`) on a connection.
+     * @param name The channel or pattern, or `nullptr` when there is none.
+     */
+    void pubsubReply(Connection& conn, const char* kind, const std::string* name, size_t count);
+
+    /**
+     * @brief Removes `conn` from one channel's (or pattern's) subscribers.
+     * @return false if it was not subscribed to it.
+     */
+    bool pubsubUnsubscribe(Connection& conn, const std::string& name, bool pattern);
+
+    /**
+     * @brief Shared implementation of UNSUBSCRIBE and PUNSUBSCRIBE.
+     */
+    void unsubscribeGeneric(const Request& request, bool pattern);
+
+    /**
+     * @brief Drops every subscription of a connection that is going away.
+     */
+    void pubsubUnsubscribeAll(Connection& conn);
+
+    /**
+     * @brief Parses the timeout of a blocking command, in seconds (0 waits forever).
+     * @return false (with an error written to `response`) unless it is a
+     * finite number from 0 to `MAX_BLOCK_TIMEOUT_S`.
+     */
+    static bool parseBlockTimeout(const std::string& str, double& timeout, Buffer& response);
+
+    /**
+     * @brief Returns the deadline of a blocking command, in `nowMs()` time,
+     * for a timeout parsed by `parseBlockTimeout`, or 0 (none) for a timeout of 0.
+     */
+    static int64_t blockDeadline(double timeout);
+
+    void blockClient(Connection& conn, std::vector<std::string> keys, BlockedPop pop, int64_t deadline_ms);
+    void unblockClient(Connection& conn);
+
+    /**
+     * @brief Pops for a blocked client from `key`, writing its reply.
+     * @return false (writing nothing) if the key cannot serve this kind of pop.
+     */
+    bool serveBlockedPop(const std::string& key, BlockedPop pop, Buffer& response);
+
+    /**
+     * @brief Records that `key` may now satisfy blocked clients; they are served in `onTick`.
+     */
+    void signalKeyAsReady(const std::string& key);
+
+    /**
+     * @brief Names the non-blocking command that pops like `pop`.
+     */
+    static const char* blockedPopCommand(BlockedPop pop);
+
+    /**
+     * @brief Hands elements of the ready keys to their waiting clients, in FIFO order.
+     */
+    void serveReadyKeys();
+
+    /**
+     * @brief Replies nil to (and resumes) the blocked clients whose timeout has passed.
+     */
+    void timeoutBlockedClients();
+
+    /* Snapshots (see Snapshot.cpp) */
+
+    /**
+     * @brief Writes the keyspace to `snapshotFilename`, replacing it atomically.
+     * @return false (with the reason logged) if the file could not be written.
+     */
+    bool saveSnapshot();
+
+    /**
+     * @brief Loads the keyspace from `snapshotFilename` into the (empty) data store.
+     * @return false if there is no snapshot to load.
+     * @throws std::runtime_error if the file is unreadable or corrupt.
+     */
+    bool loadSnapshot();
+
+    /**
+     * @brief Forks a child that writes the snapshot, as BGSAVE does.
+     * @return false (with `errno` set) if the fork failed.
+     */
+    bool startBackgroundSave();
+
+    /**
+     * @brief Reaps the BGSAVE child once it exits and records the outcome.
+     */
+    void checkSnapshotChild();
+
+    /* Append-only file (see AppendOnly.cpp) */
+
+    /**
+     * @brief Records a write for the append-only file, in a form that replays to the same effect.
+     */
+    void propagate(const std::vector<std::string>& command);
+
+    /**
+     * @brief Holds a connection's replies until the writes made so far are
+     * synced, under `appendfsync always`.
+     */
+    void holdUntilSynced(Connection& conn);
+
+    /**
+     * @brief Writes `aofBuffer` to the file and, under `appendfsync always`,
+     * requests a sync covering the clients held this iteration.
+     */
+    void flushAppendOnlyFile();
+
+    /**
+     * @brief Releases the held connections whose writes are on disk, or all of them.
+     */
+    void releaseSyncedClients(bool all);
+
+    /**
+     * @brief Reaps the rewrite child and starts scheduled or automatic rewrites.
+     */
+    void appendOnlyCron();
+
+    /**
+     * @brief Forks a child that writes the keyspace as a minimal command log.
+     * @return false (with the reason logged) if the fork failed.
+     */
+    bool startAofRewrite();
+
+    /**
+     * @brief Swaps in the child's rewritten log, completed with the commands buffered meanwhile.
+     */
+    void finishAofRewrite(bool child_ok);
+
+    void startAppendOnly();
+    void stopAppendOnly();
+
+    /**
+     * @brief Replays the append-only file into the (empty) data store.
+     * @details A command cut short at the end of the file (by a crash mid-write)
+     * is dropped and the file truncated to the last complete one.
+     * @return false if there is no file to load.
+     * @throws std::runtime_error if the file is unreadable or corrupt.
+     */
+    bool loadAppendOnlyFile();
+
+    /* Replication (see Replication.cpp) */
+
+    bool isReplica() const { return masterLinkState != MasterLinkState::NONE; }
+
+    static std::string newReplicationId();
+
+    /**
+     * @brief Applies REPLICAOF: `no one`, or the primary's host and port.
+     * @return false if the port is invalid, or in sharded or cluster mode.
+     */
+    bool replicaOf(const std::string& host, const std::string& port);
+
+    void replicationSetMaster(const std::string& host, uint16_t port);
+    void replicationUnsetMaster();
+
+    /**
+     * @brief Appends bytes to the replication stream: to the backlog and to every replica.
+     */
+    void feedReplicationStream(const uint8_t* data, size_t len);
+
+    /**
+     * @brief Forks a snapshot for the replicas waiting for a full resync, if no child is running.
+     */
+    void startReplicationSnapshot();
+
+    /**
+     * @brief Sends the snapshot just written to the replicas waiting for it, or drops them if it failed.
+     */
+    void sendSnapshotToReplicas(bool ok);
+
+    /**
+     * @brief Closes the connections of every replica of this server.
+     */
+    void disconnectReplicas();
+
+    /**
+     * @brief Connects to the primary, retries and acknowledges the stream (as a replica),
+     * and pings and times out replicas (as a primary).
+     */
+    void replicationCron();
+
+    void connectToMaster();
+    void onMasterConnected();
+    void readFromMaster();
+
+    /**
+     * @brief Consumes `masterInput` according to `masterLinkState`.
+     */
+    void processMasterInput();
+
+    /**
+     * @brief Handles the reply to PSYNC.
+     * @return false if it is neither FULLRESYNC nor CONTINUE.
+     */
+    bool handlePSyncReply(const uint8_t* data, size_t len);
+
+    /**
+     * @brief Replaces the keyspace with the snapshot just received and adopts its history.
+     * @return false if it could not be saved or loaded.
+     */
+    bool finishSnapshotTransfer();
+
+    /**
+     * @brief Executes the complete commands at the start of `data` and relays them to this server's replicas.
+     * @param consumed Receives the number of bytes they take.
+     * @return false if the stream is malformed.
+     */
+    bool applyReplicationStream(const uint8_t* data, size_t len, size_t& consumed);
+
+    /**
+     * @brief Sends a command to the primary.
+     * @return false if it could not be sent at once.
+     */
+    bool sendToMaster(const std::vector<std::string>& command);
+
+    /**
+     * @brief Closes the link to the primary (and drops a partial transfer), to be reconnected by the cron.
+     */
+    void cancelMasterLink();
+
+    /**
+     * @brief Formats the `# Replication` section of INFO.
+     */
+    std::string replicationInfo() const;
+
+    /* Sharded mode (see Sharding.cpp) */
+
+    /**
+     * @brief Returns the argument positions of a request's keys.
+     */
+    static std::vector<size_t> commandKeys(const Command& command, const Request& request);
+
+    /**
+     * @struct ShardRoute
+     * @brief Where and how a request runs in sharded mode.
+     */
+    struct ShardRoute {
+        size_t shard = 0;
+        /// @brief Runs with the other shards paused.
+        bool pause = false;
+        /// @brief Only touches keys of `shard`, so it may run while requests of
+        /// the same client are in flight to other shards. Anything else (keyless,
+        /// blocking or cross-shard) waits for them, to see their effects.
+        bool independent = false;
+    };
+
+    /**
+     * @brief Picks the shard that executes a request, and whether it must pause the others.
+     * @details A request runs on the shard owning all its keys; one whose keys
+     * span shards runs where it was received, with the others paused.
+     * @param conn The client that sent it, or `nullptr` for a forwarded request.
+     * @return false (with an error in `response`) if it can't run in sharded mode.
+     */
+    bool routeRequest(Connection* conn, const Request& request, ShardRoute& route, Buffer& response);
+
+    /**
+     * @brief Handles a client request in sharded mode: executes it here or forwards it, and replies in order.
+     */
+    void shardRequest(Connection& conn, Request& request);
+
+    /**
+     * @brief Replies to a client, after the replies it still awaits from other shards.
+     */
+    void replyInOrder(Connection& conn, Buffer response);
+
+    /**
+     * @brief Sends a client the replies that are now in order, and moves on once none is awaited.
+     */
+    void releaseReplies(Connection& conn);
+
+    /**
+     * @brief Executes a request, with the other shards paused if `pause` is set.
+     */
+    void executeOnShard(const Request& request, Buffer& response, bool pause);
+
+    /**
+     * @brief Sends a client's request to the shard owning its keys.
+     * @details The client's next requests go on meanwhile, unless `block` is
+     * set (a blocking pop), their replies held back until this one arrives.
+     */
+    void forwardRequest(Connection& conn, size_t shard, std::vector<std::string> command, bool block);
+
+    void sendToShard(size_t shard, ShardMessage message);
+
+    /**
+     * @brief Moves queued messages into the shards' queues and wakes their event loops.
+     */
+    void flushShardOutbox();
+
+    /**
+     * @brief Parks this shard if another one coordinates, then handles the messages received.
+     */
+    void processShardMessages();
+
+    /**
+     * @brief Executes a request forwarded by `shard`, replying unless it blocked.
+     */
+    void executeForwarded(size_t shard, ShardMessage& message);
+
+    /**
+     * @brief Answers a blocked client: a connection of this shard, or the stand-in of another shard's client.
+     */
+    void replyToBlocked(Connection& conn, const Buffer& response);
+
+    /**
+     * @brief Returns the shard owning `key` while a cross-shard command runs, if it is another one.
+     */
+    RedisServer* foreignShard(const std::string& key) {
+        if (!crossShard) return nullptr;
+        RedisServer& owner = shards->shard(shards->shardOf(key));
+        return &owner == this ? nullptr : &owner;
+    }
+
+    /**
+     * @brief Calls `f` with every shard, or with this server when it is not sharded.
+     * @details Other shards must be paused (or not running yet).
+     */
+    template <typename F>
+    void forEachShard(F&& f) {
+        if (!shards) {
+            f(*this);
+            return;
+        }
+        for (size_t i = 0; i < shards->size(); ++i) {
+            f(shards->shard(i));
+        }
+    }
+
+    /**
+     * @brief Formats the `# Sharding` section of INFO.
+     */
+    std::string shardingInfo() const;
+
+    /* Cluster mode (see Cluster.cpp) */
+
+    /**
+     * @brief Loads this node's view of the cluster from `clusterConfigFile`, or starts a new cluster of one.
+     * @throws std::runtime_error if the file is corrupt or can't be written.
+     */
+    void loadClusterConfig();
+
+    /**
+     * @brief Saves the cluster config now.
+     * @return false (with the reason logged) if it could not be written.
+     */
+    bool saveClusterConfig();
+
+    /**
+     * @brief Checks that this node serves the keys of a request.
+     * @return false (with a redirection or an error in `response`) if it must not run here.
+     */
+    bool clusterAcceptsRequest(Connection& conn, const Request& request, Buffer& response);
+
+    /**
+     * @brief Records a change of the cluster config, saved at the next cron.
+     * @param broadcast Also send it to every node right away, as for a change of this node's slots.
+     */
+    void clusterChanged(bool broadcast) {
+        clusterConfigDirty = true;
+        if (broadcast) {
+            clusterBroadcast = true;
+            nextClusterCronMs = 0;
+        }
+    }
+
+    /**
+     * @brief Writes the error for a request on a slot this node does not serve: MOVED, or CLUSTERDOWN if no node does.
+     */
+    void clusterRedirect(size_t slot, Buffer& response) const;
+
+    /**
+     * @brief Answers the clients blocked on keys of slots this node no longer serves with a redirection.
+     */
+    void redirectBlockedClients();
+
+    /**
+     * @brief Deletes the keys left in a slot that another node took over.
+     */
+    void deleteKeysInSlot(size_t slot);
+
+    void clusterSetSlot(const Request& request, Buffer& response);
+    void clusterAddSlots(const Request& request, Buffer& response, bool ranges);
+    void clusterDelSlots(const Request& request, Buffer& response, bool ranges);
+    void clusterMeet(const Request& request, Buffer& response);
+
+    /**
+     * @brief Applies a node's heartbeat: its epochs, the slots it claims and the nodes it knows.
+     */
+    void clusterGossip(const Request& request, Buffer& response);
+
+    /**
+     * @brief Keeps a link to every node, sends heartbeats, gives up stale handshakes
+     * and saves the config when it changed.
+     */
+    void clusterCron();
+
+    void connectClusterNode(ClusterNode& node);
+    void onClusterLinkConnected(ClusterNode& node);
+    void readClusterLink(ClusterNode& node);
+    void closeClusterLink(ClusterNode& node);
+    void sendHeartbeat(ClusterNode& node);
+
+    /**
+     * @brief Returns a connection to a MIGRATE target, opening it if needed.
+     * @return -1 (with `error` set) if it can't be connected within `timeout_ms`.
+     */
+    int migrateConnect(const std::string& host, uint16_t port, int64_t timeout_ms, std::string& error);
+
+    void closeMigrateSocket(const std::string& address);
+
+    /**
+     * @brief Formats the reply to CLUSTER INFO.
+     */
+    std::string clusterInfo() const;
+
+    /**
+     * @brief Empties this server's keyspace, freeing it in the background if `async`.
+     */
+    void flushKeyspace(bool async);
+
+    /* Key expiration (see Expire.cpp) */
+
+    /**
+     * @brief Shared implementation of EXPIRE and PEXPIRE.
+     * @param unit_ms The length of one unit of the TTL argument, in milliseconds.
+     */
+    void expireGeneric(const Request& request, Buffer& response, int64_t unit_ms);
+
+    /**
+     * @brief Shared implementation of TTL and PTTL.
+     */
+    void ttlGeneric(const Request& request, Buffer& response, bool in_ms);
+
+    /**
+     * @brief Sets (or, with 0, clears) the expiry time of an entry.
+     */
+    void setExpire(DataEntry* entry, int64_t expire_at_ms);
+
+    /**
+     * @brief Deletes expired keys, oldest first, until none is due or the
+     * `activeExpireBudgetUs` time budget is spent.
+     */
+    void activeExpireCycle();
+
+    static bool isExpired(const DataEntry* entry, int64_t now_ms) {
+        return entry->expire_at_ms != 0 && entry->expire_at_ms <= now_ms;
+    }
+
+    static int64_t unixTimeMs();
+
+    /* Memory limit and eviction (see Eviction.cpp) */
+
+    enum class EvictResult {
+        OK,       ///< Memory usage is within the limit.
+        RUNNING,  ///< Over the limit, but eviction ran out of time and continues in `onTick`.
+        FAIL,     ///< Over the limit with nothing left to evict under the current policy.
+    };
+
+    /**
+     * @brief Evicts keys until memory usage is within `maxMemory`, for at most
+     * `activeExpireBudgetUs` per call.
+     */
+    EvictResult performEvictions();
+
+    /**
+     * @brief Chooses the next key to evict according to `evictionPolicy`.
+     * @return false if there is no candidate.
+     */
+    bool selectEvictionKey(std::string& key);
+
+    /**
+     * @brief Samples `maxMemorySamples` keys and merges them into `evictionPool`.
+     */
+    void populateEvictionPool();
+
+    /**
+     * @brief Records an access to an entry in its `access_clock`.
+     */
+    void touchEntry(DataEntry* entry);
+
+    /**
+     * @brief Ranks an entry for eviction: its idle time (LRU) or inverted access frequency (LFU).
+     */
+    uint64_t evictionScore(const DataEntry* entry) const;
+
+    /**
+     * @brief Returns the LFU counter of an entry, decayed by the time since its last access.
+     */
+    uint8_t lfuDecayedCounter(const DataEntry* entry) const;
+
+    int pollTimeout() override;
+    void onTick() override;
+    void onIdle() override;
+    void onDisconnect(Connection& conn) override;
+
+    /**
+     * @brief Frames a response and queues it on a connection's outgoing buffer.
+     */
+    static void reply(Connection& conn, const Buffer& response);
+
+    static int64_t nowMs();
 
     /**
      * @brief Handles incoming requests from clients.
@@ -107,5 +1278,49 @@ private:
      */
     void executeRequest(const Request& request, Buffer& response);
 
+    /**
+     * @brief Looks up the entry stored under `key` in the data store.
+     * @details An expired key is deleted on the spot and reported as missing.
+     * @return The entry, or `nullptr` if the key does not exist.
+     */
+    DataEntry* lookupEntry(const std::string& key);
+
+    /**
+     * @brief Looks up an entry without expiring it or recording an access.
+     */
+    DataEntry* findEntry(const std::string& key);
+
+    /**
+     * @brief Creates an entry for a key that does not exist yet.
+     * @return The new entry, now owned by the data store.
+     */
+    template <typename Value>
+    DataEntry* addEntry(const std::string& key, Value&& value) {
+        if (RedisServer* owner = foreignShard(key)) {
+            return owner->addEntry(key, std::forward<Value>(value));
+        }
+        auto new_entry = std::make_unique<DataEntry>();
+        new_entry->key = key;
+        new_entry->value = std::forward<Value>(value);
+        new_entry->hashCode = stringHash(key);
+        touchEntry(new_entry.get());
+
+        DataEntry* entry = new_entry.get();
+        dataStore.insert(std::move(new_entry));
+        if (!slotKeys.empty()) {
+            slotKeys[keyHashSlot(key)].insert(entry);
+        }
+        return entry;
+    }
+
+    /**
+     * @brief Removes the entry stored under `key`, if any, along with its expiry.
+     * @param lazy Hand the entry to the lazy-free thread if it is costly to free.
+     * @return true if the key existed.
+     */
+    bool removeEntry(const std::string& key, bool lazy = false);
+
+    static bool entryEquals(HashTable::Node* node, HashTable::Node* key);
+
     static uint64_t stringHash(const std::string& str);
 };
\ No newline at end of file
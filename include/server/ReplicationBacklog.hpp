@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @file ReplicationBacklog.hpp
+ * @brief A fixed-size ring buffer holding the latest bytes of the replication stream.
+ * @details Every byte of the stream has an offset, counted from the start of
+ * the history: the backlog keeps the `capacity` bytes before `endOffset()`.
+ * A replica that reconnects after a brief disconnect asks for the stream from
+ * the offset it reached, and is served from here if the backlog still holds
+ * it, instead of having to load a whole new snapshot.
+ */
+class ReplicationBacklog {
+public:
+    /**
+     * @brief Creates an empty backlog whose history starts at `offset`.
+     */
+    ReplicationBacklog(size_t capacity, uint64_t offset);
+
+    /**
+     * @brief Appends bytes of the stream, overwriting the oldest ones once full.
+     */
+    void append(const uint8_t* data, size_t len);
+
+    /**
+     * @brief Tells whether the stream can be resumed from `offset`: whether
+     * every byte from there to `endOffset()` is still held.
+     */
+    bool contains(uint64_t offset) const { return offset >= startOffset() && offset <= end; }
+
+    /**
+     * @brief Appends the bytes from `offset` to `endOffset()` to `out`.
+     * @pre `contains(offset)`
+     */
+    void copyFrom(uint64_t offset, std::vector<uint8_t>& out) const;
+
+    /**
+     * @brief Changes the capacity, keeping as much of the latest history as fits.
+     */
+    void resize(size_t capacity);
+
+    /// @brief The offset of the oldest byte held.
+    uint64_t startOffset() const { return end - length; }
+    /// @brief The offset just past the last byte appended.
+    uint64_t endOffset() const { return end; }
+    /// @brief The number of bytes held.
+    size_t historyLength() const { return length; }
+    size_t capacity() const { return ring.size(); }
+
+private:
+    std::vector<uint8_t> ring;
+    /// @brief Where the next byte goes.
+    size_t head = 0;
+    size_t length = 0;
+    uint64_t end;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "../common/HashSlot.hpp"
+#include "../common/Serialization.hpp"
+#include "../common/SpscQueue.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class RedisServer;
+
+/// @brief SCAN cursors carry the shard being scanned above this bit, and its table cursor below.
+const size_t SHARD_CURSOR_SHIFT = 48;
+const size_t SHARD_CURSOR_MASK = (size_t(1) << SHARD_CURSOR_SHIFT) - 1;
+
+/**
+ * @file ShardSet.hpp
+ * @brief The shards of a server partitioned across threads, and the channels between them.
+ * @details In sharded mode the keyspace is split by hash slot over N
+ * `RedisServer` instances, each with its own table, event loop and clients,
+ * running on its own thread and sharing nothing but what is here:
+ *
+ * - a lock-free single-producer single-consumer queue for every ordered pair
+ *   of shards, carrying forwarded requests and their replies, with an
+ *   eventfd per shard to wake its event loop when messages arrive;
+ * - a way for one shard to park all the others, so that a command whose keys
+ *   span several shards can run on one thread against all of their tables.
+ */
+
+/**
+ * @struct ShardMessage
+ * @brief A request forwarded to the shard owning its keys, or what comes back.
+ */
+struct ShardMessage {
+    enum class Type {
+        REQUEST, ///< Execute `command`; reply unless `token` is 0.
+        REPLY,   ///< The `response` to the request sent with `token`.
+        CANCEL,  ///< The client behind `token` went away: drop its blocked request.
+    };
+
+    Type type = Type::REQUEST;
+    /// @brief Chosen by the sending shard to match the reply with its client.
+    uint64_t token = 0;
+    std::vector<std::string> command;
+    Buffer response;
+};
+
+class ShardSet {
+public:
+    /**
+     * @brief Creates the channels for `count` shards, which then attach themselves.
+     */
+    explicit ShardSet(size_t count);
+    ~ShardSet();
+
+    size_t size() const { return count; }
+
+    void attach(size_t index, RedisServer& server);
+    RedisServer& shard(size_t index) { return *servers[index]; }
+
+    /**
+     * @brief Returns the index of the shard owning `key`.
+     */
+    size_t shardOf(const std::string& key) const { return keyHashSlot(key) % count; }
+
+    /**
+     * @brief The queue from shard `from` to shard `to`: only `from` pushes and only `to` pops.
+     */
+    SpscQueue<ShardMessage>& queue(size_t from, size_t to) { return *queues[from * count + to]; }
+
+    /**
+     * @brief The eventfd that becomes readable when shard `index` has messages or is asked to pause.
+     */
+    int notifyFd(size_t index) const { return notifyFds[index]; }
+
+    /**
+     * @brief Wakes the event loop of shard `index`.
+     */
+    void notify(size_t index);
+
+    /**
+     * @brief Parks every shard but `self` and returns once they all are.
+     * @details Only one shard coordinates at a time; one that wants to while
+     * another does is parked like the others until its turn comes.
+     */
+    void pauseOthers(size_t self);
+
+    /**
+     * @brief Lets the shards parked by `pauseOthers` go.
+     */
+    void resumeOthers(size_t self);
+
+    /**
+     * @brief Parks shard `self` until it is let go, if a coordinating shard asked for it.
+     */
+    void servePause(size_t self);
+
+    ShardSet(const ShardSet&) = delete;
+    ShardSet& operator=(const ShardSet&) = delete;
+
+private:
+    size_t count;
+    std::vector<RedisServer*> servers;
+    std::vector<std::unique_ptr<SpscQueue<ShardMessage>>> queues;
+    std::vector<int> notifyFds;
+
+    /// @brief Held by the shard coordinating a cross-shard command.
+    std::mutex coordinator;
+    std::mutex pauseMutex;
+    std::condition_variable pauseChanged;
+    /// @brief Set by the coordinator for each shard it wants parked.
+    std::unique_ptr<std::atomic<bool>[]> pauseRequested;
+    /// @brief Set by each shard while it is parked (guarded by `pauseMutex`).
+    std::vector<bool> paused;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Redis.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @file SnapshotFile.hpp
+ * @brief The snapshot file format: writing it, and decoding it on several threads.
+ * @details Entries are grouped into segments of about a megabyte,
+ * each carrying its length, its entry count and a checksum of its contents.
+ * The segment headers form a chain that can be walked without decoding any
+ * entry, so a loader can verify and decode every segment on its own thread,
+ * and the counts add up to the number of keys before any of them is decoded.
+ * Segments can be LZF-compressed, which is undone by the thread decoding them.
+ */
+
+/**
+ * @class SnapshotWriter
+ * @brief Writes a snapshot to a file, one segment at a time.
+ */
+class SnapshotWriter {
+public:
+    /**
+     * @brief Starts a snapshot on `fd`, which must be empty.
+     * @param compress Compress the segments that shrink with LZF.
+     */
+    SnapshotWriter(int fd, bool compress);
+
+    /**
+     * @brief Appends a key, its value and its expiry time.
+     */
+    void writeEntry(DataEntry& entry);
+
+    /**
+     * @brief Writes out the last segment and the trailer.
+     * @return false if any write failed.
+     */
+    bool finish();
+
+private:
+    int fd;
+    bool compress;
+    Buffer segment;
+    /// @brief Scratch space for the compressed segment.
+    Buffer packed;
+    uint64_t segmentEntries = 0;
+    uint64_t keyCount = 0;
+    /// @brief The checksum of the header, the segment headers and the trailer.
+    uint64_t checksum = 0;
+    bool ok = true;
+
+    void writeChecksummed(const Buffer& bytes);
+    void flushSegment();
+    void writeAll(const uint8_t* data, size_t len);
+};
+
+/**
+ * @brief The keys decoded from a snapshot, grouped by segment in file order.
+ */
+struct SnapshotContents {
+    /// @brief The number of keys in the file, including those skipped as expired.
+    uint64_t keyCount = 0;
+    /// @brief The decoded entries, with their hash codes computed and not linked anywhere yet.
+    std::vector<std::vector<std::unique_ptr<DataEntry>>> segments;
+};
+
+/**
+ * @brief Maps the snapshot at `path` and decodes its segments on up to `threads` threads.
+ * @details Keys that expired before `now_ms` are left out.
+ * @return false if there is no file at `path`.
+ * @throws std::runtime_error if the file is unreadable or corrupt.
+ */
+bool readSnapshotFile(const std::string& path, int64_t now_ms, size_t threads, SnapshotContents& contents);
+
+/**
+ * @brief Serializes the value of `entry` as DUMP does: its snapshot encoding,
+ * followed by a u32 format version and a CRC-64 of the preceding bytes.
+ */
+std::string dumpValue(DataEntry& entry);
+
+/**
+ * @brief Decodes a payload made by `dumpValue` into the value of `entry`.
+ * @return false if the payload is corrupt or from a newer format.
+ */
+bool restoreValue(std::string_view payload, DataEntry& entry);
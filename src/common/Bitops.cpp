@@ -0,0 +1,169 @@
+#include <common/Bitops.hpp>
+#include <algorithm>
+#include <cstring>
+
+/**
+ * @file Bitops.cpp
+ * @brief Implements the word-at-a-time bitmap kernels.
+ */
+
+namespace bitops {
+
+static const uint64_t M1 = 0x5555555555555555ULL;
+static const uint64_t M2 = 0x3333333333333333ULL;
+static const uint64_t M4 = 0x0F0F0F0F0F0F0F0FULL;
+static const uint64_t M8 = 0x00FF00FF00FF00FFULL;
+static const uint64_t H8 = 0x0101010101010101ULL;
+static const uint64_t H16 = 0x0001000100010001ULL;
+
+/// @brief The number of words whose byte-wise counts are summed before a horizontal add.
+static const size_t POPCOUNT_BLOCK_WORDS = 8;
+
+static uint64_t load(const char* data) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+static void store(char* data, uint64_t word) {
+    std::memcpy(data, &word, sizeof(word));
+}
+
+/**
+ * @brief Returns the set bits of each byte of `x`, in that byte.
+ */
+static uint64_t byteCounts(uint64_t x) {
+    x = x - ((x >> 1) & M1);
+    x = (x & M2) + ((x >> 2) & M2);
+    return (x + (x >> 4)) & M4;
+}
+
+static bool bitAt(std::string_view data, uint64_t pos) {
+    return (static_cast<uint8_t>(data[pos >> 3]) >> (7 - (pos & 7))) & 1;
+}
+
+uint64_t popcount(std::string_view data) {
+    const char* p = data.data();
+    size_t len = data.size();
+    uint64_t count = 0;
+
+    // Per-byte counts are at most 8, so a block of 8 words sums to at most
+    // 64 per byte: add the words byte-wise, then reduce the block once
+    // (through 16-bit lanes, as the total may exceed a byte).
+    const size_t BLOCK_BYTES = POPCOUNT_BLOCK_WORDS * sizeof(uint64_t);
+    for (; len >= BLOCK_BYTES; p += BLOCK_BYTES, len -= BLOCK_BYTES) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < POPCOUNT_BLOCK_WORDS; ++i) {
+            sum += byteCounts(load(p + i * sizeof(uint64_t)));
+        }
+        sum = (sum & M8) + ((sum >> 8) & M8);
+        count += (sum * H16) >> 48;
+    }
+
+    for (; len >= sizeof(uint64_t); p += sizeof(uint64_t), len -= sizeof(uint64_t)) {
+        count += (byteCounts(load(p)) * H8) >> 56;
+    }
+
+    for (; len > 0; ++p, --len) {
+        count += (byteCounts(static_cast<uint8_t>(*p)) * H8) >> 56;
+    }
+    return count;
+}
+
+uint64_t popcount(std::string_view data, uint64_t first, uint64_t last) {
+    const size_t first_byte = first >> 3;
+    const size_t last_byte = last >> 3;
+    const uint8_t head_mask = 0xFF >> (first & 7);
+    const uint8_t tail_mask = static_cast<uint8_t>(0xFF << (7 - (last & 7)));
+
+    if (first_byte == last_byte) {
+        uint8_t byte = static_cast<uint8_t>(data[first_byte]) & head_mask & tail_mask;
+        return (byteCounts(byte) * H8) >> 56;
+    }
+
+    uint8_t head = static_cast<uint8_t>(data[first_byte]) & head_mask;
+    uint8_t tail = static_cast<uint8_t>(data[last_byte]) & tail_mask;
+    return ((byteCounts(head) + byteCounts(tail)) * H8 >> 56)
+        + popcount(data.substr(first_byte + 1, last_byte - first_byte - 1));
+}
+
+int64_t findBit(std::string_view data, uint64_t first, uint64_t last, bool bit) {
+    uint64_t pos = first;
+
+    // Bits up to the first byte boundary.
+    for (; pos <= last && (pos & 7) != 0; ++pos) {
+        if (bitAt(data, pos) == bit) return static_cast<int64_t>(pos);
+    }
+
+    // Skip whole words, then whole bytes, that can't hold the bit...
+    const uint64_t skip_word = bit ? 0 : ~uint64_t(0);
+    while (pos + 63 <= last && load(data.data() + (pos >> 3)) == skip_word) {
+        pos += 64;
+    }
+    const char skip_byte = bit ? 0 : static_cast<char>(0xFF);
+    while (pos + 7 <= last && data[pos >> 3] == skip_byte) {
+        pos += 8;
+    }
+
+    // ...so at most a byte's worth of bits remains to be tested.
+    for (; pos <= last; ++pos) {
+        if (bitAt(data, pos) == bit) return static_cast<int64_t>(pos);
+    }
+    return -1;
+}
+
+/**
+ * @brief Combines `source` into `result` in place; bytes past the end of `source` count as zero.
+ */
+static void combine(Op op, std::string& result, std::string_view source) {
+    char* out = &result[0];
+    const char* in = source.data();
+    const size_t len = source.size();
+    size_t i = 0;
+
+    switch (op) {
+        case Op::AND:
+            for (; i + 8 <= len; i += 8) store(out + i, load(out + i) & load(in + i));
+            for (; i < len; ++i) out[i] &= in[i];
+            std::fill(result.begin() + len, result.end(), '\0');
+            break;
+        case Op::OR:
+            for (; i + 8 <= len; i += 8) store(out + i, load(out + i) | load(in + i));
+            for (; i < len; ++i) out[i] |= in[i];
+            break;
+        case Op::XOR:
+            for (; i + 8 <= len; i += 8) store(out + i, load(out + i) ^ load(in + i));
+            for (; i < len; ++i) out[i] ^= in[i];
+            break;
+        case Op::NOT:
+            break;
+    }
+}
+
+std::string apply(Op op, const std::vector<std::string_view>& sources) {
+    size_t len = 0;
+    for (const auto& source: sources) {
+        len = std::max(len, source.size());
+    }
+
+    std::string result(len, '\0');
+    if (len == 0) {
+        return result;
+    }
+    std::copy(sources[0].begin(), sources[0].end(), result.begin());
+
+    if (op == Op::NOT) {
+        char* out = &result[0];
+        size_t i = 0;
+        for (; i + 8 <= len; i += 8) store(out + i, ~load(out + i));
+        for (; i < len; ++i) out[i] = static_cast<char>(~out[i]);
+        return result;
+    }
+
+    for (size_t k = 1; k < sources.size(); ++k) {
+        combine(op, result, sources[k]);
+    }
+    return result;
+}
+
+}
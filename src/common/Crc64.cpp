@@ -0,0 +1,54 @@
+#include <common/Crc64.hpp>
+#include <cstring>
+
+/**
+ * @file Crc64.cpp
+ * @brief Implements CRC-64/Jones with slicing-by-8 lookup tables.
+ */
+
+/// @brief The Jones polynomial, bit-reversed for the reflected algorithm.
+static const uint64_t POLY = 0x95ac9329ac4bc9b5ULL;
+
+/**
+ * @brief `table[0]` is the classic byte-at-a-time table; `table[k]` advances
+ * a byte through `k` further zero bytes, so eight bytes fold in at once.
+ */
+struct Crc64Tables {
+    uint64_t table[8][256];
+
+    Crc64Tables() {
+        for (uint64_t n = 0; n < 256; ++n) {
+            uint64_t crc = n;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ POLY : crc >> 1;
+            }
+            table[0][n] = crc;
+        }
+        for (int k = 1; k < 8; ++k) {
+            for (int n = 0; n < 256; ++n) {
+                uint64_t prev = table[k - 1][n];
+                table[k][n] = (prev >> 8) ^ table[0][prev & 0xff];
+            }
+        }
+    }
+};
+
+static const Crc64Tables tables;
+
+uint64_t crc64(uint64_t crc, const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const auto& t = tables.table;
+
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        crc ^= word;
+        crc = t[7][crc & 0xff] ^ t[6][(crc >> 8) & 0xff] ^ t[5][(crc >> 16) & 0xff] ^ t[4][(crc >> 24) & 0xff]
+            ^ t[3][(crc >> 32) & 0xff] ^ t[2][(crc >> 40) & 0xff] ^ t[1][(crc >> 48) & 0xff] ^ t[0][crc >> 56];
+    }
+
+    for (; len > 0; ++p, --len) {
+        crc = t[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
@@ -0,0 +1,19 @@
+#include <common/FileIo.hpp>
+#include <cerrno>
+#include <unistd.h>
+
+/**
+ * @file FileIo.cpp
+ * @brief Implements the blocking file descriptor helpers.
+ */
+
+bool writeAll(int fd, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
@@ -0,0 +1,184 @@
+#include <common/Glob.hpp>
+#include <cstring>
+#include <utility>
+
+/**
+ * @file Glob.cpp
+ * @brief Implements glob-style pattern matching and the pattern compiler.
+ */
+
+/**
+ * @brief The extent of the single-character atom at `pos` (a literal, an
+ * escape, `?` or a bracket class).
+ */
+struct Atom {
+    size_t next;  ///< The position just past the atom.
+    bool literal; ///< Matches exactly `ch`.
+    char ch;
+};
+
+static Atom parseAtom(std::string_view pattern, size_t pos) {
+    if (pattern[pos] == '?') {
+        return {pos + 1, false, 0};
+    }
+
+    if (pattern[pos] == '\\' && pos + 1 < pattern.size()) {
+        return {pos + 2, true, pattern[pos + 1]};
+    }
+
+    if (pattern[pos] == '[') {
+        for (size_t i = pos + 1; i < pattern.size(); ++i) {
+            if (pattern[i] == '\\') ++i;
+            else if (pattern[i] == ']') return {i + 1, false, 0};
+        }
+        // No closing bracket: the '[' is an ordinary character.
+    }
+
+    return {pos + 1, true, pattern[pos]};
+}
+
+/**
+ * @brief Matches one character against the atom at `pos`.
+ * @param next Receives the position just past the atom.
+ */
+static bool matchAtom(std::string_view pattern, size_t pos, char c, size_t& next) {
+    Atom atom = parseAtom(pattern, pos);
+    next = atom.next;
+
+    if (atom.literal) {
+        return atom.ch == c;
+    }
+    if (pattern[pos] == '?') {
+        return true;
+    }
+
+    // A bracket class spanning [pos, next).
+    size_t i = pos + 1, end = next - 1;
+    bool negate = i < end && pattern[i] == '^';
+    if (negate) ++i;
+
+    bool matched = false;
+    while (i < end) {
+        if (pattern[i] == '\\' && i + 1 < end) {
+            matched |= pattern[i + 1] == c;
+            i += 2;
+        } else if (i + 2 < end && pattern[i + 1] == '-') {
+            unsigned char low = pattern[i], high = pattern[i + 2];
+            if (low > high) std::swap(low, high);
+            matched |= static_cast<unsigned char>(c) >= low && static_cast<unsigned char>(c) <= high;
+            i += 3;
+        } else {
+            matched |= pattern[i] == c;
+            ++i;
+        }
+    }
+
+    return matched != negate;
+}
+
+bool glob::match(std::string_view pattern, std::string_view str) {
+    // Every atom but '*' consumes exactly one character, so on a mismatch it
+    // is enough to retry from the most recent star, letting it absorb one
+    // more character: no deeper backtracking is ever needed.
+    const size_t NONE = std::string_view::npos;
+    size_t p = 0, s = 0;
+    size_t star_p = NONE, star_s = 0;
+
+    while (s < str.size()) {
+        if (p < pattern.size()) {
+            if (pattern[p] == '*') {
+                while (p < pattern.size() && pattern[p] == '*') ++p;
+                if (p == pattern.size()) return true;
+                star_p = p;
+                star_s = s;
+                continue;
+            }
+
+            size_t next = 0;
+            if (matchAtom(pattern, p, str[s], next)) {
+                p = next;
+                ++s;
+                continue;
+            }
+        }
+
+        if (star_p == NONE) return false;
+        p = star_p;
+        s = ++star_s;
+    }
+
+    while (p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size();
+}
+
+/* ====== Pattern ====== */
+
+glob::Pattern::Pattern(std::string_view pattern): pattern(pattern) {
+    // Split the pattern into '*'-separated segments, each a list of literal
+    // runs broken up by wildcard atoms.
+    std::vector<std::vector<std::string>> segments(1);
+    segments.back().emplace_back();
+
+    for (size_t pos = 0; pos < pattern.size();) {
+        if (pattern[pos] == '*') {
+            has_star = true;
+            segments.emplace_back(1);
+            ++pos;
+            continue;
+        }
+
+        Atom atom = parseAtom(pattern, pos);
+        ++min_length;
+        if (atom.literal) {
+            segments.back().back() += atom.ch;
+        } else {
+            literal_only = false;
+            segments.back().emplace_back();
+        }
+        pos = atom.next;
+    }
+
+    // The leading run of the first segment and the trailing run of the last
+    // one are anchored; a segment with no wildcard is then used up entirely.
+    prefix = std::move(segments.front().front());
+    segments.front().front().clear();
+    if (has_star || !literal_only) {
+        suffix = std::move(segments.back().back());
+        segments.back().back().clear();
+    }
+
+    for (const auto& runs: segments) {
+        const std::string* longest = &runs.front();
+        for (const auto& run: runs) {
+            if (run.size() > longest->size()) longest = &run;
+        }
+        if (!longest->empty()) fragments.push_back(*longest);
+    }
+}
+
+bool glob::Pattern::matches(std::string_view str) const {
+    if (str.size() < min_length || (!has_star && str.size() != min_length)) {
+        return false;
+    }
+
+    if (str.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    if (str.compare(str.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        return false;
+    }
+
+    // Find each fragment after the previous one, between prefix and suffix.
+    // glibc's memmem (and memchr, for one-byte needles) is vectorised.
+    const char* cursor = str.data() + prefix.size();
+    const char* end = str.data() + str.size() - suffix.size();
+    for (const auto& fragment: fragments) {
+        const void* found = memmem(cursor, end - cursor, fragment.data(), fragment.size());
+        if (!found) {
+            return false;
+        }
+        cursor = static_cast<const char*>(found) + fragment.size();
+    }
+
+    return literal_only || match(pattern, str);
+}
@@ -0,0 +1,46 @@
+#include <common/HashSlot.hpp>
+
+/**
+ * @file HashSlot.cpp
+ * @brief Implements CRC-16/XMODEM with a byte-at-a-time lookup table, and key hash slots.
+ */
+
+/// @brief The CCITT polynomial, in the non-reflected form XMODEM uses.
+static const uint16_t POLY = 0x1021;
+
+struct Crc16Table {
+    uint16_t table[256];
+
+    Crc16Table() {
+        for (uint16_t n = 0; n < 256; ++n) {
+            uint16_t crc = static_cast<uint16_t>(n << 8);
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ POLY) : static_cast<uint16_t>(crc << 1);
+            }
+            table[n] = crc;
+        }
+    }
+};
+
+static const Crc16Table crc_table;
+
+uint16_t crc16(const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint16_t crc = 0;
+    for (; len > 0; ++p, --len) {
+        crc = static_cast<uint16_t>((crc << 8) ^ crc_table.table[((crc >> 8) ^ *p) & 0xff]);
+    }
+    return crc;
+}
+
+size_t keyHashSlot(std::string_view key) {
+    // An empty tag ("{}") or an unclosed brace hashes the whole key.
+    const size_t open = key.find('{');
+    if (open != std::string_view::npos) {
+        const size_t close = key.find('}', open + 1);
+        if (close != std::string_view::npos && close != open + 1) {
+            key = key.substr(open + 1, close - open - 1);
+        }
+    }
+    return crc16(key.data(), key.size()) & (HASH_SLOTS - 1);
+}
@@ -0,0 +1,255 @@
+#include <common/Lzf.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+/**
+ * @file Lzf.cpp
+ * @brief Implements LZF compression and decompression.
+ * @details The hash table holds the last position seen with each 3-byte
+ * prefix. It is thread-local and is not cleared between calls, which would
+ * cost more than compressing a small string: each call stores its positions
+ * offset by a base above every position stored before, so entries left by
+ * earlier inputs are recognized and ignored, and the output only depends on
+ * the input.
+ */
+
+static const unsigned HASH_BITS = 14;
+static const size_t MAX_LITERAL = 32;
+static const size_t MAX_OFFSET = 1 << 13;
+static const size_t MAX_MATCH = 2 + 7 + 255;
+
+static std::atomic<uint64_t> compress_calls{0}, compressed_in{0}, compressed_out{0}, incompressible{0}, compress_ns{0};
+static std::atomic<uint64_t> decompress_calls{0}, decompressed_out{0}, decompress_ns{0};
+
+static uint64_t elapsedNs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+static inline uint32_t hashPrefix(const uint8_t* p) {
+    uint32_t v = (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2];
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static size_t compressBlock(const uint8_t* in, size_t len, uint8_t* out, size_t out_len) {
+    thread_local uint32_t table[1 << HASH_BITS] = {};
+    thread_local uint64_t next_base = 1;
+    if (len >= UINT32_MAX) return 0;
+
+    // Once the bases run out, start over from a clear table.
+    if (next_base + len >= UINT32_MAX) {
+        memset(table, 0, sizeof(table));
+        next_base = 1;
+    }
+    const uint64_t base = next_base;
+    next_base += len + 1;
+
+    const uint8_t* ip = in;
+    const uint8_t* const in_end = in + len;
+    uint8_t* op = out;
+    uint8_t* const out_end = out + out_len;
+
+    // `op` always points past the control byte reserved for the current
+    // literal run, which holds `lit` bytes so far.
+    if (out_len == 0) return 0;
+    size_t lit = 0;
+    ++op;
+
+    while (ip < in_end) {
+        if (ip + 2 < in_end) {
+            const size_t pos = static_cast<size_t>(ip - in);
+            uint32_t& slot = table[hashPrefix(ip)];
+            const uint64_t candidate = slot - base;   // Wraps around for an earlier input's entry.
+            slot = static_cast<uint32_t>(base + pos);
+
+            const uint8_t* ref = in + (candidate < pos ? candidate : 0);
+            if (candidate < pos && pos - candidate <= MAX_OFFSET && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2]) {
+                const size_t max_len = std::min<size_t>(in_end - ip, MAX_MATCH);
+                size_t match = 3;
+                while (match < max_len && ref[match] == ip[match]) ++match;
+
+                // Close the literal run, or give back its unused control byte.
+                if (lit) {
+                    op[-static_cast<ptrdiff_t>(lit) - 1] = static_cast<uint8_t>(lit - 1);
+                } else {
+                    --op;
+                }
+                if (out_end - op < 3) return 0;
+
+                const size_t off = pos - candidate - 1;
+                const size_t code = match - 2;
+                if (code < 7) {
+                    *op++ = static_cast<uint8_t>((code << 5) | (off >> 8));
+                } else {
+                    *op++ = static_cast<uint8_t>((7 << 5) | (off >> 8));
+                    *op++ = static_cast<uint8_t>(code - 7);
+                }
+                *op++ = static_cast<uint8_t>(off);
+
+                lit = 0;
+                ++op;
+                ip += match;
+
+                // Index the end of the match, where the next one most likely starts.
+                if (ip + 2 < in_end) {
+                    table[hashPrefix(ip - 1)] = static_cast<uint32_t>(base + (ip - 1 - in));
+                }
+                continue;
+            }
+        }
+
+        if (op >= out_end) return 0;
+        *op++ = *ip++;
+        if (++lit == MAX_LITERAL) {
+            op[-static_cast<ptrdiff_t>(lit) - 1] = static_cast<uint8_t>(lit - 1);
+            lit = 0;
+            ++op;
+        }
+    }
+
+    if (lit) {
+        op[-static_cast<ptrdiff_t>(lit) - 1] = static_cast<uint8_t>(lit - 1);
+    } else {
+        --op;
+    }
+    return static_cast<size_t>(op - out);
+}
+
+size_t lzf::compress(const uint8_t* in, size_t len, uint8_t* out, size_t out_len) {
+    const auto start = std::chrono::steady_clock::now();
+    size_t written = compressBlock(in, len, out, out_len);
+
+    compress_calls.fetch_add(1, std::memory_order_relaxed);
+    compressed_in.fetch_add(len, std::memory_order_relaxed);
+    // Input that doesn't compress is kept as is by the callers.
+    compressed_out.fetch_add(written ? written : len, std::memory_order_relaxed);
+    if (!written) {
+        incompressible.fetch_add(1, std::memory_order_relaxed);
+    }
+    compress_ns.fetch_add(elapsedNs(start), std::memory_order_relaxed);
+    return written;
+}
+
+static bool decompressBlock(const uint8_t* in, size_t len, uint8_t* out, size_t out_len) {
+    const uint8_t* ip = in;
+    const uint8_t* const in_end = in + len;
+    uint8_t* op = out;
+    uint8_t* const out_end = out + out_len;
+
+    while (ip < in_end) {
+        const size_t ctrl = *ip++;
+        if (ctrl < 32) {
+            const size_t run = ctrl + 1;
+            if (static_cast<size_t>(in_end - ip) < run || static_cast<size_t>(out_end - op) < run) return false;
+            memcpy(op, ip, run);
+            ip += run;
+            op += run;
+            continue;
+        }
+
+        size_t match = ctrl >> 5;
+        if (match == 7) {
+            if (ip >= in_end) return false;
+            match += *ip++;
+        }
+        match += 2;
+        if (ip >= in_end) return false;
+        const size_t back = (((ctrl & 0x1f) << 8) | *ip++) + 1;
+        if (static_cast<size_t>(op - out) < back || static_cast<size_t>(out_end - op) < match) return false;
+
+        const uint8_t* ref = op - back;
+        if (back >= match) {
+            memcpy(op, ref, match);
+            op += match;
+        } else {
+            // The copy overlaps its own output: a repeated pattern.
+            for (size_t i = 0; i < match; ++i) *op++ = *ref++;
+        }
+    }
+    return op == out_end;
+}
+
+bool lzf::decompress(const uint8_t* in, size_t len, uint8_t* out, size_t out_len) {
+    const auto start = std::chrono::steady_clock::now();
+    bool ok = decompressBlock(in, len, out, out_len);
+
+    decompress_calls.fetch_add(1, std::memory_order_relaxed);
+    if (ok) {
+        decompressed_out.fetch_add(out_len, std::memory_order_relaxed);
+    }
+    decompress_ns.fetch_add(elapsedNs(start), std::memory_order_relaxed);
+    return ok;
+}
+
+/**
+ * @brief Reads the varint that starts a blob.
+ * @return The number of bytes it takes, or 0 if it is malformed.
+ */
+static size_t readLength(std::string_view blob, uint64_t& value) {
+    value = 0;
+    for (size_t i = 0; i < blob.size() && i < 10; ++i) {
+        value |= static_cast<uint64_t>(blob[i] & 0x7f) << (7 * i);
+        if (!(blob[i] & 0x80)) return i + 1;
+    }
+    return 0;
+}
+
+bool lzf::compressString(std::string_view in, size_t max_size, std::string& blob) {
+    uint8_t header[10];
+    size_t header_len = 0;
+    for (uint64_t value = in.size(); ; value >>= 7) {
+        header[header_len++] = static_cast<uint8_t>(value & 0x7f) | (value >= 0x80 ? 0x80 : 0);
+        if (value < 0x80) break;
+    }
+    if (max_size <= header_len) {
+        return false;
+    }
+
+    blob.resize(max_size);
+    memcpy(blob.data(), header, header_len);
+    size_t written = compress(reinterpret_cast<const uint8_t*>(in.data()), in.size(),
+                              reinterpret_cast<uint8_t*>(blob.data()) + header_len, max_size - header_len);
+    if (written == 0) {
+        blob.clear();
+        return false;
+    }
+    blob.resize(header_len + written);
+    blob.shrink_to_fit();
+    return true;
+}
+
+bool lzf::decompressString(std::string_view blob, std::string& out) {
+    uint64_t size;
+    size_t header_len = readLength(blob, size);
+    // A back reference of 3 bytes expands to at most MAX_MATCH bytes.
+    if (header_len == 0 || size > (blob.size() - header_len) * MAX_MATCH) {
+        return false;
+    }
+
+    std::string result(size, '\0');
+    if (!decompress(reinterpret_cast<const uint8_t*>(blob.data()) + header_len, blob.size() - header_len,
+                    reinterpret_cast<uint8_t*>(result.data()), size)) {
+        return false;
+    }
+    out = std::move(result);
+    return true;
+}
+
+size_t lzf::decompressedSize(std::string_view blob) {
+    uint64_t size;
+    return readLength(blob, size) ? size : 0;
+}
+
+lzf::Stats lzf::stats() {
+    return {
+        compress_calls.load(std::memory_order_relaxed),
+        compressed_in.load(std::memory_order_relaxed),
+        compressed_out.load(std::memory_order_relaxed),
+        incompressible.load(std::memory_order_relaxed),
+        compress_ns.load(std::memory_order_relaxed),
+        decompress_calls.load(std::memory_order_relaxed),
+        decompressed_out.load(std::memory_order_relaxed),
+        decompress_ns.load(std::memory_order_relaxed),
+    };
+}
@@ -0,0 +1,29 @@
+#include <common/Memory.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+
+// Allocations may be released from background threads, hence the atomic.
+static std::atomic<size_t> used_bytes{0};
+
+size_t memory::usedMemory() {
+    return used_bytes.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size) {
+    void* ptr = malloc(size);
+    if (!ptr) throw std::bad_alloc();
+    used_bytes.fetch_add(malloc_usable_size(ptr), std::memory_order_relaxed);
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (!ptr) return;
+    used_bytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
@@ -64,7 +64,7 @@ AVLTree::Node* AVLTree::fixLeftImbalance(Node* node) {
 }
 
 AVLTree::Node* AVLTree::fixRightImbalance(Node* node) {
-    if (getHight(node->right->left) < getHight(node->right->right)) {
+    if (getHight(node->right->left) > getHight(node->right->right)) {
         node->right = rotateRight(node->right);
     }
 
@@ -75,23 +75,29 @@ AVLTree::Node* AVLTree::balance(Node* node) {
     int balance_factor = getHight(node->left) - getHight(node->right);
 
     if (balance_factor > 1) {
-        if (getHight(node->left->left) < getHight(node->left->right)) {
-            node->left = fixLeftImbalance(node->left);
-        }
-        return rotateRight(node);
+        return fixLeftImbalance(node);
     }
 
     if (balance_factor < -1) {
-        if (getHight(node->right->right) < getHight(node->right->left)) {
-            node->right = fixRightImbalance(node->right);
-        }
-        return rotateLeft(node);
+        return fixRightImbalance(node);
     }
     
     return node;
 }
 
-AVLTree::Node* AVLTree::removeNodeWithOneChild(Node* node) {
+void AVLTree::rebalanceUpwards(Node* node) {
+    while (node) {
+        updateNode(node);
+
+        Node* parent = node->parent;
+        Node** child_ptr = parent ? (parent->left == node ? &parent->left : &parent->right) : &root;
+        *child_ptr = balance(node);
+
+        node = parent;
+    }
+}
+
+void AVLTree::removeNodeWithOneChild(Node* node) {
     assert(!node->left || !node->right);
 
     Node* child = node->left ? node->left : node->right;
@@ -107,11 +113,25 @@ AVLTree::Node* AVLTree::removeNodeWithOneChild(Node* node) {
         } else {
             parent->right = child;
         }
-
-        return balance(parent);
     } else {
-        return balance(child);
+        root = child;
+    }
+
+    rebalanceUpwards(parent);
+}
+
+AVLTree::Node* AVLTree::buildRange(std::vector<std::unique_ptr<Node>>& nodes, size_t begin, size_t end, Node* parent) {
+    if (begin >= end) {
+        return nullptr;
     }
+
+    size_t mid = begin + (end - begin) / 2;
+    Node* node = nodes[mid].release();
+    node->parent = parent;
+    node->left = buildRange(nodes, begin, mid, node);
+    node->right = buildRange(nodes, mid + 1, end, node);
+    updateNode(node);
+    return node;
 }
 
 void AVLTree::deleteTree(Node* root) {
@@ -128,16 +148,39 @@ AVLTree::~AVLTree() {
     clear();
 }
 
+AVLTree::AVLTree(AVLTree&& other) noexcept: root(other.root), node_count(other.node_count), leftmost(other.leftmost), rightmost(other.rightmost) {
+    other.root = nullptr;
+    other.node_count = 0;
+    other.leftmost = other.rightmost = nullptr;
+}
+
+AVLTree& AVLTree::operator=(AVLTree&& other) noexcept {
+    if (this != &other) {
+        clear();
+        root = other.root;
+        node_count = other.node_count;
+        leftmost = other.leftmost;
+        rightmost = other.rightmost;
+        other.root = nullptr;
+        other.node_count = 0;
+        other.leftmost = other.rightmost = nullptr;
+    }
+    return *this;
+}
+
 std::unique_ptr<AVLTree::Node> AVLTree::detach(Node* node) {
+    if (node == leftmost) leftmost = successor(node);
+    if (node == rightmost) rightmost = predecessor(node);
+
     if(!node->left || !node->right) {
-        root = removeNodeWithOneChild(node);
+        removeNodeWithOneChild(node);
     } else {
         Node* successor = node->right;
         while (successor->left) {
             successor = successor->left;
         }
 
-        root = removeNodeWithOneChild(successor);
+        removeNodeWithOneChild(successor);
 
         std::swap(node->left, successor->left);
         std::swap(node->right, successor->right);
@@ -148,7 +191,7 @@ std::unique_ptr<AVLTree::Node> AVLTree::detach(Node* node) {
         if (successor->left) successor->left->parent = successor;
         if (successor->right) successor->right->parent = successor;
 
-        Node* parent = node->parent;
+        Node* parent = successor->parent;
         if (!parent) {
             root = successor;
         } else if (parent->left == node) {
@@ -156,24 +199,29 @@ std::unique_ptr<AVLTree::Node> AVLTree::detach(Node* node) {
         } else {
             parent->right = successor;
         }
-
-        node->left = node->right = node->parent = nullptr;
-        updateNode(node);
     }
+
+    node->left = node->right = node->parent = nullptr;
+    updateNode(node);
     --node_count;
     return std::unique_ptr<Node>(node);
 }
 
 void AVLTree::insert(std::unique_ptr<Node> new_node, const std::function<int(Node*, Node*)>& compare) {
     if (!root) {
-        root = new_node.release();
+        root = leftmost = rightmost = new_node.release();
         node_count = 1;
         return;
     }
 
+    // A node reached by only left (right) turns is the new minimum (maximum).
+    bool only_left = true, only_right = true;
+    Node* inserted = new_node.get();
+
     Node* current = root;
     while (true) {
         if (compare(new_node.get(), current) < 0) {
+            only_right = false;
             if (!current->left) {
                 current->left = new_node.release();
                 current->left->parent = current;
@@ -181,6 +229,7 @@ void AVLTree::insert(std::unique_ptr<Node> new_node, const std::function<int(Nod
             }
             current = current->left;
         } else {
+            only_left = false;
             if (!current->right) {
                 current->right = new_node.release();
                 current->right->parent = current;
@@ -190,23 +239,60 @@ void AVLTree::insert(std::unique_ptr<Node> new_node, const std::function<int(Nod
         }
     }
 
-    ++node_count;
+    if (only_left) leftmost = inserted;
+    if (only_right) rightmost = inserted;
 
-    Node* unbalanced = current;
-    while (unbalanced) {
-        updateNode(unbalanced);
-        int balance_factor = getHight(unbalanced->left) - getHight(unbalanced->right);
+    ++node_count;
+    rebalanceUpwards(current);
+}
 
-        Node* parent = unbalanced->parent;
-        Node** child_ptr = parent ? (parent->left == unbalanced ? &parent->left : &parent->right) : &root;
+AVLTree::Node* AVLTree::find(const std::function<int(Node*)>& compareWithKey) {
+    Node* current = root;
 
-        if (balance_factor > 1) {
-            *child_ptr = fixLeftImbalance(unbalanced);
-        } else if (balance_factor < -1) {
-            *child_ptr = fixRightImbalance(unbalanced);
+    while (current) {
+        int cmp = compareWithKey(current);
+        if (cmp == 0) {
+            return current;
+        } else if (cmp < 0) {
+            current = current->left;
+        } else {
+            current = current->right;
         }
-        unbalanced = parent;
     }
+
+    return nullptr;
+}
+
+void AVLTree::buildFromSorted(std::vector<std::unique_ptr<Node>> nodes) {
+    assert(!root);
+    node_count = nodes.size();
+    leftmost = nodes.empty() ? nullptr : nodes.front().get();
+    rightmost = nodes.empty() ? nullptr : nodes.back().get();
+    root = buildRange(nodes, 0, nodes.size(), nullptr);
+}
+
+std::vector<std::unique_ptr<AVLTree::Node>> AVLTree::releaseInOrder() {
+    std::vector<std::unique_ptr<Node>> nodes;
+    nodes.reserve(node_count);
+
+    Node* node = root;
+    while (node && node->left) node = node->left;
+
+    while (node) {
+        // Advance before unlinking: the successor walk needs this node's links.
+        Node* next = successor(node);
+        nodes.emplace_back(node);
+        node = next;
+    }
+
+    for (auto& released: nodes) {
+        released->left = released->right = released->parent = nullptr;
+        updateNode(released.get());
+    }
+
+    root = leftmost = rightmost = nullptr;
+    node_count = 0;
+    return nodes;
 }
 
 AVLTree::Node* AVLTree::findByRank(int32_t rank) {
@@ -244,8 +330,34 @@ AVLTree::Node* AVLTree::find(Node* key, const std::function<int(Node*, Node*)>&
     return nullptr;
 }
 
+AVLTree::Node* AVLTree::successor(Node* node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left) node = node->left;
+        return node;
+    }
+
+    while (node->parent && node->parent->right == node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+AVLTree::Node* AVLTree::predecessor(Node* node) {
+    if (node->left) {
+        node = node->left;
+        while (node->right) node = node->right;
+        return node;
+    }
+
+    while (node->parent && node->parent->left == node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
 void AVLTree::clear() {
     deleteTree(root);
-    root = nullptr;
+    root = leftmost = rightmost = nullptr;
     node_count = 0;
 }
\ No newline at end of file
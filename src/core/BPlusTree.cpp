@@ -0,0 +1,500 @@
+#include <core/BPlusTree.hpp>
+#include <cassert>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+/**
+ * @file BPlusTree.cpp
+ * @brief Implements the BPlusTree ordered index.
+ */
+
+/* ====== Private methods ====== */
+
+int BPlusTree::compare(double score_a, const std::string& member_a, double score_b, const std::string& member_b) {
+    if (score_a < score_b) return -1;
+    if (score_a > score_b) return  1;
+    return member_a.compare(member_b);
+}
+
+uint32_t BPlusTree::childIndex(const Inner* inner, double score, const std::string& member) {
+    // Children are few and their keys contiguous: a linear scan beats a binary
+    // search here, and member strings are only compared on equal scores.
+    uint32_t i = 0;
+    while (i + 1 < inner->count && compare(inner->keyScores[i], inner->keyMembers[i], score, member) <= 0) {
+        ++i;
+    }
+    return i;
+}
+
+uint32_t BPlusTree::lowerBound(const Leaf* leaf, double score, const std::string& member) {
+    uint32_t low = 0, high = leaf->count;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if (compare(leaf->scores[mid], leaf->members[mid], score, member) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+uint32_t BPlusTree::subtreeSize(const Node* node) {
+    if (node->leaf) {
+        return node->count;
+    }
+
+    const Inner* inner = static_cast<const Inner*>(node);
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < inner->count; ++i) {
+        total += inner->sizes[i];
+    }
+    return total;
+}
+
+BPlusTree::Split BPlusTree::splitLeaf(Leaf* leaf) {
+    Leaf* right = new Leaf();
+    uint32_t half = leaf->count / 2;
+
+    for (uint32_t i = half; i < leaf->count; ++i) {
+        right->scores[i - half] = leaf->scores[i];
+        right->members[i - half] = std::move(leaf->members[i]);
+    }
+    right->count = leaf->count - half;
+    leaf->count = half;
+
+    right->next = leaf->next;
+    right->prev = leaf;
+    if (leaf->next) leaf->next->prev = right;
+    leaf->next = right;
+
+    return {right, right->scores[0], right->members[0]};
+}
+
+BPlusTree::Split BPlusTree::splitInner(Inner* inner) {
+    Inner* right = new Inner();
+    uint32_t half = inner->count / 2;
+
+    for (uint32_t i = half; i < inner->count; ++i) {
+        right->children[i - half] = inner->children[i];
+        right->sizes[i - half] = inner->sizes[i];
+    }
+    for (uint32_t i = half; i + 1 < inner->count; ++i) {
+        right->keyScores[i - half] = inner->keyScores[i];
+        right->keyMembers[i - half] = std::move(inner->keyMembers[i]);
+    }
+    right->count = inner->count - half;
+    inner->count = half;
+
+    // The key between the two halves moves up to the parent.
+    return {right, inner->keyScores[half - 1], std::move(inner->keyMembers[half - 1])};
+}
+
+BPlusTree::Split BPlusTree::insertIntoLeaf(Leaf* leaf, const std::string& member, double score) {
+    uint32_t pos = lowerBound(leaf, score, member);
+
+    for (uint32_t i = leaf->count; i > pos; --i) {
+        leaf->scores[i] = leaf->scores[i - 1];
+        leaf->members[i] = std::move(leaf->members[i - 1]);
+    }
+    leaf->scores[pos] = score;
+    leaf->members[pos] = member;
+    ++leaf->count;
+
+    if (leaf->count > LEAF_CAPACITY) {
+        return splitLeaf(leaf);
+    }
+    return {};
+}
+
+BPlusTree::Split BPlusTree::insertInto(Node* node, const std::string& member, double score) {
+    if (node->leaf) {
+        return insertIntoLeaf(static_cast<Leaf*>(node), member, score);
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    uint32_t i = childIndex(inner, score, member);
+
+    Split split = insertInto(inner->children[i], member, score);
+    ++inner->sizes[i];
+
+    if (!split.right) {
+        return {};
+    }
+
+    for (uint32_t j = inner->count; j > i + 1; --j) {
+        inner->children[j] = inner->children[j - 1];
+        inner->sizes[j] = inner->sizes[j - 1];
+        inner->keyScores[j - 1] = inner->keyScores[j - 2];
+        inner->keyMembers[j - 1] = std::move(inner->keyMembers[j - 2]);
+    }
+
+    inner->children[i + 1] = split.right;
+    inner->sizes[i + 1] = subtreeSize(split.right);
+    inner->sizes[i] -= inner->sizes[i + 1];
+    inner->keyScores[i] = split.score;
+    inner->keyMembers[i] = std::move(split.member);
+    ++inner->count;
+
+    if (inner->count > INNER_CAPACITY) {
+        return splitInner(inner);
+    }
+    return {};
+}
+
+bool BPlusTree::tryMerge(Inner* inner, uint32_t i) {
+    Node* left = inner->children[i];
+    Node* right = inner->children[i + 1];
+
+    if (left->leaf) {
+        Leaf* left_leaf = static_cast<Leaf*>(left);
+        Leaf* right_leaf = static_cast<Leaf*>(right);
+        if (left_leaf->count + right_leaf->count > LEAF_CAPACITY) {
+            return false;
+        }
+
+        for (uint32_t j = 0; j < right_leaf->count; ++j) {
+            left_leaf->scores[left_leaf->count + j] = right_leaf->scores[j];
+            left_leaf->members[left_leaf->count + j] = std::move(right_leaf->members[j]);
+        }
+        left_leaf->count += right_leaf->count;
+
+        left_leaf->next = right_leaf->next;
+        if (right_leaf->next) right_leaf->next->prev = left_leaf;
+        delete right_leaf;
+    } else {
+        Inner* left_inner = static_cast<Inner*>(left);
+        Inner* right_inner = static_cast<Inner*>(right);
+        if (left_inner->count + right_inner->count > INNER_CAPACITY) {
+            return false;
+        }
+
+        // The parent's separator becomes the key between the two halves.
+        left_inner->keyScores[left_inner->count - 1] = inner->keyScores[i];
+        left_inner->keyMembers[left_inner->count - 1] = std::move(inner->keyMembers[i]);
+
+        for (uint32_t j = 0; j < right_inner->count; ++j) {
+            left_inner->children[left_inner->count + j] = right_inner->children[j];
+            left_inner->sizes[left_inner->count + j] = right_inner->sizes[j];
+        }
+        for (uint32_t j = 0; j + 1 < right_inner->count; ++j) {
+            left_inner->keyScores[left_inner->count + j] = right_inner->keyScores[j];
+            left_inner->keyMembers[left_inner->count + j] = std::move(right_inner->keyMembers[j]);
+        }
+        left_inner->count += right_inner->count;
+        delete right_inner;
+    }
+
+    inner->sizes[i] += inner->sizes[i + 1];
+    for (uint32_t j = i + 1; j + 1 < inner->count; ++j) {
+        inner->children[j] = inner->children[j + 1];
+        inner->sizes[j] = inner->sizes[j + 1];
+        inner->keyScores[j - 1] = inner->keyScores[j];
+        inner->keyMembers[j - 1] = std::move(inner->keyMembers[j]);
+    }
+    --inner->count;
+    return true;
+}
+
+bool BPlusTree::removeFrom(Node* node, const std::string& member, double score) {
+    if (node->leaf) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        uint32_t pos = lowerBound(leaf, score, member);
+        if (pos >= leaf->count || leaf->scores[pos] != score || leaf->members[pos] != member) {
+            return false;
+        }
+
+        for (uint32_t i = pos; i + 1 < leaf->count; ++i) {
+            leaf->scores[i] = leaf->scores[i + 1];
+            leaf->members[i] = std::move(leaf->members[i + 1]);
+        }
+        --leaf->count;
+        leaf->members[leaf->count].clear();
+        return true;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    uint32_t i = childIndex(inner, score, member);
+
+    if (!removeFrom(inner->children[i], member, score)) {
+        return false;
+    }
+    --inner->sizes[i];
+
+    // Only merge nodes that have become sparse, so that alternating inserts
+    // and removals around a split point don't keep splitting and merging.
+    Node* child = inner->children[i];
+    uint32_t min_fill = child->leaf ? LEAF_CAPACITY / 4 : INNER_CAPACITY / 4;
+    if (child->count >= min_fill) {
+        return true;
+    }
+
+    if (i > 0 && tryMerge(inner, i - 1)) {
+        return true;
+    }
+    if (i + 1 < inner->count) {
+        tryMerge(inner, i);
+    }
+    return true;
+}
+
+BPlusTree::Leaf* BPlusTree::findLeaf(double score, const std::string& member) const {
+    Node* node = root;
+    while (!node->leaf) {
+        Inner* inner = static_cast<Inner*>(node);
+        node = inner->children[childIndex(inner, score, member)];
+    }
+    return static_cast<Leaf*>(node);
+}
+
+BPlusTree::Leaf* BPlusTree::findLeafByRank(size_t& rank) const {
+    Node* node = root;
+    while (!node->leaf) {
+        Inner* inner = static_cast<Inner*>(node);
+        uint32_t i = 0;
+        while (i + 1 < inner->count && rank >= inner->sizes[i]) {
+            rank -= inner->sizes[i];
+            ++i;
+        }
+        node = inner->children[i];
+    }
+    return static_cast<Leaf*>(node);
+}
+
+std::vector<ZSetEntry> BPlusTree::drain() {
+    std::vector<ZSetEntry> entries;
+    entries.reserve(element_count);
+
+    Node* node = root;
+    while (!node->leaf) {
+        node = static_cast<Inner*>(node)->children[0];
+    }
+
+    for (Leaf* leaf = static_cast<Leaf*>(node); leaf; leaf = leaf->next) {
+        for (uint32_t i = 0; i < leaf->count; ++i) {
+            entries.push_back({std::move(leaf->members[i]), leaf->scores[i]});
+        }
+    }
+
+    destroy(root);
+    root = new Leaf();
+    element_count = 0;
+    return entries;
+}
+
+void BPlusTree::build(std::vector<ZSetEntry> entries) {
+    assert(element_count == 0);
+    if (entries.empty()) {
+        return;
+    }
+
+    // A built node along with its size and smallest key, which becomes the
+    // separator in front of it at the next level up.
+    struct Built {
+        Node* node;
+        uint32_t size;
+        double score;
+        std::string member;
+    };
+
+    std::vector<Built> level;
+    size_t leaf_count = (entries.size() + LEAF_CAPACITY - 1) / LEAF_CAPACITY;
+    size_t next = 0;
+    Leaf* prev = nullptr;
+
+    for (size_t l = 0; l < leaf_count; ++l) {
+        // Spread entries evenly so that no leaf is left nearly empty.
+        size_t take = entries.size() / leaf_count + (l < entries.size() % leaf_count ? 1 : 0);
+        Leaf* leaf = new Leaf();
+        for (size_t i = 0; i < take; ++i, ++next) {
+            leaf->scores[i] = entries[next].score;
+            leaf->members[i] = std::move(entries[next].member);
+        }
+        leaf->count = take;
+
+        leaf->prev = prev;
+        if (prev) prev->next = leaf;
+        prev = leaf;
+
+        level.push_back({leaf, leaf->count, leaf->scores[0], leaf->members[0]});
+    }
+
+    while (level.size() > 1) {
+        std::vector<Built> parents;
+        size_t inner_count = (level.size() + INNER_CAPACITY - 1) / INNER_CAPACITY;
+        next = 0;
+
+        for (size_t p = 0; p < inner_count; ++p) {
+            size_t take = level.size() / inner_count + (p < level.size() % inner_count ? 1 : 0);
+            Inner* inner = new Inner();
+            uint32_t total = 0;
+
+            for (size_t i = 0; i < take; ++i, ++next) {
+                inner->children[i] = level[next].node;
+                inner->sizes[i] = level[next].size;
+                total += level[next].size;
+                if (i > 0) {
+                    inner->keyScores[i - 1] = level[next].score;
+                    inner->keyMembers[i - 1] = level[next].member;
+                }
+            }
+            inner->count = take;
+
+            Built& first = level[next - take];
+            parents.push_back({inner, total, first.score, std::move(first.member)});
+        }
+        level = std::move(parents);
+    }
+
+    delete static_cast<Leaf*>(root);
+    root = level[0].node;
+    element_count = entries.size();
+}
+
+void BPlusTree::destroy(Node* node) {
+    if (node->leaf) {
+        delete static_cast<Leaf*>(node);
+        return;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    for (uint32_t i = 0; i < inner->count; ++i) {
+        destroy(inner->children[i]);
+    }
+    delete inner;
+}
+
+/* ====== Public methods ====== */
+
+BPlusTree::BPlusTree(): root(new Leaf()) {}
+
+BPlusTree::~BPlusTree() {
+    destroy(root);
+}
+
+void BPlusTree::insert(const std::string& member, double score) {
+    Split split = insertInto(root, member, score);
+    ++element_count;
+
+    if (split.right) {
+        Inner* new_root = new Inner();
+        new_root->children[0] = root;
+        new_root->children[1] = split.right;
+        new_root->sizes[0] = subtreeSize(root);
+        new_root->sizes[1] = subtreeSize(split.right);
+        new_root->keyScores[0] = split.score;
+        new_root->keyMembers[0] = std::move(split.member);
+        new_root->count = 2;
+        root = new_root;
+    }
+}
+
+bool BPlusTree::remove(const std::string& member, double score) {
+    if (!removeFrom(root, member, score)) {
+        return false;
+    }
+    --element_count;
+
+    // Collapse roots left with a single child after merges.
+    while (!root->leaf && root->count == 1) {
+        Inner* old_root = static_cast<Inner*>(root);
+        root = old_root->children[0];
+        delete old_root;
+    }
+    return true;
+}
+
+void BPlusTree::updateScore(const std::string& member, double old_score, double new_score) {
+    Leaf* leaf = findLeaf(old_score, member);
+    uint32_t pos = lowerBound(leaf, old_score, member);
+    assert(pos < leaf->count && leaf->members[pos] == member);
+
+    // Rewriting in place must keep the pair ordered against its neighbours in
+    // the leaf, and inside the separators around the leaf: at either end of
+    // the leaf the score may only move inwards.
+    bool after_prev = pos > 0 ? compare(leaf->scores[pos - 1], leaf->members[pos - 1], new_score, member) < 0
+                              : new_score >= old_score;
+    bool before_next = pos + 1 < leaf->count ? compare(new_score, member, leaf->scores[pos + 1], leaf->members[pos + 1]) < 0
+                                             : new_score <= old_score;
+
+    if (after_prev && before_next) {
+        leaf->scores[pos] = new_score;
+        return;
+    }
+
+    remove(member, old_score);
+    insert(member, new_score);
+}
+
+void BPlusTree::insertSorted(std::vector<ZSetEntry> entries) {
+    if (!shouldRebuild(element_count, entries.size())) {
+        for (auto& entry: entries) {
+            insert(entry.member, entry.score);
+        }
+        return;
+    }
+
+    if (element_count == 0) {
+        build(std::move(entries));
+        return;
+    }
+
+    std::vector<ZSetEntry> existing = drain();
+    std::vector<ZSetEntry> merged;
+    merged.reserve(existing.size() + entries.size());
+    std::merge(std::make_move_iterator(existing.begin()), std::make_move_iterator(existing.end()),
+               std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.end()),
+               std::back_inserter(merged));
+    build(std::move(merged));
+}
+
+void BPlusTree::range(size_t start, size_t count, bool reverse, const Visitor& visitor) {
+    if (start >= element_count) {
+        return;
+    }
+
+    size_t pos = reverse ? element_count - 1 - start : start;
+    Leaf* leaf = findLeafByRank(pos);
+
+    while (count > 0 && leaf) {
+        visitor(leaf->members[pos], leaf->scores[pos]);
+        --count;
+
+        if (reverse) {
+            if (pos == 0) {
+                // Leaves can only be empty when a lone child of its parent
+                // was emptied, so skip over any on the way.
+                do leaf = leaf->prev; while (leaf && leaf->count == 0);
+                if (leaf) pos = leaf->count - 1;
+            } else {
+                --pos;
+            }
+        } else {
+            if (++pos == leaf->count) {
+                do leaf = leaf->next; while (leaf && leaf->count == 0);
+                pos = 0;
+            }
+        }
+    }
+}
+
+void BPlusTree::pop(size_t count, bool reverse, const Visitor& visitor) {
+    // Copy the pairs out first: removals may merge the leaves being walked.
+    std::vector<ZSetEntry> popped;
+    popped.reserve(std::min(count, element_count));
+    range(0, count, reverse, [&popped](const std::string& member, double score) {
+        popped.push_back({member, score});
+    });
+
+    for (const auto& entry: popped) {
+        remove(entry.member, entry.score);
+        visitor(entry.member, entry.score);
+    }
+}
+
+void BPlusTree::clear() {
+    destroy(root);
+    root = new Leaf();
+    element_count = 0;
+}
@@ -0,0 +1,150 @@
+#include <core/Hash.hpp>
+
+/**
+ * @file Hash.cpp
+ * @brief Implements the Hash class and its two encodings.
+ */
+
+size_t Hash::maxListpackEntries = 128;
+size_t Hash::maxListpackValue = 64;
+
+/* ====== Private methods ====== */
+
+bool Hash::fieldEquals(HashTable::Node* node, HashTable::Node* key) {
+    return static_cast<HashFieldNode*>(node)->field == static_cast<HashFieldNode*>(key)->field;
+}
+
+size_t Hash::listpackFind(std::string_view field) const {
+    // Entries alternate field, value: step over two entries at a time.
+    for (size_t pos = listpack.begin(); pos != listpack.end(); pos = listpack.next(listpack.next(pos))) {
+        if (listpack.get(pos) == field) {
+            return pos;
+        }
+    }
+    return listpack.end();
+}
+
+HashFieldNode* Hash::tableLookup(std::string_view field) {
+    HashFieldNode field_key;
+    field_key.field = field;
+    field_key.hashCode = HashTable::hashString(field);
+    return static_cast<HashFieldNode*>(table->lookup(&field_key, fieldEquals));
+}
+
+void Hash::tableInsert(std::string_view field, std::string_view value) {
+    auto new_field_node = std::make_unique<HashFieldNode>();
+    new_field_node->field = field;
+    new_field_node->value = value;
+    new_field_node->hashCode = HashTable::hashString(field);
+    table->insert(std::move(new_field_node));
+}
+
+void Hash::convertToTable() {
+    assert(encoding == Encoding::LISTPACK);
+    table = std::make_unique<HashTable>();
+
+    for (size_t pos = listpack.begin(); pos != listpack.end();) {
+        size_t value_pos = listpack.next(pos);
+        tableInsert(listpack.get(pos), listpack.get(value_pos));
+        pos = listpack.next(value_pos);
+    }
+
+    listpack.clear();
+    encoding = Encoding::HASHTABLE;
+}
+
+/* ====== Public methods ====== */
+
+Hash::Hash() = default;
+Hash::~Hash() = default;
+
+Hash::Hash(Hash&&) noexcept = default;
+Hash& Hash::operator=(Hash&&) noexcept = default;
+
+size_t Hash::size() const {
+    if (encoding == Encoding::LISTPACK) {
+        return listpack.size() / 2;
+    }
+    return table->size();
+}
+
+const char* Hash::encodingName() const {
+    return encoding == Encoding::LISTPACK ? "listpack" : "hashtable";
+}
+
+bool Hash::set(std::string_view field, std::string_view value) {
+    if (encoding == Encoding::LISTPACK) {
+        bool fits = field.size() <= maxListpackValue && value.size() <= maxListpackValue;
+        size_t pos = listpackFind(field);
+
+        if (pos != listpack.end()) {
+            if (fits) {
+                listpack.replace(listpack.next(pos), value);
+                return false;
+            }
+        } else if (fits && size() < maxListpackEntries) {
+            listpack.pushBack(field);
+            listpack.pushBack(value);
+            return true;
+        }
+
+        convertToTable();
+    }
+
+    if (HashFieldNode* field_node = tableLookup(field)) {
+        field_node->value = value;
+        return false;
+    }
+
+    tableInsert(field, value);
+    return true;
+}
+
+bool Hash::get(std::string_view field, std::string& value) {
+    if (encoding == Encoding::LISTPACK) {
+        size_t pos = listpackFind(field);
+        if (pos == listpack.end()) {
+            return false;
+        }
+        value = listpack.get(listpack.next(pos));
+        return true;
+    }
+
+    if (HashFieldNode* field_node = tableLookup(field)) {
+        value = field_node->value;
+        return true;
+    }
+    return false;
+}
+
+bool Hash::remove(std::string_view field) {
+    if (encoding == Encoding::LISTPACK) {
+        size_t pos = listpackFind(field);
+        if (pos == listpack.end()) {
+            return false;
+        }
+        listpack.erase(listpack.erase(pos));
+        return true;
+    }
+
+    HashFieldNode field_key;
+    field_key.field = field;
+    field_key.hashCode = HashTable::hashString(field);
+    return table->remove(&field_key, fieldEquals) != nullptr;
+}
+
+void Hash::forEach(const FieldCallback& callback) {
+    if (encoding == Encoding::LISTPACK) {
+        for (size_t pos = listpack.begin(); pos != listpack.end();) {
+            size_t value_pos = listpack.next(pos);
+            callback(listpack.get(pos), listpack.get(value_pos));
+            pos = listpack.next(value_pos);
+        }
+        return;
+    }
+
+    table->forEach([&callback](HashTable::Node* node) {
+        HashFieldNode* field_node = static_cast<HashFieldNode*>(node);
+        callback(field_node->field, field_node->value);
+    });
+}
@@ -1,4 +1,7 @@
 #include <core/HashTable.hpp>
+#include <algorithm>
+#include <chrono>
+#include <random>
 
 /**
  * @file HashTable.cpp
@@ -8,8 +11,13 @@
 
 /// @brief Defines the maximum number of nodes to migrate in a single `helpRehashing` call.
 const size_t REHASHING_WORK_LIMIT = 128;
-/// @brief The load factor threshold that triggers a new rehashing cycle.
-const size_t MAX_LOAD_FACTOR = 8;
+/// @brief The number of empty slots a `helpRehashing` call may skip per node it could migrate.
+const size_t REHASHING_EMPTY_VISITS = 10;
+/// @brief The smallest table size; tables never shrink below it.
+const size_t MIN_TABLE_SIZE = 4;
+
+size_t HashTable::maxLoadFactor = 8;
+size_t HashTable::minFillPercent = 10;
 
 /* ====== Private methods ====== */
 
@@ -58,23 +66,49 @@ std::unique_ptr<HashTable::Node> HashTable::detachNode(Table& table, std::unique
 }
 
 
-void HashTable::startRehashing() {
+void HashTable::startRehashing(size_t size) {
     assert(olderTable.slots.empty());
     olderTable = std::move(newerTable);
-    initializeTable(newerTable, (olderTable.mask + 1) * 2);
+    initializeTable(newerTable, size);
     migrateIndex = 0;
 }
 
+void HashTable::shrinkIfSparse() {
+    size_t slotCount = newerTable.mask + 1;
+    if (!olderTable.slots.empty() || rehashPauses > 0 || slotCount <= MIN_TABLE_SIZE) {
+        return;
+    }
+    if (newerTable.elementCount * 100 >= slotCount * minFillPercent) {
+        return;
+    }
+
+    // Shrink to the smallest power of two holding every element in its own slot.
+    size_t size = MIN_TABLE_SIZE;
+    while (size < newerTable.elementCount) {
+        size *= 2;
+    }
+    if (size < slotCount) {
+        startRehashing(size);
+    }
+}
+
 void HashTable::helpRehashing() {
-    if (olderTable.slots.empty()) {
+    // Moving nodes (or freeing the older table) would pull them from under a `forEach`.
+    if (olderTable.slots.empty() || rehashPauses > 0) {
         return;
     }
 
     size_t workDone = 0;
+    // A table that shrinks after mass deletions is mostly empty slots: bound
+    // how many of them a single call may skip.
+    size_t emptyVisits = REHASHING_WORK_LIMIT * REHASHING_EMPTY_VISITS;
     while (workDone < REHASHING_WORK_LIMIT && olderTable.elementCount > 0) {
         // Find a non-empty slot to migrate from
         while (migrateIndex < olderTable.slots.size() && !olderTable.slots[migrateIndex]) {
             migrateIndex++;
+            if (--emptyVisits == 0) {
+                return;
+            }
         }
 
         if (migrateIndex >= olderTable.slots.size()) {
@@ -90,10 +124,9 @@ void HashTable::helpRehashing() {
         workDone++;
     }
 
-    // If migration is complete, clear the old table.
+    // If migration is complete, release the old table.
     if (olderTable.elementCount == 0) {
-        olderTable.slots.clear();
-        olderTable.mask = 0;
+        olderTable = Table{};
     }
 }
 
@@ -105,6 +138,30 @@ void HashTable::forEachInTable(Table& table, const std::function<void(Node*)>& c
     }
 }
 
+void HashTable::visitSlot(Table& table, size_t pos, const std::function<void(Node*)>& callback) {
+    for (Node* current = table.slots[pos & table.mask].get(); current; current = current->next.get()) {
+        callback(current);
+    }
+}
+
+static size_t reverseBits(size_t value) {
+    size_t reversed = 0;
+    for (size_t bit = 0; bit < sizeof(size_t) * 8; ++bit) {
+        reversed = (reversed << 1) | (value & 1);
+        value >>= 1;
+    }
+    return reversed;
+}
+
+size_t HashTable::nextCursor(size_t cursor, size_t mask) {
+    // Set the bits above the mask so the increment carries straight into the
+    // (reversed) low bits, then increment the reversed cursor.
+    cursor |= ~mask;
+    cursor = reverseBits(cursor);
+    ++cursor;
+    return reverseBits(cursor);
+}
+
 /* ====== Public methods ====== */
 
 HashTable::HashTable() = default;
@@ -126,15 +183,15 @@ HashTable::Node* HashTable::lookup(Node* key, const std::function<bool(Node*, No
 
 void HashTable::insert(std::unique_ptr<Node> node) {
     if (newerTable.slots.empty()) {
-        initializeTable(newerTable, 4);
+        initializeTable(newerTable, MIN_TABLE_SIZE);
     }
     insertIntoTable(newerTable, std::move(node));
 
     // Trigger rehashing if the load factor is exceeded and we are not already rehashing.
-    if (olderTable.slots.empty()) {
-        size_t threshold = (newerTable.mask + 1) * MAX_LOAD_FACTOR;
+    if (olderTable.slots.empty() && rehashPauses == 0) {
+        size_t threshold = (newerTable.mask + 1) * std::max<size_t>(maxLoadFactor, 1);
         if (newerTable.elementCount >= threshold) {
-            startRehashing();
+            startRehashing((newerTable.mask + 1) * 2);
         }
     }
     
@@ -145,26 +202,142 @@ void HashTable::insert(std::unique_ptr<Node> node) {
 std::unique_ptr<HashTable::Node> HashTable::remove(Node* key, const std::function<bool(Node*, Node*)>& equals) {
     helpRehashing();
 
+    std::unique_ptr<Node> removed;
     if (auto* nodeOwnerPtr = findNodePtr(newerTable, key, equals)) {
-        return detachNode(newerTable, nodeOwnerPtr);
+        removed = detachNode(newerTable, nodeOwnerPtr);
+    } else if (auto* nodeOwnerPtr = findNodePtr(olderTable, key, equals)) {
+        removed = detachNode(olderTable, nodeOwnerPtr);
     }
-    
-    if (auto* nodeOwnerPtr = findNodePtr(olderTable, key, equals)) {
-        return detachNode(olderTable, nodeOwnerPtr);
+
+    if (removed) {
+        shrinkIfSparse();
     }
+    return removed;
+}
 
-    return nullptr;
+void HashTable::reserve(size_t count) {
+    if (size() != 0 || isRehashing()) {
+        return;
+    }
+
+    // `insert` doubles the table once it holds `maxLoadFactor` elements per slot.
+    const size_t load_factor = std::max<size_t>(maxLoadFactor, 1);
+    size_t slots = MIN_TABLE_SIZE;
+    while (slots * load_factor <= count) {
+        slots *= 2;
+    }
+    if (slots > newerTable.slots.size()) {
+        initializeTable(newerTable, slots);
+    }
+}
+
+bool HashTable::rehashStep(int64_t budget_us) {
+    using namespace std::chrono;
+    const auto deadline = steady_clock::now() + microseconds(budget_us);
+
+    while (!olderTable.slots.empty() && rehashPauses == 0) {
+        helpRehashing();
+        if (steady_clock::now() >= deadline) {
+            break;
+        }
+    }
+    return isRehashing();
 }
 
 size_t HashTable::size() const {
     return newerTable.elementCount + olderTable.elementCount;
 }
 
+/**
+ * @brief Holds a table's rehashing paused for its lifetime, even if a callback throws.
+ */
+struct RehashPause {
+    size_t& pauses;
+    explicit RehashPause(size_t& count) : pauses(count) { ++pauses; }
+    ~RehashPause() { --pauses; }
+};
+
 void HashTable::forEach(const std::function<void(Node*)>& callback) {
+    RehashPause pause(rehashPauses);
     forEachInTable(newerTable, callback);
     forEachInTable(olderTable, callback);
 }
 
+size_t HashTable::scan(size_t cursor, const std::function<void(Node*)>& callback) {
+    if (size() == 0) {
+        return 0;
+    }
+    RehashPause pause(rehashPauses);
+
+    if (olderTable.slots.empty()) {
+        visitSlot(newerTable, cursor, callback);
+        return nextCursor(cursor, newerTable.mask);
+    }
+
+    Table* small = &olderTable;
+    Table* large = &newerTable;
+    if (small->mask > large->mask) {
+        std::swap(small, large);
+    }
+
+    visitSlot(*small, cursor, callback);
+
+    // Visit every slot of the larger table that the small slot expands to:
+    // they share the cursor's low bits and differ in the extra mask bits.
+    do {
+        visitSlot(*large, cursor, callback);
+        cursor = nextCursor(cursor, large->mask);
+    } while (cursor & (small->mask ^ large->mask));
+
+    return cursor;
+}
+
+std::vector<HashTable::Node*> HashTable::sample(size_t count) {
+    // One generator per thread: tables of different shards are sampled concurrently.
+    thread_local std::minstd_rand rng(std::random_device{}());
+
+    std::vector<Node*> sampled;
+    count = std::min(count, size());
+    if (count == 0) {
+        return sampled;
+    }
+    sampled.reserve(count);
+
+    // Choose the table to start in proportionally to its share of elements.
+    Table* table = &newerTable;
+    if (olderTable.elementCount > 0 && rng() % size() < olderTable.elementCount) {
+        table = &olderTable;
+    }
+
+    // Walk consecutive slots from a random one, wrapping into the other table
+    // so that a table emptied by rehashing can't stall the walk.
+    size_t pos = rng() & table->mask;
+    while (sampled.size() < count) {
+        if (pos >= table->slots.size()) {
+            Table* other = table == &newerTable ? &olderTable : &newerTable;
+            if (!other->slots.empty()) table = other;
+            pos = 0;
+        }
+
+        for (Node* current = table->slots[pos].get(); current && sampled.size() < count; current = current->next.get()) {
+            sampled.push_back(current);
+        }
+        ++pos;
+    }
+
+    return sampled;
+}
+
+// FNV-1a hash function for strings
+uint64_t HashTable::hashString(std::string_view str) {
+    uint64_t hash = 0xcdf29ce484222325;
+    for(char c: str) {
+        hash ^= static_cast<uint64_t>(c);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
 void HashTable::clear() {
     newerTable = {};
     olderTable = {};
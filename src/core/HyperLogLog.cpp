@@ -0,0 +1,534 @@
+#include <core/HyperLogLog.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/**
+ * @file HyperLogLog.cpp
+ * @brief Implements the HyperLogLog sketch encodings, merging and estimation.
+ */
+
+namespace hll {
+
+size_t sparseMaxBytes = 3000;
+
+enum Encoding : uint8_t {
+    DENSE = 0,
+    SPARSE = 1,
+};
+
+static const char MAGIC[4] = {'H', 'Y', 'L', 'L'};
+static const size_t ENCODING_OFFSET = 4;
+static const size_t CACHE_OFFSET = 8;
+/// @brief Set in the cached cardinality when it no longer matches the registers.
+static const uint64_t CACHE_STALE = uint64_t(1) << 63;
+
+static const size_t SPARSE_VAL_MAX_VALUE = 32;
+static const size_t SPARSE_VAL_MAX_LEN = 4;
+static const size_t SPARSE_ZERO_MAX_LEN = 64;
+static const size_t SPARSE_XZERO_MAX_LEN = 16384;
+
+/// @brief How many registers hold each value, the input of the estimator.
+using Histogram = std::array<uint32_t, Q + 2>;
+
+/* ====== Hashing ====== */
+
+/**
+ * @brief MurmurHash64A, a fast 64-bit hash with good avalanche on every bit.
+ */
+static uint64_t murmurHash64A(std::string_view key, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(key.data());
+    const size_t blocks = key.size() / 8;
+
+    uint64_t h = seed ^ (key.size() * m);
+    for (size_t i = 0; i < blocks; ++i) {
+        uint64_t k;
+        std::memcpy(&k, data + i * 8, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const uint8_t* tail = data + blocks * 8;
+    switch (key.size() & 7) {
+        case 7: h ^= uint64_t(tail[6]) << 48; [[fallthrough]];
+        case 6: h ^= uint64_t(tail[5]) << 40; [[fallthrough]];
+        case 5: h ^= uint64_t(tail[4]) << 32; [[fallthrough]];
+        case 4: h ^= uint64_t(tail[3]) << 24; [[fallthrough]];
+        case 3: h ^= uint64_t(tail[2]) << 16; [[fallthrough]];
+        case 2: h ^= uint64_t(tail[1]) << 8; [[fallthrough]];
+        case 1: h ^= uint64_t(tail[0]);
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+/**
+ * @brief Hashes an element to its register index and the value it offers that register.
+ */
+static uint8_t hashElement(std::string_view element, size_t& index) {
+    uint64_t hash = murmurHash64A(element, 0xadc83b19ULL);
+    index = hash & (REGISTERS - 1);
+    hash >>= P;
+    // Bound the run of zeros, so the value never exceeds Q + 1.
+    hash |= uint64_t(1) << Q;
+    return static_cast<uint8_t>(__builtin_ctzll(hash) + 1);
+}
+
+/* ====== Header ====== */
+
+static std::string header(Encoding encoding, uint64_t cache) {
+    std::string sketch(HEADER_SIZE, '\0');
+    std::memcpy(&sketch[0], MAGIC, sizeof(MAGIC));
+    sketch[ENCODING_OFFSET] = static_cast<char>(encoding);
+    for (size_t i = 0; i < 8; ++i) {
+        sketch[CACHE_OFFSET + i] = static_cast<char>(cache >> (i * 8));
+    }
+    return sketch;
+}
+
+static uint64_t readCache(std::string_view sketch) {
+    uint64_t cache = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        cache |= uint64_t(static_cast<uint8_t>(sketch[CACHE_OFFSET + i])) << (i * 8);
+    }
+    return cache;
+}
+
+static void writeCache(std::string& sketch, uint64_t cache) {
+    for (size_t i = 0; i < 8; ++i) {
+        sketch[CACHE_OFFSET + i] = static_cast<char>(cache >> (i * 8));
+    }
+}
+
+static void invalidateCache(std::string& sketch) {
+    sketch[CACHE_OFFSET + 7] = static_cast<char>(sketch[CACHE_OFFSET + 7] | 0x80);
+}
+
+/* ====== Dense encoding ====== */
+
+// Four 6-bit registers fill three bytes exactly: register `i` lives in the
+// little-endian 24-bit word of group `i / 4`, at bit `6 * (i % 4)`.
+
+static uint8_t denseGet(const uint8_t* registers, size_t index) {
+    const uint8_t* group = registers + index / 4 * 3;
+    uint32_t word = group[0] | (group[1] << 8) | (group[2] << 16);
+    return (word >> (index % 4 * 6)) & 63;
+}
+
+static void denseSet(uint8_t* registers, size_t index, uint8_t value) {
+    uint8_t* group = registers + index / 4 * 3;
+    const unsigned shift = index % 4 * 6;
+    uint32_t word = group[0] | (group[1] << 8) | (group[2] << 16);
+    word = (word & ~(63u << shift)) | (uint32_t(value) << shift);
+    group[0] = word & 0xFF;
+    group[1] = (word >> 8) & 0xFF;
+    group[2] = (word >> 16) & 0xFF;
+}
+
+static uint8_t* denseRegisters(std::string& sketch) {
+    return reinterpret_cast<uint8_t*>(&sketch[HEADER_SIZE]);
+}
+
+static const uint8_t* denseRegisters(std::string_view sketch) {
+    return reinterpret_cast<const uint8_t*>(sketch.data() + HEADER_SIZE);
+}
+
+/**
+ * @brief Returns, for 8 bytes at once, the larger of each pair of bytes of `a` and `b`.
+ * @details Every byte is below 0x80, so subtracting a byte of `b` from the
+ * same byte of `a` with its top bit set never borrows from the next byte,
+ * and that top bit survives exactly where `a >= b`.
+ */
+static uint64_t maxBytes(uint64_t a, uint64_t b) {
+    const uint64_t HIGH_BITS = 0x8080808080808080ULL;
+    uint64_t a_ge_b = (((a | HIGH_BITS) - b) & HIGH_BITS) >> 7;
+    uint64_t mask = a_ge_b * 0xFF;
+    return (a & mask) | (b & ~mask);
+}
+
+static void denseMerge(Registers& registers, const uint8_t* dense) {
+    // Six packed bytes unpack to eight registers, merged as one 64-bit word.
+    for (size_t i = 0; i < REGISTERS; i += 8, dense += 6) {
+        uint64_t packed = 0;
+        std::memcpy(&packed, dense, 6);
+
+        uint64_t unpacked = 0;
+        for (unsigned k = 0; k < 8; ++k) {
+            unpacked |= ((packed >> (k * 6)) & 63) << (k * 8);
+        }
+
+        uint64_t current;
+        std::memcpy(&current, &registers[i], sizeof(current));
+        current = maxBytes(current, unpacked);
+        std::memcpy(&registers[i], &current, sizeof(current));
+    }
+}
+
+static void denseHistogram(const uint8_t* dense, Histogram& histogram) {
+    for (size_t i = 0; i < REGISTERS; i += 4, dense += 3) {
+        uint32_t word = dense[0] | (dense[1] << 8) | (dense[2] << 16);
+        ++histogram[word & 63];
+        ++histogram[(word >> 6) & 63];
+        ++histogram[(word >> 12) & 63];
+        ++histogram[(word >> 18) & 63];
+    }
+}
+
+/* ====== Sparse encoding ====== */
+
+static bool isValOpcode(uint8_t op) { return op & 0x80; }
+static bool isXZeroOpcode(uint8_t op) { return (op & 0xC0) == 0x40; }
+static uint8_t valOpcode(size_t value, size_t len) { return static_cast<uint8_t>(0x80 | ((value - 1) << 2) | (len - 1)); }
+static size_t valOpcodeValue(uint8_t op) { return ((op >> 2) & 31) + 1; }
+static size_t valOpcodeLength(uint8_t op) { return (op & 3) + 1; }
+
+/**
+ * @brief Decodes the opcode at `pos` into a run, advancing `pos` past it.
+ * @return false if the opcode is truncated.
+ */
+static bool decodeOpcode(std::string_view sketch, size_t& pos, size_t& len, uint8_t& value) {
+    uint8_t op = sketch[pos];
+    if (isValOpcode(op)) {
+        value = static_cast<uint8_t>(valOpcodeValue(op));
+        len = valOpcodeLength(op);
+        pos += 1;
+    } else if (isXZeroOpcode(op)) {
+        if (pos + 1 >= sketch.size()) {
+            return false;
+        }
+        value = 0;
+        len = (size_t(op & 63) << 8 | static_cast<uint8_t>(sketch[pos + 1])) + 1;
+        pos += 2;
+    } else {
+        value = 0;
+        len = (op & 63) + 1;
+        pos += 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Calls `visit(first, len, value)` for every run of a sparse sketch.
+ * @return false if the opcodes don't cover exactly `REGISTERS` registers.
+ */
+template <typename Visitor>
+static bool sparseForEachRun(std::string_view sketch, Visitor&& visit) {
+    size_t first = 0;
+    for (size_t pos = HEADER_SIZE; pos < sketch.size();) {
+        size_t len;
+        uint8_t value;
+        if (!decodeOpcode(sketch, pos, len, value) || first + len > REGISTERS) {
+            return false;
+        }
+        visit(first, len, value);
+        first += len;
+    }
+    return first == REGISTERS;
+}
+
+static void appendZeros(std::string& out, size_t len) {
+    while (len > 0) {
+        if (len <= SPARSE_ZERO_MAX_LEN) {
+            out.push_back(static_cast<char>(len - 1));
+            return;
+        }
+        size_t run = std::min(len, SPARSE_XZERO_MAX_LEN);
+        out.push_back(static_cast<char>(0x40 | ((run - 1) >> 8)));
+        out.push_back(static_cast<char>((run - 1) & 0xFF));
+        len -= run;
+    }
+}
+
+static void appendValues(std::string& out, size_t value, size_t len) {
+    while (len > 0) {
+        size_t run = std::min(len, SPARSE_VAL_MAX_LEN);
+        out.push_back(static_cast<char>(valOpcode(value, run)));
+        len -= run;
+    }
+}
+
+/**
+ * @brief Converts a sparse sketch to the dense encoding, keeping its cached cardinality.
+ * @return false if the sparse encoding is corrupt (the sketch is then left untouched).
+ */
+static bool toDense(std::string& sketch) {
+    std::string dense = header(DENSE, readCache(sketch));
+    dense.resize(DENSE_SIZE, '\0');
+    uint8_t* registers = denseRegisters(dense);
+
+    bool valid = sparseForEachRun(sketch, [registers](size_t first, size_t len, uint8_t value) {
+        if (value == 0) return;
+        for (size_t i = first; i < first + len; ++i) {
+            denseSet(registers, i, value);
+        }
+    });
+    if (!valid) {
+        return false;
+    }
+
+    sketch = std::move(dense);
+    return true;
+}
+
+/**
+ * @brief Merges adjacent value runs of equal value, for `opcodes` opcodes from `pos`.
+ */
+static void sparseCoalesce(std::string& sketch, size_t pos, int opcodes) {
+    while (opcodes-- > 0 && pos + 1 < sketch.size()) {
+        uint8_t op = sketch[pos];
+        uint8_t next = sketch[pos + 1];
+
+        if (isValOpcode(op) && isValOpcode(next) && valOpcodeValue(op) == valOpcodeValue(next)) {
+            size_t len = valOpcodeLength(op) + valOpcodeLength(next);
+            if (len <= SPARSE_VAL_MAX_LEN) {
+                sketch[pos] = static_cast<char>(valOpcode(valOpcodeValue(op), len));
+                sketch.erase(pos + 1, 1);
+                continue;
+            }
+        }
+        pos += isXZeroOpcode(op) ? 2 : 1;
+    }
+}
+
+/**
+ * @brief Raises register `index` of a sparse sketch to `value`, splitting the run that holds it.
+ * @return 1 if the register changed, 0 if not, -1 if the sketch is corrupt.
+ */
+static int sparseSet(std::string& sketch, size_t index, uint8_t value) {
+    if (value > SPARSE_VAL_MAX_VALUE) {
+        if (!toDense(sketch)) {
+            return -1;
+        }
+        denseSet(denseRegisters(sketch), index, value);
+        return 1;
+    }
+
+    // Find the run holding the register, and the opcode before it.
+    size_t pos = HEADER_SIZE, previous = HEADER_SIZE, first = 0;
+    size_t len = 0, opcode_size = 0;
+    uint8_t current = 0;
+    while (pos < sketch.size()) {
+        size_t next = pos;
+        if (!decodeOpcode(sketch, next, len, current)) {
+            return -1;
+        }
+        if (index < first + len) {
+            opcode_size = next - pos;
+            break;
+        }
+        first += len;
+        previous = pos;
+        pos = next;
+    }
+    if (opcode_size == 0) {
+        return -1;
+    }
+    if (current >= value) {
+        return 0;
+    }
+
+    // Replace the run by up to three: the registers before, the new one and those after.
+    const size_t before = index - first;
+    const size_t after = first + len - index - 1;
+    std::string runs;
+    if (current == 0) {
+        appendZeros(runs, before);
+        appendValues(runs, value, 1);
+        appendZeros(runs, after);
+    } else {
+        appendValues(runs, current, before);
+        appendValues(runs, value, 1);
+        appendValues(runs, current, after);
+    }
+    sketch.replace(pos, opcode_size, runs);
+
+    // The new run may continue its neighbours: from the previous opcode, cover
+    // it, the (up to three) new ones and the next one.
+    sparseCoalesce(sketch, previous, 5);
+
+    if (sketch.size() > sparseMaxBytes && !toDense(sketch)) {
+        return -1;
+    }
+    return 1;
+}
+
+/* ====== Estimation ====== */
+
+static double sigma(double x) {
+    if (x == 1.0) {
+        return INFINITY;
+    }
+    double y = 1.0, z = x, previous;
+    do {
+        x *= x;
+        previous = z;
+        z += x * y;
+        y += y;
+    } while (previous != z);
+    return z;
+}
+
+static double tau(double x) {
+    if (x == 0.0 || x == 1.0) {
+        return 0.0;
+    }
+    double y = 1.0, z = 1 - x, previous;
+    do {
+        x = std::sqrt(x);
+        previous = z;
+        y *= 0.5;
+        z -= std::pow(1 - x, 2) * y;
+    } while (previous != z);
+    return z / 3;
+}
+
+/**
+ * @brief Estimates the cardinality from the register histogram.
+ * @details Uses Ertl's improved estimator: the harmonic mean of the
+ * registers, with corrections for empty and saturated registers, computed
+ * over the (Q + 2)-entry histogram instead of one power of two per register.
+ * It needs no empirical bias tables and is accurate across the whole range.
+ */
+static uint64_t estimateFromHistogram(const Histogram& histogram) {
+    const double m = REGISTERS;
+    double z = m * tau((m - histogram[Q + 1]) / m);
+    for (int j = Q; j >= 1; --j) {
+        z += histogram[j];
+        z *= 0.5;
+    }
+    z += m * sigma(histogram[0] / m);
+    return static_cast<uint64_t>(std::llround(0.5 / std::log(2.0) * m * m / z));
+}
+
+/* ====== Public functions ====== */
+
+std::string create() {
+    std::string sketch = header(SPARSE, 0);
+    appendZeros(sketch, REGISTERS);
+    return sketch;
+}
+
+bool isValid(std::string_view sketch) {
+    if (sketch.size() < HEADER_SIZE || std::memcmp(sketch.data(), MAGIC, sizeof(MAGIC)) != 0) {
+        return false;
+    }
+    switch (sketch[ENCODING_OFFSET]) {
+        case DENSE:  return sketch.size() == DENSE_SIZE;
+        case SPARSE: return true;
+        default:     return false;
+    }
+}
+
+bool isSparse(std::string_view sketch) {
+    return sketch[ENCODING_OFFSET] == SPARSE;
+}
+
+int add(std::string& sketch, std::string_view element) {
+    size_t index;
+    uint8_t value = hashElement(element, index);
+
+    int updated;
+    if (isSparse(sketch)) {
+        updated = sparseSet(sketch, index, value);
+    } else if (denseGet(denseRegisters(sketch), index) < value) {
+        denseSet(denseRegisters(sketch), index, value);
+        updated = 1;
+    } else {
+        updated = 0;
+    }
+
+    if (updated == 1) {
+        invalidateCache(sketch);
+    }
+    return updated;
+}
+
+bool count(std::string& sketch, uint64_t& cardinality) {
+    uint64_t cache = readCache(sketch);
+    if (!(cache & CACHE_STALE)) {
+        cardinality = cache;
+        return true;
+    }
+
+    Histogram histogram{};
+    if (isSparse(sketch)) {
+        bool valid = sparseForEachRun(sketch, [&histogram](size_t, size_t len, uint8_t value) {
+            histogram[value] += static_cast<uint32_t>(len);
+        });
+        if (!valid) {
+            return false;
+        }
+    } else {
+        denseHistogram(denseRegisters(std::string_view(sketch)), histogram);
+    }
+
+    cardinality = estimateFromHistogram(histogram);
+    writeCache(sketch, cardinality);
+    return true;
+}
+
+bool merge(Registers& registers, std::string_view sketch) {
+    if (!isSparse(sketch)) {
+        denseMerge(registers, denseRegisters(sketch));
+        return true;
+    }
+
+    return sparseForEachRun(sketch, [&registers](size_t first, size_t len, uint8_t value) {
+        if (value == 0) return;
+        for (size_t i = first; i < first + len; ++i) {
+            registers[i] = std::max(registers[i], value);
+        }
+    });
+}
+
+uint64_t estimate(const Registers& registers) {
+    Histogram histogram{};
+    for (uint8_t value: registers) {
+        ++histogram[value];
+    }
+    return estimateFromHistogram(histogram);
+}
+
+std::string fromRegisters(const Registers& registers) {
+    std::string sketch = header(SPARSE, CACHE_STALE);
+    bool sparse = true;
+
+    for (size_t i = 0; sparse && i < REGISTERS;) {
+        size_t run = 1;
+        while (i + run < REGISTERS && registers[i + run] == registers[i]) {
+            ++run;
+        }
+
+        if (registers[i] == 0) {
+            appendZeros(sketch, run);
+        } else if (registers[i] <= SPARSE_VAL_MAX_VALUE) {
+            appendValues(sketch, registers[i], run);
+        } else {
+            sparse = false;
+        }
+        sparse = sparse && sketch.size() <= sparseMaxBytes;
+        i += run;
+    }
+    if (sparse) {
+        return sketch;
+    }
+
+    sketch = header(DENSE, CACHE_STALE);
+    sketch.resize(DENSE_SIZE, '\0');
+    uint8_t* dense = denseRegisters(sketch);
+    for (size_t i = 0; i < REGISTERS; ++i) {
+        denseSet(dense, i, registers[i]);
+    }
+    return sketch;
+}
+
+}
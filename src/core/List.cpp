@@ -0,0 +1,157 @@
+#include <core/List.hpp>
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+/**
+ * @file List.cpp
+ * @brief Implements the List class on top of a linked list of listpacks.
+ */
+
+size_t List::maxListpackBytes = 8192;
+
+/// @brief An upper bound on the bytes a listpack adds around an entry's payload.
+static const size_t ENTRY_OVERHEAD = 20;
+
+/* ====== Private methods ====== */
+
+bool List::fits(const ListPack& node, std::string_view element) {
+    return node.end() + element.size() + ENTRY_OVERHEAD <= maxListpackBytes;
+}
+
+List::Node List::locate(size_t index, size_t& offset) const {
+    assert(index < count);
+
+    if (index < count / 2) {
+        Node node = nodes.begin();
+        while (index >= node->size()) {
+            index -= node->size();
+            ++node;
+        }
+        offset = index;
+        return node;
+    }
+
+    size_t from_back = count - 1 - index;
+    Node node = std::prev(nodes.end());
+    while (from_back >= node->size()) {
+        from_back -= node->size();
+        --node;
+    }
+    offset = node->size() - 1 - from_back;
+    return node;
+}
+
+size_t List::entryOffset(const ListPack& node, size_t n) {
+    size_t pos = node.begin();
+    for (size_t i = 0; i < n; ++i) {
+        pos = node.next(pos);
+    }
+    return pos;
+}
+
+void List::removeFront(size_t n) {
+    count -= n;
+    while (n > 0) {
+        ListPack& node = nodes.front();
+        if (node.size() <= n) {
+            n -= node.size();
+            nodes.pop_front();
+        } else {
+            node.erase(node.begin(), n);
+            n = 0;
+        }
+    }
+}
+
+void List::removeBack(size_t n) {
+    count -= n;
+    while (n > 0) {
+        ListPack& node = nodes.back();
+        if (node.size() <= n) {
+            n -= node.size();
+            nodes.pop_back();
+        } else {
+            node.erase(entryOffset(node, node.size() - n), n);
+            n = 0;
+        }
+    }
+}
+
+/* ====== Public methods ====== */
+
+void List::pushFront(std::string_view element) {
+    if (nodes.empty() || !fits(nodes.front(), element)) {
+        nodes.emplace_front();
+    }
+    nodes.front().pushFront(element);
+    ++count;
+}
+
+void List::pushBack(std::string_view element) {
+    if (nodes.empty() || !fits(nodes.back(), element)) {
+        nodes.emplace_back();
+    }
+    nodes.back().pushBack(element);
+    ++count;
+}
+
+bool List::popFront(std::string& element) {
+    if (count == 0) {
+        return false;
+    }
+    element = nodes.front().get(nodes.front().begin());
+    removeFront(1);
+    return true;
+}
+
+bool List::popBack(std::string& element) {
+    if (count == 0) {
+        return false;
+    }
+    const ListPack& node = nodes.back();
+    element = node.get(node.prev(node.end()));
+    removeBack(1);
+    return true;
+}
+
+bool List::index(size_t index, std::string& element) const {
+    if (index >= count) {
+        return false;
+    }
+    size_t offset;
+    Node node = locate(index, offset);
+    element = node->get(entryOffset(*node, offset));
+    return true;
+}
+
+void List::range(size_t start, size_t stop, const ElementCallback& callback) const {
+    if (start > stop || stop >= count) {
+        return;
+    }
+
+    size_t offset;
+    Node node = locate(start, offset);
+    size_t pos = entryOffset(*node, offset);
+
+    for (size_t remaining = stop - start + 1; remaining > 0; --remaining) {
+        if (pos == node->end()) {
+            ++node;
+            pos = node->begin();
+        }
+        callback(node->get(pos));
+        pos = node->next(pos);
+    }
+}
+
+void List::trim(size_t start, size_t stop) {
+    if (start > stop || start >= count) {
+        nodes.clear();
+        count = 0;
+        return;
+    }
+
+    stop = std::min(stop, count - 1);
+    removeBack(count - 1 - stop);
+    removeFront(start);
+}
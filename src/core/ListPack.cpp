@@ -0,0 +1,158 @@
+#include <core/ListPack.hpp>
+#include <cassert>
+#include <cstring>
+
+/**
+ * @file ListPack.cpp
+ * @brief Implements the ListPack class.
+ */
+
+/* ====== Private methods ====== */
+
+size_t ListPack::varintSize(uint64_t value) {
+    size_t size = 1;
+    while (value >= 128) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+size_t ListPack::encodeVarint(uint8_t* out, uint64_t value) {
+    // LEB128: the low 7 bits come first, the high bit flags a continuation.
+    size_t written = 0;
+    do {
+        uint8_t byte = value & 127;
+        value >>= 7;
+        if (value) byte |= 128;
+        out[written++] = byte;
+    } while (value);
+    return written;
+}
+
+size_t ListPack::encodeBacklen(uint8_t* out, uint64_t value) {
+    // Mirror image of the varint: the low 7 bits live in the rightmost byte,
+    // and the high bit flags that more bytes follow to the left.
+    size_t size = varintSize(value);
+    for (size_t i = size; i-- > 0;) {
+        uint8_t byte = value & 127;
+        value >>= 7;
+        if (i != 0) byte |= 128;
+        out[i] = byte;
+    }
+    return size;
+}
+
+uint64_t ListPack::decodeVarint(size_t pos, size_t& len) const {
+    uint64_t value = 0;
+    unsigned shift = 0;
+    len = 0;
+    while (true) {
+        uint8_t byte = buffer[pos + len++];
+        value |= static_cast<uint64_t>(byte & 127) << shift;
+        if (!(byte & 128)) break;
+        shift += 7;
+    }
+    return value;
+}
+
+uint64_t ListPack::decodeBacklen(size_t last, size_t& len) const {
+    uint64_t value = 0;
+    unsigned shift = 0;
+    len = 0;
+    while (true) {
+        uint8_t byte = buffer[last - len++];
+        value |= static_cast<uint64_t>(byte & 127) << shift;
+        if (!(byte & 128)) break;
+        shift += 7;
+    }
+    return value;
+}
+
+size_t ListPack::encodedSize(std::string_view value) {
+    size_t body = varintSize(value.size()) + value.size();
+    return body + varintSize(body);
+}
+
+void ListPack::encodeEntry(uint8_t* out, std::string_view value) {
+    size_t header = encodeVarint(out, value.size());
+    if (!value.empty()) {
+        memcpy(out + header, value.data(), value.size());
+    }
+    encodeBacklen(out + header + value.size(), header + value.size());
+}
+
+size_t ListPack::entrySize(size_t pos) const {
+    size_t header = 0;
+    uint64_t len = decodeVarint(pos, header);
+    size_t body = header + len;
+    return body + varintSize(body);
+}
+
+/* ====== Public methods ====== */
+
+size_t ListPack::next(size_t pos) const {
+    assert(pos < buffer.size());
+    return pos + entrySize(pos);
+}
+
+size_t ListPack::prev(size_t pos) const {
+    assert(pos > 0 && pos <= buffer.size());
+    size_t backlen_size = 0;
+    uint64_t body = decodeBacklen(pos - 1, backlen_size);
+    return pos - backlen_size - body;
+}
+
+std::string_view ListPack::get(size_t pos) const {
+    assert(pos < buffer.size());
+    size_t header = 0;
+    uint64_t len = decodeVarint(pos, header);
+    return std::string_view(reinterpret_cast<const char*>(buffer.data() + pos + header), len);
+}
+
+size_t ListPack::insert(size_t pos, std::string_view value) {
+    assert(pos <= buffer.size());
+    // Open a gap of the right size and encode straight into it.
+    buffer.insert(buffer.begin() + pos, encodedSize(value), 0);
+    encodeEntry(buffer.data() + pos, value);
+    ++count;
+    return pos;
+}
+
+size_t ListPack::erase(size_t pos) {
+    assert(pos < buffer.size());
+    size_t size = entrySize(pos);
+    buffer.erase(buffer.begin() + pos, buffer.begin() + pos + size);
+    --count;
+    return pos;
+}
+
+size_t ListPack::erase(size_t pos, size_t n) {
+    size_t last = pos;
+    for (size_t i = 0; i < n; ++i) {
+        assert(last < buffer.size());
+        last += entrySize(last);
+    }
+    buffer.erase(buffer.begin() + pos, buffer.begin() + last);
+    count -= n;
+    return pos;
+}
+
+void ListPack::replace(size_t pos, std::string_view value) {
+    assert(pos < buffer.size());
+    size_t old_size = entrySize(pos);
+    size_t new_size = encodedSize(value);
+
+    if (new_size > old_size) {
+        buffer.insert(buffer.begin() + pos + old_size, new_size - old_size, 0);
+    } else if (new_size < old_size) {
+        buffer.erase(buffer.begin() + pos + new_size, buffer.begin() + pos + old_size);
+    }
+    encodeEntry(buffer.data() + pos, value);
+}
+
+void ListPack::clear() {
+    buffer.clear();
+    buffer.shrink_to_fit();
+    count = 0;
+}
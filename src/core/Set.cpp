@@ -0,0 +1,206 @@
+#include <core/Set.hpp>
+#include <algorithm>
+#include <charconv>
+
+/**
+ * @file Set.cpp
+ * @brief Implements the Set class and its two encodings.
+ */
+
+size_t Set::maxIntsetEntries = 512;
+
+/// @brief The size ratio above which intersections gallop through the larger array.
+static const size_t GALLOP_RATIO = 16;
+
+/* ====== Private methods ====== */
+
+bool Set::memberEquals(HashTable::Node* node, HashTable::Node* key) {
+    return static_cast<SetMemberNode*>(node)->member == static_cast<SetMemberNode*>(key)->member;
+}
+
+void Set::tableInsert(std::string_view member) {
+    auto new_member_node = std::make_unique<SetMemberNode>();
+    new_member_node->member = member;
+    new_member_node->hashCode = HashTable::hashString(member);
+    table->insert(std::move(new_member_node));
+}
+
+void Set::convertToTable() {
+    assert(encoding == Encoding::INTSET);
+    table = std::make_unique<HashTable>();
+
+    for (int64_t value: intset) {
+        tableInsert(std::to_string(value));
+    }
+
+    intset = {};
+    encoding = Encoding::HASHTABLE;
+}
+
+void Set::intersectSorted(const std::vector<int64_t>& a, const std::vector<int64_t>& b, std::vector<int64_t>& out) {
+    const std::vector<int64_t>& small = a.size() <= b.size() ? a : b;
+    const std::vector<int64_t>& large = a.size() <= b.size() ? b : a;
+    size_t k = 0;
+
+    if (small.size() * GALLOP_RATIO < large.size()) {
+        // Binary-search each member, never looking back past the last match.
+        auto from = large.begin();
+        std::vector<int64_t> result;
+        for (int64_t value: small) {
+            from = std::lower_bound(from, large.end(), value);
+            if (from == large.end()) break;
+            if (*from == value) result.push_back(value);
+        }
+        out = std::move(result);
+        return;
+    }
+
+    // Merge without data-dependent branches: every step advances one or both
+    // cursors and keeps the value only if both were equal.
+    std::vector<int64_t> result(small.size());
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        int64_t x = a[i], y = b[j];
+        result[k] = x;
+        k += x == y;
+        i += x <= y;
+        j += y <= x;
+    }
+    result.resize(k);
+    out = std::move(result);
+}
+
+/* ====== Public methods ====== */
+
+Set::Set() = default;
+Set::~Set() = default;
+
+Set::Set(Set&&) noexcept = default;
+Set& Set::operator=(Set&&) noexcept = default;
+
+bool Set::parseInteger(std::string_view member, int64_t& value) {
+    if (member.empty() || member.size() > 20) {
+        return false;
+    }
+    auto [end, error] = std::from_chars(member.data(), member.data() + member.size(), value);
+    if (error != std::errc() || end != member.data() + member.size()) {
+        return false;
+    }
+    // Reject the non-canonical forms from_chars accepts: "-0", "007", "-01".
+    size_t digits = member[0] == '-' ? 1 : 0;
+    return !(member[digits] == '0' && (member.size() > digits + 1 || digits == 1));
+}
+
+size_t Set::size() const {
+    if (encoding == Encoding::INTSET) {
+        return intset.size();
+    }
+    return table->size();
+}
+
+const char* Set::encodingName() const {
+    return encoding == Encoding::INTSET ? "intset" : "hashtable";
+}
+
+bool Set::add(std::string_view member) {
+    if (encoding == Encoding::INTSET) {
+        int64_t value;
+        if (parseInteger(member, value)) {
+            auto pos = std::lower_bound(intset.begin(), intset.end(), value);
+            if (pos != intset.end() && *pos == value) {
+                return false;
+            }
+            if (intset.size() < maxIntsetEntries) {
+                intset.insert(pos, value);
+                return true;
+            }
+        }
+        convertToTable();
+    }
+
+    if (contains(member)) {
+        return false;
+    }
+    tableInsert(member);
+    return true;
+}
+
+bool Set::remove(std::string_view member) {
+    if (encoding == Encoding::INTSET) {
+        int64_t value;
+        if (!parseInteger(member, value)) {
+            return false;
+        }
+        auto pos = std::lower_bound(intset.begin(), intset.end(), value);
+        if (pos == intset.end() || *pos != value) {
+            return false;
+        }
+        intset.erase(pos);
+        return true;
+    }
+
+    SetMemberNode member_key;
+    member_key.member = member;
+    member_key.hashCode = HashTable::hashString(member);
+    return table->remove(&member_key, memberEquals) != nullptr;
+}
+
+bool Set::contains(std::string_view member) {
+    if (encoding == Encoding::INTSET) {
+        int64_t value;
+        return parseInteger(member, value) && std::binary_search(intset.begin(), intset.end(), value);
+    }
+
+    SetMemberNode member_key;
+    member_key.member = member;
+    member_key.hashCode = HashTable::hashString(member);
+    return table->lookup(&member_key, memberEquals) != nullptr;
+}
+
+void Set::forEach(const MemberCallback& callback) {
+    if (encoding == Encoding::INTSET) {
+        for (int64_t value: intset) {
+            callback(std::to_string(value));
+        }
+        return;
+    }
+
+    table->forEach([&callback](HashTable::Node* node) {
+        callback(static_cast<SetMemberNode*>(node)->member);
+    });
+}
+
+void Set::intersect(std::vector<Set*> sets, const MemberCallback& callback) {
+    if (sets.empty()) {
+        return;
+    }
+
+    // Smallest first. A set given twice is dropped: it would otherwise be
+    // probed (which may rehash it) while being iterated.
+    std::sort(sets.begin(), sets.end(), [](Set* a, Set* b) {
+        return a->size() != b->size() ? a->size() < b->size() : a < b;
+    });
+    sets.erase(std::unique(sets.begin(), sets.end()), sets.end());
+
+    bool all_intsets = std::all_of(sets.begin(), sets.end(), [](Set* set) {
+        return set->encoding == Encoding::INTSET;
+    });
+
+    if (all_intsets) {
+        std::vector<int64_t> result = sets[0]->intset;
+        for (size_t i = 1; i < sets.size() && !result.empty(); ++i) {
+            intersectSorted(result, sets[i]->intset, result);
+        }
+        for (int64_t value: result) {
+            callback(std::to_string(value));
+        }
+        return;
+    }
+
+    sets[0]->forEach([&sets, &callback](std::string_view member) {
+        for (size_t i = 1; i < sets.size(); ++i) {
+            if (!sets[i]->contains(member)) return;
+        }
+        callback(member);
+    });
+}
@@ -0,0 +1,407 @@
+#include <core/ZSet.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/**
+ * @file ZSet.cpp
+ * @brief Implements the SortedSet class and its two encodings.
+ */
+
+size_t SortedSet::maxListpackEntries = 128;
+size_t SortedSet::maxListpackValue = 64;
+ZSetIndex::Engine SortedSet::indexEngine = ZSetIndex::Engine::AVL;
+
+/* ====== Private methods ====== */
+
+bool SortedSet::memberEquals(HashTable::Node* node, HashTable::Node* key) {
+    return static_cast<ZSetMemberNode*>(node)->member == static_cast<ZSetMemberNode*>(key)->member;
+}
+
+double SortedSet::listpackScore(std::string_view encoded) {
+    assert(encoded.size() == sizeof(double));
+    double score;
+    memcpy(&score, encoded.data(), sizeof(double));
+    return score;
+}
+
+size_t SortedSet::listpackFind(std::string_view member) const {
+    // Entries alternate member, score: step over two entries at a time.
+    for (size_t pos = listpack.begin(); pos != listpack.end(); pos = listpack.next(listpack.next(pos))) {
+        if (listpack.get(pos) == member) {
+            return pos;
+        }
+    }
+    return listpack.end();
+}
+
+void SortedSet::listpackInsert(const std::string& member, double score) {
+    size_t pos = listpack.begin();
+    while (pos != listpack.end()) {
+        size_t score_pos = listpack.next(pos);
+        double current = listpackScore(listpack.get(score_pos));
+
+        if (current > score || (current == score && listpack.get(pos) > member)) {
+            break;
+        }
+        pos = listpack.next(score_pos);
+    }
+
+    char encoded[sizeof(double)];
+    memcpy(encoded, &score, sizeof(double));
+
+    pos = listpack.insert(pos, member);
+    listpack.insert(listpack.next(pos), std::string_view(encoded, sizeof(double)));
+}
+
+void SortedSet::listpackUpdate(size_t pos, const std::string& member, double score) {
+    size_t score_pos = listpack.next(pos);
+    size_t next_pos = listpack.next(score_pos);
+
+    bool after_prev = true;
+    if (pos != listpack.begin()) {
+        size_t prev_score_pos = listpack.prev(pos);
+        double prev_score = listpackScore(listpack.get(prev_score_pos));
+        after_prev = prev_score < score || (prev_score == score && listpack.get(listpack.prev(prev_score_pos)) < member);
+    }
+
+    bool before_next = true;
+    if (next_pos != listpack.end()) {
+        double next_score = listpackScore(listpack.get(listpack.next(next_pos)));
+        before_next = score < next_score || (score == next_score && member < listpack.get(next_pos));
+    }
+
+    if (after_prev && before_next) {
+        // Same-sized entry: the score is overwritten without moving any bytes.
+        char encoded[sizeof(double)];
+        memcpy(encoded, &score, sizeof(double));
+        listpack.replace(score_pos, std::string_view(encoded, sizeof(double)));
+        return;
+    }
+
+    listpack.erase(listpack.erase(pos));
+    listpackInsert(member, score);
+}
+
+ZSetMemberNode* SortedSet::treeLookup(const std::string& member, uint64_t hashCode) {
+    ZSetMemberNode member_key;
+    member_key.member = member;
+    member_key.hashCode = hashCode;
+    return static_cast<ZSetMemberNode*>(tree->member_to_score_map.lookup(&member_key, memberEquals));
+}
+
+void SortedSet::treeInsert(const std::string& member, double score, uint64_t hashCode) {
+    auto new_member_node = std::make_unique<ZSetMemberNode>();
+    new_member_node->member = member;
+    new_member_node->score = score;
+    new_member_node->hashCode = hashCode;
+    tree->member_to_score_map.insert(std::move(new_member_node));
+    tree->score_index->insert(member, score);
+}
+
+void SortedSet::convertToTree() {
+    assert(encoding == Encoding::LISTPACK);
+    tree = std::make_unique<Tree>();
+    tree->score_index = ZSetIndex::create(indexEngine);
+
+    // The listpack is already sorted, so the index can be bulk-loaded.
+    std::vector<ZSetEntry> entries;
+    entries.reserve(size());
+
+    for (size_t pos = listpack.begin(); pos != listpack.end();) {
+        std::string member(listpack.get(pos));
+        pos = listpack.next(pos);
+        double score = listpackScore(listpack.get(pos));
+        pos = listpack.next(pos);
+
+        auto new_member_node = std::make_unique<ZSetMemberNode>();
+        new_member_node->member = member;
+        new_member_node->score = score;
+        new_member_node->hashCode = HashTable::hashString(member);
+        tree->member_to_score_map.insert(std::move(new_member_node));
+
+        entries.push_back({std::move(member), score});
+    }
+
+    tree->score_index->insertSorted(std::move(entries));
+    listpack.clear();
+    encoding = Encoding::TREE;
+}
+
+/* ====== Public methods ====== */
+
+SortedSet::SortedSet() = default;
+SortedSet::~SortedSet() = default;
+
+SortedSet::SortedSet(SortedSet&&) noexcept = default;
+SortedSet& SortedSet::operator=(SortedSet&&) noexcept = default;
+
+size_t SortedSet::size() const {
+    if (encoding == Encoding::LISTPACK) {
+        return listpack.size() / 2;
+    }
+    return tree->score_index->size();
+}
+
+const char* SortedSet::encodingName() const {
+    if (encoding == Encoding::LISTPACK) {
+        return "listpack";
+    }
+    return tree->score_index->name();
+}
+
+SortedSet::AddResult SortedSet::add(const std::string& member, double score, int flags, double* new_score) {
+    // Locate the member once: a listpack offset or a hash table node.
+    size_t pos = listpack.end();
+    ZSetMemberNode* member_node = nullptr;
+    uint64_t hashCode = 0;
+    bool exists;
+
+    if (encoding == Encoding::LISTPACK) {
+        pos = listpackFind(member);
+        exists = pos != listpack.end();
+    } else {
+        hashCode = HashTable::hashString(member);
+        member_node = treeLookup(member, hashCode);
+        exists = member_node != nullptr;
+    }
+
+    if (exists) {
+        if (flags & ADD_NX) {
+            return AddResult::SKIPPED;
+        }
+
+        double current = member_node ? member_node->score : listpackScore(listpack.get(listpack.next(pos)));
+        if (flags & ADD_INCR) {
+            score += current;
+            if (std::isnan(score)) {
+                return AddResult::NOT_A_NUMBER;
+            }
+        }
+
+        if (((flags & ADD_GT) && score <= current) || ((flags & ADD_LT) && score >= current)) {
+            return AddResult::SKIPPED;
+        }
+
+        if (new_score) *new_score = score;
+        if (score == current) {
+            return AddResult::UNCHANGED;
+        }
+
+        if (member_node) {
+            tree->score_index->updateScore(member, current, score);
+            member_node->score = score;
+        } else {
+            listpackUpdate(pos, member, score);
+        }
+        return AddResult::UPDATED;
+    }
+
+    if (flags & ADD_XX) {
+        return AddResult::SKIPPED;
+    }
+
+    if (new_score) *new_score = score;
+
+    if (encoding == Encoding::LISTPACK) {
+        if (member.size() <= maxListpackValue && size() < maxListpackEntries) {
+            listpackInsert(member, score);
+            return AddResult::ADDED;
+        }
+
+        convertToTree();
+        hashCode = HashTable::hashString(member);
+    }
+
+    treeInsert(member, score, hashCode);
+    return AddResult::ADDED;
+}
+
+size_t SortedSet::addMany(std::vector<ZSetEntry> entries) {
+    bool fits_listpack = encoding == Encoding::LISTPACK && size() + entries.size() <= maxListpackEntries;
+    if (entries.size() < BULK_LOAD_MIN_BATCH || fits_listpack) {
+        size_t added = 0;
+        for (const auto& entry: entries) {
+            if (add(entry.member, entry.score) == AddResult::ADDED) ++added;
+        }
+        return added;
+    }
+
+    if (encoding == Encoding::LISTPACK) {
+        convertToTree();
+    }
+
+    // Members are resolved in order against the hash table, so a member given
+    // several times ends up with its last score. Each change pushes a pending
+    // entry; the stale ones are filtered out once the batch is sorted.
+    struct Pending {
+        ZSetEntry entry;
+        ZSetMemberNode* node;
+    };
+    std::vector<Pending> pending;
+    pending.reserve(entries.size());
+    size_t added = 0;
+
+    for (auto& entry: entries) {
+        uint64_t hashCode = HashTable::hashString(entry.member);
+
+        if (ZSetMemberNode* member_node = treeLookup(entry.member, hashCode)) {
+            if (member_node->score == entry.score) {
+                continue;
+            }
+            // Fails harmlessly if an earlier entry of this batch already took it out.
+            tree->score_index->remove(entry.member, member_node->score);
+            member_node->score = entry.score;
+            pending.push_back({std::move(entry), member_node});
+        } else {
+            auto new_member_node = std::make_unique<ZSetMemberNode>();
+            new_member_node->member = entry.member;
+            new_member_node->score = entry.score;
+            new_member_node->hashCode = hashCode;
+            pending.push_back({std::move(entry), new_member_node.get()});
+            tree->member_to_score_map.insert(std::move(new_member_node));
+            ++added;
+        }
+    }
+
+    std::sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b) {
+        return a.entry < b.entry;
+    });
+
+    std::vector<ZSetEntry> batch;
+    batch.reserve(pending.size());
+    ZSetMemberNode* last_node = nullptr;
+    for (auto& item: pending) {
+        // Identical live entries sort next to each other: keep the first one.
+        if (item.node->score != item.entry.score || item.node == last_node) {
+            continue;
+        }
+        last_node = item.node;
+        batch.push_back(std::move(item.entry));
+    }
+
+    tree->score_index->insertSorted(std::move(batch));
+    return added;
+}
+
+bool SortedSet::remove(const std::string& member) {
+    if (encoding == Encoding::LISTPACK) {
+        size_t pos = listpackFind(member);
+        if (pos == listpack.end()) {
+            return false;
+        }
+        listpack.erase(listpack.erase(pos));
+        return true;
+    }
+
+    ZSetMemberNode member_key;
+    member_key.member = member;
+    member_key.hashCode = HashTable::hashString(member);
+
+    std::unique_ptr<HashTable::Node> removed = tree->member_to_score_map.remove(&member_key, memberEquals);
+    if (!removed) {
+        return false;
+    }
+
+    tree->score_index->remove(member, static_cast<ZSetMemberNode*>(removed.get())->score);
+    return true;
+}
+
+bool SortedSet::getScore(const std::string& member, double& score) {
+    if (encoding == Encoding::LISTPACK) {
+        size_t pos = listpackFind(member);
+        if (pos == listpack.end()) {
+            return false;
+        }
+        score = listpackScore(listpack.get(listpack.next(pos)));
+        return true;
+    }
+
+    if (ZSetMemberNode* member_node = treeLookup(member, HashTable::hashString(member))) {
+        score = member_node->score;
+        return true;
+    }
+    return false;
+}
+
+void SortedSet::range(size_t start, size_t stop, bool reverse, const RangeCallback& callback) {
+    assert(start <= stop && stop < size());
+    size_t count = stop - start + 1;
+
+    if (encoding == Encoding::LISTPACK) {
+        if (!reverse) {
+            size_t pos = listpack.begin();
+            for (size_t i = 0; i < start; ++i) {
+                pos = listpack.next(listpack.next(pos));
+            }
+            for (size_t i = 0; i < count; ++i) {
+                size_t score_pos = listpack.next(pos);
+                callback(std::string(listpack.get(pos)), listpackScore(listpack.get(score_pos)));
+                pos = listpack.next(score_pos);
+            }
+        } else {
+            size_t pos = listpack.end();
+            for (size_t i = 0; i < start; ++i) {
+                pos = listpack.prev(listpack.prev(pos));
+            }
+            for (size_t i = 0; i < count; ++i) {
+                size_t score_pos = listpack.prev(pos);
+                pos = listpack.prev(score_pos);
+                callback(std::string(listpack.get(pos)), listpackScore(listpack.get(score_pos)));
+            }
+        }
+        return;
+    }
+
+    tree->score_index->range(start, count, reverse, callback);
+}
+
+void SortedSet::pop(size_t count, bool reverse, const RangeCallback& callback) {
+    if (encoding == Encoding::LISTPACK) {
+        for (size_t i = 0; i < count && !listpack.empty(); ++i) {
+            size_t pos = reverse ? listpack.prev(listpack.prev(listpack.end())) : listpack.begin();
+            std::string member(listpack.get(pos));
+            double score = listpackScore(listpack.get(listpack.next(pos)));
+
+            listpack.erase(listpack.erase(pos));
+            callback(member, score);
+        }
+        return;
+    }
+
+    tree->score_index->pop(count, reverse, [this, &callback](const std::string& member, double score) {
+        ZSetMemberNode member_key;
+        member_key.member = member;
+        member_key.hashCode = HashTable::hashString(member);
+        tree->member_to_score_map.remove(&member_key, memberEquals);
+        callback(member, score);
+    });
+}
+
+void SortedSet::forEach(const RangeCallback& callback) {
+    if (encoding == Encoding::LISTPACK) {
+        for (size_t pos = listpack.begin(); pos != listpack.end();) {
+            size_t score_pos = listpack.next(pos);
+            callback(std::string(listpack.get(pos)), listpackScore(listpack.get(score_pos)));
+            pos = listpack.next(score_pos);
+        }
+        return;
+    }
+
+    tree->member_to_score_map.forEach([&callback](HashTable::Node* node) {
+        ZSetMemberNode* member_node = static_cast<ZSetMemberNode*>(node);
+        callback(member_node->member, member_node->score);
+    });
+}
+
+size_t SortedSet::scan(size_t cursor, const RangeCallback& callback) {
+    if (encoding == Encoding::LISTPACK) {
+        forEach(callback);
+        return 0;
+    }
+
+    return tree->member_to_score_map.scan(cursor, [&callback](HashTable::Node* node) {
+        ZSetMemberNode* member_node = static_cast<ZSetMemberNode*>(node);
+        callback(member_node->member, member_node->score);
+    });
+}
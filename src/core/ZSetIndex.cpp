@@ -0,0 +1,130 @@
+#include <core/ZSetIndex.hpp>
+#include <core/BPlusTree.hpp>
+
+/**
+ * @file ZSetIndex.cpp
+ * @brief Implements the ZSetIndex factory and the AVL tree index.
+ */
+
+std::unique_ptr<ZSetIndex> ZSetIndex::create(Engine engine) {
+    if (engine == Engine::BTREE) {
+        return std::make_unique<BPlusTree>();
+    }
+    return std::make_unique<AVLZSetIndex>();
+}
+
+/* ====== AVLZSetIndex ====== */
+
+int AVLZSetIndex::compareNodes(AVLTree::Node* a, AVLTree::Node* b) {
+    double score_a = static_cast<ZSetNode*>(a)->score;
+    double score_b = static_cast<ZSetNode*>(b)->score;
+
+    if (score_a < score_b) return -1;
+    if (score_a > score_b) return  1;
+
+    return static_cast<ZSetNode*>(a)->member.compare(static_cast<ZSetNode*>(b)->member);
+}
+
+AVLTree::Node* AVLZSetIndex::findNode(const std::string& member, double score) {
+    return tree.find([&member, score](AVLTree::Node* node) {
+        auto* zset_node = static_cast<ZSetNode*>(node);
+        if (score < zset_node->score) return -1;
+        if (score > zset_node->score) return  1;
+        return member.compare(zset_node->member);
+    });
+}
+
+void AVLZSetIndex::insert(const std::string& member, double score) {
+    auto new_zset_node = std::make_unique<ZSetNode>();
+    new_zset_node->member = member;
+    new_zset_node->score = score;
+    tree.insert(std::move(new_zset_node), compareNodes);
+}
+
+bool AVLZSetIndex::remove(const std::string& member, double score) {
+    if (AVLTree::Node* to_remove = findNode(member, score)) {
+        tree.detach(to_remove);
+        return true;
+    }
+    return false;
+}
+
+void AVLZSetIndex::updateScore(const std::string& member, double old_score, double new_score) {
+    AVLTree::Node* node = findNode(member, old_score);
+    assert(node);
+
+    AVLTree::Node* prev = AVLTree::predecessor(node);
+    AVLTree::Node* next = AVLTree::successor(node);
+    static_cast<ZSetNode*>(node)->score = new_score;
+
+    if ((!prev || compareNodes(prev, node) < 0) && (!next || compareNodes(node, next) < 0)) {
+        return;
+    }
+
+    // The node moves: relink the same node at its new position.
+    tree.insert(tree.detach(node), compareNodes);
+}
+
+void AVLZSetIndex::insertSorted(std::vector<ZSetEntry> entries) {
+    if (!shouldRebuild(tree.size(), entries.size())) {
+        for (auto& entry: entries) {
+            insert(entry.member, entry.score);
+        }
+        return;
+    }
+
+    // Merge the existing nodes (reused as they are) with new nodes for the
+    // batch, then rebuild the whole tree balanced in a single pass.
+    std::vector<std::unique_ptr<AVLTree::Node>> existing = tree.releaseInOrder();
+    std::vector<std::unique_ptr<AVLTree::Node>> merged;
+    merged.reserve(existing.size() + entries.size());
+
+    size_t i = 0;
+    for (auto& entry: entries) {
+        auto new_zset_node = std::make_unique<ZSetNode>();
+        new_zset_node->member = std::move(entry.member);
+        new_zset_node->score = entry.score;
+
+        while (i < existing.size() && compareNodes(existing[i].get(), new_zset_node.get()) < 0) {
+            merged.push_back(std::move(existing[i++]));
+        }
+        merged.push_back(std::move(new_zset_node));
+    }
+    while (i < existing.size()) {
+        merged.push_back(std::move(existing[i++]));
+    }
+
+    tree.buildFromSorted(std::move(merged));
+}
+
+void AVLZSetIndex::range(size_t start, size_t count, bool reverse, const Visitor& visitor) {
+    if (start >= tree.size()) {
+        return;
+    }
+
+    // Locate the first node once, then walk in-order neighbours instead of
+    // repeating a rank lookup for every member.
+    size_t first_rank = reverse ? tree.size() - 1 - start : start;
+    AVLTree::Node* node = tree.findByRank(static_cast<int32_t>(first_rank));
+
+    for (size_t i = 0; i < count && node; ++i) {
+        auto* zset_node = static_cast<ZSetNode*>(node);
+        visitor(zset_node->member, zset_node->score);
+        node = reverse ? AVLTree::predecessor(node) : AVLTree::successor(node);
+    }
+}
+
+void AVLZSetIndex::pop(size_t count, bool reverse, const Visitor& visitor) {
+    // The tree caches its extremes, so each pop starts without a search and
+    // detaching a node with at most one child only rebalances its ancestors.
+    for (size_t i = 0; i < count; ++i) {
+        AVLTree::Node* node = reverse ? tree.last() : tree.first();
+        if (!node) {
+            break;
+        }
+
+        std::unique_ptr<AVLTree::Node> popped = tree.detach(node);
+        auto* zset_node = static_cast<ZSetNode*>(popped.get());
+        visitor(zset_node->member, zset_node->score);
+    }
+}
@@ -42,7 +42,28 @@ void Connection::consumeIncoming(size_t len) {
     incoming.erase(incoming.begin(), incoming.begin() + len);
 }
 
+void Connection::appendShared(SharedBuffer buffer) {
+    // Keep the output in order: what was appended so far goes first. Moving
+    // the pending bytes into a shared buffer of their own doesn't copy them.
+    if(!outgoing.empty()) {
+        shared_outgoing.push_back(std::make_shared<const std::vector<uint8_t>>(std::move(outgoing)));
+        outgoing.clear();
+    }
+    shared_outgoing.push_back(std::move(buffer));
+}
+
 void Connection::consumeOutgoing(size_t len) {
+    while(len > 0 && !shared_outgoing.empty()) {
+        size_t remaining = shared_outgoing.front()->size() - shared_sent;
+        if(len < remaining) {
+            shared_sent += len;
+            return;
+        }
+        len -= remaining;
+        shared_outgoing.pop_front();
+        shared_sent = 0;
+    }
+
     if(len > outgoing.size())
         len = outgoing.size();
     
@@ -1,4 +1,9 @@
 #include <net/Server.hpp>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+
+/// @brief The most output segments handed to a single `sendmsg()` call.
+static const size_t MAX_IOV = 64;
 
 /* ======= Private methods ======= */
 
@@ -14,6 +19,11 @@ void Server::accept() {
         return; // No new connection or an error occurred
     }
     
+    // Replies that trickle out one at a time (e.g. those relayed from another
+    // thread) must not wait for the client's delayed ACK.
+    int nodelay = 1;
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
     std::unique_ptr<Connection> client = std::make_unique<Connection>(client_fd, client_addr);
     std::cout << "New client connected (ID:" << client_fd << "): " << client->getAddress() << std::endl;
 
@@ -21,6 +31,9 @@ void Server::accept() {
 }
 
 bool Server::process(Connection &client) {
+    if(client.blocked)
+        return false; // The previous request is still pending
+
     if(client.incoming.size() < 4)
         return false; // Not enough data to read the message header
     
@@ -49,7 +62,7 @@ bool Server::process(Connection &client) {
     // Remove the processed message from the incoming buffer
     client.consumeIncoming(4 + payload_len);
 
-    if (!client.outgoing.empty()) {
+    if (client.hasOutgoing()) {
         client.want_write = true;
     }
 
@@ -76,11 +89,15 @@ void Server::recv(Connection& client) {
     // Add the received data to the incoming buffer
     client.appendIncoming(buffer, bytes_recv);
 
+    handleIncoming(client);
+}
+
+void Server::handleIncoming(Connection& client) {
     // Process as many requests as possible
     while(process(client)) {}
 
     // If the outgoing buffer is not empty, send the data
-    if(!client.outgoing.empty()) {
+    if(client.hasOutgoing()) {
         client.want_read = false;
         client.want_write = true;
         // Try to send immediately to reduce latency
@@ -89,22 +106,46 @@ void Server::recv(Connection& client) {
 }
 
 void Server::send(Connection& client) {
-    if(client.outgoing.empty()){
+    if(client.hold_output)
+        return; // Sent once the application releases it
+
+    if(!client.hasOutgoing()){
         client.want_read = true;
         client.want_write = false;
         
         return;
     }
 
-    // Try to send the data
-    ssize_t bytes_sent = ::send(client.fd, client.outgoing.data(), client.outgoing.size(), 0);
+    // Gather the shared buffers and the outgoing buffer into a single send
+    struct iovec iov[MAX_IOV];
+    size_t iov_count = 0;
+    size_t skip = client.shared_sent;
+    for(const auto& shared: client.shared_outgoing) {
+        if(iov_count == MAX_IOV) break;
+        iov[iov_count].iov_base = const_cast<uint8_t*>(shared->data() + skip);
+        iov[iov_count].iov_len = shared->size() - skip;
+        ++iov_count;
+        skip = 0;
+    }
+    if(iov_count < MAX_IOV && !client.outgoing.empty()) {
+        iov[iov_count].iov_base = client.outgoing.data();
+        iov[iov_count].iov_len = client.outgoing.size();
+        ++iov_count;
+    }
+
+    // Try to send the data. A subscriber may go away with messages still
+    // queued: report that as an error instead of raising SIGPIPE.
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov_count;
+    ssize_t bytes_sent = ::sendmsg(client.fd, &msg, MSG_NOSIGNAL);
     
     // If the send failed, close the connection
     if(bytes_sent < 0) {
         if (errno == EAGAIN || errno == EWOULDBLOCK)
             return; // Not an error, socket buffer is full
         
-        std::cerr << "::send() error: " << strerror(errno) << std::endl;
+        std::cerr << "::sendmsg() error: " << strerror(errno) << std::endl;
         client.want_close = true;
         return;
     }
@@ -112,7 +153,7 @@ void Server::send(Connection& client) {
     // Remove the sent data from the outgoing buffer
     client.consumeOutgoing(bytes_sent);
 
-    if(client.outgoing.empty()) {
+    if(!client.hasOutgoing()) {
         client.want_read = true;
         client.want_write = false;
     }
@@ -126,9 +167,34 @@ void Server::onRequest(Connection& client, const std::string& request) {
     client.appendOutgoing(request);
 }
 
+int Server::pollTimeout() {
+    return -1;
+}
+
+void Server::onTick() {}
+
+void Server::onIdle() {}
+
+void Server::onDisconnect(Connection& client) {
+    (void) client;
+}
+
+void Server::resume(Connection& client) {
+    client.blocked = false;
+    handleIncoming(client);
+}
+
+void Server::watch(int fd, std::function<void()> on_ready, short events) {
+    watchers[fd] = {events, std::move(on_ready)};
+}
+
+void Server::unwatch(int fd) {
+    watchers.erase(fd);
+}
+
 /* ======= Public methods ======= */
 
-Server::Server(uint16_t PORT): PORT(PORT) {
+Server::Server(uint16_t PORT, bool reuse_port): PORT(PORT) {
     server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if(server_fd < 0)
         net::die("socket() error");
@@ -136,6 +202,9 @@ Server::Server(uint16_t PORT): PORT(PORT) {
     int reuse = 1;
     if(setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0)
         net::die("setsockopt() error");
+
+    if(reuse_port && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0)
+        net::die("setsockopt(SO_REUSEPORT) error");
     
     struct sockaddr_in server_addr;
     server_addr.sin_family = AF_INET;
@@ -169,6 +238,12 @@ void Server::run() {
 
         // Add all the client connection sockets
         for(const auto& client: clients) {
+            // Closed by the application since the last iteration
+            if(client.second->want_close) {
+                fd_to_remove.push_back(client.first);
+                continue;
+            }
+
             struct pollfd client_pfd = {
                 .fd = client.second->fd,
                 .events = POLLERR,
@@ -178,14 +253,18 @@ void Server::run() {
             if(client.second->want_read)
                 client_pfd.events |= POLLIN;
 
-            if(client.second->want_write)
+            if(client.second->want_write && !client.second->hold_output)
                 client_pfd.events |= POLLOUT;
 
             poll_fds.push_back(client_pfd);
         }
 
+        for(const auto& watcher: watchers) {
+            poll_fds.push_back({watcher.first, watcher.second.first, 0});
+        }
+
         // Wait for events
-        int events = poll(poll_fds.data(), (nfds_t) poll_fds.size(), -1);
+        int events = poll(poll_fds.data(), (nfds_t) poll_fds.size(), fd_to_remove.empty() ? pollTimeout() : 0);
         if(events < 0) {
             if(errno != EINTR)
                 std::cerr << "poll() error: " << strerror(errno) << std::endl;
@@ -204,14 +283,24 @@ void Server::run() {
                 if (poll_fds[i].revents & POLLIN) accept();
                 continue;
             }
+
+            auto watcher = watchers.find(fd);
+            if(watcher != watchers.end()) {
+                // Copied, as the callback may unwatch its own descriptor
+                auto on_ready = watcher->second.second;
+                on_ready();
+                continue;
+            }
             
             // find the client connection
             auto it = clients.find(fd);
             if(it == clients.end()) continue;
 
             Connection& client = *it->second;
-            if(poll_fds[i].revents & POLLIN ) assert(client.want_read ), recv(client);
-            if(poll_fds[i].revents & POLLOUT) assert(client.want_write), send(client);
+            // A watcher may have changed what the client waits for since poll()
+            // (e.g. resumed it and sent its output), so the events are rechecked.
+            if((poll_fds[i].revents & POLLIN ) && client.want_read ) recv(client);
+            if((poll_fds[i].revents & POLLOUT) && client.want_write) send(client);
             if(poll_fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) client.want_close = true;
 
             if(client.want_close) fd_to_remove.push_back(fd);
@@ -219,12 +308,21 @@ void Server::run() {
 
         // Remove closed connections
         for(int fd: fd_to_remove) {
+            auto it = clients.find(fd);
+            if(it == clients.end()) continue; // Listed twice after an interrupted poll()
+
             std::cout << "Closing connection (ID:" << fd << ") "<< std::endl;
+            onDisconnect(*it->second);
             close(fd);
             clients.erase(fd);
         }
         
         fd_to_remove.clear();
+
+        if(events == 0) onIdle();
+
+        // Timers and deferred work run after closed connections are gone
+        onTick();
     }
 }
 
@@ -0,0 +1,501 @@
+#include <core/ZSet.hpp>
+#include <core/ZSetIndex.hpp>
+#include <common/Lzf.hpp>
+#include <server/SnapshotFile.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <csignal>
+#include <fcntl.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @file redis-benchmark.cpp
+ * @brief In-process micro-benchmarks for the core data structures and snapshot loading.
+ * @details Each suite exercises a data structure directly (no networking) and
+ * prints its timings and, where relevant, the heap memory it used. Heap usage
+ * is measured by counting the usable size of every live allocation. The
+ * exception is `shards`, which starts the server next to this binary and
+ * measures its throughput over loopback connections.
+ */
+
+/* ====== Heap accounting ====== */
+
+// Snapshot decoding allocates from several threads, hence the atomic.
+static std::atomic<size_t> live_bytes{0};
+
+void* operator new(size_t size) {
+    void* ptr = malloc(size);
+    if (!ptr) throw std::bad_alloc();
+    live_bytes += malloc_usable_size(ptr);
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (!ptr) return;
+    live_bytes -= malloc_usable_size(ptr);
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+/* ====== Helpers ====== */
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedMs(Clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+static size_t argOr(int argc, char** argv, int index, size_t fallback) {
+    return argc > index ? std::strtoull(argv[index], nullptr, 10) : fallback;
+}
+
+/* ====== Suites ====== */
+
+/**
+ * @brief Compares the heap footprint of many small sorted sets in both encodings.
+ * @details usage: zset-memory [sets=100000] [members=8]
+ */
+static void benchZSetMemory(int argc, char** argv) {
+    size_t set_count = argOr(argc, argv, 2, 100000);
+    size_t members = argOr(argc, argv, 3, 8);
+
+    const size_t default_entries = SortedSet::maxListpackEntries;
+
+    for (bool compact: {true, false}) {
+        SortedSet::maxListpackEntries = compact ? default_entries : 0;
+
+        size_t before = live_bytes;
+        auto start = Clock::now();
+        {
+            std::vector<SortedSet> sets(set_count);
+            for (size_t s = 0; s < set_count; ++s) {
+                for (size_t m = 0; m < members; ++m) {
+                    sets[s].add("user:" + std::to_string(m), static_cast<double>(m * 7 % members));
+                }
+            }
+            size_t used = live_bytes - before;
+
+            std::cout << (compact ? "listpack" : "avltree ") << ": "
+                      << set_count << " sets x " << members << " members, "
+                      << used / (1024.0 * 1024.0) << " MiB ("
+                      << static_cast<double>(used) / (set_count * members) << " bytes/member), "
+                      << elapsedMs(start) << " ms to build" << std::endl;
+        }
+    }
+
+    SortedSet::maxListpackEntries = default_entries;
+}
+
+/**
+ * @brief Compares the ordered index engines on insert, rank lookup and range scans.
+ * @details usage: zset-index [elements=1000000] [lookups=1000000] [scan-length=100]
+ */
+static void benchZSetIndex(int argc, char** argv) {
+    size_t elements = argOr(argc, argv, 2, 1000000);
+    size_t lookups = argOr(argc, argv, 3, 1000000);
+    size_t scan_length = argOr(argc, argv, 4, 100);
+
+    std::vector<std::pair<std::string, double>> pairs;
+    pairs.reserve(elements);
+    std::mt19937_64 rng(42);
+    for (size_t i = 0; i < elements; ++i) {
+        pairs.emplace_back("member:" + std::to_string(i), static_cast<double>(rng() % (elements * 4)));
+    }
+
+    std::vector<size_t> ranks(lookups);
+    for (auto& rank: ranks) rank = rng() % elements;
+
+    for (ZSetIndex::Engine engine: {ZSetIndex::Engine::AVL, ZSetIndex::Engine::BTREE}) {
+        size_t before = live_bytes;
+        std::unique_ptr<ZSetIndex> index = ZSetIndex::create(engine);
+
+        auto start = Clock::now();
+        for (const auto& pair: pairs) {
+            index->insert(pair.first, pair.second);
+        }
+        double insert_ms = elapsedMs(start);
+        size_t used = live_bytes - before;
+
+        double checksum = 0;
+        auto sum = [&checksum](const std::string&, double score) { checksum += score; };
+
+        start = Clock::now();
+        for (size_t rank: ranks) {
+            index->range(rank, 1, false, sum);
+        }
+        double rank_ms = elapsedMs(start);
+
+        start = Clock::now();
+        for (size_t rank: ranks) {
+            index->range(rank, scan_length, false, sum);
+        }
+        double scan_ms = elapsedMs(start);
+
+        std::cout << index->name() << ":\n"
+                  << "  insert " << elements << ": " << insert_ms << " ms ("
+                  << elements / insert_ms * 1000 << " ops/s), "
+                  << used / (1024.0 * 1024.0) << " MiB\n"
+                  << "  rank lookup x" << lookups << ": " << rank_ms << " ms ("
+                  << lookups / rank_ms * 1000 << " ops/s)\n"
+                  << "  range scan of " << scan_length << " x" << lookups << ": " << scan_ms << " ms ("
+                  << lookups * scan_length / scan_ms * 1000 << " elements/s)\n"
+                  << "  (checksum " << checksum << ")" << std::endl;
+    }
+}
+
+/**
+ * @brief Measures loading a large sorted set member by member vs. in one batch.
+ * @details usage: zadd-bulk [members=1000000]
+ * The merge case loads half of the members, then adds the other half as one batch.
+ */
+static void benchZAddBulk(int argc, char** argv) {
+    size_t members = argOr(argc, argv, 2, 1000000);
+
+    std::vector<ZSetEntry> entries;
+    entries.reserve(members);
+    std::mt19937_64 rng(7);
+    for (size_t i = 0; i < members; ++i) {
+        entries.push_back({"player:" + std::to_string(i), static_cast<double>(rng() % 1000000)});
+    }
+
+    const ZSetIndex::Engine default_engine = SortedSet::indexEngine;
+
+    for (ZSetIndex::Engine engine: {ZSetIndex::Engine::AVL, ZSetIndex::Engine::BTREE}) {
+        SortedSet::indexEngine = engine;
+        const char* name = engine == ZSetIndex::Engine::AVL ? "avltree" : "btree";
+
+        {
+            SortedSet zset;
+            auto start = Clock::now();
+            for (const auto& entry: entries) {
+                zset.add(entry.member, entry.score);
+            }
+            std::cout << name << ": " << members << " single adds: " << elapsedMs(start) << " ms" << std::endl;
+        }
+        {
+            SortedSet zset;
+            auto start = Clock::now();
+            zset.addMany(entries);
+            std::cout << name << ": " << members << " bulk load:   " << elapsedMs(start) << " ms" << std::endl;
+        }
+        {
+            SortedSet zset;
+            std::vector<ZSetEntry> first(entries.begin(), entries.begin() + members / 2);
+            std::vector<ZSetEntry> second(entries.begin() + members / 2, entries.end());
+            zset.addMany(std::move(first));
+
+            auto start = Clock::now();
+            zset.addMany(std::move(second));
+            std::cout << name << ": merge " << members - members / 2 << " into " << members / 2 << ": "
+                      << elapsedMs(start) << " ms" << std::endl;
+        }
+    }
+
+    SortedSet::indexEngine = default_engine;
+}
+
+/**
+ * @brief Measures loading snapshots of increasing size, before and after parallel decoding.
+ * @details usage: snapshot-load [keys=1000000] [threads=all cores]
+ * Snapshots of keys / 100, keys / 10 and keys string keys (one in ten with a
+ * TTL) are written to a temporary file, then loaded by one thread into a
+ * table left to grow, and by `threads` threads into a pre-sized table. The
+ * file was just written, so it is read from the page cache.
+ */
+static void benchSnapshotLoad(int argc, char** argv) {
+    size_t max_keys = argOr(argc, argv, 2, 1000000);
+    size_t threads = argOr(argc, argv, 3, std::max(std::thread::hardware_concurrency(), 1u));
+    const std::string path = "/tmp/redis-benchmark-" + std::to_string(getpid()) + ".rdb";
+
+    for (size_t keys: {max_keys / 100, max_keys / 10, max_keys}) {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            std::cerr << "Can't create " << path << std::endl;
+            return;
+        }
+        {
+            SnapshotWriter writer(fd, true);
+            DataEntry entry;
+            for (size_t i = 0; i < keys; ++i) {
+                entry.key = "key:" + std::to_string(i);
+                entry.value = "value:" + std::to_string(i * 7919);
+                entry.expire_at_ms = i % 10 == 0 ? 4102444800000 : 0;
+                writer.writeEntry(entry);
+            }
+            writer.finish();
+        }
+        off_t file_size = lseek(fd, 0, SEEK_END);
+        ::close(fd);
+
+        std::cout << keys << " keys (" << file_size / (1024.0 * 1024.0) << " MiB):" << std::endl;
+        for (bool parallel: {false, true}) {
+            const size_t decode_threads = parallel ? threads : 1;
+            SnapshotContents contents;
+            auto start = Clock::now();
+            readSnapshotFile(path, 0, decode_threads, contents);
+            double decode_ms = elapsedMs(start);
+
+            HashTable table;
+            start = Clock::now();
+            if (parallel) {
+                table.reserve(contents.keyCount);
+            }
+            for (auto& segment: contents.segments) {
+                for (auto& entry: segment) {
+                    table.insert(std::move(entry));
+                }
+            }
+            double link_ms = elapsedMs(start);
+
+            std::cout << (parallel ? "  " + std::to_string(decode_threads) + " thread(s), pre-sized table: " : "  1 thread, growing table:     ")
+                      << "decode " << decode_ms << " ms + link " << link_ms << " ms = "
+                      << decode_ms + link_ms << " ms (" << contents.segments.size() << " segments)" << std::endl;
+        }
+    }
+    ::unlink(path.c_str());
+}
+
+/**
+ * @brief Measures LZF's ratio and throughput on JSON documents.
+ * @details usage: lzf [documents=100000] [fields=20]
+ * Each document is a flat object of `fields` fields with a mix of repeated
+ * keys, numbers and words, like typical JSON values.
+ */
+static void benchLzf(int argc, char** argv) {
+    size_t documents = argOr(argc, argv, 2, 100000);
+    size_t fields = argOr(argc, argv, 3, 20);
+
+    static const char* words[] = {"alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel"};
+    std::mt19937_64 rng(3);
+    std::vector<std::string> docs(documents);
+    size_t raw_bytes = 0;
+    for (auto& doc: docs) {
+        doc = "{";
+        for (size_t f = 0; f < fields; ++f) {
+            doc += (f ? ",\"field_" : "\"field_") + std::to_string(f) + "\":";
+            if (f % 3 == 0) {
+                doc += std::to_string(rng() % 100000);
+            } else {
+                doc += std::string("\"") + words[rng() % 8] + " " + words[rng() % 8] + "\"";
+            }
+        }
+        doc += "}";
+        raw_bytes += doc.size();
+    }
+
+    std::vector<std::string> blobs(documents);
+    size_t blob_bytes = 0;
+    auto start = Clock::now();
+    for (size_t i = 0; i < documents; ++i) {
+        if (!lzf::compressString(docs[i], docs[i].size(), blobs[i])) {
+            blobs[i] = docs[i];
+        }
+        blob_bytes += blobs[i].size();
+    }
+    double compress_ms = elapsedMs(start);
+
+    std::string out;
+    size_t mismatches = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < documents; ++i) {
+        if (!lzf::decompressString(blobs[i], out) || out != docs[i]) ++mismatches;
+    }
+    double decompress_ms = elapsedMs(start);
+
+    std::cout << documents << " documents of " << raw_bytes / documents << " bytes: ratio "
+              << static_cast<double>(raw_bytes) / blob_bytes << "\n"
+              << "  compress:   " << compress_ms << " ms (" << raw_bytes / compress_ms / 1000 << " MB/s)\n"
+              << "  decompress: " << decompress_ms << " ms (" << raw_bytes / decompress_ms / 1000 << " MB/s)"
+              << (mismatches ? " MISMATCHES: " + std::to_string(mismatches) : "") << std::endl;
+}
+
+/**
+ * @brief Connects to the server on localhost, retrying for up to five seconds while it starts.
+ * @return The connected socket, or -1.
+ */
+static int connectLocal(uint16_t port) {
+    const auto deadline = Clock::now() + std::chrono::seconds(5);
+    while (Clock::now() < deadline) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+            return fd;
+        }
+        ::close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    return -1;
+}
+
+static bool readFull(int fd, uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::recv(fd, data, len, 0);
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool writeFull(int fd, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * @brief Measures how throughput scales with the number of shards.
+ * @details usage: shards [max-shards=all cores] [clients=32] [seconds=3] [pipeline=16] [port=7400]
+ * Starts `redis-server --shards N` for N = 1, 2, 4... up to `max-shards`, and
+ * has `clients` connections send pipelined batches of GET and SET on random
+ * keys for `seconds` each. With N shards, a request reaches the shard owning
+ * its key with probability 1/N and is forwarded otherwise; every eighth
+ * batch also has a DEL over keys of different shards, which pauses the
+ * others. The server binary is looked up next to this one.
+ */
+static void benchShards(int argc, char** argv) {
+    size_t max_shards = argOr(argc, argv, 2, std::max(std::thread::hardware_concurrency(), 1u));
+    size_t clients = argOr(argc, argv, 3, 32);
+    size_t seconds = argOr(argc, argv, 4, 3);
+    size_t pipeline = std::max<size_t>(argOr(argc, argv, 5, 16), 1);
+    const uint16_t port = static_cast<uint16_t>(argOr(argc, argv, 6, 7400));
+
+    std::string server = argv[0];
+    server = server.find('/') == std::string::npos ? "redis-server" : server.substr(0, server.rfind('/') + 1) + "redis-server";
+
+    std::vector<size_t> counts;
+    for (size_t n = 1; n < max_shards; n *= 2) counts.push_back(n);
+    counts.push_back(max_shards);
+
+    double baseline = 0;
+    for (size_t shards: counts) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int null_fd = ::open("/dev/null", O_WRONLY);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            const std::string port_arg = std::to_string(port), shards_arg = std::to_string(shards);
+            // Without a snapshot file to load and with none written on the way.
+            execl(server.c_str(), server.c_str(), "--port", port_arg.c_str(), "--shards", shards_arg.c_str(),
+                  "--dbfilename", "redis-benchmark-none.rdb", static_cast<char*>(nullptr));
+            _exit(127);
+        }
+
+        int probe = connectLocal(port);
+        if (probe < 0) {
+            kill(pid, SIGTERM);
+            waitpid(pid, nullptr, 0);
+            std::cerr << "Can't connect to " << server << " on port " << port << std::endl;
+            return;
+        }
+        ::close(probe);
+
+        std::atomic<size_t> ops{0};
+        std::atomic<bool> failed{false};
+        const auto deadline = Clock::now() + std::chrono::seconds(seconds);
+        auto start = Clock::now();
+
+        std::vector<std::thread> threads;
+        for (size_t c = 0; c < clients; ++c) {
+            threads.emplace_back([&, c]() {
+                int fd = connectLocal(port);
+                if (fd < 0) {
+                    failed = true;
+                    return;
+                }
+                std::mt19937_64 rng(c);
+                Buffer batch;
+                std::vector<uint8_t> reply;
+                size_t done = 0;
+                for (size_t round = 0; Clock::now() < deadline; ++round) {
+                    batch.clear();
+                    for (size_t i = 0; i < pipeline; ++i) {
+                        const std::string key = "key:" + std::to_string(rng() % 100000);
+                        if (round % 8 == 7 && i == 0) {
+                            appendCommand(batch, std::vector<std::string>{"del", key, "key:" + std::to_string(rng() % 100000)});
+                        } else if (i % 2 == 0) {
+                            appendCommand(batch, std::vector<std::string>{"set", key, "value"});
+                        } else {
+                            appendCommand(batch, std::vector<std::string>{"get", key});
+                        }
+                    }
+                    if (!writeFull(fd, batch.data(), batch.size())) break;
+
+                    bool ok = true;
+                    for (size_t i = 0; i < pipeline && ok; ++i) {
+                        uint32_t len = 0;
+                        ok = readFull(fd, reinterpret_cast<uint8_t*>(&len), 4);
+                        reply.resize(len);
+                        ok = ok && readFull(fd, reply.data(), len);
+                    }
+                    if (!ok) break;
+                    done += pipeline;
+                }
+                ops += done;
+                ::close(fd);
+            });
+        }
+        for (auto& thread: threads) thread.join();
+        double elapsed_s = elapsedMs(start) / 1000;
+
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+        if (failed) {
+            std::cerr << "Can't connect to " << server << " on port " << port << std::endl;
+            return;
+        }
+
+        const double rate = ops / elapsed_s;
+        if (shards == 1) baseline = rate;
+        std::cout << shards << " shard(s): " << static_cast<size_t>(rate) << " ops/s";
+        if (baseline > 0) std::cout << " (x" << rate / baseline << ")";
+        std::cout << std::endl;
+        // Let the kernel release the port before the next server binds it.
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+int main(int argc, char** argv) {
+    const std::map<std::string, void(*)(int, char**)> suites = {
+        {"zset-memory", benchZSetMemory},
+        {"zset-index", benchZSetIndex},
+        {"zadd-bulk", benchZAddBulk},
+        {"snapshot-load", benchSnapshotLoad},
+        {"lzf", benchLzf},
+        {"shards", benchShards},
+    };
+
+    auto it = argc > 1 ? suites.find(argv[1]) : suites.end();
+    if (it == suites.end()) {
+        std::cerr << "Usage: ./redis-benchmark <suite> [args...]\nSuites:";
+        for (const auto& suite: suites) std::cerr << " " << suite.first;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    it->second(argc, argv);
+    return 0;
+}
@@ -1,18 +1,63 @@
 #include <net/Client.hpp>
 #include <common/Deserialization.hpp>
+#include <common/Serialization.hpp>
 #include <cstring>
+#include <algorithm>
+#include <memory>
+
+/// @brief How many redirections are followed before giving up, as a slot may be moving back and forth.
+static const int MAX_REDIRECTS = 16;
+
+/**
+ * @brief Parses a cluster redirection, "MOVED <slot> <host>:<port>" or "ASK <slot> <host>:<port>".
+ * @return false if `res` is any other reply.
+ */
+static bool parseRedirect(const Buffer &res, bool &ask, std::string &host, uint16_t &port) {
+    if (res.size() < 9 || res[0] != RES_ERR) return false;
+    size_t offset = 1;
+    if (readAs<uint32_t>(res, offset) != ERR_REDIRECT) return false;
+    const uint32_t len = readAs<uint32_t>(res, offset);
+    if (offset + len > res.size()) return false;
+    const std::string message(res.begin() + offset, res.begin() + offset + len);
+
+    const size_t space = message.rfind(' ');
+    const size_t colon = message.rfind(':');
+    if (space == std::string::npos || colon == std::string::npos || colon < space) return false;
+    ask = message.compare(0, 4, "ASK ") == 0;
+    host = message.substr(space + 1, colon - space - 1);
+    port = static_cast<uint16_t>(strtoul(message.c_str() + colon + 1, nullptr, 10));
+    return true;
+}
 
 int main(int argc, char **argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: ./redis-cli <command> [args...]" << std::endl;
+    std::string host = "127.0.0.1";
+    uint16_t port = 6379;
+    bool cluster = false;
+
+    int first = 1;
+    for (; first < argc; ++first) {
+        if (strcmp(argv[first], "-h") == 0 && first + 1 < argc) {
+            host = argv[++first];
+        } else if (strcmp(argv[first], "-p") == 0 && first + 1 < argc) {
+            port = static_cast<uint16_t>(strtoul(argv[++first], nullptr, 10));
+        } else if (strcmp(argv[first], "-c") == 0) {
+            cluster = true;
+        } else {
+            break;
+        }
+    }
+
+    if (first >= argc) {
+        std::cerr << "Usage: ./redis-cli [-h host] [-p port] [-c] <command> [args...]" << std::endl;
+        std::cerr << "  -c  Cluster mode: follow MOVED and ASK redirections." << std::endl;
         return 1;
     }
 
     try {
-        Client client("127.0.0.1", 6379); // Connect to the Redis port
+        auto client = std::make_unique<Client>(host, port);
 
         std::vector<std::string> request_cmd;
-        for (int i = 1; i < argc; ++i) {
+        for (int i = first; i < argc; ++i) {
             request_cmd.push_back(argv[i]);
         }
 
@@ -20,14 +65,36 @@ int main(int argc, char **argv) {
         for (const auto &s: request_cmd) { std::cout << s << " "; }
         std::cout << std::endl;
 
-        client.send(request_cmd);
-        Buffer res = client.recv();
+        client->send(request_cmd);
+        Buffer res = client->recv();
+
+        // An ASK redirection holds for this request only: the node is asked with ASKING first.
+        bool ask;
+        for (int redirects = 0; cluster && redirects < MAX_REDIRECTS && parseRedirect(res, ask, host, port); ++redirects) {
+            std::cout << "-> Redirected to " << (ask ? "(asking) " : "") << host << ":" << port << std::endl;
+            client = std::make_unique<Client>(host, port);
+            if (ask) {
+                client->send({"ASKING"});
+                client->recv();
+            }
+            client->send(request_cmd);
+            res = client->recv();
+        }
 
         if(res.empty()) {
             std::cerr << "Received empty response from server." << std::endl;
         } else {
             printResponse(res, 0, 0);
         }
+
+        // A subscribed connection keeps receiving messages until it is closed.
+        std::string command = request_cmd[0];
+        std::transform(command.begin(), command.end(), command.begin(), ::tolower);
+        if(command == "subscribe" || command == "psubscribe") {
+            while(true) {
+                printResponse(client->recv(), 0, 0);
+            }
+        }
     } catch (const std::exception& e) {
         std::cerr << "Fatal error: " << e.what() << std::endl;
         return 1;
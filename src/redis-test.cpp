@@ -0,0 +1,715 @@
+#include <core/HashTable.hpp>
+#include <core/ZSetIndex.hpp>
+#include <common/HashSlot.hpp>
+#include <server/Redis.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <csignal>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @file redis-test.cpp
+ * @brief Deterministic checks of the core data structures and of the server.
+ * @details `make test` runs every suite; `./bin/redis-test <suite>` runs one.
+ * A failed check prints its location and the run exits with status 1. The
+ * server suites start the `redis-server` next to this binary on a port of
+ * their own and talk to it over loopback connections.
+ */
+
+static size_t failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+            ++failures; \
+        } \
+    } while (0)
+
+/* ====== Talking to a server ====== */
+
+static std::string serverPath;
+
+/**
+ * @class TestServer
+ * @brief A `redis-server` child process, stopped when the object goes away.
+ */
+class TestServer {
+public:
+    /**
+     * @brief Starts the server on `port` with extra command-line arguments,
+     * and waits until it accepts connections.
+     * @return false if the port is taken, or if it didn't come up within five seconds.
+     */
+    bool start(uint16_t port, std::vector<std::string> args = {}) {
+        this->port = port;
+        if (probe()) {
+            std::cerr << "Port " << port << " is already in use" << std::endl;
+            return false;
+        }
+        args.insert(args.begin(), {serverPath, "--port", std::to_string(port), "--dbfilename", "redis-test-none.rdb"});
+        pid = fork();
+        if (pid == 0) {
+            int null_fd = ::open("/dev/null", O_WRONLY);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            std::vector<char*> argv;
+            for (auto& arg: args) argv.push_back(arg.data());
+            argv.push_back(nullptr);
+            execv(serverPath.c_str(), argv.data());
+            _exit(127);
+        }
+
+        int probe = connect();
+        if (probe < 0) {
+            std::cerr << "Can't connect to " << serverPath << " on port " << port << std::endl;
+            return false;
+        }
+        ::close(probe);
+        return true;
+    }
+
+    /**
+     * @brief Connects to the server, retrying for up to five seconds while it starts.
+     * @return The connected socket, or -1.
+     */
+    int connect() const {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (std::chrono::steady_clock::now() < deadline) {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+                return fd;
+            }
+            ::close(fd);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Tells whether anything accepts connections on the port.
+     */
+    bool probe() const {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        const bool accepted = ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+        ::close(fd);
+        return accepted;
+    }
+
+    ~TestServer() {
+        if (pid > 0) {
+            kill(pid, SIGTERM);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+
+private:
+    pid_t pid = -1;
+    uint16_t port = 0;
+};
+
+static bool readFull(int fd, uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::recv(fd, data, len, 0);
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool writeFull(int fd, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * @brief Renders the reply at `offset` as text: strings as they are,
+ * integers in decimal, `(nil)`, `(err) <message>` and `[a,b,...]`.
+ */
+static std::string renderReply(const Buffer& reply, size_t& offset) {
+    auto u32 = [&]() {
+        uint32_t value = 0;
+        if (offset + 4 <= reply.size()) memcpy(&value, reply.data() + offset, 4);
+        offset += 4;
+        return value;
+    };
+    if (offset >= reply.size()) return "(truncated)";
+
+    switch (reply[offset++]) {
+        case RES_NIL:
+            return "(nil)";
+        case RES_ERR: {
+            u32();
+            const uint32_t len = u32();
+            offset += len;
+            return "(err) " + std::string(reply.begin() + offset - len, reply.begin() + offset);
+        }
+        case RES_STR: {
+            const uint32_t len = u32();
+            offset += len;
+            return std::string(reply.begin() + offset - len, reply.begin() + offset);
+        }
+        case RES_INT: {
+            int64_t value = 0;
+            memcpy(&value, reply.data() + offset, 8);
+            offset += 8;
+            return std::to_string(value);
+        }
+        case RES_ARR: {
+            const uint32_t count = u32();
+            std::string out = "[";
+            for (uint32_t i = 0; i < count; ++i) {
+                if (i > 0) out += ",";
+                out += renderReply(reply, offset);
+            }
+            return out + "]";
+        }
+    }
+    return "(unknown reply type)";
+}
+
+/**
+ * @brief Reads one framed reply and renders it (see `renderReply`).
+ */
+static std::string readReply(int fd) {
+    uint32_t len = 0;
+    if (!readFull(fd, reinterpret_cast<uint8_t*>(&len), 4)) return "(connection closed)";
+    Buffer reply(len);
+    if (!readFull(fd, reply.data(), len)) return "(connection closed)";
+    size_t offset = 0;
+    return renderReply(reply, offset);
+}
+
+/**
+ * @brief Sends the commands in one write and returns their rendered replies.
+ */
+static std::vector<std::string> pipeline(int fd, const std::vector<std::vector<std::string>>& commands) {
+    Buffer batch;
+    for (const auto& command: commands) appendCommand(batch, command);
+    std::vector<std::string> replies;
+    if (!writeFull(fd, batch.data(), batch.size())) return replies;
+    for (size_t i = 0; i < commands.size(); ++i) replies.push_back(readReply(fd));
+    return replies;
+}
+
+static std::string call(int fd, const std::vector<std::string>& command) {
+    std::vector<std::string> replies = pipeline(fd, {command});
+    return replies.empty() ? "(connection closed)" : replies[0];
+}
+
+/* ====== Hash table ====== */
+
+struct NumberNode: public HashTable::Node {
+    size_t number = 0;
+};
+
+static std::unique_ptr<HashTable::Node> numberNode(size_t number) {
+    auto node = std::make_unique<NumberNode>();
+    node->number = number;
+    node->hashCode = HashTable::hashString(std::to_string(number));
+    return node;
+}
+
+static bool sameNumber(HashTable::Node* a, HashTable::Node* b) {
+    return static_cast<NumberNode*>(a)->number == static_cast<NumberNode*>(b)->number;
+}
+
+static bool contains(HashTable& table, size_t number) {
+    auto probe = numberNode(number);
+    return table.lookup(probe.get(), sameNumber) != nullptr;
+}
+
+/**
+ * @brief Walks the table with `forEach` while probing eight numbers of
+ * `present` from each callback, and checks that each was visited exactly once.
+ */
+static void checkWalkWhileProbing(HashTable& table, const std::vector<size_t>& present, size_t limit) {
+    std::vector<size_t> visits(limit, 0);
+    size_t misses = 0;
+    table.forEach([&](HashTable::Node* node) {
+        const size_t number = static_cast<NumberNode*>(node)->number;
+        ++visits[number];
+        for (size_t k = 0; k < 8; ++k) {
+            if (!contains(table, present[(number + k * present.size() / 8) % present.size()])) ++misses;
+        }
+    });
+
+    CHECK(misses == 0);
+    size_t visited_once = 0;
+    for (size_t number: present) visited_once += visits[number] == 1;
+    CHECK(visited_once == present.size());
+    CHECK(static_cast<size_t>(std::count(visits.begin(), visits.end(), 0)) == limit - present.size());
+}
+
+/**
+ * @brief Lookups made from a `forEach` callback while the table shrinks, and
+ * while it grows.
+ * @details Removing all but 409 of 20000 numbers takes the table under its
+ * minimum fill, so it starts shrinking. Nodes of a shrinking table move to
+ * slots the walk may already have passed, and the older table is freed once
+ * empty: the lookups must not move anything until the walk is over.
+ */
+static void testHashTable() {
+    const size_t count = 20000;
+    HashTable table;
+    for (size_t i = 0; i < count; ++i) table.insert(numberNode(i));
+
+    std::vector<size_t> kept;
+    for (size_t i = 0; i < count; ++i) {
+        if (i % 49 == 0) {
+            kept.push_back(i);
+            continue;
+        }
+        auto probe = numberNode(i);
+        CHECK(table.remove(probe.get(), sameNumber) != nullptr);
+    }
+    CHECK(table.size() == kept.size());
+    CHECK(table.isRehashing());
+
+    checkWalkWhileProbing(table, kept, count);
+    // Paused during the walk, the shrink goes on afterwards.
+    CHECK(table.isRehashing());
+    for (size_t i = 0; i < count && table.isRehashing(); ++i) contains(table, 0);
+    CHECK(!table.isRehashing());
+    for (size_t number: kept) CHECK(contains(table, number));
+
+    // Grow until a rehash is in progress, then walk again.
+    std::vector<size_t> all;
+    for (size_t i = 0; i < count; ++i) {
+        if (i % 49 != 0) table.insert(numberNode(i));
+        all.push_back(i);
+    }
+    while (!table.isRehashing()) {
+        table.insert(numberNode(all.size()));
+        all.push_back(all.size());
+    }
+    checkWalkWhileProbing(table, all, all.size());
+
+    // SCAN callbacks may probe too.
+    std::vector<size_t> scanned(all.size(), 0);
+    size_t cursor = 0;
+    do {
+        cursor = table.scan(cursor, [&](HashTable::Node* node) {
+            ++scanned[static_cast<NumberNode*>(node)->number];
+            contains(table, all.size() - 1 - static_cast<NumberNode*>(node)->number);
+        });
+    } while (cursor != 0);
+    CHECK(std::count(scanned.begin(), scanned.end(), 0) == 0);
+}
+
+/* ====== Sorted set index engines ====== */
+
+using Pairs = std::vector<std::pair<std::string, double>>;
+
+static Pairs collectRange(ZSetIndex& index, size_t start, size_t count, bool reverse) {
+    Pairs pairs;
+    index.range(start, count, reverse, [&pairs](const std::string& member, double score) {
+        pairs.emplace_back(member, score);
+    });
+    return pairs;
+}
+
+/**
+ * @brief Runs the same random operations on the AVL and B+tree engines and on
+ * a sorted vector, comparing ranks and ranges after each one.
+ * @details Scores are drawn from a small range so that ties (ordered by
+ * member) are common, and the set is grown and drained several times so that
+ * B+tree nodes split, merge and rebuild from bulk loads.
+ */
+static void testZSetIndex() {
+    std::mt19937_64 rng(7);
+    std::vector<ZSetEntry> model;
+    std::map<std::string, double> scores;
+    std::unique_ptr<ZSetIndex> engines[] = {
+        ZSetIndex::create(ZSetIndex::Engine::AVL),
+        ZSetIndex::create(ZSetIndex::Engine::BTREE),
+    };
+
+    auto model_insert = [&model](const ZSetEntry& entry) {
+        model.insert(std::lower_bound(model.begin(), model.end(), entry), entry);
+    };
+    auto model_erase = [&model](const ZSetEntry& entry) {
+        model.erase(std::lower_bound(model.begin(), model.end(), entry));
+    };
+    auto expected_range = [&model](size_t start, size_t count, bool reverse) {
+        Pairs pairs;
+        for (size_t rank = start; rank < model.size() && pairs.size() < count; ++rank) {
+            const ZSetEntry& entry = model[reverse ? model.size() - 1 - rank : rank];
+            pairs.emplace_back(entry.member, entry.score);
+        }
+        return pairs;
+    };
+
+    const size_t rounds = 4;
+    const size_t steps = 20000;
+    for (size_t round = 0; round < rounds; ++round) {
+        // Grow for the first half of the round, drain for the second.
+        for (size_t step = 0; step < steps; ++step) {
+            const bool growing = step < steps / 2;
+            const std::string member = "m" + std::to_string(rng() % 6000);
+            const double score = static_cast<double>(rng() % 500);
+            auto existing = scores.find(member);
+
+            switch (rng() % 8) {
+                case 0: case 1: case 2:
+                    if (existing == scores.end() && growing) {
+                        for (auto& engine: engines) engine->insert(member, score);
+                        model_insert({member, score});
+                        scores[member] = score;
+                    } else if (existing != scores.end() && !growing) {
+                        for (auto& engine: engines) CHECK(engine->remove(member, existing->second));
+                        model_erase({member, existing->second});
+                        scores.erase(existing);
+                    }
+                    break;
+                case 3:
+                    if (existing != scores.end()) {
+                        // Small moves mostly stay between the neighbours, and are rewritten in place.
+                        const double new_score = rng() % 2 ? existing->second + 1 : score;
+                        for (auto& engine: engines) engine->updateScore(member, existing->second, new_score);
+                        model_erase({member, existing->second});
+                        model_insert({member, new_score});
+                        existing->second = new_score;
+                    }
+                    break;
+                case 4:
+                    for (auto& engine: engines) CHECK(!engine->remove(member, score + 1000));
+                    break;
+                case 5:
+                    if (step % 97 == 0 && growing) {
+                        std::vector<ZSetEntry> batch;
+                        for (size_t i = 0; i < 300; ++i) {
+                            const std::string fresh = "b" + std::to_string(round) + ":" + std::to_string(step) + ":" + std::to_string(i);
+                            batch.push_back({fresh, static_cast<double>(rng() % 500)});
+                        }
+                        std::sort(batch.begin(), batch.end());
+                        for (auto& engine: engines) engine->insertSorted(batch);
+                        for (const ZSetEntry& entry: batch) {
+                            model_insert(entry);
+                            scores[entry.member] = entry.score;
+                        }
+                    } else if (step % 89 == 0 && !growing) {
+                        const size_t count = rng() % 50;
+                        const bool reverse = rng() % 2;
+                        Pairs popped[2];
+                        for (size_t e = 0; e < 2; ++e) {
+                            engines[e]->pop(count, reverse, [&](const std::string& m, double s) { popped[e].emplace_back(m, s); });
+                        }
+                        CHECK(popped[0] == expected_range(0, count, reverse));
+                        CHECK(popped[1] == popped[0]);
+                        for (const auto& pair: popped[0]) {
+                            model_erase({pair.first, pair.second});
+                            scores.erase(pair.first);
+                        }
+                    }
+                    break;
+                default: {
+                    // A rank lookup and a short range, from either end.
+                    const size_t size = model.size();
+                    const size_t rank = size ? rng() % (size + 2) : 0;
+                    const size_t count = 1 + rng() % 40;
+                    const bool reverse = rng() % 2;
+                    const Pairs expected = expected_range(rank, count, reverse);
+                    for (auto& engine: engines) {
+                        CHECK(collectRange(*engine, rank, count, reverse) == expected);
+                    }
+                    break;
+                }
+            }
+
+            for (auto& engine: engines) CHECK(engine->size() == model.size());
+            if (failures > 0) {
+                std::cerr << "zset-index: diverged at round " << round << ", step " << step << std::endl;
+                return;
+            }
+        }
+
+        const Pairs all = expected_range(0, model.size(), false);
+        for (auto& engine: engines) CHECK(collectRange(*engine, 0, model.size(), false) == all);
+    }
+
+    for (auto& engine: engines) {
+        engine->clear();
+        CHECK(engine->size() == 0);
+        CHECK(collectRange(*engine, 0, 10, false).empty());
+    }
+}
+
+/* ====== Sorted set commands ====== */
+
+/**
+ * @brief ZUNIONSTORE, ZINTERSTORE and ZDIFFSTORE given the same key twice,
+ * while its member table is shrinking.
+ * @details Removing all but 409 of 20000 members leaves the member table
+ * under its minimum fill, so it starts shrinking on the last removal: the
+ * command then walks a table whose members move as the other copy of the key
+ * is probed. With weights 1 and 2, every member counts three times.
+ */
+static void testZSetStore() {
+    TestServer server;
+    if (!server.start(7501)) {
+        CHECK(false);
+        return;
+    }
+    int fd = server.connect();
+
+    const size_t members = 20000;
+    auto kept = [](size_t i) { return i % 49 == 0; };
+    std::string kept_members = "[";
+    for (size_t i = 0; i < members; i += 49) {
+        kept_members += (i > 0 ? ",m" : "m") + std::to_string(i);
+    }
+    kept_members += "]";
+
+    auto shrinking = [&](const std::string& key) {
+        std::vector<std::vector<std::string>> commands;
+        for (size_t i = 0; i < members; i += 1000) {
+            std::vector<std::string> zadd = {"zadd", key};
+            for (size_t j = i; j < i + 1000; ++j) {
+                zadd.push_back(std::to_string(j));
+                zadd.push_back("m" + std::to_string(j));
+            }
+            commands.push_back(std::move(zadd));
+        }
+        for (size_t i = 0; i < members; ++i) {
+            if (!kept(i)) commands.push_back({"zrem", key, "m" + std::to_string(i)});
+        }
+        pipeline(fd, commands);
+        CHECK(call(fd, {"zrange", key, "0", "-1"}) == kept_members);
+        CHECK(call(fd, {"object", "encoding", key}) != "listpack");
+    };
+    auto check_tripled = [&](const std::string& destination) {
+        std::vector<std::vector<std::string>> commands;
+        std::vector<std::string> expected;
+        for (size_t i = 0; i < members; ++i) {
+            if (!kept(i)) continue;
+            commands.push_back({"zscore", destination, "m" + std::to_string(i)});
+            expected.push_back(std::to_string(3.0 * i));
+        }
+        CHECK(pipeline(fd, commands) == expected);
+    };
+
+    shrinking("union");
+    CHECK(call(fd, {"zunionstore", "dest", "2", "union", "union", "weights", "1", "2"}) == "409");
+    check_tripled("dest");
+
+    shrinking("inter");
+    CHECK(call(fd, {"zinterstore", "dest", "2", "inter", "inter", "weights", "1", "2"}) == "409");
+    check_tripled("dest");
+
+    shrinking("diff");
+    CHECK(call(fd, {"zdiffstore", "dest", "2", "diff", "diff"}) == "0");
+    CHECK(call(fd, {"zrange", "dest", "0", "-1"}) == "[]");
+
+    CHECK(call(fd, {"zrange", "union", "0", "-1"}) == kept_members);
+    ::close(fd);
+}
+
+/* ====== Sharded mode ====== */
+
+/**
+ * @brief Reads an INFO field on the connection's shard, or "" if it is missing.
+ */
+static std::string infoField(int fd, const std::string& field) {
+    const std::string info = call(fd, {"info"});
+    const size_t start = info.find("\n" + field + ":");
+    if (start == std::string::npos) return "";
+    const size_t value = start + field.size() + 2;
+    return info.substr(value, info.find('\r', value) - value);
+}
+
+/**
+ * @brief Polls an INFO field for up to two seconds until it reads `expected`.
+ */
+static bool waitForInfo(int fd, const std::string& field, const std::string& expected) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (infoField(fd, field) != expected) {
+        if (std::chrono::steady_clock::now() >= deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+/**
+ * @brief Pipelined requests on a `--shards 4` server come back in request
+ * order, and a client that leaves while blocked on another shard is cancelled there.
+ * @details Several clients send batches mixing requests for their own shard
+ * and forwarded ones (SET, GET, RPUSH), cross-shard DELs that park the other
+ * shards, and PINGs answered on the spot. The replies are checked against a
+ * model of each client's keys, which only matches if they arrive in order.
+ *
+ * Then a client blocks in BLPOP on a key of another shard, which waits on a
+ * stand-in connection there, and disconnects: the owning shard must drop the
+ * stand-in (CANCEL), or it would pop the next pushed element for nobody.
+ */
+static void testShards() {
+    const size_t shards = 4;
+    TestServer server;
+    if (!server.start(7502, {"--shards", std::to_string(shards)})) {
+        CHECK(false);
+        return;
+    }
+
+    std::atomic<size_t> mismatches{0};
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < 4; ++c) {
+        clients.emplace_back([&, c]() {
+            int fd = server.connect();
+            std::mt19937_64 rng(c);
+            std::map<std::string, std::string> strings;
+            std::map<std::string, size_t> lists;
+            const std::string prefix = "c" + std::to_string(c) + ":";
+
+            for (size_t batch = 0; batch < 20; ++batch) {
+                std::vector<std::vector<std::string>> commands;
+                std::vector<std::string> expected;
+                for (size_t i = 0; i < 200; ++i) {
+                    const std::string key = prefix + "k" + std::to_string(rng() % 300);
+                    const std::string tag = std::to_string(batch) + ":" + std::to_string(i);
+                    switch (rng() % 6) {
+                        case 0: case 1:
+                            commands.push_back({"set", key, "v" + tag});
+                            expected.push_back("(nil)");
+                            strings[key] = "v" + tag;
+                            break;
+                        case 2: {
+                            commands.push_back({"get", key});
+                            auto it = strings.find(key);
+                            expected.push_back(it == strings.end() ? "(nil)" : it->second);
+                            break;
+                        }
+                        case 3: {
+                            const std::string other = prefix + "k" + std::to_string(rng() % 300);
+                            commands.push_back({"del", key, other});
+                            size_t deleted = strings.erase(key);
+                            deleted += strings.erase(other);
+                            expected.push_back(std::to_string(deleted));
+                            break;
+                        }
+                        case 4:
+                            commands.push_back({"ping", "p" + tag});
+                            expected.push_back("p" + tag);
+                            break;
+                        default: {
+                            const std::string list = prefix + "l" + std::to_string(rng() % 40);
+                            commands.push_back({"rpush", list, tag});
+                            expected.push_back(std::to_string(++lists[list]));
+                            break;
+                        }
+                    }
+                }
+
+                const std::vector<std::string> replies = pipeline(fd, commands);
+                for (size_t i = 0; i < expected.size(); ++i) {
+                    if (i >= replies.size() || replies[i] != expected[i]) {
+                        if (mismatches++ == 0) {
+                            std::cerr << "shards: client " << c << ", batch " << batch << ", request " << i << ": expected "
+                                      << expected[i] << ", got " << (i < replies.size() ? replies[i] : "nothing") << std::endl;
+                        }
+                    }
+                }
+            }
+            ::close(fd);
+        });
+    }
+    for (auto& client: clients) client.join();
+    CHECK(mismatches == 0);
+
+    // Block on a key of another shard than the client's.
+    int blocked = server.connect();
+    const size_t home = strtoull(infoField(blocked, "shard_id").c_str(), nullptr, 10);
+    std::string key;
+    for (size_t i = 0; key.empty() || keyHashSlot(key) % shards == home; ++i) {
+        key = "blocked:" + std::to_string(i);
+    }
+    const size_t owner = keyHashSlot(key) % shards;
+    Buffer blpop;
+    appendCommand(blpop, std::vector<std::string>{"blpop", key, "0"});
+    CHECK(writeFull(blocked, blpop.data(), blpop.size()));
+
+    // Connections are spread over the shards by the kernel: look for one on the owner.
+    int observer = -1;
+    for (size_t attempt = 0; attempt < 64 && observer < 0; ++attempt) {
+        int fd = server.connect();
+        if (strtoull(infoField(fd, "shard_id").c_str(), nullptr, 10) == owner) {
+            observer = fd;
+        } else {
+            ::close(fd);
+        }
+    }
+    if (observer >= 0) {
+        CHECK(waitForInfo(observer, "remote_blocked_clients", "1"));
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+
+    ::close(blocked);
+    int fd = server.connect();
+    if (observer >= 0) {
+        CHECK(waitForInfo(observer, "remote_blocked_clients", "0"));
+        ::close(observer);
+    } else {
+        std::cerr << "shards: no connection landed on shard " << owner << ", only checking the list" << std::endl;
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    CHECK(call(fd, {"rpush", key, "x"}) == "1");
+    CHECK(call(fd, {"lrange", key, "0", "-1"}) == "[x]");
+    ::close(fd);
+}
+
+int main(int argc, char** argv) {
+    const std::map<std::string, void(*)()> suites = {
+        {"hashtable", testHashTable},
+        {"shards", testShards},
+        {"zset-index", testZSetIndex},
+        {"zset-store", testZSetStore},
+    };
+
+    serverPath = argv[0];
+    serverPath = serverPath.find('/') == std::string::npos ? "redis-server" : serverPath.substr(0, serverPath.rfind('/') + 1) + "redis-server";
+
+    if (argc > 1 && !suites.count(argv[1])) {
+        std::cerr << "Usage: ./redis-test [suite]\nSuites:";
+        for (const auto& suite: suites) std::cerr << " " << suite.first;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    for (const auto& suite: suites) {
+        if (argc > 1 && suite.first != argv[1]) continue;
+        const size_t before = failures;
+        suite.second();
+        std::cout << suite.first << ": " << (failures == before ? "ok" : "FAILED") << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -1,12 +1,84 @@
 #include <server/Redis.hpp>
+#include <thread>
+
+/**
+ * @brief Starts the server: `redis-server [--port <port>] [--shards <count>] [--<config-parameter> <value> ...]`.
+ * @details Any CONFIG parameter can be given on the command line, such as
+ * `--appendonly yes`; they are applied before the data is loaded.
+ * With `--shards`, the keyspace is partitioned over that many shards, each
+ * running on its own thread (see Sharding.cpp).
+ */
+int main(int argc, char* argv[]) {
+    uint16_t port = 6379; // Default Redis port
+    size_t shard_count = 0;
+    std::vector<std::pair<std::string, std::string>> options;
+
+    for (int i = 1; i < argc; i += 2) {
+        std::string name = argv[i];
+        if (name.size() < 3 || name.compare(0, 2, "--") != 0 || i + 1 >= argc) {
+            std::cerr << "Usage: " << argv[0] << " [--port <port>] [--shards <count>] [--<config-parameter> <value> ...]" << std::endl;
+            return EXIT_FAILURE;
+        }
+        name = name.substr(2);
+        if (name == "port") {
+            char* end;
+            long value = strtol(argv[i + 1], &end, 10);
+            if (*end != '\0' || value <= 0 || value > 65535) {
+                std::cerr << "Invalid port " << argv[i + 1] << std::endl;
+                return EXIT_FAILURE;
+            }
+            port = static_cast<uint16_t>(value);
+        } else if (name == "shards") {
+            char* end;
+            long value = strtol(argv[i + 1], &end, 10);
+            if (*end != '\0' || value <= 0 || value > 1024) {
+                std::cerr << "Invalid shard count " << argv[i + 1] << std::endl;
+                return EXIT_FAILURE;
+            }
+            shard_count = static_cast<size_t>(value);
+        } else {
+            options.emplace_back(name, argv[i + 1]);
+        }
+    }
 
-int main() {
     try {
-        RedisServer server(6379); // Default Redis port
-        server.run();
+        if (shard_count == 0) {
+            RedisServer server(port);
+            for (const auto& [name, value]: options) {
+                if (!server.setConfig(name, value)) {
+                    std::cerr << "Invalid option --" << name << " " << value << std::endl;
+                    return EXIT_FAILURE;
+                }
+            }
+            server.loadDataFromDisk();
+            server.run();
+            return EXIT_SUCCESS;
+        }
+
+        // Every shard is set up and loaded before any of them runs.
+        ShardSet shard_set(shard_count);
+        std::vector<std::unique_ptr<RedisServer>> servers;
+        for (size_t i = 0; i < shard_count; ++i) {
+            servers.push_back(std::make_unique<RedisServer>(port, &shard_set, i));
+            for (const auto& [name, value]: options) {
+                if (!servers.back()->setConfig(name, value)) {
+                    std::cerr << "Invalid option --" << name << " " << value << " in sharded mode" << std::endl;
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        for (auto& server: servers) {
+            server->loadDataFromDisk();
+        }
+
+        // The shards never return; the first runs on this thread.
+        for (size_t i = 1; i < shard_count; ++i) {
+            std::thread([server = servers[i].get()]() { server->run(); }).detach();
+        }
+        servers[0]->run();
     } catch (const std::exception& e) {
         std::cerr << "Server error: " << e.what() << std::endl;
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,451 @@
+#include <server/Redis.hpp>
+#include <common/FileIo.hpp>
+#include <common/Lzf.hpp>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * @file AppendOnly.cpp
+ * @brief Implements the append-only file: logging writes, replaying them on startup, and rewriting the log.
+ * @details Every write command is logged in the wire format clients send it
+ * in (a length-prefixed message per command), so replaying the file is just
+ * executing its messages in order. Commands whose effect depends on when
+ * they run are logged in a deterministic form instead: relative TTLs as
+ * PEXPIREAT, pops served to blocked clients as plain pops, and keys deleted
+ * by expiry or eviction as DEL (see `rewrittenCommand` and `propagate`).
+ *
+ * Commands are collected into `aofBuffer` and written out once per event
+ * loop iteration; AppendOnlyFile.hpp describes how the file is synced.
+ *
+ * The log only ever grows, so it is rewritten in the background: a forked
+ * child writes the keyspace it inherited as the shortest log that recreates
+ * it, while the parent keeps appending to the old file and also buffers the
+ * commands executed meanwhile. Once the child is done, the parent appends
+ * that buffer to the new log and renames it over the old one.
+ */
+
+/// @brief The most elements a rewritten command adds, which keeps commands well below the message size limit.
+static const size_t REWRITE_ITEMS_PER_COMMAND = 64;
+
+static std::string rewriteTempName(pid_t pid) {
+    return "temp-rewriteaof-" + std::to_string(pid) + ".aof";
+}
+
+/**
+ * @brief Formats a score so that parsing it back yields the same double.
+ */
+static std::string formatScore(double score) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.17g", score);
+    return buffer;
+}
+
+/**
+ * @brief Writes the commands that recreate `entry` to `out`.
+ */
+static void rewriteEntry(Buffer& out, DataEntry& entry) {
+    // Collections are recreated by commands of up to REWRITE_ITEMS_PER_COMMAND elements each.
+    std::vector<std::string> args;
+    size_t items = 0;
+    auto start = [&](const char* command) {
+        args = {command, entry.key};
+        items = 0;
+    };
+    auto added = [&]() {
+        if (++items == REWRITE_ITEMS_PER_COMMAND) {
+            appendCommand(out, args);
+            args.resize(2);
+            items = 0;
+        }
+    };
+    auto finish = [&]() {
+        if (items > 0) appendCommand(out, args);
+    };
+
+    if (auto* str = std::get_if<std::string>(&entry.value)) {
+        // The log holds the string itself: replaying the SET compresses it again.
+        std::string raw;
+        if (entry.compressed) {
+            lzf::decompressString(*str, raw);
+        }
+        appendCommand(out, std::vector<std::string_view>{"set", entry.key, entry.compressed ? raw : *str});
+    } else if (auto* zset = std::get_if<SortedSet>(&entry.value)) {
+        start("zadd");
+        zset->forEach([&](const std::string& member, double score) {
+            args.push_back(formatScore(score));
+            args.push_back(member);
+            added();
+        });
+        finish();
+    } else if (auto* hash = std::get_if<Hash>(&entry.value)) {
+        start("hset");
+        hash->forEach([&](std::string_view field, std::string_view value) {
+            args.emplace_back(field);
+            args.emplace_back(value);
+            added();
+        });
+        finish();
+    } else if (auto* set = std::get_if<Set>(&entry.value)) {
+        start("sadd");
+        set->forEach([&](std::string_view member) {
+            args.emplace_back(member);
+            added();
+        });
+        finish();
+    } else {
+        List& list = std::get<List>(entry.value);
+        start("rpush");
+        if (list.size() > 0) {
+            list.range(0, list.size() - 1, [&](std::string_view element) {
+                args.emplace_back(element);
+                added();
+            });
+        }
+        finish();
+    }
+
+    if (entry.expire_at_ms != 0) {
+        appendCommand(out, std::vector<std::string>{"pexpireat", entry.key, std::to_string(entry.expire_at_ms)});
+    }
+}
+
+/**
+ * @brief Writes the whole keyspace as a command log to `fd` (in the rewrite child).
+ */
+static bool rewriteKeyspace(HashTable& store, int fd, int64_t now_ms) {
+    const size_t FLUSH_BYTES = 64 * 1024;
+    Buffer out;
+    bool ok = true;
+
+    store.forEach([&](HashTable::Node* node) {
+        auto* entry = static_cast<DataEntry*>(node);
+        if (!ok || (entry->expire_at_ms != 0 && entry->expire_at_ms <= now_ms)) {
+            return;
+        }
+        rewriteEntry(out, *entry);
+        if (out.size() >= FLUSH_BYTES) {
+            ok = writeAll(fd, out.data(), out.size());
+            out.clear();
+        }
+    });
+
+    return ok && writeAll(fd, out.data(), out.size()) && ::fsync(fd) == 0;
+}
+
+void RedisServer::propagate(const std::vector<std::string>& command) {
+    if (loading) {
+        return;
+    }
+    if (aofState == AofState::ON) {
+        appendCommand(aofBuffer, command);
+    }
+    if (aofRewriteChild != -1) {
+        appendCommand(aofRewriteBuffer, command);
+    }
+    // A replica relays its primary's stream instead (see Replication.cpp).
+    if (replBacklog && !isReplica()) {
+        Buffer frame;
+        appendCommand(frame, command);
+        feedReplicationStream(frame.data(), frame.size());
+    }
+}
+
+void RedisServer::holdUntilSynced(Connection& conn) {
+    if (aofState != AofState::ON || aof.getPolicy() != AppendOnlyFile::FsyncPolicy::ALWAYS) {
+        return;
+    }
+    conn.hold_output = true;
+    if (aofPendingClients.empty() || aofPendingClients.back() != &conn) {
+        aofPendingClients.push_back(&conn);
+    }
+}
+
+void RedisServer::flushAppendOnlyFile() {
+    if (!aofBuffer.empty()) {
+        size_t written = aof.append(aofBuffer.data(), aofBuffer.size());
+        if (written < aofBuffer.size()) {
+            // Keep the rest for the next iteration, and refuse writes until it is out.
+            if (aofLastWriteOk) {
+                std::cerr << "Error writing to the append only file: " << strerror(errno) << std::endl;
+            }
+            aofLastWriteOk = false;
+            aofBuffer.erase(aofBuffer.begin(), aofBuffer.begin() + written);
+            return;
+        }
+        if (!aofLastWriteOk) {
+            std::cerr << "Append only file write error resolved" << std::endl;
+        }
+        aofLastWriteOk = true;
+        aofBuffer.clear();
+    }
+
+    // One sync for every client that wrote during this iteration.
+    if (!aofPendingClients.empty()) {
+        const uint64_t offset = aof.size();
+        for (Connection* conn: aofPendingClients) {
+            aofSyncWaiters[conn] = offset;
+        }
+        aofPendingClients.clear();
+        aof.requestSync();
+    }
+}
+
+void RedisServer::releaseSyncedClients(bool all) {
+    aof.clearNotification();
+
+    // Replying to a write that may not be on disk would break the promise of
+    // `appendfsync always`.
+    if (!all && aof.syncErrors() > 0 && aof.getPolicy() == AppendOnlyFile::FsyncPolicy::ALWAYS) {
+        std::cerr << "Can't recover from an append only file fsync error under 'appendfsync always', exiting" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    const uint64_t synced = aof.syncedOffset();
+    for (auto it = aofSyncWaiters.begin(); it != aofSyncWaiters.end();) {
+        if (!all && it->second > synced) {
+            ++it;
+            continue;
+        }
+        it->first->hold_output = false;
+        it = aofSyncWaiters.erase(it);
+    }
+    if (all) {
+        for (Connection* conn: aofPendingClients) {
+            conn->hold_output = false;
+        }
+        aofPendingClients.clear();
+    }
+}
+
+bool RedisServer::startAofRewrite() {
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Can't rewrite the append only file in background: fork: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (pid == 0) {
+        // As for BGSAVE, `_exit` skips destructors that would wait for threads
+        // that were not forked along.
+        const std::string temp_path = rewriteTempName(getpid());
+        int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool ok = fd >= 0 && rewriteKeyspace(dataStore, fd, unixTimeMs());
+        _exit(ok ? 0 : 1);
+    }
+
+    aofRewriteChild = pid;
+    aofRewriteScheduled = false;
+    aofRewriteBuffer.clear();
+    std::cout << "Background append only file rewriting started by pid " << pid << std::endl;
+    return true;
+}
+
+void RedisServer::finishAofRewrite(bool child_ok) {
+    const std::string temp_path = rewriteTempName(aofRewriteChild);
+    aofRewriteChild = -1;
+
+    // Commands not flushed yet are already part of the rewrite buffer: write
+    // them to the old file first so the new one doesn't get them twice.
+    if (aofState == AofState::ON) {
+        flushAppendOnlyFile();
+    }
+
+    int fd = child_ok ? ::open(temp_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC) : -1;
+    bool ok = fd >= 0
+        && writeAll(fd, aofRewriteBuffer.data(), aofRewriteBuffer.size())
+        && ::fsync(fd) == 0
+        && ::rename(temp_path.c_str(), aofFilename.c_str()) == 0;
+    Buffer().swap(aofRewriteBuffer);
+
+    lastAofRewriteOk = ok;
+    if (!ok) {
+        std::cerr << "Background append only file rewriting failed" << (child_ok ? std::string(": ") + strerror(errno) : "") << std::endl;
+        if (fd >= 0) ::close(fd);
+        ::unlink(temp_path.c_str());
+        // The file still has to be created.
+        aofRewriteScheduled = aofState == AofState::WAIT_REWRITE;
+        return;
+    }
+
+    const uint64_t size = static_cast<uint64_t>(::lseek(fd, 0, SEEK_END));
+    aof.replace(fd, size);
+    aofBaseSize = size;
+    aofState = AofState::ON;
+
+    // The new file was synced as a whole, with every write made so far.
+    releaseSyncedClients(true);
+    std::cout << "Background append only file rewriting terminated with success" << std::endl;
+}
+
+void RedisServer::appendOnlyCron() {
+    if (aofRewriteChild != -1) {
+        int status = 0;
+        pid_t pid = waitpid(aofRewriteChild, &status, WNOHANG);
+        if (pid != 0) {
+            finishAofRewrite(pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+        return;
+    }
+    if (snapshotChild != -1 || aofState == AofState::OFF) {
+        return;
+    }
+
+    // Rewrite automatically once the file outgrew its size after the last rewrite.
+    const uint64_t size = aof.size();
+    const bool grown = aofState == AofState::ON && aofRewritePercentage > 0 && size >= aofRewriteMinSize
+        && (size - std::min(size, aofBaseSize)) * 100 >= std::max<uint64_t>(aofBaseSize, 1) * aofRewritePercentage;
+    if (aofRewriteScheduled || grown) {
+        startAofRewrite();
+    }
+}
+
+void RedisServer::startAppendOnly() {
+    // The first rewrite creates the file; writes are buffered for it meanwhile.
+    aofState = AofState::WAIT_REWRITE;
+    if (aofRewriteChild == -1 && snapshotChild == -1) {
+        startAofRewrite();
+    } else {
+        aofRewriteScheduled = true;
+    }
+}
+
+void RedisServer::stopAppendOnly() {
+    if (aofState == AofState::ON) {
+        flushAppendOnlyFile();
+    }
+    if (aofRewriteChild != -1) {
+        ::kill(aofRewriteChild, SIGKILL);
+        waitpid(aofRewriteChild, nullptr, 0);
+        ::unlink(rewriteTempName(aofRewriteChild).c_str());
+        aofRewriteChild = -1;
+        Buffer().swap(aofRewriteBuffer);
+    }
+
+    aof.close();
+    aofBuffer.clear();
+    aofRewriteScheduled = false;
+    aofState = AofState::OFF;
+    releaseSyncedClients(true);
+}
+
+bool RedisServer::loadAppendOnlyFile() {
+    int fd = ::open(aofFilename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) return false;
+        throw std::runtime_error("Can't open the append only file " + aofFilename + ": " + strerror(errno));
+    }
+
+    std::string data;
+    char chunk[64 * 1024];
+    ssize_t n;
+    while ((n = ::read(fd, chunk, sizeof(chunk))) != 0) {
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            ::close(fd);
+            throw std::runtime_error("Can't read the append only file " + aofFilename + ": " + strerror(errno));
+        }
+        data.append(chunk, static_cast<size_t>(n));
+    }
+    ::close(fd);
+
+    loading = true;
+    size_t pos = 0;
+    size_t commands = 0;
+    while (data.size() - pos >= 4) {
+        uint32_t len;
+        memcpy(&len, data.data() + pos, 4);
+        if (data.size() - pos - 4 < len) {
+            break;
+        }
+
+        Request request;
+        if (parseRequest(data.substr(pos + 4, len), request) != 0 || request.command.empty()) {
+            loading = false;
+            throw std::runtime_error("Bad file format reading the append only file " + aofFilename
+                + " at offset " + std::to_string(pos));
+        }
+        Buffer response;
+        executeRequest(request, response);
+        pos += 4 + len;
+        ++commands;
+    }
+    loading = false;
+
+    // A crash mid-write leaves the last command incomplete: drop it.
+    if (pos != data.size()) {
+        std::cerr << "The append only file ends with an incomplete command: truncating it from "
+                  << data.size() << " to " << pos << " bytes" << std::endl;
+        if (::truncate(aofFilename.c_str(), static_cast<off_t>(pos)) != 0) {
+            throw std::runtime_error("Can't truncate the append only file " + aofFilename + ": " + strerror(errno));
+        }
+    }
+
+    std::cout << "Replayed " << commands << " commands from " << aofFilename << std::endl;
+    return true;
+}
+
+void RedisServer::loadDataFromDisk() {
+    const int64_t start_ms = nowMs();
+    bool loaded = false;
+
+    // The keys are indexed by slot as they load.
+    if (clusterEnabled) {
+        loadClusterConfig();
+    }
+
+    if (appendOnly && loadAppendOnlyFile()) {
+        if (!aof.open(aofFilename)) {
+            throw std::runtime_error("Can't open the append only file " + aofFilename + ": " + strerror(errno));
+        }
+        aofBaseSize = aof.size();
+        aofState = AofState::ON;
+        loaded = true;
+    } else {
+        loaded = loadSnapshot();
+        // Without a log to append to yet, the first rewrite creates it.
+        if (appendOnly) {
+            startAppendOnly();
+        }
+    }
+
+    if (loaded) {
+        size_t keys = 0;
+        forEachShard([&keys](RedisServer& shard) { keys += shard.dataStore.size(); });
+        std::cout << "DB loaded from disk: " << keys << " keys in " << nowMs() - start_ms << " ms" << std::endl;
+    }
+    watch(aof.notifyFd(), [this]() { releaseSyncedClients(false); });
+    dirty = 0;
+    lastSaveTime = time(nullptr);
+    diskDataLoaded = true;
+}
+
+void RedisServer::handleBgRewriteAof(const Request& request, Buffer& response) {
+    if (request.command.size() != 1) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'bgrewriteaof'");
+        return;
+    }
+    if (aofRewriteChild != -1) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Background append only file rewriting already in progress");
+        return;
+    }
+    if (aofState == AofState::OFF) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "The append only file is disabled, see 'appendonly'");
+        return;
+    }
+
+    // A running BGSAVE goes first.
+    if (snapshotChild != -1) {
+        aofRewriteScheduled = true;
+        ResponseBuilder::outStr(response, "Background append only file rewriting scheduled");
+        return;
+    }
+    if (!startAofRewrite()) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Can't rewrite the append only file in background, check the server logs");
+        return;
+    }
+    ResponseBuilder::outStr(response, "Background append only file rewriting started");
+}
@@ -0,0 +1,164 @@
+#include <server/AppendOnlyFile.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @file AppendOnlyFile.cpp
+ * @brief Implements the append-only file and its fsync thread.
+ * @details `fd` is only ever changed by the event loop, which is also the
+ * only writer, so appending needs no lock. The thread syncs a duplicate of
+ * the descriptor taken under the lock: it never holds the lock across an
+ * fsync, and the event loop can close or replace the file meanwhile.
+ */
+
+AppendOnlyFile::AppendOnlyFile() {
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd < 0) {
+        throw std::runtime_error(std::string("eventfd() error: ") + strerror(errno));
+    }
+    worker = std::thread(&AppendOnlyFile::run, this);
+}
+
+AppendOnlyFile::~AppendOnlyFile() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_one();
+    worker.join();
+
+    close();
+    ::close(eventFd);
+}
+
+bool AppendOnlyFile::open(const std::string& path) {
+    int new_fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (new_fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(new_fd, &st) != 0) {
+        ::close(new_fd);
+        return false;
+    }
+    replace(new_fd, static_cast<uint64_t>(st.st_size));
+    return true;
+}
+
+void AppendOnlyFile::replace(int new_fd, uint64_t size) {
+    int old_fd;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        old_fd = fd;
+        fd = new_fd;
+        ++generation;
+        written = size;
+        synced = size;
+        syncRequested = 0;
+    }
+    if (old_fd != -1) {
+        ::close(old_fd);
+    }
+}
+
+void AppendOnlyFile::close() {
+    int old_fd;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        old_fd = fd;
+        fd = -1;
+        ++generation;
+        written = 0;
+        synced = 0;
+        syncRequested = 0;
+    }
+    if (old_fd != -1) {
+        ::close(old_fd);
+    }
+}
+
+size_t AppendOnlyFile::append(const uint8_t* data, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::write(fd, data + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += static_cast<size_t>(n);
+    }
+    written += done;
+    return done;
+}
+
+void AppendOnlyFile::requestSync() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        syncRequested = written;
+    }
+    wakeup.notify_one();
+}
+
+void AppendOnlyFile::clearNotification() {
+    uint64_t count;
+    while (::read(eventFd, &count, sizeof(count)) > 0) {}
+}
+
+void AppendOnlyFile::setPolicy(FsyncPolicy new_policy) {
+    policy = new_policy;
+    wakeup.notify_one();
+}
+
+void AppendOnlyFile::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        auto requested = [this]() { return stopping || syncRequested > synced; };
+        if (policy == FsyncPolicy::EVERYSEC) {
+            wakeup.wait_for(lock, std::chrono::seconds(1), requested);
+        } else {
+            wakeup.wait(lock, requested);
+        }
+        if (stopping) {
+            return;
+        }
+
+        // Everything written by now is covered, including writes made after
+        // the request: they join this group.
+        const uint64_t target = written;
+        if (fd == -1 || target <= synced || policy == FsyncPolicy::NO) {
+            syncRequested = 0;
+            continue;
+        }
+        const uint64_t sync_generation = generation;
+        int sync_fd = dup(fd);
+        lock.unlock();
+
+        bool ok = sync_fd >= 0 && fdatasync(sync_fd) == 0;
+        if (!ok) {
+            std::cerr << "Can't fsync the append only file: " << strerror(errno) << std::endl;
+        }
+        if (sync_fd >= 0) {
+            ::close(sync_fd);
+        }
+
+        lock.lock();
+        if (!ok) {
+            // Don't spin on a failing disk: the event loop decides what to do.
+            ++failedSyncs;
+            syncRequested = 0;
+        } else if (generation == sync_generation && target > synced) {
+            synced = target;
+        }
+
+        uint64_t one = 1;
+        ssize_t notified = ::write(eventFd, &one, sizeof(one));
+        (void) notified;
+    }
+}
@@ -0,0 +1,238 @@
+#include <server/Redis.hpp>
+#include <common/Bitops.hpp>
+
+/**
+ * @file BitmapCommands.cpp
+ * @brief Implements the bitmap (SETBIT, BITCOUNT, BITOP, ...) command handlers of RedisServer.
+ * @details Bitmaps are plain string values; see Bitops.hpp for the bit numbering.
+ */
+
+/// @brief The largest bit offset SETBIT accepts, which bounds bitmaps to 512 MB.
+static const uint64_t MAX_BIT_OFFSET = (uint64_t(512) << 20) * 8 - 1;
+
+/**
+ * @brief Parses the BYTE|BIT unit of a BITCOUNT or BITPOS range.
+ */
+static bool parseBitUnit(const Request& request, size_t index, bool& bit_unit) {
+    const std::string unit = request.lowerCaseCommand(index);
+    bit_unit = unit == "bit";
+    return bit_unit || unit == "byte";
+}
+
+/**
+ * @brief Resolves a `start end` range, in bytes or bits and possibly negative, to bit positions.
+ * @return false if the range selects nothing.
+ */
+static bool resolveBitRange(int64_t start, int64_t end, bool bit_unit, size_t bytes, uint64_t& first, uint64_t& last) {
+    const int64_t size = static_cast<int64_t>(bit_unit ? bytes * 8 : bytes);
+
+    if (start < 0) start += size;
+    if (end < 0)   end   += size;
+    if (start < 0) start = 0;
+    if (end < 0)   end   = 0;
+    if (end >= size) end = size - 1;
+    if (start > end) {
+        return false;
+    }
+
+    first = bit_unit ? start : start * 8;
+    last = bit_unit ? end : end * 8 + 7;
+    return true;
+}
+
+void RedisServer::handleSetBit(const Request& request, Buffer& response) {
+    if (request.command.size() != 4) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'setbit'");
+        return;
+    }
+
+    int64_t offset, bit;
+    if (!parseInt64(request.command[2], offset) || offset < 0 || static_cast<uint64_t>(offset) > MAX_BIT_OFFSET) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "bit offset is not an integer or out of range");
+        return;
+    }
+    if (!parseInt64(request.command[3], bit) || (bit != 0 && bit != 1)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "bit is not an integer or out of range");
+        return;
+    }
+
+    std::string* value;
+    if (!lookupTyped(request.command[1], value, response)) return;
+    if (!value) {
+        value = &std::get<std::string>(addEntry(request.command[1], std::string())->value);
+    }
+
+    // Setting a bit past the end zero-pads the string up to it.
+    const size_t byte = static_cast<size_t>(offset >> 3);
+    if (byte >= value->size()) {
+        value->resize(byte + 1, '\0');
+    }
+
+    const uint8_t mask = 0x80 >> (offset & 7);
+    uint8_t& target = reinterpret_cast<uint8_t&>((*value)[byte]);
+    const bool previous = target & mask;
+    target = bit ? (target | mask) : (target & ~mask);
+
+    ResponseBuilder::outInt(response, previous ? 1 : 0);
+}
+
+void RedisServer::handleGetBit(const Request& request, Buffer& response) {
+    if (request.command.size() != 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'getbit'");
+        return;
+    }
+
+    int64_t offset;
+    if (!parseInt64(request.command[2], offset) || offset < 0 || static_cast<uint64_t>(offset) > MAX_BIT_OFFSET) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "bit offset is not an integer or out of range");
+        return;
+    }
+
+    std::string* value;
+    if (!lookupTyped(request.command[1], value, response)) return;
+
+    const size_t byte = static_cast<size_t>(offset >> 3);
+    const bool bit = value && byte < value->size() && (static_cast<uint8_t>((*value)[byte]) & (0x80 >> (offset & 7)));
+    ResponseBuilder::outInt(response, bit ? 1 : 0);
+}
+
+void RedisServer::handleBitCount(const Request& request, Buffer& response) {
+    const size_t argc = request.command.size();
+    if (argc != 2 && argc != 4 && argc != 5) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, argc == 3 ? "syntax error" : "Wrong number of arguments for 'bitcount'");
+        return;
+    }
+
+    int64_t start = 0, end = -1;
+    bool bit_unit = false;
+    if (argc >= 4 && (!parseInt64(request.command[2], start) || !parseInt64(request.command[3], end))) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value is not an integer or out of range");
+        return;
+    }
+    if (argc == 5 && !parseBitUnit(request, 4, bit_unit)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "syntax error");
+        return;
+    }
+
+    std::string* value;
+    if (!lookupTyped(request.command[1], value, response)) return;
+
+    uint64_t first, last;
+    if (!value || !resolveBitRange(start, end, bit_unit, value->size(), first, last)) {
+        ResponseBuilder::outInt(response, 0);
+        return;
+    }
+
+    // The whole string takes the block kernel directly.
+    uint64_t count = first == 0 && last == value->size() * 8 - 1 ? bitops::popcount(*value) : bitops::popcount(*value, first, last);
+    ResponseBuilder::outInt(response, static_cast<int64_t>(count));
+}
+
+void RedisServer::handleBitPos(const Request& request, Buffer& response) {
+    const size_t argc = request.command.size();
+    if (argc < 3 || argc > 6) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'bitpos'");
+        return;
+    }
+
+    int64_t bit;
+    if (!parseInt64(request.command[2], bit)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value is not an integer or out of range");
+        return;
+    }
+    if (bit != 0 && bit != 1) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "The bit argument must be 1 or 0.");
+        return;
+    }
+
+    int64_t start = 0, end = -1;
+    bool bit_unit = false;
+    const bool end_given = argc >= 5;
+    if ((argc >= 4 && !parseInt64(request.command[3], start)) || (end_given && !parseInt64(request.command[4], end))) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value is not an integer or out of range");
+        return;
+    }
+    if (argc == 6 && !parseBitUnit(request, 5, bit_unit)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "syntax error");
+        return;
+    }
+
+    std::string* value;
+    if (!lookupTyped(request.command[1], value, response)) return;
+
+    // A missing key is an empty string: it has no set bits, and its clear
+    // bits start right away.
+    if (!value) {
+        ResponseBuilder::outInt(response, bit ? -1 : 0);
+        return;
+    }
+
+    uint64_t first, last;
+    if (!resolveBitRange(start, end, bit_unit, value->size(), first, last)) {
+        ResponseBuilder::outInt(response, -1);
+        return;
+    }
+
+    int64_t pos = bitops::findBit(*value, first, last, bit == 1);
+
+    // Without an explicit end, the string counts as padded with clear bits.
+    if (pos < 0 && bit == 0 && !end_given) {
+        pos = static_cast<int64_t>(last + 1);
+    }
+    ResponseBuilder::outInt(response, pos);
+}
+
+void RedisServer::handleBitOp(const Request& request, Buffer& response) {
+    if (request.command.size() < 4) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'bitop'");
+        return;
+    }
+
+    const std::string name = request.lowerCaseCommand(1);
+    bitops::Op op;
+    if (name == "and") {
+        op = bitops::Op::AND;
+    } else if (name == "or") {
+        op = bitops::Op::OR;
+    } else if (name == "xor") {
+        op = bitops::Op::XOR;
+    } else if (name == "not") {
+        op = bitops::Op::NOT;
+    } else {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "syntax error");
+        return;
+    }
+
+    if (op == bitops::Op::NOT && request.command.size() != 4) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "BITOP NOT must be called with a single source key.");
+        return;
+    }
+
+    // Missing keys are empty strings.
+    std::vector<std::string_view> sources;
+    for (size_t i = 3; i < request.command.size(); ++i) {
+        std::string* value;
+        if (!lookupTyped(request.command[i], value, response)) return;
+        sources.push_back(value ? std::string_view(*value) : std::string_view());
+    }
+
+    std::string result = bitops::apply(op, sources);
+    const int64_t length = static_cast<int64_t>(result.size());
+
+    // Like SET, the destination is replaced as a whole, whatever it held.
+    const std::string& dest = request.command[2];
+    if (result.empty()) {
+        removeEntry(dest);
+    } else if (DataEntry* entry = lookupEntry(dest)) {
+        if (lazyfreeLazyServerDel && isCostlyToFree(entry->value)) {
+            lazyFree.free(std::move(entry->value));
+        }
+        entry->value = std::move(result);
+        entry->compressed = false;
+        setExpire(entry, 0);
+    } else {
+        addEntry(dest, std::move(result));
+    }
+
+    ResponseBuilder::outInt(response, length);
+}
@@ -0,0 +1,134 @@
+#include <server/Redis.hpp>
+#include <chrono>
+
+/**
+ * @file Blocking.cpp
+ * @brief Implements the wait queues behind RedisServer's blocking commands.
+ * @details A blocked connection is registered in the FIFO of every key it
+ * waits on. Writes only mark a key as ready; the waiters are served from
+ * `onTick` once the current batch of requests has been executed, so a client
+ * is never resumed from inside another client's request.
+ */
+
+int64_t RedisServer::nowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void RedisServer::blockClient(Connection& conn, std::vector<std::string> keys, BlockedPop pop, int64_t deadline_ms) {
+    for (const auto& key: keys) {
+        blockingKeys[key].push_back(&conn);
+    }
+
+    if (deadline_ms > 0) {
+        blockingDeadlines.insert({deadline_ms, &conn});
+    }
+
+    BlockedClient& blocked = blockedClients[&conn];
+    blocked.keys = std::move(keys);
+    blocked.pop = pop;
+    blocked.deadline_ms = deadline_ms;
+
+    conn.blocked = true;
+}
+
+void RedisServer::unblockClient(Connection& conn) {
+    auto it = blockedClients.find(&conn);
+    if (it == blockedClients.end()) {
+        return;
+    }
+
+    for (const auto& key: it->second.keys) {
+        auto queue = blockingKeys.find(key);
+        if (queue == blockingKeys.end()) continue;
+
+        auto& waiters = queue->second;
+        waiters.erase(std::remove(waiters.begin(), waiters.end(), &conn), waiters.end());
+        if (waiters.empty()) {
+            blockingKeys.erase(queue);
+        }
+    }
+
+    if (it->second.deadline_ms > 0) {
+        blockingDeadlines.erase({it->second.deadline_ms, &conn});
+    }
+
+    blockedClients.erase(it);
+}
+
+const char* RedisServer::blockedPopCommand(BlockedPop pop) {
+    switch (pop) {
+        case BlockedPop::ZSET_MIN:  return "zpopmin";
+        case BlockedPop::ZSET_MAX:  return "zpopmax";
+        case BlockedPop::LIST_HEAD: return "lpop";
+        case BlockedPop::LIST_TAIL: return "rpop";
+    }
+    return "";
+}
+
+bool RedisServer::serveBlockedPop(const std::string& key, BlockedPop pop, Buffer& response) {
+    switch (pop) {
+        case BlockedPop::ZSET_MIN:  return popWithKey(key, false, response);
+        case BlockedPop::ZSET_MAX:  return popWithKey(key, true, response);
+        case BlockedPop::LIST_HEAD: return listPopWithKey(key, false, response);
+        case BlockedPop::LIST_TAIL: return listPopWithKey(key, true, response);
+    }
+    return false;
+}
+
+void RedisServer::signalKeyAsReady(const std::string& key) {
+    if (RedisServer* owner = foreignShard(key)) {
+        owner->signalKeyAsReady(key);
+        return;
+    }
+    if (blockingKeys.find(key) != blockingKeys.end()) {
+        readyKeys.push_back(key);
+    }
+}
+
+void RedisServer::serveReadyKeys() {
+    // Resumed clients may run pipelined writes that ready more keys.
+    while (!readyKeys.empty()) {
+        std::vector<std::string> keys;
+        keys.swap(readyKeys);
+
+        for (const auto& key: keys) {
+            // Waiters that can't be served (the key is empty, or holds another
+            // type than they pop) are skipped and keep their place.
+            size_t next = 0;
+            auto queue = blockingKeys.find(key);
+
+            while (queue != blockingKeys.end() && next < queue->second.size()) {
+                Connection* conn = queue->second[next];
+
+                Buffer response;
+                if (!serveBlockedPop(key, blockedClients[conn].pop, response)) {
+                    ++next;
+                    continue;
+                }
+
+                // Logged as the plain pop it amounts to.
+                propagate({blockedPopCommand(blockedClients[conn].pop), key});
+                holdUntilSynced(*conn);
+
+                unblockClient(*conn);
+                replyToBlocked(*conn, response);
+
+                queue = blockingKeys.find(key);
+            }
+        }
+    }
+}
+
+void RedisServer::timeoutBlockedClients() {
+    int64_t now = nowMs();
+    while (!blockingDeadlines.empty() && blockingDeadlines.begin()->first <= now) {
+        Connection* conn = blockingDeadlines.begin()->second;
+        unblockClient(*conn);
+
+        Buffer response;
+        ResponseBuilder::outNil(response);
+        replyToBlocked(*conn, response);
+    }
+}
+
@@ -0,0 +1,1025 @@
+#include <server/Redis.hpp>
+#include <server/SnapshotFile.hpp>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <tuple>
+#include <unistd.h>
+
+/**
+ * @file Cluster.cpp
+ * @brief Implements cluster mode: the hash slots spread over several servers, redirection and slot migration.
+ * @details Each node is a server process of its own, serving the keys of the
+ * hash slots assigned to it (CLUSTER ADDSLOTS) and answering requests for
+ * the others with `MOVED <slot> <host>:<port>`, which clients follow and
+ * remember. The keys of a request must share a slot, which a `{hash tag}`
+ * guarantees.
+ *
+ * Nodes keep one another up to date with heartbeats: every node holds a
+ * link to every other one, on the ordinary client port, and sends
+ * `CLUSTER GOSSIP` with its epochs, the slots it claims and the nodes it
+ * knows, once a second and right after its slots change. CLUSTER MEET
+ * introduces two nodes, and gossip spreads each to the other's peers.
+ *
+ * A slot moves between nodes without downtime. The target is told it is
+ * IMPORTING the slot and the source that it is MIGRATING it, then MIGRATE
+ * moves the keys over in batches (see CLUSTER GETKEYSINSLOT). Meanwhile the
+ * source serves the keys it still holds and answers `ASK <slot> <host>:<port>`
+ * for the others, which the target serves to clients that send ASKING first.
+ * Finally CLUSTER SETSLOT NODE makes the target the owner under a new config
+ * epoch, whose claim then wins over the source's on every node.
+ */
+
+/// @brief How often the cluster cron runs: links, handshakes and saving the config.
+static const int64_t CLUSTER_CRON_MS = 100;
+/// @brief How often every node is sent a heartbeat, besides right after a change.
+static const int64_t CLUSTER_HEARTBEAT_MS = 1000;
+/// @brief How long a broken link stays down before it is reconnected.
+static const int64_t CLUSTER_RECONNECT_MS = 1000;
+/// @brief MIGRATE connections idle for this long are closed.
+static const int64_t MIGRATE_SOCKET_IDLE_MS = 10000;
+
+/**
+ * @brief Parses a slot number argument.
+ * @return false (with an error written to `response`) unless it is below HASH_SLOTS.
+ */
+static bool parseSlotArgument(const std::string& text, size_t& slot, Buffer& response) {
+    char* end = nullptr;
+    const long value = strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || value < 0 || static_cast<size_t>(value) >= HASH_SLOTS) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Invalid or out of range slot");
+        return false;
+    }
+    slot = static_cast<size_t>(value);
+    return true;
+}
+
+/**
+ * @brief Parses the slots of ADDSLOTS and DELSLOTS (`slot...`), or of their
+ * RANGE variants (`first last...`), from the third argument on.
+ * @return false (with an error written to `response`) if a slot is invalid or given twice.
+ */
+static bool parseSlotArguments(const Request& request, bool ranges, std::vector<bool>& slots, Buffer& response) {
+    slots.assign(HASH_SLOTS, false);
+    for (size_t i = 2; i < request.command.size(); i += ranges ? 2 : 1) {
+        size_t first, last;
+        if (!parseSlotArgument(request.command[i], first, response)) return false;
+        last = first;
+        if (ranges) {
+            if (!parseSlotArgument(request.command[i + 1], last, response)) return false;
+            if (last < first) {
+                ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "start slot number " + std::to_string(first) + " is greater than end slot number " + std::to_string(last));
+                return false;
+            }
+        }
+        for (size_t slot = first; slot <= last; ++slot) {
+            if (slots[slot]) {
+                ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Slot " + std::to_string(slot) + " specified multiple times");
+                return false;
+            }
+            slots[slot] = true;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Parses a TCP port.
+ * @return false unless it is a whole number from 1 to 65535.
+ */
+static bool parsePort(const std::string& text, uint16_t& port) {
+    char* end = nullptr;
+    const long value = strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || value <= 0 || value > 65535) return false;
+    port = static_cast<uint16_t>(value);
+    return true;
+}
+
+/* ====== Configuration ====== */
+
+void RedisServer::loadClusterConfig() {
+    cluster = ClusterState::load(clusterConfigFile);
+    if (cluster) {
+        std::cout << "Node configuration loaded, I'm " << cluster->myself->id << std::endl;
+    } else {
+        cluster = std::make_unique<ClusterState>(newReplicationId(), clusterAnnounceIp, listenPort);
+        std::cout << "No cluster configuration found, I'm " << cluster->myself->id << std::endl;
+    }
+    // A node restarted elsewhere keeps its identity and slots; heartbeats tell the others.
+    cluster->myself->host = clusterAnnounceIp;
+    cluster->myself->port = listenPort;
+    slotKeys.resize(HASH_SLOTS);
+
+    if (!saveClusterConfig()) {
+        throw std::runtime_error("Can't write the cluster config file " + clusterConfigFile);
+    }
+}
+
+bool RedisServer::saveClusterConfig() {
+    // Retried at the next cron if it fails.
+    clusterConfigDirty = !cluster->save(clusterConfigFile);
+    if (clusterConfigDirty) {
+        std::cerr << "Error saving the cluster config to " << clusterConfigFile << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/* ====== Redirection ====== */
+
+bool RedisServer::clusterAcceptsRequest(Connection& conn, const Request& request, Buffer& response) {
+    // ASKING only lasts for the next command.
+    const bool asking = askingClients.erase(&conn) != 0;
+
+    auto it = commandTable.find(request.lowerCaseCommand());
+    if (it == commandTable.end()) {
+        return true;
+    }
+    const Command& command = it->second;
+    const std::vector<size_t> keys = commandKeys(command, request);
+    if (keys.empty()) {
+        return true;
+    }
+
+    const size_t slot = keyHashSlot(request.command[keys[0]]);
+    for (size_t i = 1; i < keys.size(); ++i) {
+        if (keyHashSlot(request.command[keys[i]]) != slot) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "CROSSSLOT Keys in request don't hash to the same slot");
+            return false;
+        }
+    }
+
+    // While a slot moves, its keys are on one side or the other.
+    auto count_missing = [&]() {
+        const int64_t now_ms = unixTimeMs();
+        size_t missing = 0;
+        for (size_t index: keys) {
+            DataEntry* entry = findEntry(request.command[index]);
+            if (!entry || isExpired(entry, now_ms)) ++missing;
+        }
+        return missing;
+    };
+
+    if (cluster->importingFrom[slot] && (asking || (command.flags & CMD_ASKING))) {
+        if (keys.size() > 1 && count_missing() > 0) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "TRYAGAIN Multiple keys request during rehashing of slot");
+            return false;
+        }
+        return true;
+    }
+
+    if (cluster->slots[slot] != cluster->myself) {
+        clusterRedirect(slot, response);
+        return false;
+    }
+
+    if (const ClusterNode* target = cluster->migratingTo[slot]) {
+        const size_t missing = count_missing();
+        if (missing == keys.size()) {
+            ResponseBuilder::outErr(response, ERR_REDIRECT, "ASK " + std::to_string(slot) + " " + target->address());
+            return false;
+        }
+        if (missing > 0) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "TRYAGAIN Multiple keys request during rehashing of slot");
+            return false;
+        }
+    }
+    return true;
+}
+
+void RedisServer::clusterRedirect(size_t slot, Buffer& response) const {
+    const ClusterNode* owner = cluster->slots[slot];
+    if (!owner) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "CLUSTERDOWN Hash slot not served");
+        return;
+    }
+    ResponseBuilder::outErr(response, ERR_REDIRECT, "MOVED " + std::to_string(slot) + " " + owner->address());
+}
+
+void RedisServer::redirectBlockedClients() {
+    // The keys of a blocking command share a slot.
+    std::vector<std::pair<Connection*, size_t>> moved;
+    for (const auto& [conn, blocked]: blockedClients) {
+        const size_t slot = keyHashSlot(blocked.keys.front());
+        if (cluster->slots[slot] != cluster->myself) {
+            moved.emplace_back(conn, slot);
+        }
+    }
+
+    for (const auto& [conn, slot]: moved) {
+        unblockClient(*conn);
+        Buffer response;
+        clusterRedirect(slot, response);
+        reply(*conn, response);
+        resume(*conn);
+    }
+}
+
+void RedisServer::deleteKeysInSlot(size_t slot) {
+    std::vector<std::string> keys;
+    for (DataEntry* entry: slotKeys[slot]) {
+        keys.push_back(entry->key);
+    }
+    for (const std::string& key: keys) {
+        removeEntry(key, lazyfreeLazyServerDel);
+        propagate({"del", key});
+    }
+}
+
+/* ====== CLUSTER ====== */
+
+void RedisServer::handleCluster(const Request& request, Buffer& response) {
+    if (!cluster) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "This instance has cluster support disabled");
+        return;
+    }
+    if (request.command.size() < 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'cluster'");
+        return;
+    }
+
+    const std::string subcommand = request.lowerCaseCommand(1);
+    const size_t argc = request.command.size();
+    size_t slot;
+
+    if (subcommand == "info" && argc == 2) {
+        ResponseBuilder::outStr(response, clusterInfo());
+    } else if (subcommand == "myid" && argc == 2) {
+        ResponseBuilder::outStr(response, cluster->myself->id);
+    } else if (subcommand == "nodes" && argc == 2) {
+        ResponseBuilder::outStr(response, cluster->describeNodes(unixTimeMs(), static_cast<int64_t>(clusterNodeTimeout)));
+    } else if (subcommand == "slots" && argc == 2) {
+        // [first, last, [host, port, id]] for each range, in slot order.
+        std::vector<std::tuple<size_t, size_t, const ClusterNode*>> ranges;
+        for (const auto& node: cluster->nodes) {
+            for (const auto& range: cluster->slotRanges(node.get())) {
+                ranges.emplace_back(range.first, range.second, node.get());
+            }
+        }
+        std::sort(ranges.begin(), ranges.end());
+
+        ResponseBuilder::outArr(response, static_cast<uint32_t>(ranges.size()));
+        for (const auto& [first, last, node]: ranges) {
+            ResponseBuilder::outArr(response, 3);
+            ResponseBuilder::outInt(response, static_cast<int64_t>(first));
+            ResponseBuilder::outInt(response, static_cast<int64_t>(last));
+            ResponseBuilder::outArr(response, 3);
+            ResponseBuilder::outStr(response, node->host);
+            ResponseBuilder::outInt(response, node->port);
+            ResponseBuilder::outStr(response, node->id);
+        }
+    } else if (subcommand == "keyslot" && argc == 3) {
+        ResponseBuilder::outInt(response, static_cast<int64_t>(keyHashSlot(request.command[2])));
+    } else if (subcommand == "countkeysinslot" && argc == 3) {
+        if (parseSlotArgument(request.command[2], slot, response)) {
+            ResponseBuilder::outInt(response, static_cast<int64_t>(slotKeys[slot].size()));
+        }
+    } else if (subcommand == "getkeysinslot" && argc == 4) {
+        if (!parseSlotArgument(request.command[2], slot, response)) return;
+        char* end = nullptr;
+        const long long count = strtoll(request.command[3].c_str(), &end, 10);
+        if (request.command[3].empty() || *end != '\0' || count < 0) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Invalid number of keys");
+            return;
+        }
+        const size_t n = std::min(slotKeys[slot].size(), static_cast<size_t>(count));
+        ResponseBuilder::outArr(response, static_cast<uint32_t>(n));
+        auto key = slotKeys[slot].begin();
+        for (size_t i = 0; i < n; ++i, ++key) {
+            ResponseBuilder::outStr(response, (*key)->key);
+        }
+    } else if (subcommand == "addslots" && argc >= 3) {
+        clusterAddSlots(request, response, false);
+    } else if (subcommand == "addslotsrange" && argc >= 4 && argc % 2 == 0) {
+        clusterAddSlots(request, response, true);
+    } else if (subcommand == "delslots" && argc >= 3) {
+        clusterDelSlots(request, response, false);
+    } else if (subcommand == "delslotsrange" && argc >= 4 && argc % 2 == 0) {
+        clusterDelSlots(request, response, true);
+    } else if (subcommand == "setslot" && argc >= 4) {
+        clusterSetSlot(request, response);
+    } else if (subcommand == "meet" && argc == 4) {
+        clusterMeet(request, response);
+    } else if (subcommand == "gossip" && argc >= 8) {
+        clusterGossip(request, response);
+    } else if (subcommand == "saveconfig" && argc == 2) {
+        if (saveClusterConfig()) {
+            ResponseBuilder::outStr(response, "OK");
+        } else {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Error saving the cluster node config: " + std::string(strerror(errno)));
+        }
+    } else {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Unknown subcommand or wrong number of arguments for '" + request.command[1] + "'");
+    }
+}
+
+std::string RedisServer::clusterInfo() const {
+    const size_t assigned = cluster->countSlots();
+    size_t serving = 0;
+    for (const auto& node: cluster->nodes) {
+        if (cluster->countSlots(node.get()) > 0) ++serving;
+    }
+
+    std::string info;
+    info += std::string("cluster_state:") + (assigned == HASH_SLOTS ? "ok" : "fail") + "\r\n";
+    info += "cluster_slots_assigned:" + std::to_string(assigned) + "\r\n";
+    info += "cluster_known_nodes:" + std::to_string(cluster->nodes.size()) + "\r\n";
+    info += "cluster_size:" + std::to_string(serving) + "\r\n";
+    info += "cluster_current_epoch:" + std::to_string(cluster->currentEpoch) + "\r\n";
+    info += "cluster_my_epoch:" + std::to_string(cluster->myself->configEpoch) + "\r\n";
+    return info;
+}
+
+void RedisServer::clusterAddSlots(const Request& request, Buffer& response, bool ranges) {
+    std::vector<bool> requested;
+    if (!parseSlotArguments(request, ranges, requested, response)) {
+        return;
+    }
+    for (size_t slot = 0; slot < HASH_SLOTS; ++slot) {
+        if (requested[slot] && cluster->slots[slot]) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Slot " + std::to_string(slot) + " is already busy");
+            return;
+        }
+    }
+
+    for (size_t slot = 0; slot < HASH_SLOTS; ++slot) {
+        if (!requested[slot]) continue;
+        cluster->slots[slot] = cluster->myself;
+        cluster->importingFrom[slot] = nullptr;
+    }
+    clusterChanged(true);
+    ResponseBuilder::outStr(response, "OK");
+}
+
+void RedisServer::clusterDelSlots(const Request& request, Buffer& response, bool ranges) {
+    std::vector<bool> requested;
+    if (!parseSlotArguments(request, ranges, requested, response)) {
+        return;
+    }
+    for (size_t slot = 0; slot < HASH_SLOTS; ++slot) {
+        if (requested[slot] && !cluster->slots[slot]) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Slot " + std::to_string(slot) + " is already unassigned");
+            return;
+        }
+    }
+
+    for (size_t slot = 0; slot < HASH_SLOTS; ++slot) {
+        if (!requested[slot]) continue;
+        cluster->slots[slot] = nullptr;
+        cluster->migratingTo[slot] = nullptr;
+        cluster->importingFrom[slot] = nullptr;
+    }
+    redirectBlockedClients();
+    clusterChanged(true);
+    ResponseBuilder::outStr(response, "OK");
+}
+
+void RedisServer::clusterSetSlot(const Request& request, Buffer& response) {
+    size_t slot;
+    if (!parseSlotArgument(request.command[2], slot, response)) {
+        return;
+    }
+    const std::string action = request.lowerCaseCommand(3);
+    const size_t argc = request.command.size();
+    ClusterNode* myself = cluster->myself;
+
+    if (action == "stable" && argc == 4) {
+        cluster->migratingTo[slot] = nullptr;
+        cluster->importingFrom[slot] = nullptr;
+        clusterChanged(false);
+        ResponseBuilder::outStr(response, "OK");
+        return;
+    }
+    if (argc != 5 || (action != "migrating" && action != "importing" && action != "node")) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Invalid CLUSTER SETSLOT action or number of arguments");
+        return;
+    }
+
+    ClusterNode* node = cluster->findNode(request.command[4]);
+    if (!node || node->handshake) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "I don't know about node " + request.command[4]);
+        return;
+    }
+
+    if (action == "migrating") {
+        if (cluster->slots[slot] != myself) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "I'm not the owner of hash slot " + std::to_string(slot));
+            return;
+        }
+        if (node == myself) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Can't migrate a slot to myself");
+            return;
+        }
+        cluster->migratingTo[slot] = node;
+    } else if (action == "importing") {
+        if (cluster->slots[slot] == myself) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "I'm already the owner of hash slot " + std::to_string(slot));
+            return;
+        }
+        if (node == myself) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Can't import a slot from myself");
+            return;
+        }
+        cluster->importingFrom[slot] = node;
+    } else {
+        const bool giving_away = cluster->slots[slot] == myself && node != myself;
+        if (giving_away && !slotKeys[slot].empty()) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Can't assign hashslot " + std::to_string(slot) + " to a different node while I still hold keys for this hash slot.");
+            return;
+        }
+        cluster->migratingTo[slot] = nullptr;
+        // Taking over an imported slot: a new epoch makes this claim win over the previous owner's.
+        if (node == myself && cluster->importingFrom[slot]) {
+            cluster->importingFrom[slot] = nullptr;
+            myself->configEpoch = ++cluster->currentEpoch;
+        }
+        cluster->slots[slot] = node;
+        if (giving_away) {
+            redirectBlockedClients();
+        }
+    }
+    clusterChanged(true);
+    ResponseBuilder::outStr(response, "OK");
+}
+
+void RedisServer::clusterMeet(const Request& request, Buffer& response) {
+    const std::string& host = request.command[2];
+    uint16_t port;
+    if (host.empty() || host.find(' ') != std::string::npos || !parsePort(request.command[3], port)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Invalid node address specified: " + host + ":" + request.command[3]);
+        return;
+    }
+
+    if (!cluster->findNodeByAddress(host, port)) {
+        // Known by its address until its first heartbeat tells its id.
+        ClusterNode* node = cluster->addNode(newReplicationId(), host, port);
+        node->handshake = true;
+        node->createdMs = unixTimeMs();
+        nextClusterCronMs = 0;
+    }
+    ResponseBuilder::outStr(response, "OK");
+}
+
+void RedisServer::clusterGossip(const Request& request, Buffer& response) {
+    // CLUSTER GOSSIP <id> <host> <port> <current epoch> <config epoch> <slot ranges> [<id> <host> <port>]...
+    const auto& args = request.command;
+    const std::string& id = args[2];
+    const std::string& host = args[3];
+    uint16_t port;
+    std::vector<bool> claimed;
+    if (!parsePort(args[4], port) || (args.size() - 8) % 3 != 0 || !ClusterState::parseSlotRanges(args[7], claimed)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Malformed cluster heartbeat");
+        return;
+    }
+    if (id == cluster->myself->id) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Heartbeat from a node with my own id");
+        return;
+    }
+
+    const int64_t now_ms = unixTimeMs();
+    bool changed = false;
+
+    // A node met by its address gets its real id; any other is new.
+    auto learn = [this, now_ms](const std::string& node_id, const std::string& node_host, uint16_t node_port) {
+        for (auto& node: cluster->nodes) {
+            if (node->handshake && node->host == node_host && node->port == node_port) {
+                node->id = node_id;
+                node->handshake = false;
+                return node.get();
+            }
+        }
+        ClusterNode* node = cluster->addNode(node_id, node_host, node_port);
+        node->createdMs = now_ms;
+        return node;
+    };
+
+    ClusterNode* sender = cluster->findNode(id);
+    if (!sender) {
+        sender = learn(id, host, port);
+        changed = true;
+    }
+    if (sender->host != host || sender->port != port) {
+        // Restarted at another address: reconnect there.
+        sender->host = host;
+        sender->port = port;
+        closeClusterLink(*sender);
+        changed = true;
+    }
+    sender->lastSeenMs = now_ms;
+
+    const uint64_t current_epoch = strtoull(args[5].c_str(), nullptr, 10);
+    const uint64_t config_epoch = strtoull(args[6].c_str(), nullptr, 10);
+    if (current_epoch > cluster->currentEpoch) {
+        cluster->currentEpoch = current_epoch;
+        changed = true;
+    }
+    if (config_epoch != sender->configEpoch) {
+        sender->configEpoch = config_epoch;
+        changed = true;
+    }
+
+    bool lost = false;
+    for (size_t slot = 0; slot < HASH_SLOTS; ++slot) {
+        ClusterNode* owner = cluster->slots[slot];
+        if (!claimed[slot]) {
+            // Given up, or handed to a node whose own claim is yet to arrive.
+            if (owner == sender) {
+                cluster->slots[slot] = nullptr;
+                changed = true;
+            }
+            continue;
+        }
+        // A slot being imported is only taken over by SETSLOT NODE.
+        if (owner == sender || cluster->importingFrom[slot]) {
+            continue;
+        }
+        // The most recent claim wins.
+        if (owner && owner->configEpoch >= sender->configEpoch) {
+            continue;
+        }
+
+        if (owner == cluster->myself) {
+            lost = true;
+            cluster->migratingTo[slot] = nullptr;
+            if (!slotKeys[slot].empty()) {
+                std::cerr << "Hash slot " << slot << " was taken over by " << sender->address() << ": deleting the "
+                          << slotKeys[slot].size() << " keys left in it" << std::endl;
+                deleteKeysInSlot(slot);
+            }
+        }
+        cluster->slots[slot] = sender;
+        changed = true;
+    }
+
+    // The nodes it knows, some maybe not known here yet.
+    for (size_t i = 8; i + 2 < args.size(); i += 3) {
+        uint16_t node_port;
+        if (args[i] == cluster->myself->id || cluster->findNode(args[i]) || !parsePort(args[i + 2], node_port)) {
+            continue;
+        }
+        learn(args[i], args[i + 1], node_port);
+        changed = true;
+    }
+
+    if (lost) {
+        redirectBlockedClients();
+    }
+    if (changed) {
+        clusterChanged(false);
+    }
+    ResponseBuilder::outStr(response, "OK");
+}
+
+/* ====== Links between nodes ====== */
+
+void RedisServer::clusterCron() {
+    const int64_t now_ms = unixTimeMs();
+    if (now_ms < nextClusterCronMs) {
+        return;
+    }
+    nextClusterCronMs = now_ms + CLUSTER_CRON_MS;
+
+    // Outside cluster mode, only MIGRATE connections need looking after.
+    for (auto it = migrateSockets.begin(); it != migrateSockets.end();) {
+        if (now_ms - it->second.lastUseMs > MIGRATE_SOCKET_IDLE_MS) {
+            ::close(it->second.fd);
+            it = migrateSockets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (!cluster) {
+        return;
+    }
+
+    // A node met by its address that never answered is given up.
+    std::vector<ClusterNode*> stale;
+    for (const auto& node: cluster->nodes) {
+        if (node->handshake && now_ms - node->createdMs > static_cast<int64_t>(clusterNodeTimeout)) {
+            stale.push_back(node.get());
+        }
+    }
+    for (ClusterNode* node: stale) {
+        std::cerr << "Handshake with node " << node->address() << " timed out" << std::endl;
+        closeClusterLink(*node);
+        cluster->removeNode(node);
+    }
+
+    for (const auto& node: cluster->nodes) {
+        if (node.get() == cluster->myself) continue;
+        if (node->linkFd == -1) {
+            if (now_ms - node->linkCreatedMs >= CLUSTER_RECONNECT_MS) {
+                connectClusterNode(*node);
+            }
+        } else if (node->linkConnected && (clusterBroadcast || now_ms - node->heartbeatSentMs >= CLUSTER_HEARTBEAT_MS)) {
+            sendHeartbeat(*node);
+        }
+    }
+    clusterBroadcast = false;
+
+    if (clusterConfigDirty) {
+        saveClusterConfig();
+    }
+}
+
+void RedisServer::connectClusterNode(ClusterNode& node) {
+    node.linkCreatedMs = unixTimeMs();
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* address = nullptr;
+    int rc = getaddrinfo(node.host.c_str(), std::to_string(node.port).c_str(), &hints, &address);
+    if (rc != 0) {
+        std::cerr << "Can't resolve node " << node.host << ": " << gai_strerror(rc) << std::endl;
+        return;
+    }
+
+    // Connection errors are retried quietly: NODES shows the link as disconnected.
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || (::connect(fd, address->ai_addr, address->ai_addrlen) != 0 && errno != EINPROGRESS)) {
+        if (fd >= 0) ::close(fd);
+        freeaddrinfo(address);
+        return;
+    }
+    freeaddrinfo(address);
+
+    node.linkFd = fd;
+    node.linkConnected = false;
+    ClusterNode* target = &node;
+    watch(fd, [this, target]() { onClusterLinkConnected(*target); }, POLLOUT);
+}
+
+void RedisServer::onClusterLinkConnected(ClusterNode& node) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (::getsockopt(node.linkFd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0) {
+        closeClusterLink(node);
+        return;
+    }
+
+    node.linkConnected = true;
+    ClusterNode* target = &node;
+    watch(node.linkFd, [this, target]() { readClusterLink(*target); });
+    sendHeartbeat(node);
+}
+
+void RedisServer::readClusterLink(ClusterNode& node) {
+    // The replies to heartbeats carry nothing: they are only drained.
+    uint8_t chunk[4096];
+    ssize_t n = ::recv(node.linkFd, chunk, sizeof(chunk), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        std::cerr << "Connection with node " << node.address() << " lost" << std::endl;
+        closeClusterLink(node);
+    }
+}
+
+void RedisServer::closeClusterLink(ClusterNode& node) {
+    if (node.linkFd == -1) {
+        return;
+    }
+    unwatch(node.linkFd);
+    ::close(node.linkFd);
+    node.linkFd = -1;
+    node.linkConnected = false;
+}
+
+void RedisServer::sendHeartbeat(ClusterNode& node) {
+    const ClusterNode* myself = cluster->myself;
+    std::vector<std::string> command = {
+        "cluster", "gossip", myself->id, myself->host, std::to_string(myself->port),
+        std::to_string(cluster->currentEpoch), std::to_string(myself->configEpoch), cluster->formatSlotRanges(myself),
+    };
+    for (const auto& other: cluster->nodes) {
+        if (other.get() == myself || other->handshake) continue;
+        command.push_back(other->id);
+        command.push_back(other->host);
+        command.push_back(std::to_string(other->port));
+    }
+
+    Buffer frame;
+    appendCommand(frame, command);
+    // Heartbeats are small: a link that can't take one at once is as good as broken.
+    ssize_t sent = ::send(node.linkFd, frame.data(), frame.size(), MSG_NOSIGNAL);
+    if (sent != static_cast<ssize_t>(frame.size())) {
+        std::cerr << "Error sending a heartbeat to node " << node.address() << ": " << (sent < 0 ? strerror(errno) : "short write") << std::endl;
+        closeClusterLink(node);
+        return;
+    }
+    node.heartbeatSentMs = unixTimeMs();
+}
+
+/* ====== ASKING, DUMP, RESTORE and MIGRATE ====== */
+
+void RedisServer::handleAsking(const Request& request, Buffer& response) {
+    if (!cluster) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "This instance has cluster support disabled");
+        return;
+    }
+    if (request.command.size() != 1) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'asking'");
+        return;
+    }
+    if (currentClient) {
+        askingClients.insert(currentClient);
+    }
+    ResponseBuilder::outStr(response, "OK");
+}
+
+void RedisServer::handleDump(const Request& request, Buffer& response) {
+    if (request.command.size() != 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'dump'");
+        return;
+    }
+
+    DataEntry* entry = lookupEntry(request.command[1]);
+    if (!entry) {
+        ResponseBuilder::outNil(response);
+        return;
+    }
+    ResponseBuilder::outStr(response, dumpValue(*entry));
+}
+
+void RedisServer::handleRestore(const Request& request, Buffer& response) {
+    const auto& args = request.command;
+    if (args.size() < 4) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for '" + request.lowerCaseCommand() + "'");
+        return;
+    }
+
+    bool replace = false;
+    bool absttl = false;
+    for (size_t i = 4; i < args.size(); ++i) {
+        const std::string option = request.lowerCaseCommand(i);
+        if (option == "replace") replace = true;
+        else if (option == "absttl") absttl = true;
+        else {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "syntax error");
+            return;
+        }
+    }
+
+    char* end = nullptr;
+    const long long ttl = strtoll(args[2].c_str(), &end, 10);
+    if (args[2].empty() || *end != '\0' || ttl < 0) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Invalid TTL value, must be >= 0");
+        return;
+    }
+    const int64_t now_ms = unixTimeMs();
+    const int64_t expire_at_ms = ttl == 0 ? 0 : absttl ? ttl : now_ms + ttl;
+
+    const std::string& key = args[1];
+    if (!replace && lookupEntry(key)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "BUSYKEY Target key name already exists.");
+        return;
+    }
+
+    DataEntry restored;
+    if (!restoreValue(args[3], restored)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "DUMP payload version or checksum are wrong");
+        return;
+    }
+
+    removeEntry(key, lazyfreeLazyServerDel);
+    // Expired on the way: as good as deleted.
+    if (expire_at_ms != 0 && expire_at_ms <= now_ms) {
+        rewrittenCommand = std::vector<std::string>{"del", key};
+        ResponseBuilder::outStr(response, "OK");
+        return;
+    }
+
+    DataEntry* entry = addEntry(key, std::move(restored.value));
+    entry->compressed = restored.compressed;
+    setExpire(entry, expire_at_ms);
+    signalKeyAsReady(key);
+
+    // Replaying a relative TTL later would extend it.
+    rewrittenCommand = std::vector<std::string>{"restore", key, std::to_string(expire_at_ms), args[3], "replace", "absttl"};
+    ResponseBuilder::outStr(response, "OK");
+}
+
+/**
+ * @brief Waits until `fd` is ready for `events`.
+ * @return false if it isn't within `timeout_ms`.
+ */
+static bool waitReady(int fd, short events, int timeout_ms) {
+    struct pollfd pfd = {fd, events, 0};
+    int rc;
+    do {
+        rc = ::poll(&pfd, 1, timeout_ms);
+    } while (rc < 0 && errno == EINTR);
+    return rc > 0;
+}
+
+/**
+ * @brief Sends all of `data` on a non-blocking socket, waiting up to `timeout_ms` whenever it is full.
+ */
+static bool sendAll(int fd, const uint8_t* data, size_t len, int timeout_ms) {
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!waitReady(fd, POLLOUT, timeout_ms)) return false;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * @brief Receives exactly `len` bytes from a non-blocking socket, waiting up to `timeout_ms` whenever none are available.
+ */
+static bool recvAll(int fd, uint8_t* data, size_t len, int timeout_ms) {
+    while (len > 0) {
+        ssize_t n = ::recv(fd, data, len, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!waitReady(fd, POLLIN, timeout_ms)) return false;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+int RedisServer::migrateConnect(const std::string& host, uint16_t port, int64_t timeout_ms, std::string& error) {
+    const std::string address = host + ":" + std::to_string(port);
+    auto cached = migrateSockets.find(address);
+    if (cached != migrateSockets.end()) {
+        cached->second.lastUseMs = unixTimeMs();
+        return cached->second.fd;
+    }
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* resolved = nullptr;
+    int rc = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &resolved);
+    if (rc != 0) {
+        error = "Can't resolve " + host + ": " + gai_strerror(rc);
+        return -1;
+    }
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    bool ok = fd >= 0;
+    if (ok && ::connect(fd, resolved->ai_addr, resolved->ai_addrlen) != 0) {
+        ok = errno == EINPROGRESS && waitReady(fd, POLLOUT, static_cast<int>(timeout_ms));
+    }
+    freeaddrinfo(resolved);
+    int so_error = 0;
+    socklen_t len = sizeof(so_error);
+    if (!ok || ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &len) != 0 || so_error != 0) {
+        error = "IOERR error or timeout connecting to the client";
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    migrateSockets[address] = {fd, unixTimeMs()};
+    return fd;
+}
+
+void RedisServer::closeMigrateSocket(const std::string& address) {
+    auto it = migrateSockets.find(address);
+    if (it != migrateSockets.end()) {
+        ::close(it->second.fd);
+        migrateSockets.erase(it);
+    }
+}
+
+void RedisServer::handleMigrate(const Request& request, Buffer& response) {
+    // MIGRATE host port key|"" destination-db timeout [COPY] [REPLACE] [KEYS key...]
+    const auto& args = request.command;
+    if (args.size() < 6) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'migrate'");
+        return;
+    }
+
+    bool copy = false;
+    bool replace = false;
+    std::vector<std::string> keys;
+    for (size_t i = 6; i < args.size(); ++i) {
+        const std::string option = request.lowerCaseCommand(i);
+        if (option == "copy") {
+            copy = true;
+        } else if (option == "replace") {
+            replace = true;
+        } else if (option == "keys") {
+            if (!args[3].empty()) {
+                ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "When using MIGRATE KEYS option, the key argument must be set to the empty string");
+                return;
+            }
+            keys.assign(args.begin() + static_cast<long>(i) + 1, args.end());
+            break;
+        } else {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "syntax error");
+            return;
+        }
+    }
+    if (!args[3].empty()) {
+        keys.push_back(args[3]);
+    }
+
+    uint16_t port;
+    if (args[1].empty() || !parsePort(args[2], port)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Invalid target address");
+        return;
+    }
+    if (args[4] != "0") {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Only database 0 exists");
+        return;
+    }
+    char* end = nullptr;
+    long long timeout_ms = strtoll(args[5].c_str(), &end, 10);
+    if (args[5].empty() || *end != '\0' || timeout_ms < 0 || timeout_ms > INT32_MAX) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "timeout is not an integer or out of range");
+        return;
+    }
+    if (timeout_ms == 0) {
+        timeout_ms = 1000;
+    }
+
+    // Only the keys that exist are moved.
+    std::vector<DataEntry*> entries;
+    for (const std::string& key: keys) {
+        if (DataEntry* entry = lookupEntry(key)) entries.push_back(entry);
+    }
+    if (entries.empty()) {
+        ResponseBuilder::outStr(response, "NOKEY");
+        return;
+    }
+
+    std::string error;
+    const int fd = migrateConnect(args[1], port, timeout_ms, error);
+    if (fd < 0) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, error);
+        return;
+    }
+
+    // The whole batch in one round trip. Expiry times go absolute, so they don't drift on the way.
+    Buffer batch;
+    for (DataEntry* entry: entries) {
+        std::vector<std::string> restore = {"restore-asking", entry->key, std::to_string(entry->expire_at_ms), dumpValue(*entry), "absttl"};
+        if (replace) restore.push_back("replace");
+        appendCommand(batch, restore);
+    }
+
+    const std::string address = args[1] + ":" + std::to_string(port);
+    if (!sendAll(fd, batch.data(), batch.size(), static_cast<int>(timeout_ms))) {
+        closeMigrateSocket(address);
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "IOERR error or timeout writing to target instance");
+        return;
+    }
+
+    // Keys are only deleted once the target confirmed it has them.
+    std::vector<std::string> moved = {"del"};
+    Buffer reply;
+    for (DataEntry* entry: entries) {
+        uint32_t len = 0;
+        bool ok = recvAll(fd, reinterpret_cast<uint8_t*>(&len), sizeof(len), static_cast<int>(timeout_ms)) && len <= net::MAX_MSG;
+        if (ok) {
+            reply.resize(len);
+            ok = recvAll(fd, reply.data(), len, static_cast<int>(timeout_ms));
+        }
+        if (!ok) {
+            closeMigrateSocket(address);
+            error = "IOERR error or timeout reading from target instance";
+            break;
+        }
+
+        if (!reply.empty() && reply[0] == RES_ERR) {
+            uint32_t message_len = 0;
+            if (error.empty() && reply.size() >= 9) {
+                memcpy(&message_len, reply.data() + 5, sizeof(message_len));
+                error = "Target instance replied with error: " + std::string(reinterpret_cast<const char*>(reply.data()) + 9, std::min<size_t>(message_len, reply.size() - 9));
+            }
+            continue;
+        }
+        moved.push_back(entry->key);
+    }
+
+    if (!copy && moved.size() > 1) {
+        for (size_t i = 1; i < moved.size(); ++i) {
+            removeEntry(moved[i], lazyfreeLazyServerDel);
+        }
+        propagate(moved);
+    }
+    // Logged above: even when the target failed part of the batch, the rest is gone.
+    rewrittenCommand.emplace();
+
+    if (!error.empty()) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, error);
+        return;
+    }
+    ResponseBuilder::outStr(response, "OK");
+}
@@ -0,0 +1,283 @@
+#include <server/ClusterState.hpp>
+#include <common/FileIo.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+ClusterState::ClusterState(const std::string& my_id, const std::string& host, uint16_t port) {
+    myself = addNode(my_id, host, port);
+}
+
+ClusterNode* ClusterState::findNode(const std::string& id) const {
+    for (const auto& node: nodes) {
+        if (node->id == id) return node.get();
+    }
+    return nullptr;
+}
+
+ClusterNode* ClusterState::findNodeByAddress(const std::string& host, uint16_t port) const {
+    for (const auto& node: nodes) {
+        if (node->host == host && node->port == port) return node.get();
+    }
+    return nullptr;
+}
+
+ClusterNode* ClusterState::addNode(const std::string& id, const std::string& host, uint16_t port) {
+    auto node = std::make_unique<ClusterNode>();
+    node->id = id;
+    node->host = host;
+    node->port = port;
+    nodes.push_back(std::move(node));
+    return nodes.back().get();
+}
+
+void ClusterState::removeNode(ClusterNode* node) {
+    for (size_t slot = 0; slot < HASH_SLOTS; ++slot) {
+        if (slots[slot] == node) slots[slot] = nullptr;
+        if (migratingTo[slot] == node) migratingTo[slot] = nullptr;
+        if (importingFrom[slot] == node) importingFrom[slot] = nullptr;
+    }
+    nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [node](const auto& n) { return n.get() == node; }), nodes.end());
+}
+
+size_t ClusterState::countSlots(const ClusterNode* node) const {
+    return static_cast<size_t>(std::count_if(slots.begin(), slots.end(), [node](const ClusterNode* owner) {
+        return owner && (!node || owner == node);
+    }));
+}
+
+std::vector<std::pair<size_t, size_t>> ClusterState::slotRanges(const ClusterNode* node) const {
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t slot = 0; slot < HASH_SLOTS; ++slot) {
+        if (slots[slot] != node) continue;
+        if (!ranges.empty() && ranges.back().second == slot - 1) {
+            ranges.back().second = slot;
+        } else {
+            ranges.emplace_back(slot, slot);
+        }
+    }
+    return ranges;
+}
+
+/**
+ * @brief Formats a range of slots as "first-last", or "slot" for a single one.
+ */
+static std::string formatRange(const std::pair<size_t, size_t>& range) {
+    if (range.first == range.second) return std::to_string(range.first);
+    return std::to_string(range.first) + "-" + std::to_string(range.second);
+}
+
+std::string ClusterState::formatSlotRanges(const ClusterNode* node) const {
+    std::string out;
+    for (const auto& range: slotRanges(node)) {
+        if (!out.empty()) out += ',';
+        out += formatRange(range);
+    }
+    return out.empty() ? "-" : out;
+}
+
+/**
+ * @brief Parses a slot number.
+ * @return false unless it is a whole number below HASH_SLOTS.
+ */
+static bool parseSlot(const std::string& text, size_t& slot) {
+    if (text.empty() || text.size() > 5 || text.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    slot = strtoul(text.c_str(), nullptr, 10);
+    return slot < HASH_SLOTS;
+}
+
+/**
+ * @brief Parses "slot" or "first-last" into an inclusive range.
+ */
+static bool parseRange(const std::string& text, size_t& first, size_t& last) {
+    const size_t dash = text.find('-');
+    if (dash == std::string::npos) {
+        return parseSlot(text, first) && parseSlot(text, last);
+    }
+    return parseSlot(text.substr(0, dash), first) && parseSlot(text.substr(dash + 1), last) && first <= last;
+}
+
+bool ClusterState::parseSlotRanges(const std::string& ranges, std::vector<bool>& claimed) {
+    claimed.assign(HASH_SLOTS, false);
+    if (ranges == "-") {
+        return true;
+    }
+
+    std::stringstream stream(ranges);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        size_t first, last;
+        if (!parseRange(range, first, last)) return false;
+        std::fill(claimed.begin() + first, claimed.begin() + last + 1, true);
+    }
+    return true;
+}
+
+std::string ClusterState::describeNodes(int64_t now_ms, int64_t node_timeout_ms) const {
+    std::string out;
+    for (const auto& node: nodes) {
+        std::string flags = node.get() == myself ? "myself,master" : node->handshake ? "handshake" : "master";
+        if (node.get() != myself && !node->handshake && now_ms - node->lastSeenMs > node_timeout_ms) {
+            flags += ",fail?";
+        }
+        const bool connected = node.get() == myself || node->linkConnected;
+
+        out += node->id + " " + node->address() + " " + flags + " - 0 " + std::to_string(node->lastSeenMs) + " "
+            + std::to_string(node->configEpoch) + (connected ? " connected" : " disconnected");
+        for (const auto& range: slotRanges(node.get())) {
+            out += " " + formatRange(range);
+        }
+        // Slots in transit only show on the line of the node moving them.
+        if (node.get() == myself) {
+            for (size_t slot = 0; slot < HASH_SLOTS; ++slot) {
+                if (migratingTo[slot]) out += " [" + std::to_string(slot) + "->-" + migratingTo[slot]->id + "]";
+                if (importingFrom[slot]) out += " [" + std::to_string(slot) + "-<-" + importingFrom[slot]->id + "]";
+            }
+        }
+        out += "\n";
+    }
+    return out;
+}
+
+bool ClusterState::save(const std::string& path) const {
+    // Nodes still in their handshake are met again if need be, not remembered.
+    std::string contents;
+    std::stringstream lines(describeNodes(0, INT64_MAX));
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.find(" handshake ") == std::string::npos) contents += line + "\n";
+    }
+    contents += "vars currentEpoch " + std::to_string(currentEpoch) + "\n";
+
+    const std::string temp_path = path + ".tmp-" + std::to_string(getpid());
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool ok = writeAll(fd, reinterpret_cast<const uint8_t*>(contents.data()), contents.size());
+    ok = ok && ::fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if (!ok || ::rename(temp_path.c_str(), path.c_str()) != 0) {
+        const int error = errno;
+        ::unlink(temp_path.c_str());
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Splits "host:port", the port being after the last colon.
+ */
+static bool parseAddress(const std::string& address, std::string& host, uint16_t& port) {
+    const size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0) return false;
+    char* end = nullptr;
+    const long value = strtol(address.c_str() + colon + 1, &end, 10);
+    if (*end != '\0' || value <= 0 || value > 65535) return false;
+    host = address.substr(0, colon);
+    port = static_cast<uint16_t>(value);
+    return true;
+}
+
+std::unique_ptr<ClusterState> ClusterState::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        if (::access(path.c_str(), F_OK) != 0 && errno == ENOENT) return nullptr;
+        throw std::runtime_error("Can't open the cluster config file " + path);
+    }
+
+    auto corrupt = [&path](const std::string& line) {
+        return std::runtime_error("Corrupt cluster config file " + path + " at: " + line);
+    };
+
+    struct NodeLine {
+        std::vector<std::string> fields;
+        std::string line;
+    };
+    std::vector<NodeLine> node_lines;
+    uint64_t current_epoch = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::stringstream stream(line);
+        std::vector<std::string> fields;
+        std::string field;
+        while (stream >> field) fields.push_back(field);
+        if (fields.empty()) continue;
+
+        if (fields[0] == "vars") {
+            if (fields.size() != 3 || fields[1] != "currentEpoch") throw corrupt(line);
+            current_epoch = strtoull(fields[2].c_str(), nullptr, 10);
+        } else if (fields.size() >= 8) {
+            node_lines.push_back({std::move(fields), line});
+        } else {
+            throw corrupt(line);
+        }
+    }
+
+    // Myself first, as the state is built around it.
+    auto mine = std::find_if(node_lines.begin(), node_lines.end(), [](const NodeLine& node) {
+        return node.fields[2].find("myself") != std::string::npos;
+    });
+    if (mine == node_lines.end()) {
+        throw std::runtime_error("Corrupt cluster config file " + path + ": no line for this node");
+    }
+    std::rotate(node_lines.begin(), mine, mine + 1);
+
+    std::unique_ptr<ClusterState> state;
+    // Migrations name nodes that may come later in the file.
+    std::vector<std::pair<const NodeLine*, std::string>> transit;
+    for (const NodeLine& node_line: node_lines) {
+        const auto& fields = node_line.fields;
+        std::string host;
+        uint16_t port;
+        if (fields[0].empty() || !parseAddress(fields[1], host, port)) throw corrupt(node_line.line);
+
+        ClusterNode* node;
+        if (!state) {
+            state = std::make_unique<ClusterState>(fields[0], host, port);
+            node = state->myself;
+        } else {
+            if (state->findNode(fields[0])) throw corrupt(node_line.line);
+            node = state->addNode(fields[0], host, port);
+        }
+        node->lastSeenMs = strtoll(fields[5].c_str(), nullptr, 10);
+        node->configEpoch = strtoull(fields[6].c_str(), nullptr, 10);
+
+        for (size_t i = 8; i < fields.size(); ++i) {
+            if (fields[i].front() == '[') {
+                transit.emplace_back(&node_line, fields[i]);
+                continue;
+            }
+            size_t first, last;
+            if (!parseRange(fields[i], first, last)) throw corrupt(node_line.line);
+            std::fill(state->slots.begin() + first, state->slots.begin() + last + 1, node);
+        }
+    }
+
+    for (const auto& [node_line, field]: transit) {
+        // [slot->-id] or [slot-<-id]
+        const size_t arrow = field.find("-", 1);
+        if (field.back() != ']' || arrow == std::string::npos || field.size() < arrow + 4) throw corrupt(node_line->line);
+        size_t slot;
+        ClusterNode* other = state->findNode(field.substr(arrow + 3, field.size() - arrow - 4));
+        if (!parseSlot(field.substr(1, arrow - 1), slot) || !other) throw corrupt(node_line->line);
+
+        const std::string direction = field.substr(arrow, 3);
+        if (direction == "->-") state->migratingTo[slot] = other;
+        else if (direction == "-<-") state->importingFrom[slot] = other;
+        else throw corrupt(node_line->line);
+    }
+
+    state->currentEpoch = current_epoch;
+    return state;
+}
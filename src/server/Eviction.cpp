@@ -0,0 +1,177 @@
+#include <server/Redis.hpp>
+#include <common/Memory.hpp>
+#include <chrono>
+#include <random>
+
+/**
+ * @file Eviction.cpp
+ * @brief Implements the `maxmemory` limit and its eviction policies.
+ * @details Eviction runs before write commands, one victim at a time, until
+ * memory usage is back under the limit. LRU and LFU victims are approximated:
+ * each round samples a few keys and merges them into a small pool of the best
+ * candidates seen so far, so every eviction costs O(samples) instead of a
+ * scan of the keyspace. Under volatile-ttl the expiry index already orders
+ * keys by expiry time, so its first key is the exact victim.
+ */
+
+/// @brief The number of candidates kept between sampling rounds.
+static const size_t EVICTION_POOL_SIZE = 16;
+/// @brief The LFU counter given to new keys, so they are not evicted before they had a chance to be used.
+static const uint8_t LFU_INIT_VAL = 5;
+
+static uint32_t lruClock() {
+    using namespace std::chrono;
+    return static_cast<uint32_t>(duration_cast<seconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+/// @brief A 24-bit minutes clock, the time base of LFU decay.
+static uint32_t lfuMinutes() {
+    using namespace std::chrono;
+    return static_cast<uint32_t>(duration_cast<minutes>(steady_clock::now().time_since_epoch()).count()) & 0xFFFFFF;
+}
+
+uint8_t RedisServer::lfuDecayedCounter(const DataEntry* entry) const {
+    uint32_t last_decay = entry->access_clock >> 8;
+    uint8_t counter = entry->access_clock & 0xFF;
+
+    if (lfuDecayTime == 0) {
+        return counter;
+    }
+
+    uint32_t elapsed = (lfuMinutes() - last_decay) & 0xFFFFFF;
+    uint32_t periods = elapsed / static_cast<uint32_t>(lfuDecayTime);
+    return periods >= counter ? 0 : counter - periods;
+}
+
+void RedisServer::touchEntry(DataEntry* entry) {
+    if (evictionPolicy != EvictionPolicy::ALLKEYS_LFU) {
+        entry->access_clock = lruClock();
+        return;
+    }
+
+    // A fresh entry (clock 0) starts at LFU_INIT_VAL.
+    if (entry->access_clock == 0) {
+        entry->access_clock = (lfuMinutes() << 8) | LFU_INIT_VAL;
+        return;
+    }
+
+    uint8_t counter = lfuDecayedCounter(entry);
+
+    // Logarithmic increment: the higher the counter, the less likely it grows,
+    // so 8 bits can tell apart keys accessed up to millions of times.
+    // One generator per thread: shards touch keys concurrently.
+    thread_local std::minstd_rand rng(std::random_device{}());
+    if (counter < 255) {
+        double base = counter > LFU_INIT_VAL ? counter - LFU_INIT_VAL : 0;
+        double probability = 1.0 / (base * lfuLogFactor + 1);
+        if (std::uniform_real_distribution<double>(0.0, 1.0)(rng) < probability) {
+            ++counter;
+        }
+    }
+
+    entry->access_clock = (lfuMinutes() << 8) | counter;
+}
+
+uint64_t RedisServer::evictionScore(const DataEntry* entry) const {
+    if (evictionPolicy == EvictionPolicy::ALLKEYS_LFU) {
+        return 255 - lfuDecayedCounter(entry);
+    }
+    return lruClock() - entry->access_clock;
+}
+
+void RedisServer::populateEvictionPool() {
+    for (HashTable::Node* node: dataStore.sample(maxMemorySamples)) {
+        DataEntry* entry = static_cast<DataEntry*>(node);
+        uint64_t score = evictionScore(entry);
+
+        if (evictionPool.size() == EVICTION_POOL_SIZE && score <= evictionPool.front().score) {
+            continue;
+        }
+
+        bool pooled = std::any_of(evictionPool.begin(), evictionPool.end(), [entry](const EvictionCandidate& candidate) {
+            return candidate.key == entry->key;
+        });
+        if (pooled) {
+            continue;
+        }
+
+        if (evictionPool.size() == EVICTION_POOL_SIZE) {
+            evictionPool.erase(evictionPool.begin());
+        }
+
+        auto pos = std::upper_bound(evictionPool.begin(), evictionPool.end(), score, [](uint64_t value, const EvictionCandidate& candidate) {
+            return value < candidate.score;
+        });
+        evictionPool.insert(pos, {score, entry->key});
+    }
+}
+
+bool RedisServer::selectEvictionKey(std::string& key) {
+    switch (evictionPolicy) {
+        case EvictionPolicy::NOEVICTION:
+            return false;
+
+        case EvictionPolicy::VOLATILE_TTL:
+            if (expiryIndex.empty()) {
+                return false;
+            }
+            key = expiryIndex.begin()->second->key;
+            return true;
+
+        case EvictionPolicy::ALLKEYS_LRU:
+        case EvictionPolicy::ALLKEYS_LFU:
+            while (dataStore.size() > 0) {
+                // Sample every round: the pool then holds the best of all
+                // recent samples rather than draining down to poor candidates.
+                populateEvictionPool();
+
+                // The pool may hold keys deleted since they were sampled.
+                while (!evictionPool.empty()) {
+                    key = std::move(evictionPool.back().key);
+                    evictionPool.pop_back();
+                    if (findEntry(key)) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+    }
+    return false;
+}
+
+RedisServer::EvictResult RedisServer::performEvictions() {
+    using namespace std::chrono;
+
+    evictionPending = false;
+    if (maxMemory == 0 || memory::usedMemory() <= maxMemory) {
+        return EvictResult::OK;
+    }
+
+    // Values being destroyed by the lazy-free thread are still counted: let
+    // that memory come back before evicting more keys for it. The next write
+    // checks again.
+    if (lazyFree.pending() > 0) {
+        return EvictResult::RUNNING;
+    }
+
+    const auto start = steady_clock::now();
+    std::string key;
+
+    for (size_t evicted = 0; memory::usedMemory() > maxMemory;) {
+        if (!selectEvictionKey(key)) {
+            return EvictResult::FAIL;
+        }
+
+        removeEntry(key);
+        ++evictedKeys;
+        propagate({"del", key});
+
+        // Don't stall the current client: continue from onTick if this takes long.
+        if (++evicted % 16 == 0 && duration_cast<microseconds>(steady_clock::now() - start).count() >= static_cast<int64_t>(activeExpireBudgetUs)) {
+            evictionPending = true;
+            return EvictResult::RUNNING;
+        }
+    }
+
+    return EvictResult::OK;
+}
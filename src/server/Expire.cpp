@@ -0,0 +1,177 @@
+#include <server/Redis.hpp>
+#include <chrono>
+
+/**
+ * @file Expire.cpp
+ * @brief Implements key expiration: the TTL commands and the active expiry cycle.
+ * @details Expired keys are reclaimed in two ways. Lazily, `lookupEntry`
+ * deletes a key it finds past its expiry time, so no command ever sees one.
+ * Actively, `onTick` runs `activeExpireCycle`, which deletes due keys in
+ * expiry order under a time budget so keys that are never accessed again
+ * don't linger in memory.
+ */
+
+int64_t RedisServer::unixTimeMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+void RedisServer::setExpire(DataEntry* entry, int64_t expire_at_ms) {
+    if (RedisServer* owner = foreignShard(entry->key)) {
+        owner->setExpire(entry, expire_at_ms);
+        return;
+    }
+    if (entry->expire_at_ms != 0) {
+        expiryIndex.erase({entry->expire_at_ms, entry});
+    }
+
+    entry->expire_at_ms = expire_at_ms;
+    if (expire_at_ms != 0) {
+        expiryIndex.insert({expire_at_ms, entry});
+    }
+}
+
+void RedisServer::activeExpireCycle() {
+    using namespace std::chrono;
+    const auto start = steady_clock::now();
+    const int64_t now_ms = unixTimeMs();
+    bool out_of_time = false;
+
+    for (size_t removed = 0; !expiryIndex.empty() && expiryIndex.begin()->first <= now_ms;) {
+        std::string key = expiryIndex.begin()->second->key;
+        removeEntry(key);
+        ++expiredKeys;
+        propagate({"del", key});
+
+        // Reading the clock is not free: check the budget every few keys.
+        if (++removed % 16 == 0 && duration_cast<microseconds>(steady_clock::now() - start).count() >= static_cast<int64_t>(activeExpireBudgetUs)) {
+            out_of_time = true;
+            break;
+        }
+    }
+
+    // When keys are left over, go again right after the next round of I/O.
+    nextExpireCycleMs = out_of_time ? 0 : now_ms + 1000 / static_cast<int64_t>(std::max<size_t>(1, hz));
+}
+
+void RedisServer::expireGeneric(const Request& request, Buffer& response, int64_t unit_ms) {
+    if (request.command.size() != 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, std::string("Wrong number of arguments for '") + (unit_ms == 1 ? "pexpire" : "expire") + "'");
+        return;
+    }
+
+    long long ttl;
+    try {
+        size_t consumed = 0;
+        ttl = std::stoll(request.command[2], &consumed);
+        if (consumed != request.command[2].size()) throw std::invalid_argument(request.command[2]);
+    } catch (const std::exception &e) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value is not an integer or out of range");
+        return;
+    }
+
+    if (ttl > (1LL << 46) / unit_ms) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "invalid expire time in '" + request.lowerCaseCommand() + "' command");
+        return;
+    }
+
+    DataEntry* entry = lookupEntry(request.command[1]);
+    if (!entry) {
+        ResponseBuilder::outInt(response, 0);
+        return;
+    }
+
+    if (ttl <= 0) {
+        // A TTL in the past deletes the key right away.
+        removeEntry(request.command[1]);
+        rewrittenCommand = {"del", request.command[1]};
+    } else {
+        setExpire(entry, unixTimeMs() + ttl * unit_ms);
+        rewrittenCommand = {"pexpireat", request.command[1], std::to_string(entry->expire_at_ms)};
+    }
+    ResponseBuilder::outInt(response, 1);
+}
+
+void RedisServer::handlePExpireAt(const Request& request, Buffer& response) {
+    if (request.command.size() != 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'pexpireat'");
+        return;
+    }
+
+    long long expire_at_ms;
+    try {
+        size_t consumed = 0;
+        expire_at_ms = std::stoll(request.command[2], &consumed);
+        if (consumed != request.command[2].size()) throw std::invalid_argument(request.command[2]);
+    } catch (const std::exception &e) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value is not an integer or out of range");
+        return;
+    }
+
+    DataEntry* entry = lookupEntry(request.command[1]);
+    if (!entry) {
+        ResponseBuilder::outInt(response, 0);
+        return;
+    }
+
+    if (expire_at_ms <= unixTimeMs()) {
+        removeEntry(request.command[1]);
+        rewrittenCommand = {"del", request.command[1]};
+    } else {
+        setExpire(entry, expire_at_ms);
+    }
+    ResponseBuilder::outInt(response, 1);
+}
+
+void RedisServer::handleExpire(const Request& request, Buffer& response) {
+    expireGeneric(request, response, 1000);
+}
+
+void RedisServer::handlePExpire(const Request& request, Buffer& response) {
+    expireGeneric(request, response, 1);
+}
+
+void RedisServer::ttlGeneric(const Request& request, Buffer& response, bool in_ms) {
+    if (request.command.size() != 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, std::string("Wrong number of arguments for '") + (in_ms ? "pttl" : "ttl") + "'");
+        return;
+    }
+
+    DataEntry* entry = lookupEntry(request.command[1]);
+    if (!entry) {
+        ResponseBuilder::outInt(response, -2);
+        return;
+    }
+
+    if (entry->expire_at_ms == 0) {
+        ResponseBuilder::outInt(response, -1);
+        return;
+    }
+
+    int64_t remaining_ms = std::max<int64_t>(0, entry->expire_at_ms - unixTimeMs());
+    ResponseBuilder::outInt(response, in_ms ? remaining_ms : (remaining_ms + 500) / 1000);
+}
+
+void RedisServer::handleTTL(const Request& request, Buffer& response) {
+    ttlGeneric(request, response, false);
+}
+
+void RedisServer::handlePTTL(const Request& request, Buffer& response) {
+    ttlGeneric(request, response, true);
+}
+
+void RedisServer::handlePersist(const Request& request, Buffer& response) {
+    if (request.command.size() != 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'persist'");
+        return;
+    }
+
+    DataEntry* entry = lookupEntry(request.command[1]);
+    if (!entry || entry->expire_at_ms == 0) {
+        ResponseBuilder::outInt(response, 0);
+        return;
+    }
+
+    setExpire(entry, 0);
+    ResponseBuilder::outInt(response, 1);
+}
@@ -0,0 +1,161 @@
+#include <server/Redis.hpp>
+
+/**
+ * @file HashCommands.cpp
+ * @brief Implements the hash (HSET, HGET, ...) command handlers of RedisServer.
+ */
+
+void RedisServer::handleHSet(const Request& request, Buffer& response) {
+    if (request.command.size() < 4 || request.command.size() % 2 != 0) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'hset'");
+        return;
+    }
+
+    Hash* hash;
+    if (!lookupTyped(request.command[1], hash, response)) return;
+    if (!hash) {
+        hash = &std::get<Hash>(addEntry(request.command[1], Hash{})->value);
+    }
+
+    int64_t added = 0;
+    for (size_t i = 2; i < request.command.size(); i += 2) {
+        if (hash->set(request.command[i], request.command[i + 1])) {
+            ++added;
+        }
+    }
+
+    ResponseBuilder::outInt(response, added);
+}
+
+void RedisServer::handleHGet(const Request& request, Buffer& response) {
+    if (request.command.size() != 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'hget'");
+        return;
+    }
+
+    Hash* hash;
+    if (!lookupTyped(request.command[1], hash, response)) return;
+
+    std::string value;
+    if (hash && hash->get(request.command[2], value)) {
+        ResponseBuilder::outStr(response, value);
+    } else {
+        ResponseBuilder::outNil(response);
+    }
+}
+
+void RedisServer::handleHMGet(const Request& request, Buffer& response) {
+    if (request.command.size() < 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'hmget'");
+        return;
+    }
+
+    Hash* hash;
+    if (!lookupTyped(request.command[1], hash, response)) return;
+
+    ResponseBuilder::outArr(response, static_cast<uint32_t>(request.command.size() - 2));
+    std::string value;
+    for (size_t i = 2; i < request.command.size(); ++i) {
+        if (hash && hash->get(request.command[i], value)) {
+            ResponseBuilder::outStr(response, value);
+        } else {
+            ResponseBuilder::outNil(response);
+        }
+    }
+}
+
+void RedisServer::handleHDel(const Request& request, Buffer& response) {
+    if (request.command.size() < 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'hdel'");
+        return;
+    }
+
+    Hash* hash;
+    if (!lookupTyped(request.command[1], hash, response)) return;
+    if (!hash) {
+        ResponseBuilder::outInt(response, 0);
+        return;
+    }
+
+    int64_t removed = 0;
+    for (size_t i = 2; i < request.command.size(); ++i) {
+        if (hash->remove(request.command[i])) {
+            ++removed;
+        }
+    }
+
+    // A hash never stays empty: the key goes away with its last field.
+    if (hash->size() == 0) {
+        removeEntry(request.command[1]);
+    }
+
+    ResponseBuilder::outInt(response, removed);
+}
+
+void RedisServer::handleHGetAll(const Request& request, Buffer& response) {
+    if (request.command.size() != 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'hgetall'");
+        return;
+    }
+
+    Hash* hash;
+    if (!lookupTyped(request.command[1], hash, response)) return;
+    if (!hash) {
+        ResponseBuilder::outArr(response, 0);
+        return;
+    }
+
+    ResponseBuilder::outArr(response, static_cast<uint32_t>(hash->size() * 2));
+    hash->forEach([&response](std::string_view field, std::string_view value) {
+        ResponseBuilder::outStr(response, std::string(field));
+        ResponseBuilder::outStr(response, std::string(value));
+    });
+}
+
+void RedisServer::handleHIncrBy(const Request& request, Buffer& response) {
+    if (request.command.size() != 4) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'hincrby'");
+        return;
+    }
+
+    int64_t increment = 0;
+    if (!parseInt64(request.command[3], increment)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value is not an integer or out of range");
+        return;
+    }
+
+    Hash* hash;
+    if (!lookupTyped(request.command[1], hash, response)) return;
+
+    int64_t current = 0;
+    std::string value;
+    if (hash && hash->get(request.command[2], value) && !parseInt64(value, current)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "hash value is not an integer");
+        return;
+    }
+
+    int64_t result = 0;
+    if (__builtin_add_overflow(current, increment, &result)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "increment or decrement would overflow");
+        return;
+    }
+
+    if (!hash) {
+        hash = &std::get<Hash>(addEntry(request.command[1], Hash{})->value);
+    }
+    hash->set(request.command[2], std::to_string(result));
+
+    ResponseBuilder::outInt(response, result);
+}
+
+void RedisServer::handleHLen(const Request& request, Buffer& response) {
+    if (request.command.size() != 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'hlen'");
+        return;
+    }
+
+    Hash* hash;
+    if (!lookupTyped(request.command[1], hash, response)) return;
+
+    ResponseBuilder::outInt(response, hash ? static_cast<int64_t>(hash->size()) : 0);
+}
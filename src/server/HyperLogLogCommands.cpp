@@ -0,0 +1,114 @@
+#include <server/Redis.hpp>
+
+/**
+ * @file HyperLogLogCommands.cpp
+ * @brief Implements the HyperLogLog (PFADD, PFCOUNT, PFMERGE) command handlers of RedisServer.
+ */
+
+static const char* const CORRUPT_SKETCH = "Corrupted HLL object detected";
+
+bool RedisServer::lookupHyperLogLog(const std::string& key, std::string*& sketch, Buffer& response) {
+    sketch = nullptr;
+    DataEntry* entry = lookupEntry(key);
+    if (!entry) {
+        return true;
+    }
+    auto* value = std::holds_alternative<std::string>(entry->value) ? &rawString(entry) : nullptr;
+    if (!value || !hll::isValid(*value)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Key is not a valid HyperLogLog string value");
+        return false;
+    }
+    sketch = value;
+    return true;
+}
+
+void RedisServer::handlePFAdd(const Request& request, Buffer& response) {
+    if (request.command.size() < 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'pfadd'");
+        return;
+    }
+
+    std::string* sketch;
+    if (!lookupHyperLogLog(request.command[1], sketch, response)) return;
+
+    // Creating the key counts as a change, even without elements.
+    bool updated = false;
+    if (!sketch) {
+        sketch = &std::get<std::string>(addEntry(request.command[1], hll::create())->value);
+        updated = true;
+    }
+
+    for (size_t i = 2; i < request.command.size(); ++i) {
+        int result = hll::add(*sketch, request.command[i]);
+        if (result < 0) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, CORRUPT_SKETCH);
+            return;
+        }
+        updated = updated || result == 1;
+    }
+
+    ResponseBuilder::outInt(response, updated ? 1 : 0);
+}
+
+void RedisServer::handlePFCount(const Request& request, Buffer& response) {
+    if (request.command.size() < 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'pfcount'");
+        return;
+    }
+
+    // A single sketch answers from (and refreshes) its cached cardinality.
+    if (request.command.size() == 2) {
+        std::string* sketch;
+        if (!lookupHyperLogLog(request.command[1], sketch, response)) return;
+
+        uint64_t cardinality = 0;
+        if (sketch && !hll::count(*sketch, cardinality)) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, CORRUPT_SKETCH);
+            return;
+        }
+        ResponseBuilder::outInt(response, static_cast<int64_t>(cardinality));
+        return;
+    }
+
+    // Several sketches are counted as their union, without storing it.
+    hll::Registers registers{};
+    for (size_t i = 1; i < request.command.size(); ++i) {
+        std::string* sketch;
+        if (!lookupHyperLogLog(request.command[i], sketch, response)) return;
+        if (sketch && !hll::merge(registers, *sketch)) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, CORRUPT_SKETCH);
+            return;
+        }
+    }
+
+    ResponseBuilder::outInt(response, static_cast<int64_t>(hll::estimate(registers)));
+}
+
+void RedisServer::handlePFMerge(const Request& request, Buffer& response) {
+    if (request.command.size() < 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'pfmerge'");
+        return;
+    }
+
+    // The destination's own registers are part of the union.
+    hll::Registers registers{};
+    for (size_t i = 1; i < request.command.size(); ++i) {
+        std::string* sketch;
+        if (!lookupHyperLogLog(request.command[i], sketch, response)) return;
+        if (sketch && !hll::merge(registers, *sketch)) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, CORRUPT_SKETCH);
+            return;
+        }
+    }
+
+    // Overwrite an existing destination in place, so it keeps its TTL.
+    std::string merged = hll::fromRegisters(registers);
+    if (DataEntry* entry = findEntry(request.command[1])) {
+        entry->value = std::move(merged);
+        entry->compressed = false;
+    } else {
+        addEntry(request.command[1], std::move(merged));
+    }
+
+    ResponseBuilder::outStr(response, "OK");
+}
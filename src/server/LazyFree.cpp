@@ -0,0 +1,50 @@
+#include <server/LazyFree.hpp>
+
+/**
+ * @file LazyFree.cpp
+ * @brief Implements the background reclamation thread.
+ */
+
+LazyFree::LazyFree() {
+    worker = std::thread(&LazyFree::run, this);
+}
+
+LazyFree::~LazyFree() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_one();
+    worker.join();
+}
+
+void LazyFree::enqueue(std::unique_ptr<Garbage> garbage) {
+    ++pendingObjects;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(garbage));
+    }
+    wakeup.notify_one();
+}
+
+void LazyFree::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        wakeup.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            return; // Stopping, and everything was freed.
+        }
+
+        // Destroy outside of the lock so the event loop never waits on it.
+        std::unique_ptr<Garbage> garbage = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+
+        garbage.reset();
+        --pendingObjects;
+        ++freedObjects;
+
+        lock.lock();
+    }
+}
@@ -0,0 +1,266 @@
+#include <server/Redis.hpp>
+
+/**
+ * @file ListCommands.cpp
+ * @brief Implements the list (LPUSH, LPOP, BLPOP, ...) command handlers of RedisServer.
+ */
+
+void RedisServer::pushGeneric(const Request& request, Buffer& response, bool to_tail) {
+    if (request.command.size() < 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, std::string("Wrong number of arguments for '") + (to_tail ? "rpush" : "lpush") + "'");
+        return;
+    }
+
+    List* list;
+    if (!lookupTyped(request.command[1], list, response)) return;
+    if (!list) {
+        list = &std::get<List>(addEntry(request.command[1], List{})->value);
+    }
+
+    for (size_t i = 2; i < request.command.size(); ++i) {
+        if (to_tail) {
+            list->pushBack(request.command[i]);
+        } else {
+            list->pushFront(request.command[i]);
+        }
+    }
+
+    // Reply with the length before blocked clients get their share.
+    ResponseBuilder::outInt(response, static_cast<int64_t>(list->size()));
+    signalKeyAsReady(request.command[1]);
+}
+
+void RedisServer::handleLPush(const Request& request, Buffer& response) {
+    pushGeneric(request, response, false);
+}
+
+void RedisServer::handleRPush(const Request& request, Buffer& response) {
+    pushGeneric(request, response, true);
+}
+
+void RedisServer::popGeneric(const Request& request, Buffer& response, bool from_tail) {
+    if (request.command.size() != 2 && request.command.size() != 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, std::string("Wrong number of arguments for '") + (from_tail ? "rpop" : "lpop") + "'");
+        return;
+    }
+
+    // Without a count the reply is a single element; with one, an array.
+    int64_t count = 1;
+    const bool has_count = request.command.size() == 3;
+    if (has_count && (!parseInt64(request.command[2], count) || count < 0)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value is out of range, must be positive");
+        return;
+    }
+
+    List* list;
+    if (!lookupTyped(request.command[1], list, response)) return;
+    if (!list) {
+        ResponseBuilder::outNil(response);
+        return;
+    }
+
+    const size_t popped = std::min(static_cast<size_t>(count), list->size());
+    if (has_count) {
+        ResponseBuilder::outArr(response, static_cast<uint32_t>(popped));
+    }
+
+    std::string element;
+    for (size_t i = 0; i < popped; ++i) {
+        if (from_tail) {
+            list->popBack(element);
+        } else {
+            list->popFront(element);
+        }
+        ResponseBuilder::outStr(response, element);
+    }
+
+    // A list never stays empty: the key goes away with its last element.
+    if (list->size() == 0) {
+        removeEntry(request.command[1]);
+    }
+}
+
+void RedisServer::handleLPop(const Request& request, Buffer& response) {
+    popGeneric(request, response, false);
+}
+
+void RedisServer::handleRPop(const Request& request, Buffer& response) {
+    popGeneric(request, response, true);
+}
+
+void RedisServer::handleLRange(const Request& request, Buffer& response) {
+    if (request.command.size() != 4) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'lrange'");
+        return;
+    }
+
+    int64_t start, end;
+    if (!parseInt64(request.command[2], start) || !parseInt64(request.command[3], end)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value is not an integer or out of range");
+        return;
+    }
+
+    List* list;
+    if (!lookupTyped(request.command[1], list, response)) return;
+    if (!list) {
+        ResponseBuilder::outArr(response, 0);
+        return;
+    }
+
+    int64_t size = static_cast<int64_t>(list->size());
+
+    if (start < 0) start += size;
+    if (end < 0)   end   += size;
+    if (start < 0) start = 0;
+    if (start >= size || start > end) {
+        ResponseBuilder::outArr(response, 0);
+        return;
+    }
+
+    if (end >= size) end = size - 1;
+
+    ResponseBuilder::outArr(response, static_cast<uint32_t>(end - start + 1));
+    list->range(start, end, [&response](std::string_view element) {
+        ResponseBuilder::outStr(response, std::string(element));
+    });
+}
+
+void RedisServer::handleLLen(const Request& request, Buffer& response) {
+    if (request.command.size() != 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'llen'");
+        return;
+    }
+
+    List* list;
+    if (!lookupTyped(request.command[1], list, response)) return;
+    ResponseBuilder::outInt(response, list ? static_cast<int64_t>(list->size()) : 0);
+}
+
+void RedisServer::handleLIndex(const Request& request, Buffer& response) {
+    if (request.command.size() != 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'lindex'");
+        return;
+    }
+
+    int64_t index;
+    if (!parseInt64(request.command[2], index)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value is not an integer or out of range");
+        return;
+    }
+
+    List* list;
+    if (!lookupTyped(request.command[1], list, response)) return;
+    if (!list) {
+        ResponseBuilder::outNil(response);
+        return;
+    }
+
+    if (index < 0) index += static_cast<int64_t>(list->size());
+
+    std::string element;
+    if (index >= 0 && list->index(static_cast<size_t>(index), element)) {
+        ResponseBuilder::outStr(response, element);
+    } else {
+        ResponseBuilder::outNil(response);
+    }
+}
+
+void RedisServer::handleLTrim(const Request& request, Buffer& response) {
+    if (request.command.size() != 4) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'ltrim'");
+        return;
+    }
+
+    int64_t start, end;
+    if (!parseInt64(request.command[2], start) || !parseInt64(request.command[3], end)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value is not an integer or out of range");
+        return;
+    }
+
+    List* list;
+    if (!lookupTyped(request.command[1], list, response)) return;
+    if (!list) {
+        ResponseBuilder::outStr(response, "OK");
+        return;
+    }
+
+    int64_t size = static_cast<int64_t>(list->size());
+
+    if (start < 0) start += size;
+    if (end < 0)   end   += size;
+    if (start < 0) start = 0;
+    if (end >= size) end = size - 1;
+
+    if (start >= size || start > end) {
+        removeEntry(request.command[1]);
+    } else {
+        list->trim(start, end);
+    }
+
+    ResponseBuilder::outStr(response, "OK");
+}
+
+bool RedisServer::listPopWithKey(const std::string& key, bool from_tail, Buffer& response) {
+    DataEntry* entry = lookupEntry(key);
+    if (!entry || !std::holds_alternative<List>(entry->value)) {
+        return false;
+    }
+
+    List& list = std::get<List>(entry->value);
+    std::string element;
+    if (!(from_tail ? list.popBack(element) : list.popFront(element))) {
+        return false;
+    }
+
+    ResponseBuilder::outArr(response, 2);
+    ResponseBuilder::outStr(response, key);
+    ResponseBuilder::outStr(response, element);
+
+    if (list.size() == 0) {
+        removeEntry(key);
+    }
+    return true;
+}
+
+void RedisServer::blockingPopGeneric(const Request& request, Buffer& response, bool from_tail) {
+    if (request.command.size() < 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, std::string("Wrong number of arguments for '") + (from_tail ? "brpop" : "blpop") + "'");
+        return;
+    }
+
+    double timeout;
+    if (!parseBlockTimeout(request.command.back(), timeout, response)) {
+        return;
+    }
+
+    std::vector<std::string> keys(request.command.begin() + 1, request.command.end() - 1);
+    for (const auto& key: keys) {
+        DataEntry* entry = lookupEntry(key);
+        if (entry && !std::holds_alternative<List>(entry->value)) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
+            return;
+        }
+    }
+
+    for (const auto& key: keys) {
+        if (listPopWithKey(key, from_tail, response)) {
+            rewrittenCommand = {from_tail ? "rpop" : "lpop", key};
+            return;
+        }
+    }
+
+    if (!currentClient) {
+        ResponseBuilder::outNil(response);
+        return;
+    }
+
+    blockClient(*currentClient, std::move(keys), from_tail ? BlockedPop::LIST_TAIL : BlockedPop::LIST_HEAD, blockDeadline(timeout));
+}
+
+void RedisServer::handleBLPop(const Request& request, Buffer& response) {
+    blockingPopGeneric(request, response, false);
+}
+
+void RedisServer::handleBRPop(const Request& request, Buffer& response) {
+    blockingPopGeneric(request, response, true);
+}
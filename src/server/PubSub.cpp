@@ -0,0 +1,212 @@
+#include <server/Redis.hpp>
+
+/**
+ * @file PubSub.cpp
+ * @brief Implements Pub/Sub: SUBSCRIBE, PSUBSCRIBE, their UNSUBSCRIBE counterparts and PUBLISH.
+ * @details A published message is framed once into a reference-counted
+ * buffer, which is queued by reference on every subscriber's connection, so
+ * fanning a message out to N subscribers costs N pointer enqueues rather
+ * than N copies of the payload. Pattern subscribers get one frame per
+ * matching pattern, shared by all subscribers of that pattern.
+ *
+ * Subscription requests are confirmed with one reply per channel or pattern
+ * (`[kind, name, count]`, where `count` is the number of subscriptions the
+ * connection still has), so their handlers queue the replies themselves.
+ */
+
+/**
+ * @brief Frames a response into a buffer that can be queued on many connections.
+ */
+static net::SharedBuffer shareResponse(const Buffer& response) {
+    auto frame = std::make_shared<std::vector<uint8_t>>(4 + response.size());
+    uint32_t total_len = static_cast<uint32_t>(response.size());
+    memcpy(frame->data(), &total_len, 4);
+    std::copy(response.begin(), response.end(), frame->begin() + 4);
+    return frame;
+}
+
+void RedisServer::pubsubReply(Connection& conn, const char* kind, const std::string* name, size_t count) {
+    Buffer response;
+    ResponseBuilder::outArr(response, 3);
+    ResponseBuilder::outStr(response, kind);
+    if (name) {
+        ResponseBuilder::outStr(response, *name);
+    } else {
+        ResponseBuilder::outNil(response);
+    }
+    ResponseBuilder::outInt(response, static_cast<int64_t>(count));
+    reply(conn, response);
+}
+
+void RedisServer::handleSubscribe(const Request& request, Buffer& response) {
+    if (request.command.size() < 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'subscribe'");
+        return;
+    }
+    if (!currentClient) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "SUBSCRIBE needs a client connection");
+        return;
+    }
+
+    PubSubClient& client = pubsubClients[currentClient];
+    for (size_t i = 1; i < request.command.size(); ++i) {
+        const std::string& channel = request.command[i];
+        if (client.channels.insert(channel).second) {
+            pubsubChannels[channel].push_back(currentClient);
+        }
+        pubsubReply(*currentClient, "subscribe", &channel, client.count());
+    }
+}
+
+void RedisServer::handlePSubscribe(const Request& request, Buffer& response) {
+    if (request.command.size() < 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'psubscribe'");
+        return;
+    }
+    if (!currentClient) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "PSUBSCRIBE needs a client connection");
+        return;
+    }
+
+    PubSubClient& client = pubsubClients[currentClient];
+    for (size_t i = 1; i < request.command.size(); ++i) {
+        const std::string& pattern = request.command[i];
+        if (client.patterns.insert(pattern).second) {
+            auto it = pubsubPatterns.find(pattern);
+            if (it == pubsubPatterns.end()) {
+                it = pubsubPatterns.emplace(pattern, PatternSubscribers{glob::Pattern(pattern), {}}).first;
+            }
+            it->second.subscribers.push_back(currentClient);
+        }
+        pubsubReply(*currentClient, "psubscribe", &pattern, client.count());
+    }
+}
+
+bool RedisServer::pubsubUnsubscribe(Connection& conn, const std::string& name, bool pattern) {
+    auto client = pubsubClients.find(&conn);
+    if (client == pubsubClients.end()) {
+        return false;
+    }
+    if ((pattern ? client->second.patterns : client->second.channels).erase(name) == 0) {
+        return false;
+    }
+
+    auto forget = [&conn](std::vector<Connection*>& subscribers) {
+        subscribers.erase(std::find(subscribers.begin(), subscribers.end(), &conn));
+        return subscribers.empty();
+    };
+
+    if (pattern) {
+        auto it = pubsubPatterns.find(name);
+        if (forget(it->second.subscribers)) pubsubPatterns.erase(it);
+    } else {
+        auto it = pubsubChannels.find(name);
+        if (forget(it->second)) pubsubChannels.erase(it);
+    }
+    return true;
+}
+
+void RedisServer::unsubscribeGeneric(const Request& request, bool pattern) {
+    const char* kind = pattern ? "punsubscribe" : "unsubscribe";
+    Connection& conn = *currentClient;
+
+    // Without arguments, leave every channel (or pattern).
+    std::vector<std::string> names(request.command.begin() + 1, request.command.end());
+    auto client = pubsubClients.find(&conn);
+    if (names.empty() && client != pubsubClients.end()) {
+        const auto& subscribed = pattern ? client->second.patterns : client->second.channels;
+        names.assign(subscribed.begin(), subscribed.end());
+    }
+
+    auto remaining = [&]() -> size_t {
+        return client != pubsubClients.end() ? client->second.count() : 0;
+    };
+    for (const auto& name: names) {
+        pubsubUnsubscribe(conn, name, pattern);
+        pubsubReply(conn, kind, &name, remaining());
+    }
+    if (names.empty()) {
+        pubsubReply(conn, kind, nullptr, remaining());
+    }
+
+    // With its last subscription gone, the connection leaves subscribed mode.
+    if (client != pubsubClients.end() && client->second.count() == 0) {
+        pubsubClients.erase(client);
+    }
+}
+
+void RedisServer::handleUnsubscribe(const Request& request, Buffer& response) {
+    if (!currentClient) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "UNSUBSCRIBE needs a client connection");
+        return;
+    }
+    unsubscribeGeneric(request, false);
+}
+
+void RedisServer::handlePUnsubscribe(const Request& request, Buffer& response) {
+    if (!currentClient) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "PUNSUBSCRIBE needs a client connection");
+        return;
+    }
+    unsubscribeGeneric(request, true);
+}
+
+void RedisServer::pubsubUnsubscribeAll(Connection& conn) {
+    auto client = pubsubClients.find(&conn);
+    if (client == pubsubClients.end()) {
+        return;
+    }
+
+    const PubSubClient subscriptions = client->second;
+    for (const auto& channel: subscriptions.channels) {
+        pubsubUnsubscribe(conn, channel, false);
+    }
+    for (const auto& pattern: subscriptions.patterns) {
+        pubsubUnsubscribe(conn, pattern, true);
+    }
+    pubsubClients.erase(&conn);
+}
+
+void RedisServer::handlePublish(const Request& request, Buffer& response) {
+    if (request.command.size() != 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'publish'");
+        return;
+    }
+
+    const std::string& channel = request.command[1];
+    const std::string& message = request.command[2];
+    int64_t receivers = 0;
+
+    auto fanOut = [&receivers](const std::vector<Connection*>& subscribers, const net::SharedBuffer& frame) {
+        for (Connection* conn: subscribers) {
+            conn->appendShared(frame);
+            conn->want_write = true;
+        }
+        receivers += static_cast<int64_t>(subscribers.size());
+    };
+
+    auto subscribers = pubsubChannels.find(channel);
+    if (subscribers != pubsubChannels.end()) {
+        Buffer frame;
+        ResponseBuilder::outArr(frame, 3);
+        ResponseBuilder::outStr(frame, "message");
+        ResponseBuilder::outStr(frame, channel);
+        ResponseBuilder::outStr(frame, message);
+        fanOut(subscribers->second, shareResponse(frame));
+    }
+
+    for (const auto& [name, pattern]: pubsubPatterns) {
+        if (!pattern.pattern.matches(channel)) {
+            continue;
+        }
+        Buffer frame;
+        ResponseBuilder::outArr(frame, 4);
+        ResponseBuilder::outStr(frame, "pmessage");
+        ResponseBuilder::outStr(frame, name);
+        ResponseBuilder::outStr(frame, channel);
+        ResponseBuilder::outStr(frame, message);
+        fanOut(pattern.subscribers, shareResponse(frame));
+    }
+
+    ResponseBuilder::outInt(response, receivers);
+}
@@ -1,4 +1,25 @@
 #include <server/Redis.hpp>
+#include <common/Memory.hpp>
+#include <common/Lzf.hpp>
+#include <cmath>
+#include <strings.h>
+#include <utility>
+
+/// @brief Values that take more allocations than this to free are freed lazily (when enabled).
+static const size_t LAZYFREE_THRESHOLD = 64;
+
+/// @brief The longest timeout a blocking command accepts, in seconds (about 31 years).
+static const double MAX_BLOCK_TIMEOUT_S = 1e9;
+
+bool parseInt64(const std::string& str, int64_t& value) {
+    try {
+        size_t consumed = 0;
+        value = std::stoll(str, &consumed);
+        return consumed == str.size();
+    } catch (const std::exception &e) {
+        return false;
+    }
+}
 
 /* ====== Private methods ====== */
 
@@ -9,17 +30,60 @@ void RedisServer::onRequest(Connection& conn, const std::string& request) {
     if(parseRequest(request, parsed_request) != 0) {
         ResponseBuilder::outErr(response, ERR_PROTOCOL, "Protocol error");
         conn.want_close = true;
+    } else if(shards) {
+        // Replies once the replies before it are in (see Sharding.cpp).
+        shardRequest(conn, parsed_request);
+    } else if(cluster && !clusterAcceptsRequest(conn, parsed_request, response)) {
+        // Its keys are served elsewhere, or not at all: the error says which.
     } else {
+        const size_t logged = aofBuffer.size();
+        currentClient = &conn;
         executeRequest(parsed_request, response);
+        currentClient = nullptr;
+
+        // Under `appendfsync always`, a write is acknowledged once it is on disk.
+        if(aofBuffer.size() != logged) {
+            holdUntilSynced(conn);
+        }
     }
 
+    // A blocked request leaves the response empty: it is answered later.
     if(!response.empty()) {
-        uint32_t total_len = static_cast<uint32_t>(response.size());
-        conn.appendOutgoing(reinterpret_cast<const uint8_t*>(&total_len), 4);
-        conn.appendOutgoing(response.data(), response.size());
+        reply(conn, response);
     }
 }
 
+void RedisServer::onDisconnect(Connection& conn) {
+    unblockClient(conn);
+    pubsubUnsubscribeAll(conn);
+    replicas.erase(&conn);
+
+    // The owning shards stop waiting on behalf of a client that left.
+    auto pending = pendingReplies.find(&conn);
+    if(pending != pendingReplies.end()) {
+        for(const PendingReply& forwarded: pending->second) {
+            if(forwarded.done) continue;
+            forwardedRequests.erase(forwarded.token);
+            ShardMessage cancel;
+            cancel.type = ShardMessage::Type::CANCEL;
+            cancel.token = forwarded.token;
+            sendToShard(forwarded.shard, std::move(cancel));
+        }
+        pendingReplies.erase(pending);
+    }
+    deferredRequests.erase(&conn);
+    askingClients.erase(&conn);
+
+    aofPendingClients.erase(std::remove(aofPendingClients.begin(), aofPendingClients.end(), &conn), aofPendingClients.end());
+    aofSyncWaiters.erase(&conn);
+}
+
+void RedisServer::reply(Connection& conn, const Buffer& response) {
+    uint32_t total_len = static_cast<uint32_t>(response.size());
+    conn.appendOutgoing(reinterpret_cast<const uint8_t*>(&total_len), 4);
+    conn.appendOutgoing(response.data(), response.size());
+}
+
 bool RedisServer::parseUInt32(const char*& cursor, const char* buffer_end, uint32_t& value) {
     if(cursor + 4 > buffer_end)
         return false; // Not enough data to read a uint32_t
@@ -38,7 +102,9 @@ int32_t RedisServer::parseRequest(const std::string& raw_data, Request& parsed_r
     if(!parseUInt32(cursor, buffer_end, num_strings))
         return -1; // Failed to parse the number of strings
 
-    const size_t K_MAX_ARGS = 1024;
+    // Bulk loads (e.g. a ZADD with a whole leaderboard) need many arguments;
+    // the message size limit still bounds the total request size.
+    const size_t K_MAX_ARGS = 1 << 20;
     if(num_strings > K_MAX_ARGS)
         return -2; // Too many arguments
 
@@ -69,21 +135,197 @@ void RedisServer::executeRequest(const Request& request, Buffer& response) {
     const std::string& cmd = request.lowerCaseCommand();
     auto it = commandTable.find(cmd);
 
-    if(it != commandTable.end()) {
-        it->second(request, response);
-    } else {
+    if(it == commandTable.end()) {
         handleUnknown(request, response);
+        return;
+    }
+
+    // A subscribed connection only receives messages, besides managing its subscriptions.
+    if(currentClient && !(it->second.flags & CMD_PUBSUB) && pubsubClients.count(currentClient)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Can't execute '" + cmd + "': only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING are allowed in this context");
+        return;
+    }
+
+    // A replica only changes through its primary's stream.
+    if(isReplica() && currentClient && (it->second.flags & CMD_WRITE)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "READONLY You can't write against a read only replica.");
+        return;
+    }
+
+    // Make room before any write, so memory is reclaimed a little at a time.
+    // A replica leaves eviction to its primary, whose deletions it receives.
+    if(maxMemory != 0 && !isReplica() && (it->second.flags & CMD_WRITE)) {
+        if(performEvictions() == EvictResult::FAIL && (it->second.flags & CMD_DENYOOM)) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "OOM command not allowed when used memory > 'maxmemory'");
+            return;
+        }
+    }
+
+    // Keep the keyspace in line with the log: accept no writes it may miss.
+    if(aofState == AofState::ON && !aofLastWriteOk && (it->second.flags & CMD_WRITE)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Errors writing to the AOF file, write commands are disabled");
+        return;
+    }
+
+    rewrittenCommand.reset();
+    it->second.handler(request, response);
+
+    // Failed writes change nothing, and a blocked command is logged once it is served.
+    if((it->second.flags & CMD_WRITE) && !response.empty() && response[0] != RES_ERR) {
+        ++dirty;
+        // Rewritten as nothing when the command logged its effects itself.
+        if(!rewrittenCommand || !rewrittenCommand->empty()) {
+            propagate(rewrittenCommand ? *rewrittenCommand : request.command);
+        }
     }
 }
 
 void RedisServer::handleKeys(const Request& request, Buffer& response) {
-    (void) request;
+    if (request.command.size() > 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'keys'");
+        return;
+    }
+
+    // Without a pattern (or with "*"), every key is listed.
+    std::optional<glob::Pattern> pattern;
+    if (request.command.size() == 2 && request.command[1] != "*") {
+        pattern.emplace(request.command[1]);
+    }
 
-    ResponseBuilder::outArr(response, static_cast<uint32_t>(dataStore.size()));
+    // Expired keys that were not reclaimed yet must not be listed.
+    const int64_t now_ms = unixTimeMs();
+    std::vector<const std::string*> keys;
+    forEachShard([&keys, &pattern, now_ms](RedisServer& shard) {
+        if (!pattern) {
+            keys.reserve(keys.size() + shard.dataStore.size());
+        }
 
-    dataStore.forEach([this, &response](HashTable::Node* node) {
-        ResponseBuilder::outStr(response, static_cast<DataEntry*>(node)->key);
+        shard.dataStore.forEach([&keys, &pattern, now_ms](HashTable::Node* node) {
+            DataEntry* entry = static_cast<DataEntry*>(node);
+            if (pattern && !pattern->matches(entry->key)) return;
+            if (!isExpired(entry, now_ms)) {
+                keys.push_back(&entry->key);
+            }
+        });
     });
+
+    ResponseBuilder::outArr(response, static_cast<uint32_t>(keys.size()));
+    for (const std::string* key: keys) {
+        ResponseBuilder::outStr(response, *key);
+    }
+}
+
+bool RedisServer::parseScanOptions(const Request& request, size_t cursor_index, ScanOptions& options, Buffer& response) {
+    const std::string& cursor = request.command[cursor_index];
+    try {
+        size_t consumed = 0;
+        options.cursor = std::stoull(cursor, &consumed);
+        if (consumed != cursor.size() || cursor[0] == '-') throw std::invalid_argument("cursor");
+    } catch (const std::exception &e) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "invalid cursor");
+        return false;
+    }
+
+    for (size_t i = cursor_index + 1; i < request.command.size(); i += 2) {
+        std::string option = request.lowerCaseCommand(i);
+        if (i + 1 >= request.command.size() || (option != "match" && option != "count")) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "syntax error");
+            return false;
+        }
+
+        if (option == "match") {
+            options.pattern.emplace(request.command[i + 1]);
+            continue;
+        }
+
+        long long count = 0;
+        try {
+            size_t consumed = 0;
+            count = std::stoll(request.command[i + 1], &consumed);
+            if (consumed != request.command[i + 1].size()) count = 0;
+        } catch (const std::exception &e) {
+            count = 0;
+        }
+        if (count < 1) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value is not an integer or out of range");
+            return false;
+        }
+        options.count = static_cast<size_t>(count);
+    }
+
+    return true;
+}
+
+bool RedisServer::parseBlockTimeout(const std::string& str, double& timeout, Buffer& response) {
+    try {
+        size_t consumed = 0;
+        timeout = std::stod(str, &consumed);
+        if (consumed != str.size() || !std::isfinite(timeout)) throw std::invalid_argument("timeout");
+    } catch (const std::exception &e) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "timeout is not a float or out of range");
+        return false;
+    }
+    if (timeout < 0) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "timeout is negative");
+        return false;
+    }
+    if (timeout > MAX_BLOCK_TIMEOUT_S) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "timeout is out of range");
+        return false;
+    }
+    return true;
+}
+
+int64_t RedisServer::blockDeadline(double timeout) {
+    if (timeout <= 0) {
+        return 0;
+    }
+    // Clamped before the conversion, which is undefined for doubles out of int64_t range.
+    const double wait_ms = std::min(timeout, MAX_BLOCK_TIMEOUT_S) * 1000;
+    return nowMs() + std::max<int64_t>(1, static_cast<int64_t>(wait_ms));
+}
+
+void RedisServer::handleScan(const Request& request, Buffer& response) {
+    if (request.command.size() < 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'scan'");
+        return;
+    }
+
+    ScanOptions options;
+    if (!parseScanOptions(request, 1, options, response)) {
+        return;
+    }
+
+    // COUNT bounds the work, not the reply: keep visiting slots until enough
+    // keys were seen (matching or not) or the iteration is over.
+    // In sharded mode the shard being scanned is in the top bits of the
+    // cursor, and every shard's table is walked in turn.
+    const int64_t now_ms = unixTimeMs();
+    std::vector<const std::string*> keys;
+    size_t visited = 0;
+    size_t cursor = options.cursor & (shards ? SHARD_CURSOR_MASK : SIZE_MAX);
+
+    do {
+        cursor = dataStore.scan(cursor, [&](HashTable::Node* node) {
+            DataEntry* entry = static_cast<DataEntry*>(node);
+            ++visited;
+            if (isExpired(entry, now_ms)) return;
+            if (options.pattern && !options.pattern->matches(entry->key)) return;
+            keys.push_back(&entry->key);
+        });
+    } while (cursor != 0 && visited < options.count);
+
+    if (shards) {
+        const size_t next_shard = cursor != 0 ? shardIndex : shardIndex + 1;
+        cursor = next_shard < shards->size() ? cursor | next_shard << SHARD_CURSOR_SHIFT : 0;
+    }
+
+    ResponseBuilder::outArr(response, 2);
+    ResponseBuilder::outStr(response, std::to_string(cursor));
+    ResponseBuilder::outArr(response, static_cast<uint32_t>(keys.size()));
+    for (const std::string* key: keys) {
+        ResponseBuilder::outStr(response, *key);
+    }
 }
 
 void RedisServer::handlePing(const Request& request, Buffer& response) {
@@ -105,29 +347,53 @@ void RedisServer::handleUnknown(const Request& request, Buffer& response) {
 }
 
 void RedisServer::handleSet(const Request& request, Buffer& response) {
-    if(request.command.size() != 3) {
+    if(request.command.size() != 3 && request.command.size() != 5) {
         ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'set'");
         return;
     }
 
-    DataEntry key_entry;
-    key_entry.key = request.command[1];
-    key_entry.hashCode = stringHash(key_entry.key);
+    int64_t expire_at_ms = 0;
+    if(request.command.size() == 5) {
+        const std::string option = request.lowerCaseCommand(3);
+        if(option != "ex" && option != "px" && option != "exat" && option != "pxat") {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "syntax error");
+            return;
+        }
 
-    auto equals = [](HashTable::Node* node, HashTable::Node* key) {
-        return static_cast<DataEntry*>(node)->key == static_cast<DataEntry*>(key)->key;
-    };
+        long long ttl = 0;
+        try {
+            size_t consumed = 0;
+            ttl = std::stoll(request.command[4], &consumed);
+            if(consumed != request.command[4].size()) ttl = 0;
+        } catch (const std::exception &e) {
+            ttl = 0;
+        }
+
+        if(ttl <= 0 || ttl > (1LL << 46)) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "invalid expire time in 'set' command");
+            return;
+        }
+        const int64_t ttl_ms = option[0] == 'e' ? ttl * 1000 : ttl;
+        expire_at_ms = option.size() == 4 ? ttl_ms : unixTimeMs() + ttl_ms;
+
+        // Replaying a relative TTL later would extend it.
+        rewrittenCommand = {"set", request.command[1], request.command[2], "pxat", std::to_string(expire_at_ms)};
+    }
 
-    if(HashTable::Node* found_node = dataStore.lookup(&key_entry, equals)) {
-        static_cast<DataEntry*>(found_node)->value = request.command[2];
+    DataEntry* entry = lookupEntry(request.command[1]);
+    if(entry) {
+        if(lazyfreeLazyServerDel && isCostlyToFree(entry->value)) {
+            lazyFree.free(std::move(entry->value));
+        }
+        entry->value = request.command[2];
     } else {
-        auto new_entry = std::make_unique<DataEntry>();
-        new_entry->key = request.command[1];
-        new_entry->value = request.command[2];
-        new_entry->hashCode = key_entry.hashCode;
-        dataStore.insert(std::move(new_entry));
+        entry = addEntry(request.command[1], request.command[2]);
     }
 
+    // SET replaces the key as a whole: any previous TTL is discarded.
+    setExpire(entry, expire_at_ms);
+    compressString(entry);
+
     ResponseBuilder::outNil(response);
 }
 
@@ -137,18 +403,9 @@ void RedisServer::handleGet(const Request& request, Buffer& response) {
         return;
     }
 
-    DataEntry key_entry;
-    key_entry.key = request.command[1];
-    key_entry.hashCode = stringHash(key_entry.key);
-
-    auto equals = [](HashTable::Node* node, HashTable::Node* key) {
-        return static_cast<DataEntry*>(node)->key == static_cast<DataEntry*>(key)->key;
-    };
-
-    if(HashTable::Node* found_node = dataStore.lookup(&key_entry, equals)) {
-        DataEntry* entry = static_cast<DataEntry*>(found_node);
+    if(DataEntry* entry = lookupEntry(request.command[1])) {
         if (std::holds_alternative<std::string>(entry->value)) {
-            ResponseBuilder::outStr(response, std::get<std::string>(entry->value));
+            replyString(entry, response);
         } else {
             ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
         }
@@ -157,393 +414,731 @@ void RedisServer::handleGet(const Request& request, Buffer& response) {
     }
 }
 
-void RedisServer::handleDel(const Request& request, Buffer& response) {
-    if(request.command.size() != 2) {
-        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'del'");
+void RedisServer::compressString(DataEntry* entry) {
+    auto& value = std::get<std::string>(entry->value);
+    entry->compressed = false;
+    if (stringCompressionThreshold == 0 || value.size() < stringCompressionThreshold) {
         return;
     }
 
-    DataEntry key_entry;
-    key_entry.key = request.command[1];
-    key_entry.hashCode = stringHash(key_entry.key);
-
-    auto equals = [](HashTable::Node* node, HashTable::Node* key) {
-        return static_cast<DataEntry*>(node)->key == static_cast<DataEntry*>(key)->key;
-    };
+    // Decompressing on every read is only worth it if it saves an eighth.
+    std::string blob;
+    if (lzf::compressString(value, value.size() - value.size() / 8, blob)) {
+        value = std::move(blob);
+        entry->compressed = true;
+    }
+}
 
-    if(dataStore.remove(&key_entry, equals)) {
-        ResponseBuilder::outInt(response, 1);
-    } else {
-        ResponseBuilder::outInt(response, 0);
+std::string& RedisServer::rawString(DataEntry* entry) {
+    auto& value = std::get<std::string>(entry->value);
+    if (entry->compressed) {
+        // Blobs are made by `compressString` or loaded from a checksummed
+        // snapshot, so they always decompress.
+        lzf::decompressString(value, value);
+        entry->compressed = false;
     }
+    return value;
 }
 
-void RedisServer::handleZAdd(const Request& request, Buffer& response) {
-    if (request.command.size() < 4 || request.command.size() % 2 != 0) {
-        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "c");
+void RedisServer::replyString(DataEntry* entry, Buffer& response) {
+    const auto& value = std::get<std::string>(entry->value);
+    if (!entry->compressed) {
+        ResponseBuilder::outStr(response, value);
         return;
     }
 
-    const std::string& key = request.command[1];
-    DataEntry key_entry;
-    key_entry.key = key;
-    key_entry.hashCode = stringHash(key);
+    std::string raw;
+    lzf::decompressString(value, raw);
+    ResponseBuilder::outStr(response, raw);
+}
 
-    auto equals = [](HashTable::Node* node, HashTable::Node* key) {
-        return static_cast<DataEntry*>(node)->key == static_cast<DataEntry*>(key)->key;
-    };
+void RedisServer::delGeneric(const Request& request, Buffer& response, bool lazy) {
+    if(request.command.size() < 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for '" + request.lowerCaseCommand() + "'");
+        return;
+    }
 
-    DataEntry* entry = nullptr;
-    if (HashTable::Node* found_node = dataStore.lookup(&key_entry, equals)) {
-        entry = static_cast<DataEntry*>(found_node);
-        if (!std::holds_alternative<SortedSet>(entry->value)) {
-            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
-            return;
+    const int64_t now_ms = unixTimeMs();
+    int64_t removed = 0;
+    for(size_t i = 1; i < request.command.size(); ++i) {
+        // An expired key that was not reclaimed yet doesn't count as deleted.
+        DataEntry* entry = findEntry(request.command[i]);
+        bool expired = entry && isExpired(entry, now_ms);
+        if(removeEntry(request.command[i], lazy) && !expired) {
+            ++removed;
         }
-    } else {
-        auto new_entry = std::make_unique<DataEntry>();
-        new_entry->key = key;
-        new_entry->value = SortedSet{};
-        new_entry->hashCode = key_entry.hashCode;
-        entry = new_entry.get();
-        dataStore.insert(std::move(new_entry));
     }
 
-    SortedSet &zset = std::get<SortedSet>(entry->value);
-    int elements = 0;
-
-    auto compare_nodes = [](AVLTree::Node* a, AVLTree::Node* b) {
-        double score_a = static_cast<ZSetNode*>(a)->score;
-        double score_b = static_cast<ZSetNode*>(b)->score;
-
-        if (score_a < score_b) return -1;
-        if (score_a > score_b) return  1;
+    ResponseBuilder::outInt(response, removed);
+}
 
-        return static_cast<ZSetNode*>(a)->member.compare(static_cast<ZSetNode*>(b)->member);
-    };
+void RedisServer::handleDel(const Request& request, Buffer& response) {
+    delGeneric(request, response, lazyfreeLazyUserDel);
+}
 
-    for (size_t i=2; i<request.command.size(); i+=2) {
-        const std::string &score_str = request.command[i];
-        const std::string &member = request.command[i+1];
+void RedisServer::handleUnlink(const Request& request, Buffer& response) {
+    delGeneric(request, response, true);
+}
 
-        double score;
-        try {
-            score = std::stod(score_str);
-        } catch (const std::invalid_argument &e) {
-            response.clear();
-            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value \'" + request.command[i] + "\' is not a valid float");
+void RedisServer::handleFlushAll(const Request& request, Buffer& response) {
+    bool async = false;
+    if(request.command.size() == 2) {
+        const std::string mode = request.lowerCaseCommand(1);
+        if(mode != "async" && mode != "sync") {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "syntax error");
             return;
         }
+        async = mode == "async";
+    } else if(request.command.size() > 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for '" + request.lowerCaseCommand() + "'");
+        return;
+    }
 
-        ZSetMemberNode member_key;
-        member_key.member = member;
-        member_key.hashCode = stringHash(member);
-        auto member_equals = [](HashTable::Node* node, HashTable::Node* key) {
-            return static_cast<ZSetMemberNode*>(node)->member == static_cast<ZSetMemberNode*>(key)->member;
-        };
+    forEachShard([async](RedisServer& shard) { shard.flushKeyspace(async); });
+    ResponseBuilder::outStr(response, "OK");
+}
 
-        if (auto* found_ptr = zset.member_to_score_map.lookup(&member_key, member_equals)) {
-            auto* member_node = static_cast<ZSetMemberNode*>(found_ptr);
+void RedisServer::flushKeyspace(bool async) {
+    expiryIndex.clear();
+    evictionPool.clear();
+    for(auto& keys: slotKeys) {
+        keys.clear();
+    }
 
-            auto old_zset_node_key = std::make_unique<ZSetNode>();
-            old_zset_node_key->member = member;
-            old_zset_node_key->score = member_node->score;
+    if(async) {
+        // Swap in an empty table and let the background thread tear down the old one.
+        lazyFree.free(std::exchange(dataStore, HashTable()));
+    } else {
+        dataStore.clear();
+    }
+}
 
-            if (AVLTree::Node* to_remove = zset.score_sorted_tree.find(old_zset_node_key.get(), compare_nodes)) {
-                zset.score_sorted_tree.detach(to_remove);
-            }
+void RedisServer::handleConfig(const Request& request, Buffer& response) {
+    const std::string subcommand = request.lowerCaseCommand(1);
 
-            member_node->score = score;
-        } else {
-            auto new_member_node = std::make_unique<ZSetMemberNode>();
-            new_member_node->member = member;
-            new_member_node->score = score;
-            new_member_node->hashCode = member_key.hashCode;
-            zset.member_to_score_map.insert(std::move(new_member_node));
-            ++elements;
+    if (subcommand == "get" && request.command.size() == 3) {
+        auto it = configTable.find(request.lowerCaseCommand(2));
+        if (it == configTable.end()) {
+            ResponseBuilder::outArr(response, 0);
+            return;
         }
-
-        auto new_zset_node = std::make_unique<ZSetNode>();
-        new_zset_node->member = member;
-        new_zset_node->score = score;
-        zset.score_sorted_tree.insert(std::move(new_zset_node), compare_nodes);
+        ResponseBuilder::outArr(response, 2);
+        ResponseBuilder::outStr(response, it->first);
+        ResponseBuilder::outStr(response, it->second.get());
+    } else if (subcommand == "set" && request.command.size() == 4) {
+        auto it = configTable.find(request.lowerCaseCommand(2));
+        if (it == configTable.end()) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Unsupported CONFIG parameter '" + request.command[2] + "'");
+            return;
+        }
+        if (!it->second.set(request.command[3])) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Invalid value '" + request.command[3] + "' for CONFIG parameter '" + it->first + "'");
+            return;
+        }
+        // Every shard runs with the same settings.
+        forEachShard([&](RedisServer& shard) {
+            if (&shard != this) shard.setConfig(it->first, request.command[3]);
+        });
+        ResponseBuilder::outStr(response, "OK");
+    } else {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'config'");
     }
+}
 
-    ResponseBuilder::outInt(response, elements);
+static const char* evictionPolicyName(EvictionPolicy policy) {
+    switch (policy) {
+        case EvictionPolicy::ALLKEYS_LRU:  return "allkeys-lru";
+        case EvictionPolicy::ALLKEYS_LFU:  return "allkeys-lfu";
+        case EvictionPolicy::VOLATILE_TTL: return "volatile-ttl";
+        default:                           return "noeviction";
+    }
 }
 
-void RedisServer::handleZRem(const Request& request, Buffer& response) {
-    if (request.command.size() < 3) {
-        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of args for 'zrem'");
+void RedisServer::handleInfo(const Request& request, Buffer& response) {
+    if (request.command.size() > 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'info'");
         return;
     }
 
-    const std::string& key = request.command[1];
-    DataEntry key_entry;
-    key_entry.key = key;
-    key_entry.hashCode = stringHash(key);
-
-    auto equals = [](HashTable::Node* node, HashTable::Node* key) {
-        return static_cast<DataEntry*>(node)->key == static_cast<DataEntry*>(key)->key;
-    };
+    std::string info;
+    info += "# Memory\r\n";
+    info += "used_memory:" + std::to_string(memory::usedMemory()) + "\r\n";
+    info += "maxmemory:" + std::to_string(maxMemory) + "\r\n";
+    info += std::string("maxmemory_policy:") + evictionPolicyName(evictionPolicy) + "\r\n";
+    info += "\r\n# Stats\r\n";
+    info += "expired_keys:" + std::to_string(expiredKeys) + "\r\n";
+    info += "evicted_keys:" + std::to_string(evictedKeys) + "\r\n";
+    info += "lazyfree_pending_objects:" + std::to_string(lazyFree.pending()) + "\r\n";
+    info += "lazyfreed_objects:" + std::to_string(lazyFree.freed()) + "\r\n";
+    info += "pubsub_channels:" + std::to_string(pubsubChannels.size()) + "\r\n";
+    info += "pubsub_patterns:" + std::to_string(pubsubPatterns.size()) + "\r\n";
+    info += "sync_full:" + std::to_string(syncFull) + "\r\n";
+    info += "sync_partial_ok:" + std::to_string(syncPartialOk) + "\r\n";
+    info += "sync_partial_err:" + std::to_string(syncPartialErr) + "\r\n";
+    info += "\r\n# Persistence\r\n";
+    info += std::string("aof_enabled:") + (aofState != AofState::OFF ? "1" : "0") + "\r\n";
+    info += std::string("aof_rewrite_in_progress:") + (aofRewriteChild != -1 ? "1" : "0") + "\r\n";
+    info += std::string("aof_rewrite_scheduled:") + (aofRewriteScheduled ? "1" : "0") + "\r\n";
+    info += std::string("aof_last_bgrewrite_status:") + (lastAofRewriteOk ? "ok" : "err") + "\r\n";
+    info += std::string("aof_last_write_status:") + (aofLastWriteOk ? "ok" : "err") + "\r\n";
+    info += "aof_current_size:" + std::to_string(aof.size()) + "\r\n";
+    info += "aof_base_size:" + std::to_string(aofBaseSize) + "\r\n";
+    info += "aof_pending_fsync_bytes:" + std::to_string(aof.size() - std::min(aof.size(), aof.syncedOffset())) + "\r\n";
+    info += "rdb_changes_since_last_save:" + std::to_string(dirty) + "\r\n";
+    info += std::string("rdb_bgsave_in_progress:") + (snapshotChild != -1 ? "1" : "0") + "\r\n";
+    info += "rdb_last_save_time:" + std::to_string(lastSaveTime) + "\r\n";
+    info += std::string("rdb_last_bgsave_status:") + (lastBgsaveOk ? "ok" : "err") + "\r\n";
+
+    // Ratios and throughputs are derived from the compressor's counters, so
+    // they cover strings and snapshot segments alike (but not BGSAVE, which
+    // compresses in a child process).
+    const lzf::Stats lzf_stats = lzf::stats();
+    char derived[128];
+    snprintf(derived, sizeof(derived),
+             "lzf_compress_ratio:%.2f\r\nlzf_compress_mb_per_sec:%.1f\r\nlzf_decompress_mb_per_sec:%.1f\r\n",
+             lzf_stats.compressedOut ? static_cast<double>(lzf_stats.compressedIn) / lzf_stats.compressedOut : 0.0,
+             lzf_stats.compressNs ? lzf_stats.compressedIn * 1e3 / lzf_stats.compressNs : 0.0,
+             lzf_stats.decompressNs ? lzf_stats.decompressedOut * 1e3 / lzf_stats.decompressNs : 0.0);
+    info += "\r\n# Compression\r\n";
+    info += "string_compression_threshold:" + std::to_string(stringCompressionThreshold) + "\r\n";
+    info += "lzf_compress_calls:" + std::to_string(lzf_stats.compressCalls) + "\r\n";
+    info += "lzf_compress_input_bytes:" + std::to_string(lzf_stats.compressedIn) + "\r\n";
+    info += "lzf_compress_output_bytes:" + std::to_string(lzf_stats.compressedOut) + "\r\n";
+    info += "lzf_incompressible:" + std::to_string(lzf_stats.incompressible) + "\r\n";
+    info += "lzf_decompress_calls:" + std::to_string(lzf_stats.decompressCalls) + "\r\n";
+    info += "lzf_decompress_output_bytes:" + std::to_string(lzf_stats.decompressedOut) + "\r\n";
+    info += derived;
+    info += "\r\n# Replication\r\n";
+    info += replicationInfo();
+    if (shards) {
+        info += "\r\n# Sharding\r\n";
+        info += shardingInfo();
+    }
+    info += "\r\n# Cluster\r\n";
+    info += std::string("cluster_enabled:") + (cluster ? "1" : "0") + "\r\n";
+    info += "\r\n# Keyspace\r\n";
+    info += "keys:" + std::to_string(dataStore.size()) + "\r\n";
+    info += "expires:" + std::to_string(expiryIndex.size()) + "\r\n";
+    info += std::string("rehashing:") + (dataStore.isRehashing() ? "1" : "0") + "\r\n";
+
+    ResponseBuilder::outStr(response, info);
+}
 
-    DataEntry* entry = nullptr;
-    if (HashTable::Node* found_node = dataStore.lookup(&key_entry, equals)) {
-        entry = static_cast<DataEntry*>(found_node);
-    } else {
-        ResponseBuilder::outInt(response, 0);
+void RedisServer::handleObject(const Request& request, Buffer& response) {
+    if (request.command.size() != 3 || request.lowerCaseCommand(1) != "encoding") {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'object'");
         return;
     }
 
-    if (!std::holds_alternative<SortedSet>(entry->value)) {
-        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
+    DataEntry* entry = lookupEntry(request.command[2]);
+    if (!entry) {
+        ResponseBuilder::outNil(response);
         return;
     }
 
-    SortedSet& zset = std::get<SortedSet>(entry->value);
-    int removed_count = 0;
-    
-    auto compare_nodes = [](AVLTree::Node* a, AVLTree::Node* b) {
-        double score_a = static_cast<ZSetNode*>(a)->score;
-        double score_b = static_cast<ZSetNode*>(b)->score;
-
-        if (score_a < score_b) return -1;
-        if (score_a > score_b) return  1;
+    if (std::holds_alternative<std::string>(entry->value)) {
+        ResponseBuilder::outStr(response, entry->compressed ? "lzf" : "raw");
+    } else if (auto* zset = std::get_if<SortedSet>(&entry->value)) {
+        ResponseBuilder::outStr(response, zset->encodingName());
+    } else if (auto* hash = std::get_if<Hash>(&entry->value)) {
+        ResponseBuilder::outStr(response, hash->encodingName());
+    } else if (auto* set = std::get_if<Set>(&entry->value)) {
+        ResponseBuilder::outStr(response, set->encodingName());
+    } else {
+        ResponseBuilder::outStr(response, std::get<List>(entry->value).encodingName());
+    }
+}
 
-        return static_cast<ZSetNode*>(a)->member.compare(static_cast<ZSetNode*>(b)->member);
-    };
+DataEntry* RedisServer::findEntry(const std::string& key) {
+    if (RedisServer* owner = foreignShard(key)) {
+        return owner->findEntry(key);
+    }
+    DataEntry key_entry;
+    key_entry.key = key;
+    key_entry.hashCode = stringHash(key);
+    return static_cast<DataEntry*>(dataStore.lookup(&key_entry, entryEquals));
+}
 
-    for (size_t i=2; i<request.command.size(); i+=2) {
-        const std::string& member = request.command[i];
-
-        ZSetMemberNode member_key;
-        member_key.member = member;
-        member_key.hashCode = stringHash(member);
-
-        auto member_equals = [](HashTable::Node* node, HashTable::Node* key) {
-            return static_cast<ZSetMemberNode*>(node)->member == static_cast<ZSetMemberNode*>(key)->member;
-        };
-
-        if (auto* found_ptr = zset.member_to_score_map.lookup(&member_key, member_equals)) {
-            auto* member_node = static_cast<ZSetMemberNode*>(found_ptr);
-            
-            auto old_zset_node_key = std::make_unique<ZSetNode>();
-            old_zset_node_key->member = member;
-            old_zset_node_key->score = member_node->score;
-            
-            if (AVLTree::Node* to_remove = zset.score_sorted_tree.find(old_zset_node_key.get(), compare_nodes)) {
-                zset.score_sorted_tree.detach(to_remove);
-            }
+DataEntry* RedisServer::lookupEntry(const std::string& key) {
+    if (RedisServer* owner = foreignShard(key)) {
+        return owner->lookupEntry(key);
+    }
+    DataEntry* entry = findEntry(key);
+    if (!entry) {
+        return nullptr;
+    }
 
-            zset.member_to_score_map.remove(&member_key, member_equals);
-            ++removed_count;
+    if (entry->expire_at_ms != 0 && isExpired(entry, unixTimeMs())) {
+        // A replica waits for its primary's DEL: it hides the key from its
+        // clients, but the commands of the stream still see it.
+        if (!isReplica() || loading) {
+            removeEntry(key);
+            ++expiredKeys;
+            propagate({"del", key});
+            return nullptr;
+        }
+        if (currentClient) {
+            return nullptr;
         }
     }
 
-    ResponseBuilder::outInt(response, removed_count);
+    touchEntry(entry);
+    return entry;
 }
 
-void RedisServer::handleZRange(const Request& request, Buffer& response) {
-    if (request.command.size() != 4) {
-        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'zrange'");
-        return;
-    }
-
-    const std::string& key = request.command[1];
-    long start, end;
-
-    try {
-        start = std::stol(request.command[2]);
-        end = std::stol(request.command[3]);
-    } catch (const std::invalid_argument &e) {
-        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "values provided (" + request.command[2] + ", " + request.command[3] + ") are not an integer");
-        return;
+bool RedisServer::removeEntry(const std::string& key, bool lazy) {
+    if (RedisServer* owner = foreignShard(key)) {
+        return owner->removeEntry(key, lazy);
     }
-
     DataEntry key_entry;
     key_entry.key = key;
     key_entry.hashCode = stringHash(key);
 
-    auto equals = [](HashTable::Node* node, HashTable::Node* key) {
-        return static_cast<DataEntry*>(node)->key == static_cast<DataEntry*>(key)->key;
-    };
-
-    DataEntry* entry = nullptr;
-    if (HashTable::Node* found_node = dataStore.lookup(&key_entry, equals)) {
-        entry = static_cast<DataEntry*>(found_node);
-    } else {
-        ResponseBuilder::outArr(response, 0); // Key doesn't exist
-        return;
+    std::unique_ptr<HashTable::Node> removed = dataStore.remove(&key_entry, entryEquals);
+    if (!removed) {
+        return false;
     }
 
-    if (!std::holds_alternative<SortedSet>(entry->value)) {
-        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
-        return;
+    DataEntry* entry = static_cast<DataEntry*>(removed.get());
+    if (entry->expire_at_ms != 0) {
+        expiryIndex.erase({entry->expire_at_ms, entry});
     }
-
-    SortedSet& zset = std::get<SortedSet>(entry->value);
-    long size = zset.score_sorted_tree.size();
-    
-    if (start < 0) start += size;
-    if (end < 0)   end   += size;
-    if (start < 0) start = 0;
-    if (start >= size || start > end) {
-        ResponseBuilder::outArr(response, 0);
-        return;
+    if (!slotKeys.empty()) {
+        slotKeys[keyHashSlot(key)].erase(entry);
     }
 
-    if (end >= size) end = size - 1;
-
-    std::vector<std::string> result;
-    for (long i = start; i <= end; ++i) {
-        if (AVLTree::Node* node = zset.score_sorted_tree.findByRank(i)) {
-            result.push_back(static_cast<ZSetNode*>(node)->member);
-        }
+    if (lazy && isCostlyToFree(entry->value)) {
+        lazyFree.free(std::move(removed));
     }
+    return true;
+}
 
-    ResponseBuilder::outArr(response, result.size());
-    for (const auto& member : result) {
-        ResponseBuilder::outStr(response, member);
+bool RedisServer::isCostlyToFree(const DataEntry::Value& value) {
+    // Freeing a string, a listpack or an intset is a single deallocation; a
+    // tree-encoded sorted set has a hash node and an index node per member,
+    // hash-table encoded hashes and sets a node per field or member, and a
+    // list one allocation per quicklist node.
+    if (auto* zset = std::get_if<SortedSet>(&value)) {
+        return zset->getEncoding() == SortedSet::Encoding::TREE && zset->size() > LAZYFREE_THRESHOLD;
+    }
+    if (auto* hash = std::get_if<Hash>(&value)) {
+        return hash->getEncoding() == Hash::Encoding::HASHTABLE && hash->size() > LAZYFREE_THRESHOLD;
+    }
+    if (auto* set = std::get_if<Set>(&value)) {
+        return set->getEncoding() == Set::Encoding::HASHTABLE && set->size() > LAZYFREE_THRESHOLD;
+    }
+    if (auto* list = std::get_if<List>(&value)) {
+        return list->nodeCount() > LAZYFREE_THRESHOLD;
     }
+    return false;
 }
 
-void RedisServer::handleZScore(const Request& request, Buffer& response) {
-    if (request.command.size() != 3) {
-        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'zscore'");
-        return;
+int RedisServer::pollTimeout() {
+    if (!readyKeys.empty() || evictionPending) {
+        return 0;
     }
 
-    const std::string& key = request.command[1];
-    const std::string& member = request.command[2];
-
-    DataEntry key_entry;
-    key_entry.key = key;
-    key_entry.hashCode = stringHash(key);
+    // Retry soon when a shard's queue was full.
+    const bool outbox_pending = std::any_of(shardOutbox.begin(), shardOutbox.end(), [](const auto& outbox) { return !outbox.empty(); });
 
-    auto equals = [](HashTable::Node* node, HashTable::Node* key) {
-        return static_cast<DataEntry*>(node)->key == static_cast<DataEntry*>(key)->key;
-    };
+    const bool child_running = snapshotChild != -1 || aofRewriteChild != -1;
 
-    DataEntry* entry = nullptr;
-    if (HashTable::Node* found_node = dataStore.lookup(&key_entry, equals)) {
-        entry = static_cast<DataEntry*>(found_node);
-    } else {
-        ResponseBuilder::outNil(response);
-        return;
+    // Keep polling without sleeping so that onIdle finishes the rehash.
+    if (activeRehashing && dataStore.isRehashing() && !child_running) {
+        return 0;
     }
 
-    if (!std::holds_alternative<SortedSet>(entry->value)) {
-        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong type of value");
-        return;
+    // Wake up regularly to reap children, start scheduled rewrites, retry
+    // failed writes to the append-only file and keep replication links going.
+    const bool cron = child_running || aofRewriteScheduled || !aofBuffer.empty() || isReplica() || !replicas.empty() || cluster || !migrateSockets.empty();
+    int64_t wait_ms = cron ? static_cast<int64_t>(1000 / std::max<size_t>(hz, 1)) : -1;
+    if (outbox_pending) {
+        wait_ms = 1;
+    }
+    if (!blockingDeadlines.empty()) {
+        int64_t block_wait_ms = std::max<int64_t>(0, blockingDeadlines.begin()->first - nowMs());
+        wait_ms = wait_ms < 0 ? block_wait_ms : std::min(wait_ms, block_wait_ms);
     }
 
-    SortedSet& zset = std::get<SortedSet>(entry->value);
-
-    ZSetMemberNode member_key;
-    member_key.member = member;
-    member_key.hashCode = stringHash(member);
-
-    auto member_equals = [](HashTable::Node* node, HashTable::Node* key) {
-        return static_cast<ZSetMemberNode*>(node)->member == static_cast<ZSetMemberNode*>(key)->member;
-    };
-
-    if (auto* found_ptr = zset.member_to_score_map.lookup(&member_key, member_equals)) {
-        auto* member_node = static_cast<ZSetMemberNode*>(found_ptr);
-        ResponseBuilder::outStr(response, std::to_string(member_node->score));
-    } else {
-        ResponseBuilder::outNil(response);
+    if (!expiryIndex.empty() && !isReplica()) {
+        // Sleep until the earliest TTL is due, but no less than the cycle period.
+        int64_t due_ms = std::max(expiryIndex.begin()->first, nextExpireCycleMs);
+        int64_t expire_wait_ms = std::max<int64_t>(0, due_ms - unixTimeMs());
+        wait_ms = wait_ms < 0 ? expire_wait_ms : std::min(wait_ms, expire_wait_ms);
     }
+
+    return static_cast<int>(std::min<int64_t>(wait_ms, INT32_MAX));
 }
 
-void RedisServer::handleZRevRange(const Request& request, Buffer& response) {
-    if (request.command.size() != 3) {
-        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'zrevrange'");
-        return;
+void RedisServer::onTick() {
+    if (snapshotChild != -1) {
+        checkSnapshotChild();
+    }
+    if (aofState != AofState::OFF || aofRewriteChild != -1) {
+        appendOnlyCron();
     }
 
-    const std::string& key = request.command[1];
-    long start, end;
-
-    try {
-        start = std::stol(request.command[2]);
-        end = std::stol(request.command[3]);
-    } catch (const std::invalid_argument &e) {
-        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "values provided (" + request.command[2] + ", " + request.command[3] + ") are not an integer");
-        return;
+    if (isReplica() || !replicas.empty()) {
+        replicationCron();
     }
 
-    DataEntry key_entry;
-    key_entry.key = key;
-    key_entry.hashCode = stringHash(key);
+    if (cluster || !migrateSockets.empty()) {
+        clusterCron();
+    }
 
-    auto equals = [](HashTable::Node* node, HashTable::Node* key) {
-        return static_cast<DataEntry*>(node)->key == static_cast<DataEntry*>(key)->key;
-    };
+    timeoutBlockedClients();
+    serveReadyKeys();
 
-    DataEntry* entry = nullptr;
-    if (HashTable::Node* found_node = dataStore.lookup(&key_entry, equals)) {
-        entry = static_cast<DataEntry*>(found_node);
-    } else {
-        ResponseBuilder::outArr(response, 0);
-        return;
+    if (!expiryIndex.empty() && !isReplica() && unixTimeMs() >= nextExpireCycleMs) {
+        activeExpireCycle();
     }
 
-    if (!std::holds_alternative<SortedSet>(entry->value)) {
-        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong type of value");
-        return;
+    if (evictionPending) {
+        performEvictions();
     }
 
-    SortedSet& zset = std::get<SortedSet>(entry->value);
-    long size = zset.score_sorted_tree.size();
+    // Everything this iteration wrote goes out in one write.
+    if (aofState == AofState::ON) {
+        flushAppendOnlyFile();
+    }
 
-    if (start < 0) start += size;
-    if (end < 0) end += size;
-    if (start < 0) start = 0;
+    // Likewise, the messages for other shards wake each of them once.
+    if (shards) {
+        flushShardOutbox();
+    }
+}
 
-    if (start >= size || start > end) {
-        ResponseBuilder::outArr(response, 0);
-        return;
+void RedisServer::onIdle() {
+    // Requests help the rehash along, but without them the keyspace would
+    // stay split across two tables (and both allocated) indefinitely. While a
+    // child runs, moving entries would only copy pages it shares.
+    if (activeRehashing && snapshotChild == -1 && aofRewriteChild == -1) {
+        dataStore.rehashStep(static_cast<int64_t>(activeExpireBudgetUs));
     }
+}
 
-    if (end >= size) end = size - 1;
+bool RedisServer::entryEquals(HashTable::Node* node, HashTable::Node* key) {
+    return static_cast<DataEntry*>(node)->key == static_cast<DataEntry*>(key)->key;
+}
+
+uint64_t RedisServer::stringHash(const std::string& str) {
+    return HashTable::hashString(str);
+}
 
-    std::vector<std::string> result;
-    for (long i=start; i<=end; ++i) {
-        long rank = size - 1 - i;
-        if (AVLTree::Node* node = zset.score_sorted_tree.findByRank(rank)) {
-            result.push_back(static_cast<ZSetNode*>(node)->member);
+/**
+ * @brief Builds a CONFIG parameter backed by a non-negative integer variable.
+ */
+static ConfigParam sizeParam(size_t& target) {
+    return {
+        [&target]() { return std::to_string(target); },
+        [&target](const std::string& value) {
+            try {
+                size_t consumed = 0;
+                long long parsed = std::stoll(value, &consumed);
+                if (consumed != value.size() || parsed < 0) return false;
+                target = static_cast<size_t>(parsed);
+                return true;
+            } catch (const std::exception&) {
+                return false;
+            }
         }
-    }
+    };
+}
 
-    ResponseBuilder::outArr(response, result.size());
-    for (const auto& member: result) {
-        ResponseBuilder::outStr(response, member);
-    }
+/**
+ * @brief Builds a CONFIG parameter backed by a flag, set with "yes" or "no".
+ */
+static ConfigParam boolParam(bool& target) {
+    return {
+        [&target]() { return std::string(target ? "yes" : "no"); },
+        [&target](const std::string& value) {
+            if (strcasecmp(value.c_str(), "yes") == 0) target = true;
+            else if (strcasecmp(value.c_str(), "no") == 0) target = false;
+            else return false;
+            return true;
+        }
+    };
 }
 
-// FNV-1a hash function for strings
-uint64_t RedisServer::stringHash(const std::string& str) {
-    uint64_t hash = 0xcdf29ce484222325;
-    for(char c: str) {
-        hash ^= static_cast<uint64_t>(c);
-        hash *= 0x100000001b3;
-    }
-    return hash;
+/**
+ * @brief Builds a CONFIG parameter for a byte count, accepting kb/mb/gb suffixes.
+ * @details Counts that don't fit in a size_t once scaled are rejected.
+ */
+static ConfigParam memoryParam(size_t& target) {
+    return {
+        [&target]() { return std::to_string(target); },
+        [&target](const std::string& value) {
+            static const std::pair<const char*, size_t> units[] = {
+                {"gb", 1ULL << 30}, {"mb", 1ULL << 20}, {"kb", 1ULL << 10}, {"b", 1},
+            };
+
+            std::string digits = value;
+            size_t multiplier = 1;
+            for (const auto& unit: units) {
+                size_t len = strlen(unit.first);
+                if (digits.size() > len && strcasecmp(digits.c_str() + digits.size() - len, unit.first) == 0) {
+                    digits.resize(digits.size() - len);
+                    multiplier = unit.second;
+                    break;
+                }
+            }
+
+            try {
+                size_t consumed = 0;
+                long long parsed = std::stoll(digits, &consumed);
+                if (consumed != digits.size() || parsed < 0) return false;
+                if (static_cast<size_t>(parsed) > SIZE_MAX / multiplier) return false;
+                target = static_cast<size_t>(parsed) * multiplier;
+                return true;
+            } catch (const std::exception&) {
+                return false;
+            }
+        }
+    };
 }
 
 /* ====== Public methods ====== */
 
-RedisServer::RedisServer(uint16_t port) : Server(port) {
+RedisServer::RedisServer(uint16_t port, ShardSet* shard_set, size_t shard_index)
+    : Server(port, shard_set != nullptr), shards(shard_set), shardIndex(shard_index) {
+    listenPort = port;
+    if (shards) {
+        shards->attach(shardIndex, *this);
+        shardOutbox.resize(shards->size());
+        watch(shards->notifyFd(shardIndex), [this]() { processShardMessages(); });
+    }
+
     commandTable = {
-        {"get",  [this](const Request& req, Buffer& res) { handleGet(req, res);  }},
-        {"set",  [this](const Request& req, Buffer& res) { handleSet(req, res);  }},
-        {"del",  [this](const Request& req, Buffer& res) { handleDel(req, res);  }},
-        {"zadd", [this](const Request& req, Buffer& res) { handleZAdd(req, res); }}, 
-        {"zrem", [this](const Request& req, Buffer& res) { handleZRem(req, res); }}, 
-        {"keys", [this](const Request& req, Buffer& res) { handleKeys(req, res); }},
-        {"ping", [this](const Request& req, Buffer& res) { handlePing(req, res); }},
-        {"zrange", [this](const Request& req, Buffer& res) { handleZRange(req, res); }},
-        {"zscore", [this](const Request& req, Buffer& res) { handleZScore(req, res); }},
-        {"zrevrange", [this](const Request& req, Buffer& res) { handleZRevRange(req, res); }},
+        {"get", {[this](const Request& req, Buffer& res) { handleGet(req, res); }, CMD_READONLY, 1, 1}},
+        {"set", {[this](const Request& req, Buffer& res) { handleSet(req, res); }, CMD_WRITE | CMD_DENYOOM, 1, 1}},
+        {"setbit", {[this](const Request& req, Buffer& res) { handleSetBit(req, res); }, CMD_WRITE | CMD_DENYOOM, 1, 1}},
+        {"getbit", {[this](const Request& req, Buffer& res) { handleGetBit(req, res); }, CMD_READONLY, 1, 1}},
+        {"bitcount", {[this](const Request& req, Buffer& res) { handleBitCount(req, res); }, CMD_READONLY, 1, 1}},
+        {"bitpos", {[this](const Request& req, Buffer& res) { handleBitPos(req, res); }, CMD_READONLY, 1, 1}},
+        {"bitop", {[this](const Request& req, Buffer& res) { handleBitOp(req, res); }, CMD_WRITE | CMD_DENYOOM, 2, -1}},
+        {"del", {[this](const Request& req, Buffer& res) { handleDel(req, res); }, CMD_WRITE, 1, -1}},
+        {"unlink", {[this](const Request& req, Buffer& res) { handleUnlink(req, res); }, CMD_WRITE, 1, -1}},
+        {"flushall", {[this](const Request& req, Buffer& res) { handleFlushAll(req, res); }, CMD_WRITE | CMD_ALLSHARDS}},
+        {"flushdb", {[this](const Request& req, Buffer& res) { handleFlushAll(req, res); }, CMD_WRITE | CMD_ALLSHARDS}},
+        {"zadd", {[this](const Request& req, Buffer& res) { handleZAdd(req, res); }, CMD_WRITE | CMD_DENYOOM, 1, 1}},
+        {"zincrby", {[this](const Request& req, Buffer& res) { handleZIncrBy(req, res); }, CMD_WRITE | CMD_DENYOOM, 1, 1}},
+        {"zrem", {[this](const Request& req, Buffer& res) { handleZRem(req, res); }, CMD_WRITE, 1, 1}},
+        {"keys", {[this](const Request& req, Buffer& res) { handleKeys(req, res); }, CMD_READONLY | CMD_ALLSHARDS}},
+        {"scan", {[this](const Request& req, Buffer& res) { handleScan(req, res); }, CMD_READONLY}},
+        {"ping", {[this](const Request& req, Buffer& res) { handlePing(req, res); }, CMD_READONLY | CMD_PUBSUB}},
+        {"zrange", {[this](const Request& req, Buffer& res) { handleZRange(req, res); }, CMD_READONLY, 1, 1}},
+        {"zscore", {[this](const Request& req, Buffer& res) { handleZScore(req, res); }, CMD_READONLY, 1, 1}},
+        {"zrevrange", {[this](const Request& req, Buffer& res) { handleZRevRange(req, res); }, CMD_READONLY, 1, 1}},
+        {"zscan", {[this](const Request& req, Buffer& res) { handleZScan(req, res); }, CMD_READONLY, 1, 1}},
+        {"zunionstore", {[this](const Request& req, Buffer& res) { handleZUnionStore(req, res); }, CMD_WRITE | CMD_DENYOOM | CMD_NUMKEYS, 1, 1}},
+        {"zinterstore", {[this](const Request& req, Buffer& res) { handleZInterStore(req, res); }, CMD_WRITE | CMD_DENYOOM | CMD_NUMKEYS, 1, 1}},
+        {"zdiffstore", {[this](const Request& req, Buffer& res) { handleZDiffStore(req, res); }, CMD_WRITE | CMD_DENYOOM | CMD_NUMKEYS, 1, 1}},
+        {"zpopmin", {[this](const Request& req, Buffer& res) { handleZPopMin(req, res); }, CMD_WRITE, 1, 1}},
+        {"zpopmax", {[this](const Request& req, Buffer& res) { handleZPopMax(req, res); }, CMD_WRITE, 1, 1}},
+        {"bzpopmin", {[this](const Request& req, Buffer& res) { handleBZPopMin(req, res); }, CMD_WRITE | CMD_BLOCKING, 1, -2}},
+        {"bzpopmax", {[this](const Request& req, Buffer& res) { handleBZPopMax(req, res); }, CMD_WRITE | CMD_BLOCKING, 1, -2}},
+        {"expire", {[this](const Request& req, Buffer& res) { handleExpire(req, res); }, CMD_WRITE, 1, 1}},
+        {"pexpire", {[this](const Request& req, Buffer& res) { handlePExpire(req, res); }, CMD_WRITE, 1, 1}},
+        {"pexpireat", {[this](const Request& req, Buffer& res) { handlePExpireAt(req, res); }, CMD_WRITE, 1, 1}},
+        {"ttl", {[this](const Request& req, Buffer& res) { handleTTL(req, res); }, CMD_READONLY, 1, 1}},
+        {"pttl", {[this](const Request& req, Buffer& res) { handlePTTL(req, res); }, CMD_READONLY, 1, 1}},
+        {"persist", {[this](const Request& req, Buffer& res) { handlePersist(req, res); }, CMD_WRITE, 1, 1}},
+        {"config", {[this](const Request& req, Buffer& res) { handleConfig(req, res); }, CMD_READONLY | CMD_ALLSHARDS}},
+        {"object", {[this](const Request& req, Buffer& res) { handleObject(req, res); }, CMD_READONLY, 2, 2}},
+        {"info", {[this](const Request& req, Buffer& res) { handleInfo(req, res); }, CMD_READONLY}},
+        {"hset", {[this](const Request& req, Buffer& res) { handleHSet(req, res); }, CMD_WRITE | CMD_DENYOOM, 1, 1}},
+        {"hget", {[this](const Request& req, Buffer& res) { handleHGet(req, res); }, CMD_READONLY, 1, 1}},
+        {"hmget", {[this](const Request& req, Buffer& res) { handleHMGet(req, res); }, CMD_READONLY, 1, 1}},
+        {"hdel", {[this](const Request& req, Buffer& res) { handleHDel(req, res); }, CMD_WRITE, 1, 1}},
+        {"hgetall", {[this](const Request& req, Buffer& res) { handleHGetAll(req, res); }, CMD_READONLY, 1, 1}},
+        {"hincrby", {[this](const Request& req, Buffer& res) { handleHIncrBy(req, res); }, CMD_WRITE | CMD_DENYOOM, 1, 1}},
+        {"hlen", {[this](const Request& req, Buffer& res) { handleHLen(req, res); }, CMD_READONLY, 1, 1}},
+        {"lpush", {[this](const Request& req, Buffer& res) { handleLPush(req, res); }, CMD_WRITE | CMD_DENYOOM, 1, 1}},
+        {"rpush", {[this](const Request& req, Buffer& res) { handleRPush(req, res); }, CMD_WRITE | CMD_DENYOOM, 1, 1}},
+        {"lpop", {[this](const Request& req, Buffer& res) { handleLPop(req, res); }, CMD_WRITE, 1, 1}},
+        {"rpop", {[this](const Request& req, Buffer& res) { handleRPop(req, res); }, CMD_WRITE, 1, 1}},
+        {"lrange", {[this](const Request& req, Buffer& res) { handleLRange(req, res); }, CMD_READONLY, 1, 1}},
+        {"llen", {[this](const Request& req, Buffer& res) { handleLLen(req, res); }, CMD_READONLY, 1, 1}},
+        {"lindex", {[this](const Request& req, Buffer& res) { handleLIndex(req, res); }, CMD_READONLY, 1, 1}},
+        {"ltrim", {[this](const Request& req, Buffer& res) { handleLTrim(req, res); }, CMD_WRITE, 1, 1}},
+        {"blpop", {[this](const Request& req, Buffer& res) { handleBLPop(req, res); }, CMD_WRITE | CMD_BLOCKING, 1, -2}},
+        {"brpop", {[this](const Request& req, Buffer& res) { handleBRPop(req, res); }, CMD_WRITE | CMD_BLOCKING, 1, -2}},
+        {"pfadd", {[this](const Request& req, Buffer& res) { handlePFAdd(req, res); }, CMD_WRITE | CMD_DENYOOM, 1, 1}},
+        {"pfcount", {[this](const Request& req, Buffer& res) { handlePFCount(req, res); }, CMD_READONLY, 1, -1}},
+        {"pfmerge", {[this](const Request& req, Buffer& res) { handlePFMerge(req, res); }, CMD_WRITE | CMD_DENYOOM, 1, -1}},
+        {"subscribe", {[this](const Request& req, Buffer& res) { handleSubscribe(req, res); }, CMD_READONLY | CMD_PUBSUB}},
+        {"unsubscribe", {[this](const Request& req, Buffer& res) { handleUnsubscribe(req, res); }, CMD_READONLY | CMD_PUBSUB}},
+        {"psubscribe", {[this](const Request& req, Buffer& res) { handlePSubscribe(req, res); }, CMD_READONLY | CMD_PUBSUB}},
+        {"punsubscribe", {[this](const Request& req, Buffer& res) { handlePUnsubscribe(req, res); }, CMD_READONLY | CMD_PUBSUB}},
+        {"publish", {[this](const Request& req, Buffer& res) { handlePublish(req, res); }, CMD_READONLY | CMD_BROADCAST}},
+        {"sadd", {[this](const Request& req, Buffer& res) { handleSAdd(req, res); }, CMD_WRITE | CMD_DENYOOM, 1, 1}},
+        {"srem", {[this](const Request& req, Buffer& res) { handleSRem(req, res); }, CMD_WRITE, 1, 1}},
+        {"sismember", {[this](const Request& req, Buffer& res) { handleSIsMember(req, res); }, CMD_READONLY, 1, 1}},
+        {"scard", {[this](const Request& req, Buffer& res) { handleSCard(req, res); }, CMD_READONLY, 1, 1}},
+        {"smembers", {[this](const Request& req, Buffer& res) { handleSMembers(req, res); }, CMD_READONLY, 1, 1}},
+        {"sinter", {[this](const Request& req, Buffer& res) { handleSInter(req, res); }, CMD_READONLY, 1, -1}},
+        {"sunion", {[this](const Request& req, Buffer& res) { handleSUnion(req, res); }, CMD_READONLY, 1, -1}},
+        {"sdiff", {[this](const Request& req, Buffer& res) { handleSDiff(req, res); }, CMD_READONLY, 1, -1}},
+        {"save", {[this](const Request& req, Buffer& res) { handleSave(req, res); }, CMD_READONLY | CMD_ALLSHARDS}},
+        {"bgsave", {[this](const Request& req, Buffer& res) { handleBgSave(req, res); }, CMD_READONLY | CMD_ALLSHARDS}},
+        {"lastsave", {[this](const Request& req, Buffer& res) { handleLastSave(req, res); }, CMD_READONLY | CMD_ALLSHARDS}},
+        {"bgrewriteaof", {[this](const Request& req, Buffer& res) { handleBgRewriteAof(req, res); }, CMD_READONLY}},
+        {"replicaof", {[this](const Request& req, Buffer& res) { handleReplicaOf(req, res); }, CMD_READONLY}},
+        {"slaveof", {[this](const Request& req, Buffer& res) { handleReplicaOf(req, res); }, CMD_READONLY}},
+        {"psync", {[this](const Request& req, Buffer& res) { handlePSync(req, res); }, CMD_READONLY}},
+        {"replconf", {[this](const Request& req, Buffer& res) { handleReplConf(req, res); }, CMD_READONLY}},
+        {"cluster", {[this](const Request& req, Buffer& res) { handleCluster(req, res); }, CMD_READONLY}},
+        {"asking", {[this](const Request& req, Buffer& res) { handleAsking(req, res); }, CMD_READONLY}},
+        {"dump", {[this](const Request& req, Buffer& res) { handleDump(req, res); }, CMD_READONLY, 1, 1}},
+        {"restore", {[this](const Request& req, Buffer& res) { handleRestore(req, res); }, CMD_WRITE | CMD_DENYOOM, 1, 1}},
+        {"restore-asking", {[this](const Request& req, Buffer& res) { handleRestore(req, res); }, CMD_WRITE | CMD_DENYOOM | CMD_ASKING, 1, 1}},
+        // Its keys may be anywhere in the arguments, and all of them must be local.
+        {"migrate", {[this](const Request& req, Buffer& res) { handleMigrate(req, res); }, CMD_WRITE | CMD_ALLSHARDS}},
     };
+
+    configTable = {
+        {"zset-max-listpack-entries", sizeParam(SortedSet::maxListpackEntries)},
+        {"zset-max-listpack-value",   sizeParam(SortedSet::maxListpackValue)},
+        {"hash-max-listpack-entries", sizeParam(Hash::maxListpackEntries)},
+        {"hash-max-listpack-value",   sizeParam(Hash::maxListpackValue)},
+        {"set-max-intset-entries",    sizeParam(Set::maxIntsetEntries)},
+        {"list-max-listpack-size",    sizeParam(List::maxListpackBytes)},
+        {"hll-sparse-max-bytes",      sizeParam(hll::sparseMaxBytes)},
+        {"hz", sizeParam(hz)},
+        {"maxmemory", memoryParam(maxMemory)},
+        {"maxmemory-samples", sizeParam(maxMemorySamples)},
+        {"lfu-log-factor", sizeParam(lfuLogFactor)},
+        {"lfu-decay-time", sizeParam(lfuDecayTime)},
+        {"hashtable-max-load-factor", sizeParam(HashTable::maxLoadFactor)},
+        {"hashtable-min-fill-percent", sizeParam(HashTable::minFillPercent)},
+        {"active-rehashing", boolParam(activeRehashing)},
+        {"lazyfree-lazy-user-del", boolParam(lazyfreeLazyUserDel)},
+        {"lazyfree-lazy-server-del", boolParam(lazyfreeLazyServerDel)},
+        {"appendonly", {
+            [this]() { return std::string(appendOnly ? "yes" : "no"); },
+            [this](const std::string& value) {
+                // Shards would each log their own writes, in no order relative to the others'.
+                if (shards && strcasecmp(value.c_str(), "yes") == 0) return false;
+                if (strcasecmp(value.c_str(), "yes") == 0) appendOnly = true;
+                else if (strcasecmp(value.c_str(), "no") == 0) appendOnly = false;
+                else return false;
+                // Before the data is loaded, this only picks the file to load it from.
+                if (diskDataLoaded && appendOnly && aofState == AofState::OFF) startAppendOnly();
+                if (diskDataLoaded && !appendOnly && aofState != AofState::OFF) stopAppendOnly();
+                return true;
+            }
+        }},
+        {"appendfsync", {
+            [this]() {
+                switch (aof.getPolicy()) {
+                    case AppendOnlyFile::FsyncPolicy::ALWAYS: return std::string("always");
+                    case AppendOnlyFile::FsyncPolicy::EVERYSEC: return std::string("everysec");
+                    default: return std::string("no");
+                }
+            },
+            [this](const std::string& value) {
+                if (value == "always") aof.setPolicy(AppendOnlyFile::FsyncPolicy::ALWAYS);
+                else if (value == "everysec") aof.setPolicy(AppendOnlyFile::FsyncPolicy::EVERYSEC);
+                else if (value == "no") aof.setPolicy(AppendOnlyFile::FsyncPolicy::NO);
+                else return false;
+                // Only `always` holds replies back.
+                if (aof.getPolicy() != AppendOnlyFile::FsyncPolicy::ALWAYS) releaseSyncedClients(true);
+                return true;
+            }
+        }},
+        {"appendfilename", {
+            [this]() { return aofFilename; },
+            [this](const std::string& value) {
+                // Renaming the log of a running server is not supported.
+                if (diskDataLoaded || value.empty() || value.find('/') != std::string::npos) return false;
+                aofFilename = value;
+                return true;
+            }
+        }},
+        {"auto-aof-rewrite-percentage", sizeParam(aofRewritePercentage)},
+        {"auto-aof-rewrite-min-size", memoryParam(aofRewriteMinSize)},
+        {"rdbcompression", boolParam(snapshotCompression)},
+        {"string-compression-threshold", memoryParam(stringCompressionThreshold)},
+        {"dbfilename", {
+            [this]() { return snapshotFilename; },
+            [this](const std::string& value) {
+                if (value.empty() || value.find('/') != std::string::npos) return false;
+                snapshotFilename = value;
+                return true;
+            }
+        }},
+        {"maxmemory-policy", {
+            [this]() { return std::string(evictionPolicyName(evictionPolicy)); },
+            [this](const std::string& value) {
+                if (value == "noeviction") evictionPolicy = EvictionPolicy::NOEVICTION;
+                else if (value == "allkeys-lru") evictionPolicy = EvictionPolicy::ALLKEYS_LRU;
+                else if (value == "allkeys-lfu") evictionPolicy = EvictionPolicy::ALLKEYS_LFU;
+                else if (value == "volatile-ttl") evictionPolicy = EvictionPolicy::VOLATILE_TTL;
+                else return false;
+                // Pool scores are only comparable under the policy that produced them.
+                evictionPool.clear();
+                return true;
+            }
+        }},
+        {"active-expire-budget-us", sizeParam(activeExpireBudgetUs)},
+        {"replicaof", {
+            [this]() { return isReplica() ? masterHost + " " + std::to_string(masterPort) : std::string(); },
+            [this](const std::string& value) {
+                const size_t space = value.find(' ');
+                return space != std::string::npos && replicaOf(value.substr(0, space), value.substr(space + 1));
+            }
+        }},
+        {"repl-backlog-size", {
+            [this]() { return std::to_string(replBacklogSize); },
+            [this](const std::string& value) {
+                size_t size = 0;
+                if (!memoryParam(size).set(value) || size == 0) return false;
+                replBacklogSize = size;
+                // The latest history is kept, as much of it as fits.
+                if (replBacklog) replBacklog->resize(size);
+                return true;
+            }
+        }},
+        {"repl-timeout", sizeParam(replTimeout)},
+        {"cluster-enabled", {
+            [this]() { return std::string(clusterEnabled ? "yes" : "no"); },
+            [this](const std::string& value) {
+                // The node's identity and slots are loaded along with the data; shards
+                // already partition the keyspace their own way.
+                if (diskDataLoaded || shards) return false;
+                return boolParam(clusterEnabled).set(value);
+            }
+        }},
+        {"cluster-config-file", {
+            [this]() { return clusterConfigFile; },
+            [this](const std::string& value) {
+                if (diskDataLoaded || value.empty() || value.find('/') != std::string::npos) return false;
+                clusterConfigFile = value;
+                return true;
+            }
+        }},
+        {"cluster-announce-ip", {
+            [this]() { return clusterAnnounceIp; },
+            [this](const std::string& value) {
+                if (diskDataLoaded || value.empty() || value.find(' ') != std::string::npos) return false;
+                clusterAnnounceIp = value;
+                return true;
+            }
+        }},
+        {"cluster-node-timeout", sizeParam(clusterNodeTimeout)},
+        {"zset-index-engine", {
+            []() { return std::string(SortedSet::indexEngine == ZSetIndex::Engine::BTREE ? "btree" : "avltree"); },
+            [](const std::string& value) {
+                if (value == "avltree") SortedSet::indexEngine = ZSetIndex::Engine::AVL;
+                else if (value == "btree") SortedSet::indexEngine = ZSetIndex::Engine::BTREE;
+                else return false;
+                return true;
+            }
+        }},
+    };
+}
+
+bool RedisServer::setConfig(const std::string& name, const std::string& value) {
+    auto it = configTable.find(name);
+    return it != configTable.end() && it->second.set(value);
 }
\ No newline at end of file
@@ -0,0 +1,683 @@
+#include <server/Redis.hpp>
+#include <common/FileIo.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <random>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+/**
+ * @file Replication.cpp
+ * @brief Implements primary/replica replication: REPLICAOF, PSYNC and the replication stream.
+ * @details A primary sends its replicas the command log it also writes to
+ * the append-only file (see `propagate`), as a single stream whose bytes are
+ * numbered by `replOffset` within the history named by `replicationId`. The
+ * latest `repl-backlog-size` bytes of the stream stay in a ring buffer.
+ *
+ * A replica connects and sends `PSYNC <replication id> <offset>`: the history
+ * it holds and how far into it it got. If the backlog still holds the stream
+ * from there, the primary replies `CONTINUE` and sends the missing bytes (a
+ * partial resync), so a brief disconnect costs only what was missed.
+ * Otherwise it replies `FULLRESYNC <replication id> <offset>` and forks a
+ * BGSAVE, buffering for the replica the stream produced meanwhile, and then
+ * sends the snapshot (its length as a u64, then the file) followed by that
+ * buffer. Replicas that wait for the same snapshot share it.
+ *
+ * A replica executes the stream without replying, reports its offset every
+ * second and relays the stream verbatim to its own replicas. It refuses
+ * writes from its clients, and leaves expiry and eviction to the primary,
+ * whose DELs it receives. When the link breaks, it reconnects and asks to
+ * continue from its offset.
+ */
+
+/// @brief How often the replication cron runs: reconnects, acknowledgements and timeouts.
+static const int64_t REPLICATION_CRON_MS = 1000;
+/// @brief How often a primary pings its replicas through the stream, so that idle links don't time out.
+static const int64_t REPLICA_PING_PERIOD_MS = 10000;
+
+static std::string transferTempName() {
+    return "temp-sync-" + std::to_string(getpid()) + ".rdb";
+}
+
+/**
+ * @brief Reads a whole file into a buffer that can be queued on several connections.
+ * @return The contents, or `nullptr` (with `errno` set) if it can't be read.
+ */
+static net::SharedBuffer readFileShared(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        if (fd >= 0) ::close(fd);
+        return nullptr;
+    }
+
+    auto contents = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(st.st_size));
+    size_t done = 0;
+    while (done < contents->size()) {
+        ssize_t n = ::read(fd, contents->data() + done, contents->size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        done += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    return contents;
+}
+
+std::string RedisServer::newReplicationId() {
+    static const char digits[] = "0123456789abcdef";
+    std::random_device random;
+    std::string id(40, '0');
+    for (char& c: id) {
+        c = digits[random() & 15];
+    }
+    return id;
+}
+
+/* ====== Primary side ====== */
+
+void RedisServer::feedReplicationStream(const uint8_t* data, size_t len) {
+    replOffset += len;
+    if (replBacklog) {
+        replBacklog->append(data, len);
+    }
+
+    for (auto& [conn, replica]: replicas) {
+        if (replica.state == ReplicaState::ONLINE) {
+            conn->appendOutgoing(data, len);
+            conn->want_write = true;
+        } else if (replica.state == ReplicaState::WAIT_BGSAVE_END) {
+            replica.pending.insert(replica.pending.end(), data, data + len);
+        }
+    }
+}
+
+void RedisServer::handlePSync(const Request& request, Buffer& response) {
+    if (request.command.size() != 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'psync'");
+        return;
+    }
+    if (shards) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Replication is not supported in sharded mode");
+        return;
+    }
+    if (!currentClient || replicas.count(currentClient)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "PSYNC already issued on this connection");
+        return;
+    }
+    // A replica can only pass on a history it is following.
+    if (isReplica() && masterLinkState != MasterLinkState::CONNECTED) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Can't SYNC while not connected with my master");
+        return;
+    }
+
+    Connection& conn = *currentClient;
+    int64_t offset = -1;
+    try {
+        offset = std::stoll(request.command[2]);
+    } catch (const std::exception&) {
+        // Asks for a full resync.
+    }
+
+    if (!replBacklog) {
+        replBacklog = std::make_unique<ReplicationBacklog>(replBacklogSize, replOffset);
+    }
+
+    ReplicaClient& replica = replicas[&conn];
+    replica.lastAckMs = nowMs();
+
+    const std::string& id = request.command[1];
+    const bool same_history = id == replicationId
+        || (!previousReplicationId.empty() && id == previousReplicationId && offset >= 0 && static_cast<uint64_t>(offset) <= previousReplicationIdEnd);
+    if (same_history && offset >= 0 && replBacklog->contains(static_cast<uint64_t>(offset))) {
+        // The reply goes first, then what the replica missed.
+        ResponseBuilder::outStr(response, "CONTINUE " + replicationId);
+        reply(conn, response);
+        response.clear();
+
+        Buffer missing;
+        replBacklog->copyFrom(static_cast<uint64_t>(offset), missing);
+        conn.appendOutgoing(missing.data(), missing.size());
+
+        replica.state = ReplicaState::ONLINE;
+        replica.ackOffset = static_cast<uint64_t>(offset);
+        ++syncPartialOk;
+        std::cout << "Partial resynchronization request from " << conn.getAddress() << " accepted, sending "
+                  << missing.size() << " bytes of backlog" << std::endl;
+        return;
+    }
+
+    if (id != "?") {
+        ++syncPartialErr;
+    }
+    ++syncFull;
+    std::cout << "Full resync requested by replica " << conn.getAddress() << std::endl;
+
+    // Answered once a snapshot is forked for it, as FULLRESYNC carries the
+    // offset the snapshot is taken at.
+    replica.state = ReplicaState::WAIT_BGSAVE_START;
+    startReplicationSnapshot();
+}
+
+void RedisServer::handleReplConf(const Request& request, Buffer& response) {
+    if (request.command.size() == 3 && request.lowerCaseCommand(1) == "ack") {
+        auto it = replicas.find(currentClient);
+        if (it != replicas.end()) {
+            it->second.ackOffset = strtoull(request.command[2].c_str(), nullptr, 10);
+            it->second.lastAckMs = nowMs();
+        }
+        // Acknowledgements get no reply.
+        return;
+    }
+    ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Unrecognized REPLCONF option");
+}
+
+void RedisServer::startReplicationSnapshot() {
+    if (snapshotChild != -1 || aofRewriteChild != -1) {
+        return; // Retried by the cron once the child is done.
+    }
+
+    std::vector<Connection*> waiting;
+    for (const auto& [conn, replica]: replicas) {
+        if (replica.state == ReplicaState::WAIT_BGSAVE_START) {
+            waiting.push_back(conn);
+        }
+    }
+    if (waiting.empty()) {
+        return;
+    }
+
+    if (!startBackgroundSave()) {
+        std::cerr << "Can't save in background for replication: fork: " << strerror(errno) << std::endl;
+        for (Connection* conn: waiting) {
+            conn->want_close = true;
+        }
+        return;
+    }
+
+    Buffer response;
+    ResponseBuilder::outStr(response, "FULLRESYNC " + replicationId + " " + std::to_string(replOffset));
+    for (Connection* conn: waiting) {
+        reply(*conn, response);
+        conn->want_write = true;
+
+        ReplicaClient& replica = replicas[conn];
+        replica.state = ReplicaState::WAIT_BGSAVE_END;
+        replica.pending.clear();
+    }
+}
+
+void RedisServer::sendSnapshotToReplicas(bool ok) {
+    net::SharedBuffer snapshot;
+    for (auto& [conn, replica]: replicas) {
+        if (replica.state != ReplicaState::WAIT_BGSAVE_END) {
+            continue;
+        }
+
+        if (ok && !snapshot) {
+            snapshot = readFileShared(snapshotFilename);
+            if (!snapshot) {
+                std::cerr << "Can't read " << snapshotFilename << " for replication: " << strerror(errno) << std::endl;
+                ok = false;
+            }
+        }
+        if (!ok) {
+            // It reconnects and asks again.
+            conn->want_close = true;
+            continue;
+        }
+
+        const uint64_t size = snapshot->size();
+        conn->appendOutgoing(reinterpret_cast<const uint8_t*>(&size), sizeof(size));
+        conn->appendShared(snapshot);
+        conn->appendOutgoing(replica.pending.data(), replica.pending.size());
+        Buffer().swap(replica.pending);
+        conn->want_write = true;
+
+        replica.state = ReplicaState::ONLINE;
+        std::cout << "Sending a " << size << " bytes snapshot to replica " << conn->getAddress() << std::endl;
+    }
+}
+
+void RedisServer::disconnectReplicas() {
+    for (auto& replica: replicas) {
+        replica.first->want_close = true;
+    }
+}
+
+/* ====== Replica side ====== */
+
+bool RedisServer::replicaOf(const std::string& host, const std::string& port) {
+    if (shards || clusterEnabled) {
+        return false;
+    }
+    if (strcasecmp(host.c_str(), "no") == 0 && strcasecmp(port.c_str(), "one") == 0) {
+        if (isReplica()) {
+            replicationUnsetMaster();
+        }
+        return true;
+    }
+
+    char* end = nullptr;
+    long value = strtol(port.c_str(), &end, 10);
+    if (host.empty() || port.empty() || *end != '\0' || value <= 0 || value > 65535) {
+        return false;
+    }
+    if (!isReplica() || host != masterHost || value != masterPort) {
+        replicationSetMaster(host, static_cast<uint16_t>(value));
+    }
+    return true;
+}
+
+void RedisServer::replicationSetMaster(const std::string& host, uint16_t port) {
+    cancelMasterLink();
+    masterHost = host;
+    masterPort = port;
+    masterLinkState = MasterLinkState::CONNECT;
+    // Connect on the next tick.
+    nextReplicationCronMs = 0;
+
+    // This server's replicas will have to follow whatever history the new
+    // primary has.
+    disconnectReplicas();
+    std::cout << "Connecting to MASTER " << host << ":" << port << std::endl;
+}
+
+void RedisServer::replicationUnsetMaster() {
+    cancelMasterLink();
+    masterHost.clear();
+    masterPort = 0;
+    masterLinkState = MasterLinkState::NONE;
+
+    // Writes start a new history, which continues the one followed so far:
+    // replicas of the former primary can still resume from it.
+    previousReplicationId = replicationId;
+    previousReplicationIdEnd = replOffset;
+    replicationId = newReplicationId();
+    // Let this server's replicas reconnect to learn the new id.
+    disconnectReplicas();
+    std::cout << "MASTER MODE enabled" << std::endl;
+}
+
+void RedisServer::handleReplicaOf(const Request& request, Buffer& response) {
+    if (request.command.size() != 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for '" + request.lowerCaseCommand() + "'");
+        return;
+    }
+    if (shards) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Replication is not supported in sharded mode");
+        return;
+    }
+    if (clusterEnabled) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "REPLICAOF not allowed in cluster mode.");
+        return;
+    }
+    if (!replicaOf(request.command[1], request.command[2])) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Invalid master port");
+        return;
+    }
+    ResponseBuilder::outStr(response, "OK");
+}
+
+void RedisServer::connectToMaster() {
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* address = nullptr;
+    int rc = getaddrinfo(masterHost.c_str(), std::to_string(masterPort).c_str(), &hints, &address);
+    if (rc != 0) {
+        std::cerr << "Can't resolve MASTER " << masterHost << ": " << gai_strerror(rc) << std::endl;
+        return;
+    }
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || (::connect(fd, address->ai_addr, address->ai_addrlen) != 0 && errno != EINPROGRESS)) {
+        std::cerr << "Error connecting to MASTER " << masterHost << ":" << masterPort << ": " << strerror(errno) << std::endl;
+        if (fd >= 0) ::close(fd);
+        freeaddrinfo(address);
+        return;
+    }
+    freeaddrinfo(address);
+
+    masterFd = fd;
+    masterLinkState = MasterLinkState::CONNECTING;
+    masterLastIoMs = nowMs();
+    watch(fd, [this]() { onMasterConnected(); }, POLLOUT);
+}
+
+void RedisServer::onMasterConnected() {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (::getsockopt(masterFd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0) {
+        std::cerr << "Error connecting to MASTER " << masterHost << ":" << masterPort << ": " << strerror(error ? error : errno) << std::endl;
+        cancelMasterLink();
+        return;
+    }
+
+    // Ask to continue the history held so far; the primary decides whether it can.
+    std::cout << "MASTER <-> REPLICA sync started, trying a partial resynchronization from offset " << replOffset << std::endl;
+    if (!sendToMaster({"psync", replicationId, std::to_string(replOffset)})) {
+        cancelMasterLink();
+        return;
+    }
+    masterLinkState = MasterLinkState::HANDSHAKE;
+    watch(masterFd, [this]() { readFromMaster(); });
+}
+
+bool RedisServer::sendToMaster(const std::vector<std::string>& command) {
+    Buffer frame;
+    appendCommand(frame, command);
+
+    // Commands to the primary are tiny: a socket that can't take one at once is as good as broken.
+    ssize_t sent = ::send(masterFd, frame.data(), frame.size(), MSG_NOSIGNAL);
+    if (sent != static_cast<ssize_t>(frame.size())) {
+        std::cerr << "Error writing to MASTER: " << (sent < 0 ? strerror(errno) : "short write") << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void RedisServer::readFromMaster() {
+    uint8_t chunk[64 * 1024];
+    ssize_t n = ::recv(masterFd, chunk, sizeof(chunk), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        std::cerr << (n == 0 ? std::string("Connection with MASTER lost") : std::string("Error reading from MASTER: ") + strerror(errno)) << std::endl;
+        cancelMasterLink();
+        return;
+    }
+
+    masterLastIoMs = nowMs();
+    masterInput.insert(masterInput.end(), chunk, chunk + n);
+    processMasterInput();
+}
+
+void RedisServer::processMasterInput() {
+    size_t pos = 0;
+    bool ok = true;
+
+    while (ok && pos < masterInput.size()) {
+        const uint8_t* data = masterInput.data() + pos;
+        const size_t available = masterInput.size() - pos;
+
+        if (masterLinkState == MasterLinkState::HANDSHAKE) {
+            uint32_t len;
+            if (available < 4) break;
+            memcpy(&len, data, 4);
+            if (available - 4 < len) break;
+            ok = handlePSyncReply(data + 4, len);
+            pos += 4 + len;
+        } else if (masterLinkState == MasterLinkState::TRANSFER) {
+            if (!transferRemaining) {
+                uint64_t size;
+                if (available < sizeof(size)) break;
+                memcpy(&size, data, sizeof(size));
+                transferRemaining = size;
+                pos += sizeof(size);
+                std::cout << "MASTER <-> REPLICA sync: receiving " << size << " bytes from master" << std::endl;
+            } else {
+                const size_t n = static_cast<size_t>(std::min<uint64_t>(available, *transferRemaining));
+                if (!writeAll(transferFd, data, n)) {
+                    std::cerr << "Failed writing the snapshot received from MASTER: " << strerror(errno) << std::endl;
+                    ok = false;
+                    break;
+                }
+                pos += n;
+                *transferRemaining -= n;
+            }
+            if (transferRemaining && *transferRemaining == 0) {
+                ok = finishSnapshotTransfer();
+            }
+        } else if (masterLinkState == MasterLinkState::CONNECTED) {
+            size_t consumed = 0;
+            ok = applyReplicationStream(data, available, consumed);
+            pos += consumed;
+            break;
+        } else {
+            break;
+        }
+    }
+
+    if (!ok) {
+        cancelMasterLink();
+        return;
+    }
+    masterInput.erase(masterInput.begin(), masterInput.begin() + pos);
+}
+
+bool RedisServer::handlePSyncReply(const uint8_t* data, size_t len) {
+    std::string reply_text;
+    uint32_t text_len = 0;
+    if (len >= 5 && data[0] == RES_STR) {
+        memcpy(&text_len, data + 1, 4);
+        reply_text.assign(reinterpret_cast<const char*>(data) + 5, std::min<size_t>(text_len, len - 5));
+    } else if (len >= 9 && data[0] == RES_ERR) {
+        memcpy(&text_len, data + 5, 4);
+        std::cerr << "MASTER refused PSYNC: " << std::string(reinterpret_cast<const char*>(data) + 9, std::min<size_t>(text_len, len - 9)) << std::endl;
+        return false;
+    }
+
+    if (reply_text.compare(0, 11, "FULLRESYNC ") == 0) {
+        const size_t space = reply_text.find(' ', 11);
+        if (space == std::string::npos) {
+            std::cerr << "Bad FULLRESYNC reply from MASTER: " << reply_text << std::endl;
+            return false;
+        }
+        transferReplicationId = reply_text.substr(11, space - 11);
+        transferOffset = strtoull(reply_text.c_str() + space + 1, nullptr, 10);
+        transferRemaining.reset();
+
+        const std::string temp_path = transferTempName();
+        transferFd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (transferFd < 0) {
+            std::cerr << "Can't open " << temp_path << " to receive the snapshot from MASTER: " << strerror(errno) << std::endl;
+            return false;
+        }
+        masterLinkState = MasterLinkState::TRANSFER;
+        std::cout << "Full resync from MASTER: " << transferReplicationId << ":" << transferOffset << std::endl;
+        return true;
+    }
+
+    if (reply_text.compare(0, 9, "CONTINUE ") == 0) {
+        // A promoted replica continues our history under a new id.
+        const std::string id = reply_text.substr(9);
+        if (id != replicationId) {
+            previousReplicationId = replicationId;
+            previousReplicationIdEnd = replOffset;
+            replicationId = id;
+            disconnectReplicas();
+        }
+        masterLinkState = MasterLinkState::CONNECTED;
+        std::cout << "Successful partial resynchronization with MASTER from offset " << replOffset << std::endl;
+        return true;
+    }
+
+    std::cerr << "Unexpected reply to PSYNC from MASTER: " << reply_text << std::endl;
+    return false;
+}
+
+bool RedisServer::finishSnapshotTransfer() {
+    const std::string temp_path = transferTempName();
+    bool ok = ::fsync(transferFd) == 0;
+    ok = ::close(transferFd) == 0 && ok;
+    transferFd = -1;
+    if (!ok || ::rename(temp_path.c_str(), snapshotFilename.c_str()) != 0) {
+        std::cerr << "Failed saving the snapshot received from MASTER: " << strerror(errno) << std::endl;
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+
+    // The old keyspace is torn down in the background.
+    const int64_t start_ms = nowMs();
+    expiryIndex.clear();
+    evictionPool.clear();
+    lazyFree.free(std::exchange(dataStore, HashTable()));
+    try {
+        loadSnapshot();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed loading the snapshot received from MASTER: " << e.what() << std::endl;
+        return false;
+    }
+
+    // Adopt the primary's history. Replicas of this server followed another one.
+    replicationId = transferReplicationId;
+    replOffset = transferOffset;
+    previousReplicationId.clear();
+    previousReplicationIdEnd = 0;
+    if (replBacklog) {
+        replBacklog = std::make_unique<ReplicationBacklog>(replBacklogSize, replOffset);
+    }
+    disconnectReplicas();
+
+    // The log must recreate the new keyspace, not the old one.
+    if (aofState != AofState::OFF) {
+        stopAppendOnly();
+        startAppendOnly();
+    }
+
+    masterLinkState = MasterLinkState::CONNECTED;
+    std::cout << "MASTER <-> REPLICA sync: loaded " << dataStore.size() << " keys in " << nowMs() - start_ms << " ms" << std::endl;
+    return true;
+}
+
+bool RedisServer::applyReplicationStream(const uint8_t* data, size_t len, size_t& consumed) {
+    consumed = 0;
+    while (len - consumed >= 4) {
+        uint32_t frame_len;
+        memcpy(&frame_len, data + consumed, 4);
+        if (frame_len > net::MAX_MSG) {
+            std::cerr << "Protocol error in the stream from MASTER: " << frame_len << " bytes command" << std::endl;
+            return false;
+        }
+        if (len - consumed - 4 < frame_len) {
+            break;
+        }
+
+        Request request;
+        if (parseRequest(std::string(reinterpret_cast<const char*>(data + consumed + 4), frame_len), request) != 0) {
+            std::cerr << "Protocol error in the stream from MASTER at offset " << replOffset << std::endl;
+            return false;
+        }
+        Buffer response;
+        executeRequest(request, response);
+        consumed += 4 + frame_len;
+    }
+
+    // Relayed as received, so that offsets match all the way down.
+    feedReplicationStream(data, consumed);
+    return true;
+}
+
+void RedisServer::cancelMasterLink() {
+    if (masterFd != -1) {
+        unwatch(masterFd);
+        ::close(masterFd);
+        masterFd = -1;
+    }
+    if (transferFd != -1) {
+        ::close(transferFd);
+        ::unlink(transferTempName().c_str());
+        transferFd = -1;
+    }
+    Buffer().swap(masterInput);
+    if (isReplica()) {
+        masterLinkState = MasterLinkState::CONNECT;
+    }
+}
+
+/* ====== Both sides ====== */
+
+void RedisServer::replicationCron() {
+    // Clients blocked while this server was a primary would wait for writes
+    // that now only come from the stream.
+    while (isReplica() && !blockedClients.empty()) {
+        Connection* conn = blockedClients.begin()->first;
+        unblockClient(*conn);
+
+        Buffer response;
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "UNBLOCKED force unblock from blocking operation, instance state changed (master -> replica?)");
+        reply(*conn, response);
+        resume(*conn);
+    }
+
+    startReplicationSnapshot();
+
+    const int64_t now = nowMs();
+    if (now < nextReplicationCronMs) {
+        return;
+    }
+    nextReplicationCronMs = now + REPLICATION_CRON_MS;
+    const int64_t timeout_ms = static_cast<int64_t>(replTimeout) * 1000;
+
+    if (masterLinkState == MasterLinkState::CONNECT) {
+        connectToMaster();
+    } else if (isReplica() && now - masterLastIoMs > timeout_ms) {
+        std::cerr << "Timeout on the link with MASTER, reconnecting" << std::endl;
+        cancelMasterLink();
+    } else if (masterLinkState == MasterLinkState::CONNECTED && !sendToMaster({"replconf", "ack", std::to_string(replOffset)})) {
+        cancelMasterLink();
+    }
+
+    bool any_online = false;
+    for (auto& [conn, replica]: replicas) {
+        if (replica.state != ReplicaState::ONLINE) {
+            continue;
+        }
+        if (now - replica.lastAckMs > timeout_ms) {
+            std::cerr << "Disconnecting timed out replica " << conn->getAddress() << std::endl;
+            conn->want_close = true;
+            continue;
+        }
+        any_online = true;
+    }
+
+    // A replica relays its primary's pings instead.
+    if (any_online && !isReplica() && now - lastReplicaPingMs >= REPLICA_PING_PERIOD_MS) {
+        lastReplicaPingMs = now;
+        Buffer ping;
+        appendCommand(ping, std::vector<std::string>{"ping"});
+        feedReplicationStream(ping.data(), ping.size());
+    }
+}
+
+std::string RedisServer::replicationInfo() const {
+    static const char* const link_states[] = {"none", "connect", "connecting", "handshake", "transfer", "connected"};
+    const int64_t now = nowMs();
+    std::string info;
+
+    info += std::string("role:") + (isReplica() ? "slave" : "master") + "\r\n";
+    if (isReplica()) {
+        info += "master_host:" + masterHost + "\r\n";
+        info += "master_port:" + std::to_string(masterPort) + "\r\n";
+        info += std::string("master_link_status:") + (masterLinkState == MasterLinkState::CONNECTED ? "up" : "down") + "\r\n";
+        info += std::string("master_link_state:") + link_states[static_cast<int>(masterLinkState)] + "\r\n";
+        info += "master_last_io_seconds_ago:" + std::to_string(masterFd != -1 ? (now - masterLastIoMs) / 1000 : -1) + "\r\n";
+        info += std::string("master_sync_in_progress:") + (masterLinkState == MasterLinkState::TRANSFER ? "1" : "0") + "\r\n";
+        info += "slave_repl_offset:" + std::to_string(replOffset) + "\r\n";
+    }
+
+    info += "connected_slaves:" + std::to_string(replicas.size()) + "\r\n";
+    size_t index = 0;
+    for (const auto& [conn, replica]: replicas) {
+        const char* state = replica.state == ReplicaState::ONLINE ? "online" : "wait_bgsave";
+        info += "slave" + std::to_string(index++) + ":addr=" + conn->getAddress() + ",state=" + state
+            + ",offset=" + std::to_string(replica.ackOffset) + ",lag=" + std::to_string((now - replica.lastAckMs) / 1000) + "\r\n";
+    }
+
+    info += "master_replid:" + replicationId + "\r\n";
+    info += "master_replid2:" + (previousReplicationId.empty() ? std::string(40, '0') : previousReplicationId) + "\r\n";
+    info += "master_repl_offset:" + std::to_string(replOffset) + "\r\n";
+    info += std::string("repl_backlog_active:") + (replBacklog ? "1" : "0") + "\r\n";
+    info += "repl_backlog_size:" + std::to_string(replBacklogSize) + "\r\n";
+    info += "repl_backlog_first_byte_offset:" + std::to_string(replBacklog ? replBacklog->startOffset() : 0) + "\r\n";
+    info += "repl_backlog_histlen:" + std::to_string(replBacklog ? replBacklog->historyLength() : 0) + "\r\n";
+    return info;
+}
@@ -0,0 +1,49 @@
+#include <server/ReplicationBacklog.hpp>
+#include <algorithm>
+#include <cstring>
+
+ReplicationBacklog::ReplicationBacklog(size_t capacity, uint64_t offset): ring(std::max<size_t>(capacity, 1)), end(offset) {}
+
+void ReplicationBacklog::append(const uint8_t* data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    end += len;
+
+    // Only the tail of a write larger than the whole ring survives.
+    if (len > ring.size()) {
+        data += len - ring.size();
+        len = ring.size();
+    }
+
+    const size_t first = std::min(len, ring.size() - head);
+    memcpy(ring.data() + head, data, first);
+    memcpy(ring.data(), data + first, len - first);
+    head = (head + len) % ring.size();
+    length = std::min(length + len, ring.size());
+}
+
+void ReplicationBacklog::copyFrom(uint64_t offset, std::vector<uint8_t>& out) const {
+    const size_t count = static_cast<size_t>(end - offset);
+    // The byte at `offset` sits `count` bytes behind the head.
+    const size_t start = (head + ring.size() - count) % ring.size();
+    const size_t first = std::min(count, ring.size() - start);
+
+    out.insert(out.end(), ring.begin() + start, ring.begin() + start + first);
+    out.insert(out.end(), ring.begin(), ring.begin() + (count - first));
+}
+
+void ReplicationBacklog::resize(size_t capacity) {
+    capacity = std::max<size_t>(capacity, 1);
+    if (capacity == ring.size()) {
+        return;
+    }
+
+    std::vector<uint8_t> history;
+    copyFrom(end - std::min(length, capacity), history);
+
+    ring.assign(capacity, 0);
+    std::copy(history.begin(), history.end(), ring.begin());
+    length = history.size();
+    head = length % capacity;
+}
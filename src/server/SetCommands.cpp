@@ -0,0 +1,162 @@
+#include <server/Redis.hpp>
+
+/**
+ * @file SetCommands.cpp
+ * @brief Implements the set (SADD, SREM, ...) command handlers of RedisServer.
+ */
+
+void RedisServer::handleSAdd(const Request& request, Buffer& response) {
+    if (request.command.size() < 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'sadd'");
+        return;
+    }
+
+    Set* set;
+    if (!lookupTyped(request.command[1], set, response)) return;
+    if (!set) {
+        set = &std::get<Set>(addEntry(request.command[1], Set{})->value);
+    }
+
+    int64_t added = 0;
+    for (size_t i = 2; i < request.command.size(); ++i) {
+        if (set->add(request.command[i])) {
+            ++added;
+        }
+    }
+
+    ResponseBuilder::outInt(response, added);
+}
+
+void RedisServer::handleSRem(const Request& request, Buffer& response) {
+    if (request.command.size() < 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'srem'");
+        return;
+    }
+
+    Set* set;
+    if (!lookupTyped(request.command[1], set, response)) return;
+    if (!set) {
+        ResponseBuilder::outInt(response, 0);
+        return;
+    }
+
+    int64_t removed = 0;
+    for (size_t i = 2; i < request.command.size(); ++i) {
+        if (set->remove(request.command[i])) {
+            ++removed;
+        }
+    }
+
+    // A set never stays empty: the key goes away with its last member.
+    if (set->size() == 0) {
+        removeEntry(request.command[1]);
+    }
+
+    ResponseBuilder::outInt(response, removed);
+}
+
+void RedisServer::handleSIsMember(const Request& request, Buffer& response) {
+    if (request.command.size() != 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'sismember'");
+        return;
+    }
+
+    Set* set;
+    if (!lookupTyped(request.command[1], set, response)) return;
+
+    ResponseBuilder::outInt(response, set && set->contains(request.command[2]) ? 1 : 0);
+}
+
+void RedisServer::handleSCard(const Request& request, Buffer& response) {
+    if (request.command.size() != 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'scard'");
+        return;
+    }
+
+    Set* set;
+    if (!lookupTyped(request.command[1], set, response)) return;
+
+    ResponseBuilder::outInt(response, set ? static_cast<int64_t>(set->size()) : 0);
+}
+
+void RedisServer::handleSMembers(const Request& request, Buffer& response) {
+    if (request.command.size() != 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'smembers'");
+        return;
+    }
+
+    Set* set;
+    if (!lookupTyped(request.command[1], set, response)) return;
+    if (!set) {
+        ResponseBuilder::outArr(response, 0);
+        return;
+    }
+
+    ResponseBuilder::outArr(response, static_cast<uint32_t>(set->size()));
+    set->forEach([&response](std::string_view member) {
+        ResponseBuilder::outStr(response, std::string(member));
+    });
+}
+
+void RedisServer::setOpGeneric(const Request& request, Buffer& response, SetOp op) {
+    if (request.command.size() < 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for '" + request.lowerCaseCommand() + "'");
+        return;
+    }
+
+    // Resolve every key first so that a type error is reported before any work.
+    // A missing key is an empty set.
+    std::vector<Set*> sets;
+    bool missing = false;
+    for (size_t i = 1; i < request.command.size(); ++i) {
+        Set* set;
+        if (!lookupTyped(request.command[i], set, response)) return;
+        if (set) sets.push_back(set);
+        else if (i == 1 || op == SetOp::INTER) missing = true;
+    }
+
+    std::vector<std::string> members;
+    auto collect = [&members](std::string_view member) { members.emplace_back(member); };
+
+    if (op == SetOp::INTER) {
+        if (!missing) {
+            Set::intersect(sets, collect);
+        }
+    } else if (op == SetOp::UNION) {
+        Set result;
+        for (Set* set: sets) {
+            set->forEach([&result](std::string_view member) { result.add(member); });
+        }
+        result.forEach(collect);
+    } else if (!missing) {
+        Set* first = sets[0];
+        sets.erase(sets.begin());
+        // Subtracting a set from itself leaves nothing, and probing the set
+        // being iterated could rehash it under our feet.
+        if (std::find(sets.begin(), sets.end(), first) == sets.end()) {
+            first->forEach([&sets, &members](std::string_view member) {
+                for (Set* other: sets) {
+                    if (other->contains(member)) return;
+                }
+                members.emplace_back(member);
+            });
+        }
+    }
+
+    ResponseBuilder::outArr(response, static_cast<uint32_t>(members.size()));
+    for (const auto& member: members) {
+        ResponseBuilder::outStr(response, member);
+    }
+}
+
+void RedisServer::handleSInter(const Request& request, Buffer& response) {
+    setOpGeneric(request, response, SetOp::INTER);
+}
+
+void RedisServer::handleSUnion(const Request& request, Buffer& response) {
+    setOpGeneric(request, response, SetOp::UNION);
+}
+
+void RedisServer::handleSDiff(const Request& request, Buffer& response) {
+    setOpGeneric(request, response, SetOp::DIFF);
+}
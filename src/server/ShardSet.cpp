@@ -0,0 +1,93 @@
+#include <server/ShardSet.hpp>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/// @brief Messages in flight between two shards before the sender keeps them back.
+static const size_t SHARD_QUEUE_CAPACITY = 4096;
+
+ShardSet::ShardSet(size_t count): count(count), servers(count, nullptr), paused(count, false) {
+    queues.reserve(count * count);
+    for (size_t i = 0; i < count * count; ++i) {
+        queues.push_back(std::make_unique<SpscQueue<ShardMessage>>(SHARD_QUEUE_CAPACITY));
+    }
+
+    pauseRequested = std::make_unique<std::atomic<bool>[]>(count);
+    for (size_t i = 0; i < count; ++i) {
+        pauseRequested[i] = false;
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error(std::string("eventfd() error: ") + strerror(errno));
+        }
+        notifyFds.push_back(fd);
+    }
+}
+
+ShardSet::~ShardSet() {
+    for (int fd: notifyFds) {
+        close(fd);
+    }
+}
+
+void ShardSet::attach(size_t index, RedisServer& server) {
+    servers[index] = &server;
+}
+
+void ShardSet::notify(size_t index) {
+    uint64_t one = 1;
+    // Only fails when the counter would overflow, in which case it is already set.
+    (void) !write(notifyFds[index], &one, sizeof(one));
+}
+
+void ShardSet::pauseOthers(size_t self) {
+    // A shard waiting for its turn must still let the current coordinator park it.
+    while (!coordinator.try_lock()) {
+        servePause(self);
+        std::this_thread::yield();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pauseMutex);
+        for (size_t i = 0; i < count; ++i) {
+            if (i != self) pauseRequested[i] = true;
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (i != self) notify(i);
+    }
+
+    std::unique_lock<std::mutex> lock(pauseMutex);
+    pauseChanged.wait(lock, [this, self]() {
+        for (size_t i = 0; i < count; ++i) {
+            if (i != self && !paused[i]) return false;
+        }
+        return true;
+    });
+}
+
+void ShardSet::resumeOthers(size_t self) {
+    {
+        std::lock_guard<std::mutex> lock(pauseMutex);
+        for (size_t i = 0; i < count; ++i) {
+            if (i != self) pauseRequested[i] = false;
+        }
+    }
+    pauseChanged.notify_all();
+    coordinator.unlock();
+}
+
+void ShardSet::servePause(size_t self) {
+    if (!pauseRequested[self].load(std::memory_order_acquire)) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(pauseMutex);
+    paused[self] = true;
+    pauseChanged.notify_all();
+    // Requested again by the next coordinator before waking up, it simply stays parked.
+    pauseChanged.wait(lock, [this, self]() { return !pauseRequested[self].load(); });
+    paused[self] = false;
+}
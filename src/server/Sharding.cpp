@@ -0,0 +1,339 @@
+#include <server/Redis.hpp>
+#include <unistd.h>
+
+/**
+ * @file Sharding.cpp
+ * @brief Implements sharded mode: routing requests to the shard owning their keys.
+ * @details Each shard is a RedisServer on its own thread, owning the keys of
+ * the hash slots congruent to its index and accepting its share of the
+ * connections on the common port (SO_REUSEPORT). A request is routed by its
+ * keys:
+ *
+ * - all of them on the receiving shard: executed right away, as in a
+ *   single-threaded server;
+ * - all of them on one other shard: forwarded through the shards' lock-free
+ *   queues. The client's pipelined requests go on meanwhile, so that several
+ *   can be in flight, and their replies are held back until those of the
+ *   earlier requests came in. A request that isn't confined to one shard's
+ *   keys waits for them instead. A blocking pop waits on the owning shard, on
+ *   a stand-in connection, with its client blocked;
+ * - spread over several shards: executed on the receiving shard while the
+ *   others are parked (see `ShardSet::pauseOthers`), with every key looked up
+ *   in its owner's table. Blocking pops can't wait on several shards at once,
+ *   so their keys must share a `{hash tag}`.
+ *
+ * Commands that read or change every shard (KEYS, FLUSHALL, SAVE, CONFIG...)
+ * run on the first shard with the others parked, and PUBLISH is executed on
+ * every shard, each delivering to its own subscribers. SCAN walks the shards
+ * one after the other.
+ */
+
+std::vector<size_t> RedisServer::commandKeys(const Command& command, const Request& request) {
+    std::vector<size_t> keys;
+    const size_t argc = request.command.size();
+    if (command.firstKey == 0 || static_cast<size_t>(command.firstKey) >= argc) {
+        return keys;
+    }
+
+    if (command.flags & CMD_NUMKEYS) {
+        keys.push_back(command.firstKey);
+        const size_t count_index = command.firstKey + 1;
+        if (count_index < argc) {
+            const size_t count = strtoull(request.command[count_index].c_str(), nullptr, 10);
+            for (size_t i = count_index + 1; i < argc && i <= count_index + count; ++i) {
+                keys.push_back(i);
+            }
+        }
+        return keys;
+    }
+
+    const long last = command.lastKey < 0 ? static_cast<long>(argc) + command.lastKey : command.lastKey;
+    for (long i = command.firstKey; i <= last && i < static_cast<long>(argc); i += command.keyStep) {
+        keys.push_back(static_cast<size_t>(i));
+    }
+    return keys;
+}
+
+bool RedisServer::routeRequest(Connection* conn, const Request& request, ShardRoute& route, Buffer& response) {
+    route = {shardIndex, false, false};
+
+    // Unknown commands and subscribed connections get their error here.
+    auto it = commandTable.find(request.lowerCaseCommand());
+    if (it == commandTable.end() || (conn && pubsubClients.count(conn))) {
+        return true;
+    }
+    const Command& command = it->second;
+
+    if (command.flags & CMD_ALLSHARDS) {
+        route.shard = 0;
+        route.pause = true;
+        return true;
+    }
+
+    if (it->first == "scan") {
+        if (request.command.size() > 1) {
+            const size_t cursor_shard = strtoull(request.command[1].c_str(), nullptr, 10) >> SHARD_CURSOR_SHIFT;
+            if (cursor_shard < shards->size()) route.shard = cursor_shard;
+        }
+        return true;
+    }
+
+    const std::vector<size_t> keys = commandKeys(command, request);
+    if (keys.empty()) {
+        return true;
+    }
+
+    const size_t owner = shards->shardOf(request.command[keys[0]]);
+    for (size_t i = 1; i < keys.size(); ++i) {
+        if (shards->shardOf(request.command[keys[i]]) != owner) {
+            if (command.flags & CMD_BLOCKING) {
+                ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "CROSSSLOT Keys of a blocking command must belong to the same shard, use a {hash tag}");
+                return false;
+            }
+            route.pause = true;
+            return true;
+        }
+    }
+    route.shard = owner;
+    route.independent = !(command.flags & CMD_BLOCKING);
+    return true;
+}
+
+void RedisServer::shardRequest(Connection& conn, Request& request) {
+    ShardRoute route;
+    Buffer response;
+    if (!routeRequest(&conn, request, route, response)) {
+        replyInOrder(conn, std::move(response));
+        return;
+    }
+
+    // Picked up again once the replies in flight came in (see releaseReplies).
+    if (!route.independent && pendingReplies.count(&conn)) {
+        deferredRequests[&conn] = std::move(request);
+        conn.blocked = true;
+        return;
+    }
+
+    const Command* command = nullptr;
+    auto it = commandTable.find(request.lowerCaseCommand());
+    if (it != commandTable.end()) command = &it->second;
+
+    if (route.shard != shardIndex) {
+        forwardRequest(conn, route.shard, std::move(request.command), command && (command->flags & CMD_BLOCKING));
+        return;
+    }
+
+    currentClient = &conn;
+    executeOnShard(request, response, route.pause);
+    currentClient = nullptr;
+    // A blocked request leaves the response empty: it is answered later.
+    if (!response.empty()) {
+        replyInOrder(conn, std::move(response));
+    }
+
+    if (command && (command->flags & CMD_BROADCAST)) {
+        for (size_t i = 0; i < shards->size(); ++i) {
+            if (i == shardIndex) continue;
+            ShardMessage message;
+            message.command = request.command;
+            sendToShard(i, std::move(message));
+        }
+    }
+}
+
+void RedisServer::replyInOrder(Connection& conn, Buffer response) {
+    auto pending = pendingReplies.find(&conn);
+    if (pending == pendingReplies.end()) {
+        reply(conn, response);
+        return;
+    }
+    pending->second.push_back({shardIndex, 0, true, std::move(response)});
+}
+
+void RedisServer::releaseReplies(Connection& conn) {
+    auto pending = pendingReplies.find(&conn);
+    std::deque<PendingReply>& replies = pending->second;
+    while (!replies.empty() && replies.front().done) {
+        if (!replies.front().response.empty()) {
+            reply(conn, replies.front().response);
+        }
+        replies.pop_front();
+    }
+    if (!replies.empty()) {
+        if (conn.hasOutgoing()) conn.want_write = true;
+        return;
+    }
+    pendingReplies.erase(pending);
+
+    // Blocked for a forwarded blocking pop or a deferred request, which can go now.
+    conn.blocked = false;
+    auto deferred = deferredRequests.find(&conn);
+    if (deferred != deferredRequests.end()) {
+        Request request = std::move(deferred->second);
+        deferredRequests.erase(deferred);
+        shardRequest(conn, request);
+    }
+
+    if (!conn.blocked) {
+        resume(conn);
+    } else if (conn.hasOutgoing()) {
+        conn.want_write = true;
+    }
+}
+
+void RedisServer::executeOnShard(const Request& request, Buffer& response, bool pause) {
+    if (!pause) {
+        executeRequest(request, response);
+        return;
+    }
+
+    shards->pauseOthers(shardIndex);
+    crossShard = true;
+    executeRequest(request, response);
+    crossShard = false;
+    shards->resumeOthers(shardIndex);
+    ++crossShardCount;
+}
+
+void RedisServer::forwardRequest(Connection& conn, size_t shard, std::vector<std::string> command, bool block) {
+    const uint64_t token = ++nextForwardToken;
+    forwardedRequests[token] = &conn;
+    pendingReplies[&conn].push_back({shard, token, false, {}});
+    conn.blocked = block;
+    ++forwardedCount;
+
+    ShardMessage message;
+    message.token = token;
+    message.command = std::move(command);
+    sendToShard(shard, std::move(message));
+}
+
+void RedisServer::sendToShard(size_t shard, ShardMessage message) {
+    shardOutbox[shard].push_back(std::move(message));
+}
+
+void RedisServer::flushShardOutbox() {
+    for (size_t i = 0; i < shardOutbox.size(); ++i) {
+        auto& outbox = shardOutbox[i];
+        if (outbox.empty()) continue;
+
+        // Whatever doesn't fit waits for the next iteration: blocking here
+        // could deadlock two shards filling each other's queues.
+        SpscQueue<ShardMessage>& queue = shards->queue(shardIndex, i);
+        bool sent = false;
+        while (!outbox.empty() && queue.push(std::move(outbox.front()))) {
+            outbox.pop_front();
+            sent = true;
+        }
+        if (sent) {
+            shards->notify(i);
+        }
+    }
+}
+
+void RedisServer::processShardMessages() {
+    uint64_t count;
+    (void) !read(shards->notifyFd(shardIndex), &count, sizeof(count));
+
+    shards->servePause(shardIndex);
+
+    ShardMessage message;
+    for (size_t from = 0; from < shards->size(); ++from) {
+        if (from == shardIndex) continue;
+
+        SpscQueue<ShardMessage>& queue = shards->queue(from, shardIndex);
+        while (queue.pop(message)) {
+            switch (message.type) {
+                case ShardMessage::Type::REQUEST:
+                    executeForwarded(from, message);
+                    break;
+
+                case ShardMessage::Type::REPLY: {
+                    // The client may have left meanwhile.
+                    auto it = forwardedRequests.find(message.token);
+                    if (it == forwardedRequests.end()) break;
+                    Connection* conn = it->second;
+                    forwardedRequests.erase(it);
+
+                    for (PendingReply& pending: pendingReplies[conn]) {
+                        if (pending.token == message.token) {
+                            pending.done = true;
+                            pending.response = std::move(message.response);
+                            break;
+                        }
+                    }
+                    releaseReplies(*conn);
+                    break;
+                }
+
+                case ShardMessage::Type::CANCEL:
+                    for (auto it = remoteClients.begin(); it != remoteClients.end(); ++it) {
+                        if (it->second.shard == from && it->second.token == message.token) {
+                            unblockClient(*it->first);
+                            remoteClients.erase(it);
+                            break;
+                        }
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+void RedisServer::executeForwarded(size_t shard, ShardMessage& message) {
+    Request request;
+    request.command = std::move(message.command);
+    Buffer response;
+
+    // Stands in for the client, should the command block it.
+    auto stand_in = std::make_unique<Connection>();
+    ShardRoute route;
+    if (routeRequest(nullptr, request, route, response)) {
+        currentClient = stand_in.get();
+        executeOnShard(request, response, route.pause);
+        currentClient = nullptr;
+    }
+
+    // A broadcast expects no reply.
+    if (message.token == 0) {
+        return;
+    }
+
+    if (response.empty() && stand_in->blocked) {
+        Connection* conn = stand_in.get();
+        remoteClients[conn] = {shard, message.token, std::move(stand_in)};
+        return;
+    }
+
+    ShardMessage reply_message;
+    reply_message.type = ShardMessage::Type::REPLY;
+    reply_message.token = message.token;
+    reply_message.response = std::move(response);
+    sendToShard(shard, std::move(reply_message));
+}
+
+void RedisServer::replyToBlocked(Connection& conn, const Buffer& response) {
+    auto remote = remoteClients.find(&conn);
+    if (remote == remoteClients.end()) {
+        reply(conn, response);
+        resume(conn);
+        return;
+    }
+
+    ShardMessage message;
+    message.type = ShardMessage::Type::REPLY;
+    message.token = remote->second.token;
+    message.response = response;
+    sendToShard(remote->second.shard, std::move(message));
+    remoteClients.erase(remote);
+}
+
+std::string RedisServer::shardingInfo() const {
+    std::string info;
+    info += "shard_id:" + std::to_string(shardIndex) + "\r\n";
+    info += "shards:" + std::to_string(shards->size()) + "\r\n";
+    info += "forwarded_requests:" + std::to_string(forwardedCount) + "\r\n";
+    info += "cross_shard_commands:" + std::to_string(crossShardCount) + "\r\n";
+    info += "remote_blocked_clients:" + std::to_string(remoteClients.size()) + "\r\n";
+    return info;
+}
@@ -0,0 +1,182 @@
+#include <server/Redis.hpp>
+#include <server/SnapshotFile.hpp>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * @file Snapshot.cpp
+ * @brief Implements point-in-time snapshots of the keyspace: SAVE, BGSAVE and loading on startup.
+ * @details BGSAVE forks: the child serializes the copy-on-write image of the
+ * keyspace it inherited at the fork, while the parent keeps serving clients
+ * and only polls for the child's exit status from `onTick`. SAVE writes the
+ * same file synchronously, blocking every client meanwhile.
+ *
+ * The file format lives in SnapshotFile.cpp. The file is written under a
+ * temporary name and renamed over the previous snapshot once complete, so a
+ * crash never leaves a truncated one. Loading decodes the file's segments on
+ * every core, then links the decoded entries into the keyspace on the main
+ * thread, into a table sized for them up front.
+ */
+
+bool RedisServer::saveSnapshot() {
+    const std::string temp_path = snapshotFilename + ".tmp-" + std::to_string(getpid());
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed opening " << temp_path << " for saving: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    SnapshotWriter writer(fd, snapshotCompression);
+
+    // Keys that expired but were not reclaimed yet are left out. In sharded
+    // mode one file holds every shard's keys, so it loads with any number of them.
+    const int64_t now_ms = unixTimeMs();
+    forEachShard([&](RedisServer& shard) {
+        shard.dataStore.forEach([&](HashTable::Node* node) {
+            auto* entry = static_cast<DataEntry*>(node);
+            if (!isExpired(entry, now_ms)) {
+                writer.writeEntry(*entry);
+            }
+        });
+    });
+
+    // The snapshot must be on disk before it replaces the previous one.
+    bool ok = writer.finish() && ::fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if (ok && ::rename(temp_path.c_str(), snapshotFilename.c_str()) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        std::cerr << "Failed writing snapshot " << snapshotFilename << ": " << strerror(errno) << std::endl;
+        ::unlink(temp_path.c_str());
+    }
+    return ok;
+}
+
+bool RedisServer::loadSnapshot() {
+    // The first shard loads the keys of all of them, before any runs.
+    if (shards && shardIndex != 0) {
+        return false;
+    }
+
+    SnapshotContents contents;
+    if (!readSnapshotFile(snapshotFilename, unixTimeMs(), std::thread::hardware_concurrency(), contents)) {
+        return false;
+    }
+
+    // The table and the expiry index are not thread-safe: link on this thread,
+    // into a table that no longer needs to grow on the way.
+    const size_t shard_count = shards ? shards->size() : 1;
+    forEachShard([&](RedisServer& shard) { shard.dataStore.reserve(contents.keyCount / shard_count); });
+    for (auto& segment: contents.segments) {
+        for (auto& new_entry: segment) {
+            DataEntry* entry = new_entry.get();
+            RedisServer& owner = shards ? shards->shard(shards->shardOf(entry->key)) : *this;
+            owner.touchEntry(entry);
+            owner.dataStore.insert(std::move(new_entry));
+            if (!owner.slotKeys.empty()) {
+                owner.slotKeys[keyHashSlot(entry->key)].insert(entry);
+            }
+            // Not indexed yet, so `setExpire` has nothing to replace.
+            if (entry->expire_at_ms != 0) {
+                owner.expiryIndex.insert({entry->expire_at_ms, entry});
+            }
+        }
+        segment.clear();
+        segment.shrink_to_fit();
+    }
+    return true;
+}
+
+void RedisServer::handleSave(const Request& request, Buffer& response) {
+    if (request.command.size() != 1) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'save'");
+        return;
+    }
+    if (snapshotChild != -1) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Background save already in progress");
+        return;
+    }
+
+    if (!saveSnapshot()) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Error saving the snapshot, check the server logs");
+        return;
+    }
+    dirty = 0;
+    lastSaveTime = time(nullptr);
+    ResponseBuilder::outStr(response, "OK");
+}
+
+void RedisServer::handleBgSave(const Request& request, Buffer& response) {
+    if (request.command.size() != 1) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'bgsave'");
+        return;
+    }
+    if (snapshotChild != -1) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Background save already in progress");
+        return;
+    }
+    if (aofRewriteChild != -1) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Can't save in background while the append only file is being rewritten");
+        return;
+    }
+
+    if (!startBackgroundSave()) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, std::string("Can't save in background: fork: ") + strerror(errno));
+        return;
+    }
+    ResponseBuilder::outStr(response, "Background saving started");
+}
+
+bool RedisServer::startBackgroundSave() {
+    pid_t pid = fork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid == 0) {
+        // The child only writes the snapshot: `_exit` skips the destructors,
+        // which would wait for threads (like the lazy-free one) that were not
+        // forked along.
+        _exit(saveSnapshot() ? 0 : 1);
+    }
+
+    snapshotChild = pid;
+    dirtyAtSnapshot = dirty;
+    std::cout << "Background saving started by pid " << pid << std::endl;
+    return true;
+}
+
+void RedisServer::handleLastSave(const Request& request, Buffer& response) {
+    if (request.command.size() != 1) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'lastsave'");
+        return;
+    }
+    ResponseBuilder::outInt(response, static_cast<int64_t>(lastSaveTime));
+}
+
+void RedisServer::checkSnapshotChild() {
+    int status = 0;
+    pid_t pid = waitpid(snapshotChild, &status, WNOHANG);
+    if (pid == 0) {
+        return;
+    }
+
+    snapshotChild = -1;
+    lastBgsaveOk = pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (lastBgsaveOk) {
+        // Writes made while the child was saving are not in the snapshot.
+        dirty -= dirtyAtSnapshot;
+        lastSaveTime = time(nullptr);
+        std::cout << "Background saving terminated with success" << std::endl;
+    } else {
+        std::cerr << "Background saving failed" << std::endl;
+    }
+
+    // Replicas waiting for a full resync get the snapshot this child wrote for them.
+    sendSnapshotToReplicas(lastBgsaveOk);
+}
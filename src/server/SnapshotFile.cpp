@@ -0,0 +1,583 @@
+#include <server/SnapshotFile.hpp>
+#include <common/Crc64.hpp>
+#include <common/FileIo.hpp>
+#include <common/Lzf.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+/**
+ * @file SnapshotFile.cpp
+ * @brief Implements the snapshot file format.
+ * @details Snapshot layout (fixed-size integers are little-endian; lengths
+ * and counts are LEB128 varints):
+ *
+ *     "RCDB" | u32 version
+ *     segment*: u8 SNAPSHOT_SEGMENT | u64 length | u64 entry count | u64 CRC-64 of the entries | entries
+ *             | u8 SNAPSHOT_SEGMENT_LZF | u64 length | u64 entry count | u64 CRC-64 of the compressed entries
+ *               | u64 decompressed length | LZF-compressed entries
+ *     u8 SNAPSHOT_EOF | u64 key count | u64 CRC-64 of the header, the segment headers and the trailer
+ *
+ *     entry: u8 type [| i64 expire_at_ms, with SNAPSHOT_EXPIRES] | key | value
+ *
+ * A string is its length and bytes. A value is a string (strings), or a
+ * count followed by (member, score) pairs with raw IEEE-754 scores (sorted
+ * sets), (field, value) pairs (hashes), or members or elements (sets and
+ * lists). A string stored compressed in memory (`DataEntry::compressed`) is
+ * written as is, with type `SNAPSHOT_STRING_LZF`, and loads compressed.
+ *
+ * Segments are compressed with LZF when `rdbcompression` is on and that makes
+ * them smaller. Version 2 files are the same without compression. Version 1
+ * files, written before segments existed, are a single run of entries
+ * followed by `SNAPSHOT_EOF` and a CRC-64 of every preceding byte, and load
+ * as one segment decoded on one thread.
+ *
+ * The payloads of DUMP and RESTORE, which MIGRATE moves keys with, encode a
+ * single value the same way:
+ *
+ *     u8 type | value | u32 version | u64 CRC-64 of the preceding bytes
+ */
+
+static const char SNAPSHOT_MAGIC[4] = {'R', 'C', 'D', 'B'};
+static const uint32_t SNAPSHOT_VERSION = 3;
+/// @brief Segments are closed once their entries take this many bytes.
+static const size_t SNAPSHOT_SEGMENT_BYTES = 1 << 20;
+
+enum SnapshotOpcode : uint8_t {
+    SNAPSHOT_STRING      = 0,
+    SNAPSHOT_ZSET        = 1,
+    SNAPSHOT_HASH        = 2,
+    SNAPSHOT_SET         = 3,
+    SNAPSHOT_LIST        = 4,
+    SNAPSHOT_STRING_LZF  = 5,    ///< A string stored compressed (see `lzf::compressString`).
+    SNAPSHOT_EXPIRES     = 0x40, ///< Flag on the type: an expiry time follows it.
+    SNAPSHOT_SEGMENT_LZF = 0xFD,
+    SNAPSHOT_SEGMENT     = 0xFE,
+    SNAPSHOT_EOF         = 0xFF,
+};
+
+static const size_t HEADER_SIZE = sizeof(SNAPSHOT_MAGIC) + sizeof(uint32_t);
+static const size_t SEGMENT_HEADER_SIZE = 1 + 3 * sizeof(uint64_t);
+static const size_t SEGMENT_LZF_HEADER_SIZE = SEGMENT_HEADER_SIZE + sizeof(uint64_t);
+static const size_t TRAILER_SIZE = 1 + 2 * sizeof(uint64_t);
+
+/* ====== Encoding ====== */
+
+static void putBytes(Buffer& out, const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), p, p + len);
+}
+
+template <typename T>
+static void putFixed(Buffer& out, T value) { putBytes(out, &value, sizeof(value)); }
+
+static void putVarint(Buffer& out, uint64_t value) {
+    for (; value >= 0x80; value >>= 7) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static void putString(Buffer& out, std::string_view str) {
+    putVarint(out, str.size());
+    putBytes(out, str.data(), str.size());
+}
+
+/**
+ * @brief Serializes a value's type-specific payload.
+ */
+static void writeValue(Buffer& out, DataEntry::Value& value) {
+    if (auto* str = std::get_if<std::string>(&value)) {
+        putString(out, *str);
+    } else if (auto* zset = std::get_if<SortedSet>(&value)) {
+        putVarint(out, zset->size());
+        zset->forEach([&out](const std::string& member, double score) {
+            putString(out, member);
+            putFixed(out, score);
+        });
+    } else if (auto* hash = std::get_if<Hash>(&value)) {
+        putVarint(out, hash->size());
+        hash->forEach([&out](std::string_view field, std::string_view val) {
+            putString(out, field);
+            putString(out, val);
+        });
+    } else if (auto* set = std::get_if<Set>(&value)) {
+        putVarint(out, set->size());
+        set->forEach([&out](std::string_view member) { putString(out, member); });
+    } else {
+        List& list = std::get<List>(value);
+        putVarint(out, list.size());
+        if (list.size() > 0) {
+            list.range(0, list.size() - 1, [&out](std::string_view element) { putString(out, element); });
+        }
+    }
+}
+
+static uint8_t snapshotType(const DataEntry::Value& value) {
+    switch (value.index()) {
+        case 0:  return SNAPSHOT_STRING;
+        case 1:  return SNAPSHOT_ZSET;
+        case 2:  return SNAPSHOT_HASH;
+        case 3:  return SNAPSHOT_SET;
+        default: return SNAPSHOT_LIST;
+    }
+}
+
+SnapshotWriter::SnapshotWriter(int fd, bool compress): fd(fd), compress(compress) {
+    Buffer header;
+    putBytes(header, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    putFixed(header, SNAPSHOT_VERSION);
+    writeChecksummed(header);
+}
+
+void SnapshotWriter::writeEntry(DataEntry& entry) {
+    uint8_t type = entry.compressed ? static_cast<uint8_t>(SNAPSHOT_STRING_LZF) : snapshotType(entry.value);
+    if (entry.expire_at_ms != 0) {
+        segment.push_back(type | SNAPSHOT_EXPIRES);
+        putFixed(segment, entry.expire_at_ms);
+    } else {
+        segment.push_back(type);
+    }
+    putString(segment, entry.key);
+    writeValue(segment, entry.value);
+
+    ++segmentEntries;
+    ++keyCount;
+    if (segment.size() >= SNAPSHOT_SEGMENT_BYTES) {
+        flushSegment();
+    }
+}
+
+bool SnapshotWriter::finish() {
+    flushSegment();
+
+    Buffer trailer;
+    trailer.push_back(SNAPSHOT_EOF);
+    putFixed(trailer, keyCount);
+    writeChecksummed(trailer);
+    writeAll(reinterpret_cast<const uint8_t*>(&checksum), sizeof(checksum));
+    return ok;
+}
+
+void SnapshotWriter::writeChecksummed(const Buffer& bytes) {
+    checksum = crc64(checksum, bytes.data(), bytes.size());
+    writeAll(bytes.data(), bytes.size());
+}
+
+void SnapshotWriter::flushSegment() {
+    if (segmentEntries == 0) {
+        return;
+    }
+
+    // Keep the segment raw unless compressing it saves space.
+    size_t packed_size = 0;
+    if (compress) {
+        packed.resize(segment.size());
+        packed_size = lzf::compress(segment.data(), segment.size(), packed.data(), segment.size() - 1);
+    }
+    const Buffer& stored = packed_size ? packed : segment;
+    const size_t stored_size = packed_size ? packed_size : segment.size();
+
+    Buffer header;
+    header.push_back(packed_size ? SNAPSHOT_SEGMENT_LZF : SNAPSHOT_SEGMENT);
+    putFixed<uint64_t>(header, stored_size);
+    putFixed(header, segmentEntries);
+    putFixed(header, crc64(0, stored.data(), stored_size));
+    if (packed_size) {
+        putFixed<uint64_t>(header, segment.size());
+    }
+    writeChecksummed(header);
+    writeAll(stored.data(), stored_size);
+
+    segment.clear();
+    segmentEntries = 0;
+}
+
+void SnapshotWriter::writeAll(const uint8_t* data, size_t len) {
+    ok = ok && ::writeAll(fd, data, len);
+}
+
+/* ====== Decoding ====== */
+
+/**
+ * @class SnapshotReader
+ * @brief A bounds-checked cursor over a snapshot in memory.
+ * @details Every read returns false instead of running past the end.
+ */
+class SnapshotReader {
+public:
+    SnapshotReader(const uint8_t* data, size_t size): cursor(data), end(data + size) {}
+
+    bool readBytes(void* out, size_t len) {
+        if (static_cast<size_t>(end - cursor) < len) return false;
+        memcpy(out, cursor, len);
+        cursor += len;
+        return true;
+    }
+
+    bool readByte(uint8_t& byte) { return readBytes(&byte, 1); }
+
+    template <typename T>
+    bool readFixed(T& value) { return readBytes(&value, sizeof(value)); }
+
+    bool readVarint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && cursor < end; shift += 7) {
+            uint8_t byte = *cursor++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool readString(std::string& str) {
+        uint64_t len;
+        if (!readVarint(len) || static_cast<uint64_t>(end - cursor) < len) return false;
+        str.assign(reinterpret_cast<const char*>(cursor), len);
+        cursor += len;
+        return true;
+    }
+
+    size_t remaining() const { return static_cast<size_t>(end - cursor); }
+
+private:
+    const uint8_t* cursor;
+    const uint8_t* end;
+};
+
+/**
+ * @brief Decodes a value's payload, as written by `writeValue` for `type`.
+ * @return false if the payload is truncated or the type is unknown.
+ */
+static bool readValue(SnapshotReader& reader, uint8_t type, DataEntry::Value& value) {
+    uint64_t count = 0;
+    if (type != SNAPSHOT_STRING && type != SNAPSHOT_STRING_LZF && !reader.readVarint(count)) {
+        return false;
+    }
+
+    std::string str, other;
+    switch (type) {
+        case SNAPSHOT_STRING:
+            if (!reader.readString(str)) return false;
+            value = std::move(str);
+            return true;
+
+        case SNAPSHOT_STRING_LZF:
+            if (!reader.readString(str) || lzf::decompressedSize(str) == 0) return false;
+            value = std::move(str);
+            return true;
+
+        case SNAPSHOT_ZSET: {
+            // A snapshot holds whole sets, which is what the bulk path is for.
+            std::vector<ZSetEntry> entries;
+            entries.reserve(std::min<uint64_t>(count, reader.remaining()));
+            for (uint64_t i = 0; i < count; ++i) {
+                double score;
+                if (!reader.readString(str) || !reader.readFixed(score)) return false;
+                entries.push_back({std::move(str), score});
+            }
+            SortedSet zset;
+            zset.addMany(std::move(entries));
+            value = std::move(zset);
+            return true;
+        }
+
+        case SNAPSHOT_HASH: {
+            Hash hash;
+            for (uint64_t i = 0; i < count; ++i) {
+                if (!reader.readString(str) || !reader.readString(other)) return false;
+                hash.set(str, other);
+            }
+            value = std::move(hash);
+            return true;
+        }
+
+        case SNAPSHOT_SET: {
+            Set set;
+            for (uint64_t i = 0; i < count; ++i) {
+                if (!reader.readString(str)) return false;
+                set.add(str);
+            }
+            value = std::move(set);
+            return true;
+        }
+
+        case SNAPSHOT_LIST: {
+            List list;
+            for (uint64_t i = 0; i < count; ++i) {
+                if (!reader.readString(str)) return false;
+                list.pushBack(str);
+            }
+            value = std::move(list);
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief A run of entries that decodes on its own.
+ */
+struct SegmentRef {
+    const uint8_t* data;
+    size_t size;
+    uint64_t entries;
+    uint64_t checksum;
+    bool checked;       ///< Whether `checksum` covers the segment (version 2 on).
+    size_t rawSize;     ///< The decompressed size of an LZF segment, 0 for a raw one.
+};
+
+/**
+ * @brief Verifies and decodes one segment into `out`.
+ * @param scratch Where to decompress the segment, if needed.
+ * @return nullptr on success, otherwise what is wrong with the segment.
+ */
+static const char* decodeSegment(const SegmentRef& segment, int64_t now_ms, Buffer& scratch, std::vector<std::unique_ptr<DataEntry>>& out) {
+    if (segment.checked && crc64(0, segment.data, segment.size) != segment.checksum) {
+        return "checksum mismatch";
+    }
+
+    const uint8_t* entries = segment.data;
+    size_t size = segment.size;
+    if (segment.rawSize) {
+        scratch.resize(segment.rawSize);
+        if (!lzf::decompress(segment.data, segment.size, scratch.data(), segment.rawSize)) {
+            return "bad compressed segment";
+        }
+        entries = scratch.data();
+        size = segment.rawSize;
+    }
+
+    SnapshotReader reader(entries, size);
+    out.reserve(std::min<uint64_t>(segment.entries, size));
+    uint64_t decoded = 0;
+    uint8_t type;
+    while (reader.readByte(type)) {
+        auto entry = std::make_unique<DataEntry>();
+        if ((type & SNAPSHOT_EXPIRES) && !reader.readFixed(entry->expire_at_ms)) {
+            return "truncated entry";
+        }
+        if (!reader.readString(entry->key) || !readValue(reader, type & ~SNAPSHOT_EXPIRES, entry->value)) {
+            return "truncated entry";
+        }
+        entry->compressed = (type & ~SNAPSHOT_EXPIRES) == SNAPSHOT_STRING_LZF;
+        ++decoded;
+
+        // Keys that expired while the server was down are not loaded at all.
+        if (entry->expire_at_ms != 0 && entry->expire_at_ms <= now_ms) {
+            continue;
+        }
+        entry->hashCode = HashTable::hashString(entry->key);
+        out.push_back(std::move(entry));
+    }
+    if (segment.checked && decoded != segment.entries) {
+        return "wrong entry count";
+    }
+    return nullptr;
+}
+
+/**
+ * @class MappedFile
+ * @brief A read-only memory mapping of a whole file, unmapped on destruction.
+ */
+class MappedFile {
+public:
+    MappedFile(int fd, size_t size): size(size) {
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            return;
+        }
+        data = static_cast<const uint8_t*>(addr);
+        // Segments are read front to back: ask for aggressive readahead, and
+        // start reading the whole file in while the segment chain is walked.
+        madvise(addr, size, MADV_SEQUENTIAL);
+        madvise(addr, size, MADV_WILLNEED);
+    }
+
+    ~MappedFile() {
+        if (data) {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data = nullptr;
+    size_t size;
+};
+
+bool readSnapshotFile(const std::string& path, int64_t now_ms, size_t threads, SnapshotContents& contents) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) return false;
+        throw std::runtime_error("Can't open snapshot " + path + ": " + strerror(errno));
+    }
+
+    auto corrupt = [&path](const char* what) {
+        return std::runtime_error("Snapshot " + path + " is corrupt: " + what);
+    };
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("Can't read snapshot " + path + ": " + strerror(error));
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    if (size < HEADER_SIZE + 1 + sizeof(uint64_t)) {
+        ::close(fd);
+        throw corrupt("not a snapshot file");
+    }
+
+    // The mapping outlives the descriptor.
+    MappedFile file(fd, size);
+    int map_error = errno;
+    ::close(fd);
+    if (!file.data) {
+        throw std::runtime_error("Can't map snapshot " + path + ": " + strerror(map_error));
+    }
+    const uint8_t* data = file.data;
+
+    uint32_t version;
+    memcpy(&version, data + sizeof(SNAPSHOT_MAGIC), sizeof(version));
+    if (memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        throw corrupt("not a snapshot file");
+    }
+
+    // Walk the segment chain, verifying it, before decoding anything.
+    std::vector<SegmentRef> segments;
+    if (version == 1) {
+        const size_t body_size = size - sizeof(uint64_t);
+        uint64_t checksum;
+        memcpy(&checksum, data + body_size, sizeof(checksum));
+        if (crc64(0, data, body_size) != checksum) {
+            throw corrupt("checksum mismatch");
+        }
+        if (data[body_size - 1] != SNAPSHOT_EOF) {
+            throw corrupt("missing end of file marker");
+        }
+        segments.push_back({data + HEADER_SIZE, body_size - 1 - HEADER_SIZE, 0, 0, false, 0});
+    } else if (version == 2 || version == SNAPSHOT_VERSION) {
+        uint64_t checksum = crc64(0, data, HEADER_SIZE);
+        uint64_t entries = 0;
+        size_t pos = HEADER_SIZE;
+        while (pos < size && (data[pos] == SNAPSHOT_SEGMENT || (data[pos] == SNAPSHOT_SEGMENT_LZF && version >= 3))) {
+            const bool packed = data[pos] == SNAPSHOT_SEGMENT_LZF;
+            const size_t header_size = packed ? SEGMENT_LZF_HEADER_SIZE : SEGMENT_HEADER_SIZE;
+            if (size - pos < header_size) {
+                throw corrupt("truncated segment");
+            }
+            SegmentRef segment;
+            memcpy(&segment.size, data + pos + 1, sizeof(uint64_t));
+            memcpy(&segment.entries, data + pos + 9, sizeof(uint64_t));
+            memcpy(&segment.checksum, data + pos + 17, sizeof(uint64_t));
+            segment.rawSize = 0;
+            if (packed) {
+                memcpy(&segment.rawSize, data + pos + 25, sizeof(uint64_t));
+                if (segment.rawSize == 0) {
+                    throw corrupt("bad compressed segment");
+                }
+            }
+            checksum = crc64(checksum, data + pos, header_size);
+            pos += header_size;
+            if (size - pos < segment.size) {
+                throw corrupt("truncated segment");
+            }
+            segment.data = data + pos;
+            segment.checked = true;
+            segments.push_back(segment);
+            entries += segment.entries;
+            pos += segment.size;
+        }
+
+        if (size - pos != TRAILER_SIZE || data[pos] != SNAPSHOT_EOF) {
+            throw corrupt("missing end of file marker");
+        }
+        memcpy(&contents.keyCount, data + pos + 1, sizeof(uint64_t));
+        checksum = crc64(checksum, data + pos, 1 + sizeof(uint64_t));
+        uint64_t expected;
+        memcpy(&expected, data + pos + 1 + sizeof(uint64_t), sizeof(expected));
+        if (checksum != expected) {
+            throw corrupt("checksum mismatch");
+        }
+        if (entries != contents.keyCount) {
+            throw corrupt("wrong key count");
+        }
+    } else {
+        throw corrupt("unsupported version");
+    }
+
+    // Segments are handed out one at a time, so a thread that got small ones
+    // picks up more.
+    contents.segments.resize(segments.size());
+    std::vector<const char*> errors(segments.size(), nullptr);
+    std::atomic<size_t> next{0};
+    auto decode = [&]() {
+        Buffer scratch;
+        for (size_t i; (i = next.fetch_add(1)) < segments.size();) {
+            errors[i] = decodeSegment(segments[i], now_ms, scratch, contents.segments[i]);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    const size_t worker_count = std::min(std::max<size_t>(threads, 1), segments.size());
+    for (size_t i = 1; i < worker_count; ++i) {
+        workers.emplace_back(decode);
+    }
+    decode();
+    for (auto& worker: workers) {
+        worker.join();
+    }
+
+    for (const char* error: errors) {
+        if (error) throw corrupt(error);
+    }
+    if (version == 1) {
+        contents.keyCount = contents.segments[0].size();
+    }
+    return true;
+}
+
+/* ====== DUMP payloads ====== */
+
+std::string dumpValue(DataEntry& entry) {
+    Buffer out;
+    out.push_back(entry.compressed ? static_cast<uint8_t>(SNAPSHOT_STRING_LZF) : snapshotType(entry.value));
+    writeValue(out, entry.value);
+    putFixed(out, SNAPSHOT_VERSION);
+    putFixed(out, crc64(0, out.data(), out.size()));
+    return std::string(out.begin(), out.end());
+}
+
+bool restoreValue(std::string_view payload, DataEntry& entry) {
+    const size_t footer = sizeof(uint32_t) + sizeof(uint64_t);
+    if (payload.size() < 1 + footer) {
+        return false;
+    }
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(payload.data());
+    const size_t body = payload.size() - sizeof(uint64_t);
+    uint32_t version;
+    uint64_t checksum;
+    memcpy(&version, data + body - sizeof(version), sizeof(version));
+    memcpy(&checksum, data + body, sizeof(checksum));
+    if (version > SNAPSHOT_VERSION || crc64(0, data, body) != checksum) {
+        return false;
+    }
+
+    SnapshotReader reader(data + 1, payload.size() - 1 - footer);
+    if (!readValue(reader, data[0], entry.value) || reader.remaining() != 0) {
+        return false;
+    }
+    entry.compressed = data[0] == SNAPSHOT_STRING_LZF;
+    return true;
+}
@@ -0,0 +1,625 @@
+#include <server/Redis.hpp>
+#include <cmath>
+
+/**
+ * @file ZSetCommands.cpp
+ * @brief Implements the sorted set (ZSET) command handlers of RedisServer.
+ */
+
+/**
+ * @brief Parses a score argument, rejecting trailing garbage and NaN.
+ */
+static bool parseScore(const std::string& str, double& score) {
+    try {
+        size_t consumed = 0;
+        score = std::stod(str, &consumed);
+        return consumed == str.size() && !std::isnan(score);
+    } catch (const std::exception &e) {
+        return false;
+    }
+}
+
+void RedisServer::zaddGeneric(const std::string& key, std::vector<ZSetEntry> entries, int flags, bool report_changed, Buffer& response) {
+    const bool incr = flags & SortedSet::ADD_INCR;
+
+    DataEntry* entry = lookupEntry(key);
+    if (entry) {
+        if (!std::holds_alternative<SortedSet>(entry->value)) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
+            return;
+        }
+    } else if (flags & SortedSet::ADD_XX) {
+        // Nothing can be updated in a set that doesn't exist: don't create it.
+        if (incr) ResponseBuilder::outNil(response);
+        else ResponseBuilder::outInt(response, 0);
+        return;
+    } else {
+        entry = addEntry(key, SortedSet{});
+    }
+
+    SortedSet &zset = std::get<SortedSet>(entry->value);
+
+    if (flags == SortedSet::ADD_NONE && !report_changed) {
+        size_t added = zset.addMany(std::move(entries));
+        if (added > 0) {
+            signalKeyAsReady(key);
+        }
+        ResponseBuilder::outInt(response, added);
+        return;
+    }
+
+    size_t added = 0, updated = 0;
+    double new_score = 0;
+
+    for (const auto& pair: entries) {
+        switch (zset.add(pair.member, pair.score, flags, &new_score)) {
+            case SortedSet::AddResult::ADDED:
+                ++added;
+                break;
+            case SortedSet::AddResult::UPDATED:
+                ++updated;
+                break;
+            case SortedSet::AddResult::NOT_A_NUMBER:
+                ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "resulting score is not a number (NaN)");
+                return;
+            case SortedSet::AddResult::SKIPPED:
+                if (incr) {
+                    ResponseBuilder::outNil(response);
+                    return;
+                }
+                break;
+            case SortedSet::AddResult::UNCHANGED:
+                break;
+        }
+    }
+
+    if (added > 0) {
+        signalKeyAsReady(key);
+    }
+
+    if (incr) {
+        ResponseBuilder::outStr(response, std::to_string(new_score));
+    } else {
+        ResponseBuilder::outInt(response, report_changed ? added + updated : added);
+    }
+}
+
+void RedisServer::handleZAdd(const Request& request, Buffer& response) {
+    int flags = SortedSet::ADD_NONE;
+    bool report_changed = false;
+
+    size_t i = 2;
+    for (; i < request.command.size(); ++i) {
+        const std::string option = request.lowerCaseCommand(i);
+        if (option == "nx")        flags |= SortedSet::ADD_NX;
+        else if (option == "xx")   flags |= SortedSet::ADD_XX;
+        else if (option == "gt")   flags |= SortedSet::ADD_GT;
+        else if (option == "lt")   flags |= SortedSet::ADD_LT;
+        else if (option == "incr") flags |= SortedSet::ADD_INCR;
+        else if (option == "ch")   report_changed = true;
+        else break;
+    }
+
+    const size_t pair_args = request.command.size() - i;
+    if (request.command.size() < 2 || pair_args == 0 || pair_args % 2 != 0) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'zadd'");
+        return;
+    }
+
+    if ((flags & SortedSet::ADD_NX) && (flags & SortedSet::ADD_XX)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "XX and NX options at the same time are not compatible");
+        return;
+    }
+
+    const bool gt_or_lt = flags & (SortedSet::ADD_GT | SortedSet::ADD_LT);
+    if (((flags & SortedSet::ADD_GT) && (flags & SortedSet::ADD_LT)) || (gt_or_lt && (flags & SortedSet::ADD_NX))) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "GT, LT, and/or NX options at the same time are not compatible");
+        return;
+    }
+
+    if ((flags & SortedSet::ADD_INCR) && pair_args != 2) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "INCR option supports a single increment-element pair");
+        return;
+    }
+
+    // Validate every score up front so a bad argument leaves the set untouched.
+    std::vector<ZSetEntry> entries;
+    entries.reserve(pair_args / 2);
+    for (; i < request.command.size(); i += 2) {
+        double score;
+        if (!parseScore(request.command[i], score)) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value \'" + request.command[i] + "\' is not a valid float");
+            return;
+        }
+        entries.push_back({request.command[i+1], score});
+    }
+
+    zaddGeneric(request.command[1], std::move(entries), flags, report_changed, response);
+}
+
+void RedisServer::handleZIncrBy(const Request& request, Buffer& response) {
+    if (request.command.size() != 4) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'zincrby'");
+        return;
+    }
+
+    double increment;
+    if (!parseScore(request.command[2], increment)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value \'" + request.command[2] + "\' is not a valid float");
+        return;
+    }
+
+    zaddGeneric(request.command[1], {{request.command[3], increment}}, SortedSet::ADD_INCR, false, response);
+}
+
+void RedisServer::handleZRem(const Request& request, Buffer& response) {
+    if (request.command.size() < 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of args for 'zrem'");
+        return;
+    }
+
+    DataEntry* entry = lookupEntry(request.command[1]);
+    if (!entry) {
+        ResponseBuilder::outInt(response, 0);
+        return;
+    }
+
+    if (!std::holds_alternative<SortedSet>(entry->value)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
+        return;
+    }
+
+    SortedSet& zset = std::get<SortedSet>(entry->value);
+    int removed_count = 0;
+
+    for (size_t i=2; i<request.command.size(); ++i) {
+        if (zset.remove(request.command[i])) {
+            ++removed_count;
+        }
+    }
+
+    ResponseBuilder::outInt(response, removed_count);
+}
+
+void RedisServer::zrangeGeneric(const Request& request, Buffer& response, bool reverse) {
+    if (request.command.size() != 4) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, std::string("Wrong number of arguments for '") + (reverse ? "zrevrange" : "zrange") + "'");
+        return;
+    }
+
+    long start, end;
+
+    try {
+        start = std::stol(request.command[2]);
+        end = std::stol(request.command[3]);
+    } catch (const std::exception &e) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "values provided (" + request.command[2] + ", " + request.command[3] + ") are not an integer");
+        return;
+    }
+
+    DataEntry* entry = lookupEntry(request.command[1]);
+    if (!entry) {
+        ResponseBuilder::outArr(response, 0); // Key doesn't exist
+        return;
+    }
+
+    if (!std::holds_alternative<SortedSet>(entry->value)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
+        return;
+    }
+
+    SortedSet& zset = std::get<SortedSet>(entry->value);
+    long size = zset.size();
+
+    if (start < 0) start += size;
+    if (end < 0)   end   += size;
+    if (start < 0) start = 0;
+    if (start >= size || start > end) {
+        ResponseBuilder::outArr(response, 0);
+        return;
+    }
+
+    if (end >= size) end = size - 1;
+
+    ResponseBuilder::outArr(response, end - start + 1);
+    zset.range(start, end, reverse, [&response](const std::string& member, double) {
+        ResponseBuilder::outStr(response, member);
+    });
+}
+
+void RedisServer::handleZRange(const Request& request, Buffer& response) {
+    zrangeGeneric(request, response, false);
+}
+
+void RedisServer::handleZRevRange(const Request& request, Buffer& response) {
+    zrangeGeneric(request, response, true);
+}
+
+void RedisServer::handleZScan(const Request& request, Buffer& response) {
+    if (request.command.size() < 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'zscan'");
+        return;
+    }
+
+    ScanOptions options;
+    if (!parseScanOptions(request, 2, options, response)) {
+        return;
+    }
+
+    DataEntry* entry = lookupEntry(request.command[1]);
+    if (entry && !std::holds_alternative<SortedSet>(entry->value)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
+        return;
+    }
+
+    std::vector<ZSetEntry> members;
+    size_t visited = 0;
+    size_t cursor = 0;
+
+    if (entry) {
+        SortedSet &zset = std::get<SortedSet>(entry->value);
+        cursor = options.cursor;
+        do {
+            cursor = zset.scan(cursor, [&](const std::string& member, double score) {
+                ++visited;
+                if (options.pattern && !options.pattern->matches(member)) return;
+                members.push_back({member, score});
+            });
+        } while (cursor != 0 && visited < options.count);
+    }
+
+    ResponseBuilder::outArr(response, 2);
+    ResponseBuilder::outStr(response, std::to_string(cursor));
+    ResponseBuilder::outArr(response, static_cast<uint32_t>(members.size() * 2));
+    for (const auto& pair: members) {
+        ResponseBuilder::outStr(response, pair.member);
+        ResponseBuilder::outStr(response, std::to_string(pair.score));
+    }
+}
+
+void RedisServer::handleZScore(const Request& request, Buffer& response) {
+    if (request.command.size() != 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Wrong number of arguments for 'zscore'");
+        return;
+    }
+
+    DataEntry* entry = lookupEntry(request.command[1]);
+    if (!entry) {
+        ResponseBuilder::outNil(response);
+        return;
+    }
+
+    if (!std::holds_alternative<SortedSet>(entry->value)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong type of value");
+        return;
+    }
+
+    double score;
+    if (std::get<SortedSet>(entry->value).getScore(request.command[2], score)) {
+        ResponseBuilder::outStr(response, std::to_string(score));
+    } else {
+        ResponseBuilder::outNil(response);
+    }
+}
+
+void RedisServer::zsetStoreGeneric(const Request& request, Buffer& response, ZSetOp op) {
+    const char* name = op == ZSetOp::UNION ? "zunionstore" : op == ZSetOp::INTER ? "zinterstore" : "zdiffstore";
+
+    size_t num_keys = 0;
+    if (request.command.size() >= 3) {
+        try {
+            size_t consumed = 0;
+            long long parsed = std::stoll(request.command[2], &consumed);
+            if (consumed == request.command[2].size() && parsed > 0) num_keys = static_cast<size_t>(parsed);
+        } catch (const std::exception &e) {}
+    }
+
+    if (num_keys == 0) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, std::string("at least 1 input key is needed for '") + name + "'");
+        return;
+    }
+
+    if (request.command.size() < 3 + num_keys) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, std::string("Wrong number of arguments for '") + name + "'");
+        return;
+    }
+
+    /**
+     * @struct Input
+     * @brief One source set; `zset` is null for keys that don't exist.
+     */
+    struct Input {
+        SortedSet* zset;
+        double weight;
+
+        size_t size() const { return zset ? zset->size() : 0; }
+        bool getScore(const std::string& member, double& score) const { return zset && zset->getScore(member, score); }
+    };
+
+    std::vector<Input> inputs;
+    inputs.reserve(num_keys);
+    for (size_t i = 0; i < num_keys; ++i) {
+        DataEntry* entry = lookupEntry(request.command[3 + i]);
+        if (entry && !std::holds_alternative<SortedSet>(entry->value)) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
+            return;
+        }
+        inputs.push_back({entry ? &std::get<SortedSet>(entry->value) : nullptr, 1.0});
+    }
+
+    enum class Aggregate { SUM, MIN, MAX } aggregate = Aggregate::SUM;
+
+    for (size_t i = 3 + num_keys; i < request.command.size();) {
+        const std::string option = request.lowerCaseCommand(i);
+
+        if (op != ZSetOp::DIFF && option == "weights" && i + num_keys < request.command.size()) {
+            for (size_t k = 0; k < num_keys; ++k) {
+                if (!parseScore(request.command[i + 1 + k], inputs[k].weight)) {
+                    ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "weight value is not a float");
+                    return;
+                }
+            }
+            i += 1 + num_keys;
+        } else if (op != ZSetOp::DIFF && option == "aggregate" && i + 1 < request.command.size()) {
+            const std::string mode = request.lowerCaseCommand(i + 1);
+            if (mode == "sum")      aggregate = Aggregate::SUM;
+            else if (mode == "min") aggregate = Aggregate::MIN;
+            else if (mode == "max") aggregate = Aggregate::MAX;
+            else {
+                ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "syntax error");
+                return;
+            }
+            i += 2;
+        } else {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "syntax error");
+            return;
+        }
+    }
+
+    auto combine = [aggregate](double acc, double score) {
+        switch (aggregate) {
+            case Aggregate::SUM: {
+                // inf + -inf would be NaN, which a sorted set cannot hold.
+                double sum = acc + score;
+                return std::isnan(sum) ? 0.0 : sum;
+            }
+            case Aggregate::MIN: return std::min(acc, score);
+            case Aggregate::MAX: return std::max(acc, score);
+        }
+        return acc;
+    };
+    auto weighted = [](double score, double weight) {
+        double result = score * weight;
+        return std::isnan(result) ? 0.0 : result; // 0 * inf
+    };
+
+    // The members of the input driving the operation are copied out before
+    // the other inputs are probed through their member hash tables: the same
+    // key may be given twice, and a probe can move the members of the table
+    // being walked (see HashTable::lookup).
+    auto members = [](const Input& input) {
+        std::vector<ZSetEntry> entries;
+        entries.reserve(input.size());
+        input.zset->forEach([&entries](const std::string& member, double score) {
+            entries.push_back({member, score});
+        });
+        return entries;
+    };
+    std::vector<ZSetEntry> result;
+
+    if (op == ZSetOp::UNION) {
+        // A member is emitted by the first input that holds it: skip it in
+        // later inputs, and aggregate over the inputs that follow.
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (!inputs[i].zset) continue;
+
+            for (ZSetEntry& entry: members(inputs[i])) {
+                double other;
+                bool seen = false;
+                for (size_t j = 0; j < i && !seen; ++j) {
+                    seen = inputs[j].getScore(entry.member, other);
+                }
+                if (seen) continue;
+
+                double acc = weighted(entry.score, inputs[i].weight);
+                for (size_t j = i + 1; j < inputs.size(); ++j) {
+                    if (inputs[j].getScore(entry.member, other)) acc = combine(acc, weighted(other, inputs[j].weight));
+                }
+                result.push_back({std::move(entry.member), acc});
+            }
+        }
+    } else if (op == ZSetOp::INTER) {
+        // Drive the intersection from the smallest input, probing the larger
+        // ones smallest first so that misses are found early.
+        std::vector<size_t> order(inputs.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&inputs](size_t a, size_t b) {
+            return inputs[a].size() < inputs[b].size();
+        });
+
+        const Input& smallest = inputs[order[0]];
+        if (smallest.size() > 0) {
+            result.reserve(smallest.size());
+            for (ZSetEntry& entry: members(smallest)) {
+                double acc = weighted(entry.score, smallest.weight);
+                double other;
+                bool everywhere = true;
+                for (size_t k = 1; k < order.size() && everywhere; ++k) {
+                    const Input& input = inputs[order[k]];
+                    everywhere = input.getScore(entry.member, other);
+                    if (everywhere) acc = combine(acc, weighted(other, input.weight));
+                }
+                if (everywhere) result.push_back({std::move(entry.member), acc});
+            }
+        }
+    } else {
+        if (inputs[0].zset) {
+            for (ZSetEntry& entry: members(inputs[0])) {
+                double other;
+                bool elsewhere = false;
+                for (size_t j = 1; j < inputs.size() && !elsewhere; ++j) {
+                    elsewhere = inputs[j].getScore(entry.member, other);
+                }
+                if (!elsewhere) result.push_back(std::move(entry));
+            }
+        }
+    }
+
+    const std::string& destination = request.command[1];
+    const size_t result_size = result.size();
+
+    if (result.empty()) {
+        removeEntry(destination);
+        ResponseBuilder::outInt(response, 0);
+        return;
+    }
+
+    SortedSet zset;
+    zset.addMany(std::move(result));
+
+    if (DataEntry* entry = lookupEntry(destination)) {
+        entry->value = std::move(zset);
+        entry->compressed = false;
+        setExpire(entry, 0);
+    } else {
+        addEntry(destination, std::move(zset));
+    }
+
+    signalKeyAsReady(destination);
+    ResponseBuilder::outInt(response, result_size);
+}
+
+void RedisServer::handleZUnionStore(const Request& request, Buffer& response) {
+    zsetStoreGeneric(request, response, ZSetOp::UNION);
+}
+
+void RedisServer::handleZInterStore(const Request& request, Buffer& response) {
+    zsetStoreGeneric(request, response, ZSetOp::INTER);
+}
+
+void RedisServer::handleZDiffStore(const Request& request, Buffer& response) {
+    zsetStoreGeneric(request, response, ZSetOp::DIFF);
+}
+
+void RedisServer::zpopGeneric(const Request& request, Buffer& response, bool pop_max) {
+    const char* name = pop_max ? "zpopmax" : "zpopmin";
+    if (request.command.size() != 2 && request.command.size() != 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, std::string("Wrong number of arguments for '") + name + "'");
+        return;
+    }
+
+    long count = 1;
+    if (request.command.size() == 3) {
+        try {
+            size_t consumed = 0;
+            count = std::stol(request.command[2], &consumed);
+            if (consumed != request.command[2].size()) count = -1;
+        } catch (const std::exception &e) {
+            count = -1;
+        }
+
+        if (count < 0) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "value is out of range, must be positive");
+            return;
+        }
+    }
+
+    DataEntry* entry = lookupEntry(request.command[1]);
+    if (!entry) {
+        ResponseBuilder::outArr(response, 0);
+        return;
+    }
+
+    if (!std::holds_alternative<SortedSet>(entry->value)) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
+        return;
+    }
+
+    SortedSet& zset = std::get<SortedSet>(entry->value);
+    size_t popped = std::min(static_cast<size_t>(count), zset.size());
+
+    ResponseBuilder::outArr(response, popped * 2);
+    zset.pop(popped, pop_max, [&response](const std::string& member, double score) {
+        ResponseBuilder::outStr(response, member);
+        ResponseBuilder::outStr(response, std::to_string(score));
+    });
+
+    if (zset.size() == 0) {
+        removeEntry(request.command[1]);
+    }
+}
+
+void RedisServer::handleZPopMin(const Request& request, Buffer& response) {
+    zpopGeneric(request, response, false);
+}
+
+void RedisServer::handleZPopMax(const Request& request, Buffer& response) {
+    zpopGeneric(request, response, true);
+}
+
+bool RedisServer::popWithKey(const std::string& key, bool pop_max, Buffer& response) {
+    DataEntry* entry = lookupEntry(key);
+    if (!entry || !std::holds_alternative<SortedSet>(entry->value)) {
+        return false;
+    }
+
+    SortedSet& zset = std::get<SortedSet>(entry->value);
+    if (zset.size() == 0) {
+        return false;
+    }
+
+    ResponseBuilder::outArr(response, 3);
+    ResponseBuilder::outStr(response, key);
+    zset.pop(1, pop_max, [&response](const std::string& member, double score) {
+        ResponseBuilder::outStr(response, member);
+        ResponseBuilder::outStr(response, std::to_string(score));
+    });
+
+    if (zset.size() == 0) {
+        removeEntry(key);
+    }
+    return true;
+}
+
+void RedisServer::bzpopGeneric(const Request& request, Buffer& response, bool pop_max) {
+    if (request.command.size() < 3) {
+        ResponseBuilder::outErr(response, ERR_WRONG_ARGS, std::string("Wrong number of arguments for '") + (pop_max ? "bzpopmax" : "bzpopmin") + "'");
+        return;
+    }
+
+    double timeout;
+    if (!parseBlockTimeout(request.command.back(), timeout, response)) {
+        return;
+    }
+
+    std::vector<std::string> keys(request.command.begin() + 1, request.command.end() - 1);
+    for (const auto& key: keys) {
+        DataEntry* entry = lookupEntry(key);
+        if (entry && !std::holds_alternative<SortedSet>(entry->value)) {
+            ResponseBuilder::outErr(response, ERR_WRONG_ARGS, "Operation against a key holding the wrong kind of value");
+            return;
+        }
+    }
+
+    for (const auto& key: keys) {
+        if (popWithKey(key, pop_max, response)) {
+            rewrittenCommand = {pop_max ? "zpopmax" : "zpopmin", key};
+            return;
+        }
+    }
+
+    if (!currentClient) {
+        ResponseBuilder::outNil(response);
+        return;
+    }
+
+    blockClient(*currentClient, std::move(keys), pop_max ? BlockedPop::ZSET_MAX : BlockedPop::ZSET_MIN, blockDeadline(timeout));
+}
+
+void RedisServer::handleBZPopMin(const Request& request, Buffer& response) {
+    bzpopGeneric(request, response, false);
+}
+
+void RedisServer::handleBZPopMax(const Request& request, Buffer& response) {
+    bzpopGeneric(request, response, true);
+}